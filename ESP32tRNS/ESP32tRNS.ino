@@ -27,7 +27,18 @@
 #include "preset_storage.h"
 #include "encoder_control.h"
 #include "session_control.h"
+#include "session_regulator.h"
+#include "adc_autocal.h"
 #include "menu_control.h"
+#include "session_dosimetry.h"
+#include "session_log.h"
+#include "session_resume.h"
+#include "adc_loop_average.h"
+#include "adc_spectrum.h"
+#include "adc_lockin.h"
+#include "adc_transfer.h"
+#include "adc_history.h"
+#include "stim_protocol.h"
 #include <driver/rtc_io.h>
 #include <esp_ota_ops.h>
 #include <esp_partition.h>
@@ -39,13 +50,51 @@ static void releaseBootUfh2Hold() {
   rtc_gpio_deinit((gpio_num_t)BOOT_UF2_GPIO);
 }
 
+// Команды по Serial: строка до '\n', без ожидания (сколько пришло за проход loop)
+// "hist" — история тока сеанса (adc_history), "log" — журналы сеансов (session_log),
+// "proto" — загрузка протокола в ffat (stim_protocol), "frames" — сырые DMA фреймы АЦП
+static void pollSerialCommands() {
+  static char line[64];
+  static uint8_t len = 0;
+  while (Serial.available() > 0) {
+    int c = Serial.read();
+    // Приём файла протокола: байты идут в загрузчик, не в разбор строк
+    if (updateProtocolUpload()) {
+      feedProtocolUpload((uint8_t)c);
+      continue;
+    }
+    if (c == '\r') continue;
+    if (c != '\n') {
+      if (len < sizeof(line) - 1) line[len++] = (char)c;
+      continue;
+    }
+    line[len] = '\0';
+    len = 0;
+    if (strncmp(line, "hist", 4) == 0) {
+      handleADCHistoryCommand(line + 4);
+    } else if (strncmp(line, "log", 3) == 0) {
+      handleSessionLogCommand(line + 3);
+    } else if (strncmp(line, "proto", 5) == 0) {
+      handleProtocolCommand(line + 5);
+    } else if (strncmp(line, "frames", 6) == 0) {
+      handleADCFrameCommand(line + 6);
+    } else if (line[0] != '\0') {
+      Serial.printf("[CMD] unknown: %s\n", line);
+    }
+  }
+}
+
 // ============================================================================
 // === SETUP ===
 // ============================================================================
 
 void setup() {
+  // Сброс посреди сеанса (brownout/panic/WDT) → быстрый путь: без заставок
+  // и задержек, сеанс продолжается из снимка в RTC памяти
+  bool warm_resume = checkResumeSnapshot();
+
   // КРИТИЧНО: Задержка перед инициализацией Serial для esptool!
-  delay(1000);
+  if (!warm_resume) delay(1000);
 
   // Снимаем удержание BOOT_UF2 pin, если оно было включено
   releaseBootUfh2Hold();
@@ -69,7 +118,8 @@ void setup() {
   // Инициализируем Serial БЕЗ ожидания
   Serial.begin(921600);
   Serial.setRxBufferSize(40960);  // Увеличиваем RX буфер до 40KB (для CMD_SET_DAC)
-  delay(100);
+  if (!warm_resume) delay(100);
+  if (warm_resume) Serial.println("[BOOT] Warm resume after reset");
   
   // EEPROM.begin() ПЕРВЫМ — до любых malloc, иначе NVS может зависнуть!
   Serial.println("[BOOT] EEPROM.begin()");
@@ -95,12 +145,14 @@ void setup() {
   showBootScreen("Allocate ADC...");
   Serial.println("[BOOT] allocate ADC ring buffer");
   adc_ring_buffer = (int16_t*)malloc(ADC_RING_SIZE * sizeof(int16_t));
-  if (!adc_ring_buffer) {
+  adc_uA_ring_buffer = (int16_t*)malloc(ADC_RING_SIZE * sizeof(int16_t));
+  if (!adc_ring_buffer || !adc_uA_ring_buffer) {
     showBootScreen("ADC alloc FAIL!");
     while (1) { delay(1000); }
   }
   for (uint32_t i = 0; i < ADC_RING_SIZE; i++) {
     adc_ring_buffer[i] = ADC_INVALID_VALUE;
+    adc_uA_ring_buffer[i] = ADC_INVALID_VALUE;
   }
 
   // Шаг 3: Инициализация ADC DMA
@@ -110,7 +162,7 @@ void setup() {
   initADC();
   Serial.println("[BOOT] initADC() OK");
   Serial.flush();
-  delay(100);  // Даём ADC DMA стабилизироваться
+  if (!warm_resume) delay(100);  // Даём ADC DMA стабилизироваться
 
   // Шаг 4: Выделение памяти под DAC сигнал
   Serial.println("[BOOT] showBootScreen Allocate DAC...");
@@ -124,8 +176,10 @@ void setup() {
   }
 
   // Шаг 5: Загрузка пресета из PROGMEM (обязательно!)
+  // При продолжении сеанса форму сигнала всё равно сгенерирует resumeSession()
   Serial.println("[BOOT] loadPresetFromFlash()");
-  bool preset_loaded = loadPresetFromFlash(signal_buffer, current_preset_name, PRESET_NAME_MAX_LEN);
+  bool preset_loaded = warm_resume ||
+                       loadPresetFromFlash(signal_buffer, current_preset_name, PRESET_NAME_MAX_LEN);
   if (!preset_loaded) {
     showBootScreen("ERROR: No preset!");
     while (1) { delay(1000); }  // Зависаем, без пресета работать нельзя
@@ -145,6 +199,9 @@ void setup() {
   showBootScreen("Init Settings...");
   Serial.println("[BOOT] initSession()");
   initSession();
+  showBootScreen("Init Log...");
+  Serial.println("[BOOT] initSessionLog()");
+  initSessionLog();
   showBootScreen("Init Menu...");
   Serial.println("[BOOT] initMenu()");
   initMenu();
@@ -152,6 +209,13 @@ void setup() {
   stack_depth = 0;
   screen_stack[0] = SCR_MAIN_MENU;
 
+  // Быстрый путь: продолжаем прерванный сеанс сразу на дашборд
+  if (warm_resume && resumeSession()) {
+    screen_stack[0] = SCR_DASHBOARD;
+    renderCurrentScreen();
+    return;
+  }
+
   // Финальный экран
   showBootScreen("Starting...");
   Serial.println("[BOOT] renderCurrentScreen()");
@@ -168,22 +232,38 @@ void setup() {
 void loop() {
   // ============================================================
   // СТРАТЕГИЯ: Неблокирующий loop для работы в реальном времени
-  // - ADC DMA: читается железом, мы забираем из DMA буфера
+  // - ADC DMA: читается железом, фреймы забирает задача ingest по прерыванию
   // - DAC DMA: гоняется железом по кругу
   // ============================================================
 
   // 1. Подкладываем данные в I2S DMA для DAC (неблокирующе, ~1мс)
   keepDMAFilled();
 
-  // 2. Читаем данные из ADC DMA и складываем в кольцевой буфер
-  readADCFromDMA();
+  // 2. ADC DMA разбирает задача ingest (будится из ISR) — здесь ничего не ждём
 
   // 3. Обновление состояния сеанса (fadein/stable/fadeout)
   updateSession();
   
+  // Журнал сеанса: раз в секунду запись в RAM (флеш пишет фоновая задача)
+  updateSessionLog();
+  
   // Проверка автозавершения сеанса (независимо от текущего экрана)
   if (isSessionJustFinished()) {
     // Сеанс завершился автоматически → показываем SCR_FINISH
+    Serial.printf("[SESSION] Finished: %s\n", getStopReasonName(getSessionStopReason()));
+    printSessionDosimetry();
+    printADCLoopAverage();
+    printADCSpectrum();
+    if (session_mode == MODE_TACS) printADCLockIn();
+    printADCTransfer();
+    printADCSignSkew();
+    printSessionRegulator();
+    if (isCalibrationSession()) finishADCAutoCalibration();
+    Serial.printf("[ADC] ingest %.1f cycles/sample (decimator %.0f cycles/frame, x%u), pool overflows %lu, desync %lu, outliers %lu\n",
+                  getADCIngestCyclesPerSample(), getADCDecimatorCyclesPerFrame(), (unsigned)getADCOversampleRatio(),
+                  (unsigned long)adc_pool_overflow_count, (unsigned long)adc_pair_desync_count,
+                  (unsigned long)getADCOutlierCount());
+    finishSessionLog();
     stack_depth = 0;
     screen_stack[0] = SCR_FINISH;
     menu_selected = 0;
@@ -195,6 +275,11 @@ void loop() {
   // 5. Обновляем OLED дисплей (неблокирующе, с ограничением частоты)
   updateDisplay();
   
+  // 6. Команды по Serial (запросы истории тока)
+  pollSerialCommands();
+  pollADCFrameCapture();
+  pollADCSignSkew();
+  
   /*
   //DEBUG: 50 отсчётов ADC в mA (раз в 2 сек во время сеанса)
   static uint32_t last_dump = 0;
@@ -0,0 +1,95 @@
+#include "adc_autocal.h"
+#include "adc_calibration.h"
+#include "adc_loop_average.h"
+#include "dac_control.h"
+#include "session_control.h"
+
+static const uint32_t STEP_SAMPLES = SIGNAL_SAMPLES / ADC_CAL_STEPS;
+static const uint32_t SETTLE_SAMPLES = STEP_SAMPLES * ADC_CAL_SETTLE_PCT / 100;
+static_assert(SIGNAL_SAMPLES % ADC_CAL_STEPS == 0, "Ступени должны делить луп");
+static_assert(ADC_CAL_STEPS - 1 <= ADC_CAL_MAX_POINTS, "Ступеней больше, чем точек в таблице");
+
+// Код signal_buffer ступени k (0 — ноль, ADC_CAL_STEPS - 1 — полный масштаб)
+static int16_t ladderCode(uint32_t k) {
+  return (int16_t)((int32_t)MAX_VAL * (int32_t)k / (ADC_CAL_STEPS - 1));
+}
+
+void fillADCCalibrationLadder(int16_t* buffer) {
+  for (uint32_t i = 0; i < SIGNAL_SAMPLES; i++) {
+    buffer[i] = ladderCode(i / STEP_SAMPLES);
+  }
+  snprintf(current_preset_name, PRESET_NAME_MAX_LEN, "Калибровка ADC %.1fmA", ADC_CAL_MAX_MA);
+}
+
+bool startADCAutoCalibration() {
+  if (current_state != STATE_IDLE) return false;
+  // Рампа + (лупы + 1 на захват фазы) + очередь DAC + рампа
+  uint32_t fade_frames = (uint32_t)(((uint64_t)ADC_CAL_FADE_MS * SAMPLE_RATE) / 1000);
+  uint32_t stable_frames = (ADC_CAL_LOOPS + 1) * SIGNAL_SAMPLES + DAC_PIPELINE_FRAMES;
+  Serial.printf("[CAL] Sweep: %u steps to %.1f mA, %u loops, %.1f s\n",
+                (unsigned)ADC_CAL_STEPS, ADC_CAL_MAX_MA, (unsigned)ADC_CAL_LOOPS,
+                (2.0f * fade_frames + stable_frames) / SAMPLE_RATE);
+  return startCalibrationSession(fade_frames, stable_frames);
+}
+
+bool finishADCAutoCalibration() {
+  if (getSessionStopReason() != STOP_COMPLETED) {
+    Serial.printf("[CAL] Aborted: %s\n", getStopReasonName(getSessionStopReason()));
+    return false;
+  }
+  int16_t* avg = (int16_t*)malloc(SIGNAL_SAMPLES * sizeof(int16_t));  // PSRAM
+  uint32_t loops = 0;
+  if (avg == NULL || !getADCLoopAverage(avg, &loops) || loops < ADC_CAL_LOOPS) {
+    Serial.printf("[CAL] Not enough coherent loops (%lu)\n", (unsigned long)loops);
+    free(avg);
+    return false;
+  }
+  
+  // Ток ступени — из команды DAC; среднее ADC — в дробный raw код старой таблицы
+  float uA_per_code = getAmplitudeScale() * 1000.0f / current_settings.dac_code_to_mA;
+  uint16_t codes[ADC_CAL_MAX_POINTS];
+  float mA[ADC_CAL_MAX_POINTS];
+  uint8_t count = 0;
+  float last_code = 0.0f;
+  float top_uA = 0.0f;
+  for (uint32_t k = 0; k < ADC_CAL_STEPS; k++) {
+    int32_t sum = 0;
+    for (uint32_t i = k * STEP_SAMPLES + SETTLE_SAMPLES; i < (k + 1) * STEP_SAMPLES; i++) {
+      sum += avg[i];
+    }
+    float mean_uA = (float)sum / (STEP_SAMPLES - SETTLE_SAMPLES);
+    float code = adcMicroampsToRawCode(mean_uA);
+    float ref_uA = ladderCode(k) * uA_per_code;
+    Serial.printf("[CAL] step %2lu: ref %7.1f uA, ADC %7.1f uA, raw %.1f\n",
+                  (unsigned long)k, ref_uA, mean_uA, code);
+    top_uA = mean_uA;
+    // Нулевая ступень и ступени в мёртвой зоне / не растущие — не точки таблицы
+    if (k == 0 || code < last_code + ADC_CAL_MIN_STEP_CODES) continue;
+    codes[count] = (uint16_t)(code + 0.5f);
+    mA[count] = ref_uA / 1000.0f;
+    last_code = code;
+    count++;
+  }
+  free(avg);
+  
+  float top_ref_uA = ladderCode(ADC_CAL_STEPS - 1) * uA_per_code;
+  if (top_uA < top_ref_uA * 0.1f) {
+    Serial.println("[CAL] No current through the load, table unchanged");
+    return false;
+  }
+  if (count < ADC_CAL_MIN_POINTS) {
+    Serial.printf("[CAL] Only %u usable steps, table unchanged\n", (unsigned)count);
+    return false;
+  }
+  // Таблица поглощает подстроечный множитель
+  float old_multiplier = current_settings.adc_multiplier;
+  current_settings.adc_multiplier = 1.0f;
+  if (!setADCCalibrationTable(codes, mA, count)) {
+    current_settings.adc_multiplier = old_multiplier;
+    Serial.println("[CAL] Fitted table is not monotonic, table unchanged");
+    return false;
+  }
+  saveSettings();
+  printADCCalibrationTable();
+  return true;
+}
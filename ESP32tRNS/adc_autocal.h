@@ -0,0 +1,29 @@
+#ifndef ADC_AUTOCAL_H
+#define ADC_AUTOCAL_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC AUTOCAL (автокалибровка показометра лестницей DAC) ===
+// ============================================================================
+// Калибровочный сеанс — обычный протокол tDCS (рампы, аварийная защита,
+// журнал), только луп signal_buffer — лестница из ADC_CAL_STEPS ступеней
+// 0..ADC_CAL_MAX_MA в эталонную нагрузку. Ток ступени задаёт DAC
+// (dac_code_to_mA опорный), ADC копит adc_loop_average: когерентное среднее
+// по лупам, фаза сэмпла = номер ступени. После сеанса: среднее каждой ступени
+// (без переходного начала) → дробный raw код по текущей таблице → новые точки
+// {raw, мА} → LUT + NVS, adc_multiplier = 1. Регулятор тока и контроль
+// контакта на время калибровки выключены.
+
+// Лестница в buffer (SIGNAL_SAMPLES), имя пресета — для дашборда
+void fillADCCalibrationLadder(int16_t* buffer);
+
+// Старт калибровочного сеанса (из меню). false — сеанс уже идёт
+bool startADCAutoCalibration();
+
+// Итог после окончания калибровочного сеанса (из loop): подгонка и запись
+// Возвращает true, если новая таблица принята
+bool finishADCAutoCalibration();
+
+#endif // ADC_AUTOCAL_H
@@ -1,11 +1,14 @@
 #include "adc_calibration.h"
 #include "session_control.h"
+#include "adc_control.h"  // для requestADCMicroampRebuild
+#include <Preferences.h>
 
 // ============================================================================
 // === КАЛИБРОВОЧНАЯ ТАБЛИЦА ===
 // ============================================================================
 // Формат: {ADC_raw, mA}
 // ВАЖНО: таблица ОБЯЗАНА быть отсортирована по возрастанию ADC_raw!
+// Заводская таблица; автокалибровка кладёт свою в NVS и она имеет приоритет
 
 struct CalibrationPoint {
   uint16_t adc_raw;
@@ -48,25 +51,76 @@ constexpr bool isTableValid() {
 
 static_assert(CALIB_TABLE_SIZE >= 2, "Таблица должна содержать минимум 2 точки");
 static_assert(isTableValid(), "Таблица должна быть отсортирована по возрастанию ADC без дубликатов");
+static_assert(CALIB_TABLE_SIZE <= ADC_CAL_MAX_POINTS, "Заводская таблица не влезает в рабочую");
+
+// ============================================================================
+// === РАБОЧАЯ ТАБЛИЦА (заводская или из NVS) ===
+// ============================================================================
+
+#define CALIB_NVS_NAMESPACE "adc_cal"
+#define CALIB_NVS_KEY       "table"
+#define CALIB_NVS_VERSION   1
+
+struct CalibrationBlob {
+  uint16_t version;
+  uint16_t count;
+  CalibrationPoint points[ADC_CAL_MAX_POINTS];
+};
+
+static CalibrationPoint calib_table[ADC_CAL_MAX_POINTS];
+static size_t calib_count = 0;
+static bool calib_from_nvs = false;
+
+static bool isPointsValid(const CalibrationPoint* points, size_t count) {
+  if (count < 2 || count > ADC_CAL_MAX_POINTS) return false;
+  for (size_t i = 0; i < count; i++) {
+    if (points[i].adc_raw >= 4096 || !(points[i].mA >= 0.0f)) return false;
+    if (i > 0 && (points[i].adc_raw <= points[i-1].adc_raw || points[i].mA <= points[i-1].mA)) return false;
+  }
+  return true;
+}
+
+static void useFactoryTable() {
+  memcpy(calib_table, CALIB_TABLE, sizeof(CALIB_TABLE));
+  calib_count = CALIB_TABLE_SIZE;
+  calib_from_nvs = false;
+}
+
+static bool loadTableFromNVS() {
+  Preferences prefs;
+  if (!prefs.begin(CALIB_NVS_NAMESPACE, true)) return false;
+  CalibrationBlob blob;
+  size_t len = prefs.getBytes(CALIB_NVS_KEY, &blob, sizeof(blob));
+  prefs.end();
+  if (len != sizeof(blob) || blob.version != CALIB_NVS_VERSION ||
+      !isPointsValid(blob.points, blob.count)) {
+    return false;
+  }
+  memcpy(calib_table, blob.points, blob.count * sizeof(CalibrationPoint));
+  calib_count = blob.count;
+  calib_from_nvs = true;
+  return true;
+}
 
 // ============================================================================
 // === LOOKUP TABLE (LUT) ===
 // ============================================================================
 
 static float code2mA[4096];  // Предрассчитанная таблица: индекс = ADC код, значение = mA
+static int16_t code2uA[4096];  // То же в мкА с учётом adc_multiplier (для ingest без float)
 
 // Интерполяция для заполнения LUT (вызывается один раз при старте)
 static float interpolateMilliamps(uint16_t adc_raw) {
   size_t i1 = 0, i2 = 1;
   
-  if (adc_raw <= CALIB_TABLE[0].adc_raw) {
+  if (adc_raw <= calib_table[0].adc_raw) {
     i1 = 0; i2 = 1;
-  } else if (adc_raw >= CALIB_TABLE[CALIB_TABLE_SIZE - 1].adc_raw) {
-    i1 = CALIB_TABLE_SIZE - 2;
-    i2 = CALIB_TABLE_SIZE - 1;
+  } else if (adc_raw >= calib_table[calib_count - 1].adc_raw) {
+    i1 = calib_count - 2;
+    i2 = calib_count - 1;
   } else {
-    for (size_t i = 0; i < CALIB_TABLE_SIZE - 1; i++) {
-      if (adc_raw >= CALIB_TABLE[i].adc_raw && adc_raw < CALIB_TABLE[i + 1].adc_raw) {
+    for (size_t i = 0; i < calib_count - 1; i++) {
+      if (adc_raw >= calib_table[i].adc_raw && adc_raw < calib_table[i + 1].adc_raw) {
         i1 = i;
         i2 = i + 1;
         break;
@@ -74,20 +128,82 @@ static float interpolateMilliamps(uint16_t adc_raw) {
     }
   }
   
-  float adc1 = (float)CALIB_TABLE[i1].adc_raw;
-  float adc2 = (float)CALIB_TABLE[i2].adc_raw;
-  float mA1 = CALIB_TABLE[i1].mA;
-  float mA2 = CALIB_TABLE[i2].mA;
+  float adc1 = (float)calib_table[i1].adc_raw;
+  float adc2 = (float)calib_table[i2].adc_raw;
+  float mA1 = calib_table[i1].mA;
+  float mA2 = calib_table[i2].mA;
   
   float mA = mA1 + ((float)adc_raw - adc1) * (mA2 - mA1) / (adc2 - adc1);
   return (mA < 0.0f) ? 0.0f : mA;
 }
 
+static void rebuildMilliampLUT() {
+  for (uint16_t i = 0; i < 4096; i++) {
+    code2mA[i] = interpolateMilliamps(i);
+  }
+  updateADCCalibrationScale();
+}
+
 // Инициализация LUT — вызвать один раз при старте!
 void initADCCalibration() {
+  if (!loadTableFromNVS()) useFactoryTable();
+  Serial.printf("[CAL] ADC table: %u points (%s)\n", (unsigned)calib_count,
+                calib_from_nvs ? "NVS" : "factory");
+  rebuildMilliampLUT();
+}
+
+bool setADCCalibrationTable(const uint16_t* adc_raw, const float* mA, uint8_t count) {
+  CalibrationBlob blob;
+  memset(&blob, 0, sizeof(blob));
+  blob.version = CALIB_NVS_VERSION;
+  blob.count = count;
+  for (uint8_t i = 0; i < count && i < ADC_CAL_MAX_POINTS; i++) {
+    blob.points[i].adc_raw = adc_raw[i];
+    blob.points[i].mA = mA[i];
+  }
+  if (!isPointsValid(blob.points, count)) return false;
+  
+  memcpy(calib_table, blob.points, count * sizeof(CalibrationPoint));
+  calib_count = count;
+  calib_from_nvs = true;
+  rebuildMilliampLUT();
+  
+  Preferences prefs;
+  if (!prefs.begin(CALIB_NVS_NAMESPACE, false) ||
+      prefs.putBytes(CALIB_NVS_KEY, &blob, sizeof(blob)) != sizeof(blob)) {
+    Serial.println("[CAL] NVS write failed, table active until reboot");
+  }
+  prefs.end();
+  return true;
+}
+
+void resetADCCalibrationTable() {
+  Preferences prefs;
+  if (prefs.begin(CALIB_NVS_NAMESPACE, false)) {
+    prefs.remove(CALIB_NVS_KEY);
+    prefs.end();
+  }
+  useFactoryTable();
+  rebuildMilliampLUT();
+}
+
+void printADCCalibrationTable() {
+  Serial.printf("[CAL] ADC table (%s):", calib_from_nvs ? "NVS" : "factory");
+  for (size_t i = 0; i < calib_count; i++) {
+    Serial.printf(" %u=%.3f", (unsigned)calib_table[i].adc_raw, calib_table[i].mA);
+  }
+  Serial.println();
+}
+
+void updateADCCalibrationScale() {
+  float mult = current_settings.adc_multiplier;
+  if (mult <= 0.0f) mult = DEF_ADC_MULTIPLIER;
   for (uint16_t i = 0; i < 4096; i++) {
-    code2mA[i] = interpolateMilliamps(i);
+    float uA = code2mA[i] * mult * 1000.0f + 0.5f;
+    code2uA[i] = (uA > 32767.0f) ? 32767 : (int16_t)uA;
   }
+  // Кольцо мкА (и суммы окон по нему) посчитано по старой LUT — пересобрать
+  requestADCMicroampRebuild();
 }
 
 // ============================================================================
@@ -105,3 +221,41 @@ float adcSignedToMilliamps(int16_t adc_signed) {
   float mag = adcRawToMilliamps((uint16_t)abs(adc_signed));
   return (adc_signed < 0) ? -mag : mag;
 }
+
+// Целочисленный вариант: мкА со знаком
+int16_t adcSignedToMicroamps(int16_t adc_signed) {
+  if (adc_signed < 0) {
+    uint16_t mag = (uint16_t)(-adc_signed);
+    return -code2uA[(mag >= 4096) ? 4095 : mag];
+  }
+  return code2uA[(adc_signed >= 4096) ? 4095 : adc_signed];
+}
+
+// Обратный пересчёт в дробный код: code2mA линейна между целыми кодами
+float adcMicroampsToRawCode(float uA) {
+  float mult = current_settings.adc_multiplier;
+  if (mult <= 0.0f) mult = DEF_ADC_MULTIPLIER;
+  float mA = ((uA < 0.0f) ? -uA : uA) / (1000.0f * mult);
+  if (mA <= code2mA[0]) return 0.0f;
+  if (mA >= code2mA[4095]) return 4095.0f;
+  uint16_t lo = 0, hi = 4095;  // Первый код с code2mA ≥ mA
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (code2mA[mid] < mA) lo = mid + 1;
+    else hi = mid;
+  }
+  float step = code2mA[lo] - code2mA[lo - 1];
+  return (step > 0.0f) ? (lo - 1) + (mA - code2mA[lo - 1]) / step : (float)lo;
+}
+
+// Обратный пересчёт (редко: настройка порогов) — двоичный поиск по монотонной LUT
+int16_t adcMicroampsToSigned(int32_t uA) {
+  int32_t mag = (uA < 0) ? -uA : uA;
+  uint16_t lo = 0, hi = 4095;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (code2uA[mid] < mag) lo = mid + 1;
+    else hi = mid;
+  }
+  return (uA < 0) ? -(int16_t)lo : (int16_t)lo;
+}
@@ -2,16 +2,27 @@
 #define ADC_CALIBRATION_H
 
 #include <Arduino.h>
+#include "config.h"
 
 // ============================================================================
 // === КАЛИБРОВКА ADC: таблица ADC_raw → mA ===
 // ============================================================================
 // Линейная интерполяция между точками таблицы
 // Экстраполяция за границами
+// Рабочая таблица: из NVS (автокалибровка, adc_autocal), иначе заводская CALIB_TABLE
 
-// Инициализация LUT — вызвать один раз при старте!
+// Инициализация LUT — вызвать один раз при старте (после EEPROM.begin: NVS)!
 void initADCCalibration();
 
+// Новая таблица (коды по возрастанию) → LUT + NVS. false — таблица некорректна
+bool setADCCalibrationTable(const uint16_t* adc_raw, const float* mA, uint8_t count);
+
+// Вернуть заводскую таблицу (и стереть её копию в NVS)
+void resetADCCalibrationTable();
+
+// Таблица в Serial (источник: NVS или заводская)
+void printADCCalibrationTable();
+
 // Пересчёт беззнакового raw ADC кода (magnitude) в миллиамперы (O(1) через LUT)
 float adcRawToMilliamps(uint16_t adc_raw);
 
@@ -19,5 +30,19 @@ float adcRawToMilliamps(uint16_t adc_raw);
 // Сохраняет знак: положительный код → положительные mA, отрицательный → отрицательные
 float adcSignedToMilliamps(int16_t adc_signed);
 
+// Пересобрать целочисленную LUT (мкА) с текущим adc_multiplier
+// Вызывать при старте сеанса (множитель мог поменяться в настройках)
+void updateADCCalibrationScale();
+
+// Пересчёт знакового ADC кода в микроамперы (целочисленно, для ingest-пути)
+int16_t adcSignedToMicroamps(int16_t adc_signed);
+
+// Обратный пересчёт по рабочей таблице (с adc_multiplier): дробный raw код модуля,
+// дающий ток uA (для усреднённых мкА при автокалибровке)
+float adcMicroampsToRawCode(float uA);
+
+// Обратный пересчёт: знаковый код, чей ток ближе всего сверху к uA (поиск по LUT)
+int16_t adcMicroampsToSigned(int32_t uA);
+
 #endif // ADC_CALIBRATION_H
 
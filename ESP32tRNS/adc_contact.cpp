@@ -0,0 +1,207 @@
+#include "adc_contact.h"
+#include "adc_loop_average.h"
+#include "dac_control.h"
+
+// Суммы одного блока
+struct ContactBlock {
+  int32_t meas_abs_uA;   // Σ|измеренный|
+  int32_t cmd_abs;       // Σ|команда| в кодах signal_buffer
+  uint16_t sign_total;   // Сэмплов с |командой| выше порога
+  uint16_t sign_agree;   // Из них знак совпал
+  uint32_t anomalies;
+  uint32_t raw_pairs;
+  uint32_t n;
+  uint32_t phase;        // Фаза лупа первого сэмпла
+};
+
+static ContactBlock contact_blocks[ADC_CONTACT_WINDOW_BLOCKS];
+static uint8_t contact_head = 0;
+static uint8_t contact_filled = 0;
+static uint8_t bad_windows = 0;
+static uint32_t settle_samples = 0;    // Сэмплов STABLE подряд (очередь DAC доигрывает рампу)
+
+// Конфигурация: пишет loop, применяет ingest
+static volatile bool contact_pending = false;
+static float pending_uA_per_code = 0.0f;
+static float contact_uA_per_code = 0.0f;
+
+// Порог знака — доля пика формы (в кодах signal_buffer)
+static const int32_t SIGN_FLOOR_CODE = (int32_t)MAX_VAL * ADC_CONTACT_SIGN_FLOOR_PCT / 100;
+
+// Фазы лупа, где знак сравнивается: команда выше порога одного знака на всём
+// [фаза − GUARD, фаза + GUARD] — сэмпл с ошибкой привязки фазы в пределах GUARD
+// видит команду того же знака. Пишет loop (configureADCContact), читает ingest
+static uint32_t sign_pos_mask[SIGNAL_SAMPLES / 32];
+static uint32_t sign_neg_mask[SIGNAL_SAMPLES / 32];
+static volatile bool sign_mask_ready = false;
+#define MASK_BIT(mask, p)  (((mask)[(p) >> 5] >> ((p) & 31)) & 1u)
+
+static AdcContactStatus contact_status;
+static portMUX_TYPE contact_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void resetContactWindow() {
+  contact_head = 0;
+  contact_filled = 0;
+  bad_windows = 0;
+  settle_samples = 0;
+}
+
+// Два круга по лупу: серия одного знака, закончившаяся на q длиной ≥ 2·GUARD + 1,
+// покрывает окно фазы q − GUARD (первый круг лишь недооценивает серию)
+static void buildSignMask(uint32_t* mask, bool positive) {
+  memset(mask, 0, (SIGNAL_SAMPLES / 32) * sizeof(uint32_t));
+  if (signal_buffer == NULL) return;
+  const uint32_t span = 2 * ADC_CONTACT_SIGN_GUARD + 1;
+  uint32_t run = 0;
+  for (uint32_t i = 0; i < 2 * SIGNAL_SAMPLES; i++) {
+    int32_t c = signal_buffer[i & (SIGNAL_SAMPLES - 1)];
+    bool same = positive ? (c > SIGN_FLOOR_CODE) : (c < -SIGN_FLOOR_CODE);
+    run = same ? run + 1 : 0;
+    if (run >= span) {
+      uint32_t p = (i - ADC_CONTACT_SIGN_GUARD) & (SIGNAL_SAMPLES - 1);
+      mask[p >> 5] |= 1u << (p & 31);
+    }
+  }
+}
+
+void configureADCContact(float uA_per_code) {
+  // Ingest не сравнивает знак, пока маска перестраивается под новую форму
+  sign_mask_ready = false;
+  __sync_synchronize();
+  buildSignMask(sign_pos_mask, true);
+  buildSignMask(sign_neg_mask, false);
+  __sync_synchronize();
+  sign_mask_ready = true;
+  pending_uA_per_code = uA_per_code;
+  __sync_synchronize();
+  contact_pending = true;
+}
+
+// Σ|команды| (коды) по фазам [from, from + len) лупа
+static int32_t cmdAbsSum(uint32_t from, uint32_t len) {
+  int32_t sum = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    int32_t c = signal_buffer[(from + i) & (SIGNAL_SAMPLES - 1)];
+    sum += (c < 0) ? -c : c;
+  }
+  return sum;
+}
+
+// ratio_valid = false — отношение тока в окне не оценивается (сдвиг фазы)
+static uint8_t classifyWindow(bool ratio_valid, float ratio_pct, float anomaly_pct, float sign_pct) {
+  if (anomaly_pct > ADC_CONTACT_MAX_ANOMALY_PCT ||
+      (ratio_valid && ratio_pct < ADC_CONTACT_OPEN_RATIO_PCT)) {
+    return ADC_CONTACT_OPEN;
+  }
+  if (ratio_valid && ratio_pct < ADC_CONTACT_MIN_RATIO_PCT) return ADC_CONTACT_REGULATION;
+  if (sign_pct < ADC_CONTACT_MIN_SIGN_PCT) return ADC_CONTACT_SIGN;
+  return ADC_CONTACT_OK;
+}
+
+void updateADCContact(const int16_t* block_uA, uint32_t n, uint32_t seq, bool stable,
+                      uint32_t anomalies, uint32_t raw_pairs) {
+  if (contact_pending) {
+    contact_pending = false;
+    contact_uA_per_code = pending_uA_per_code;
+    resetContactWindow();
+    portENTER_CRITICAL(&contact_mux);
+    contact_status.valid = false;
+    contact_status.fault = ADC_CONTACT_OK;
+    contact_status.ratio_valid = false;
+    portEXIT_CRITICAL(&contact_mux);
+  }
+
+  uint32_t phase;
+  if (!stable || contact_uA_per_code <= 0.0f || signal_buffer == NULL || !sign_mask_ready ||
+      !getADCLoopPhase(seq, &phase)) {
+    resetContactWindow();
+    return;
+  }
+  // Первые DAC_PIPELINE_FRAMES сэмплов STABLE на выходе ещё хвост рампы
+  settle_samples += n;
+  if (settle_samples <= DAC_PIPELINE_FRAMES) return;
+
+  // O(1) на сэмпл: команда той же фазы лупа
+  ContactBlock b = { 0, 0, 0, 0, anomalies, raw_pairs, n, phase };
+  for (uint32_t i = 0; i < n; i++) {
+    int32_t x = block_uA[i];
+    uint32_t p = (phase + i) & (SIGNAL_SAMPLES - 1);
+    int32_t c = signal_buffer[p];
+    b.meas_abs_uA += (x < 0) ? -x : x;
+    b.cmd_abs += (c < 0) ? -c : c;
+    if (MASK_BIT(sign_pos_mask, p)) {
+      b.sign_total++;
+      if (x > 0) b.sign_agree++;
+    } else if (MASK_BIT(sign_neg_mask, p)) {
+      b.sign_total++;
+      if (x <= 0) b.sign_agree++;
+    }
+  }
+  contact_blocks[contact_head] = b;
+  contact_head = (contact_head + 1) % ADC_CONTACT_WINDOW_BLOCKS;
+  if (contact_filled < ADC_CONTACT_WINDOW_BLOCKS) contact_filled++;
+  if (contact_filled < ADC_CONTACT_WINDOW_BLOCKS) return;
+
+  // Окно из последних блоков
+  int64_t meas = 0, cmd = 0;
+  uint32_t sign_total = 0, sign_agree = 0, anomaly = 0, pairs = 0, samples = 0;
+  for (uint8_t k = 0; k < ADC_CONTACT_WINDOW_BLOCKS; k++) {
+    meas += contact_blocks[k].meas_abs_uA;
+    cmd += contact_blocks[k].cmd_abs;
+    sign_total += contact_blocks[k].sign_total;
+    sign_agree += contact_blocks[k].sign_agree;
+    anomaly += contact_blocks[k].anomalies;
+    pairs += contact_blocks[k].raw_pairs;
+    samples += contact_blocks[k].n;
+  }
+  float cmd_uA = (float)cmd * contact_uA_per_code;
+  if (cmd_uA < (float)ADC_CONTACT_MIN_CMD_UA * samples) return;  // Нечего сравнивать
+
+  float ratio_pct = 100.0f * (float)meas / cmd_uA;
+  float anomaly_pct = (pairs > 0) ? 100.0f * anomaly / pairs : 0.0f;
+  // tDCS тоже: обратный знак постоянного тока — перепутанная полярность
+  float sign_pct = (sign_total > 0) ? 100.0f * sign_agree / sign_total : 100.0f;
+
+  // Ошибка привязки фазы e (|e| ≤ GUARD) сдвигает окно команды: Σ|команды|
+  // меняется на разность краёв. У медленной формы у нуля это больше самой суммы —
+  // такое окно по отношению тока не судим (знак и аномалии — судим)
+  const uint32_t guard = ADC_CONTACT_SIGN_GUARD;
+  uint32_t start = contact_blocks[contact_head].phase;  // Самый старый блок окна
+  uint32_t end = start + samples;
+  int32_t shift_fwd = cmdAbsSum(end, guard) - cmdAbsSum(start, guard);
+  int32_t shift_back = cmdAbsSum(start - guard, guard) - cmdAbsSum(end - guard, guard);
+  int32_t shift = max(abs(shift_fwd), abs(shift_back));
+  bool ratio_valid = (int64_t)shift * 100 <= cmd * ADC_CONTACT_SHIFT_TOL_PCT;
+
+  uint8_t verdict = classifyWindow(ratio_valid, ratio_pct, anomaly_pct, sign_pct);
+  bad_windows = (verdict == ADC_CONTACT_OK) ? 0 : bad_windows + 1;
+
+  portENTER_CRITICAL(&contact_mux);
+  contact_status.valid = true;
+  if (ratio_valid) {
+    contact_status.ratio_valid = true;
+    contact_status.ratio_pct = ratio_pct;
+  }
+  contact_status.anomaly_pct = anomaly_pct;
+  contact_status.sign_pct = sign_pct;
+  if (bad_windows >= ADC_CONTACT_BAD_WINDOWS && contact_status.fault == ADC_CONTACT_OK) {
+    contact_status.fault = verdict;
+  }
+  portEXIT_CRITICAL(&contact_mux);
+}
+
+void getADCContactStatus(AdcContactStatus* status) {
+  portENTER_CRITICAL(&contact_mux);
+  *status = contact_status;
+  portEXIT_CRITICAL(&contact_mux);
+}
+
+const char* getADCContactFaultName(uint8_t fault) {
+  switch (fault) {
+    case ADC_CONTACT_OK: return "OK";
+    case ADC_CONTACT_OPEN: return "open circuit";
+    case ADC_CONTACT_REGULATION: return "low current";
+    case ADC_CONTACT_SIGN: return "sign mismatch";
+    default: return "?";
+  }
+}
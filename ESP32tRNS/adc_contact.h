@@ -0,0 +1,55 @@
+#ifndef ADC_CONTACT_H
+#define ADC_CONTACT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC CONTACT (качество контакта электродов, потоково в ingest) ===
+// ============================================================================
+// Каждый сэмпл мкА сравнивается с командой той же фазы лупа
+// (signal_buffer[фаза] × мкА на код): O(1) на сэмпл — два |x|, одно сравнение
+// знака. Суммы блока копятся в окно из ADC_CONTACT_WINDOW_BLOCKS блоков:
+//  - отношение измеренного |I| к заданному (обрыв / VCCS упёрся в напряжение) —
+//    в окнах, где сдвиг фазы на ±ADC_CONTACT_SIGN_GUARD мало меняет Σ|команды|;
+//  - доля пар вне калибровки (открытый вход шумит);
+//  - доля совпадений знака там, где команда заметно не ноль и того же знака
+//    на ±ADC_CONTACT_SIGN_GUARD сэмплов (H-мост): ошибка привязки фазы лупа
+//    не превращает быстрый tACS/tRNS в «несовпадение знака».
+// ADC_CONTACT_BAD_WINDOWS плохих окон подряд → защёлка с кодом причины,
+// сеанс уходит в fadeout (session_control). Оценка — только в STABLE на полной
+// амплитуде после того, как очередь DAC доиграла прежний gain.
+
+enum AdcContactFault : uint8_t {
+  ADC_CONTACT_OK = 0,
+  ADC_CONTACT_OPEN = 1,         // Обрыв / нет контакта
+  ADC_CONTACT_REGULATION = 2,   // Ток заметно ниже заданного (высокий импеданс)
+  ADC_CONTACT_SIGN = 3          // Знак тока не совпадает с командой
+};
+
+struct AdcContactStatus {
+  bool valid;            // Было хотя бы одно оценённое окно
+  uint8_t fault;         // AdcContactFault (защёлка)
+  bool ratio_valid;      // Отношение тока оценено хотя бы в одном окне
+  float ratio_pct;       // Измеренный / заданный |I| в последнем окне, где оценивалось
+  float anomaly_pct;     // Пар вне калибровки
+  float sign_pct;        // Совпадений знака там, где команда устойчиво не ноль
+};
+
+// Масштаб команды: мкА на код signal_buffer (из applyModeScaling, после генерации
+// формы: здесь же строится маска фаз для сравнения знака, O(SIGNAL_SAMPLES))
+// Сбрасывает защёлку; применит ingest перед следующим блоком
+void configureADCContact(float uA_per_code);
+
+// Блок мкА (ingest): seq — adc_sample_seq первого сэмпла, stable — STABLE на полной
+// амплитуде, anomalies — пар вне калибровки в блоке (из raw_pairs сырых пар)
+void updateADCContact(const int16_t* block_uA, uint32_t n, uint32_t seq, bool stable,
+                      uint32_t anomalies, uint32_t raw_pairs);
+
+// Последнее окно и защёлка
+void getADCContactStatus(AdcContactStatus* status);
+
+// Название причины для Serial/экрана
+const char* getADCContactFaultName(uint8_t fault);
+
+#endif // ADC_CONTACT_H
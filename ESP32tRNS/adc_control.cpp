@@ -1,117 +1,333 @@
 #include "adc_control.h"
 #include "adc_calibration.h"
 #include "session_control.h"
-#include "dac_control.h"  // для dynamic_dac_gain
+#include "dac_control.h"  // для dynamic_dac_gain и muteDACOutput
+#include "session_dosimetry.h"
+#include "adc_frame_parser.h"
+#include "adc_window_stats.h"
+#include "adc_envelope.h"
+#include "adc_crossing.h"
+#include "adc_decimator.h"
+#include "adc_estimator.h"
+#include "adc_loop_average.h"
+#include "adc_spectrum.h"
+#include "adc_lockin.h"
+#include "adc_transfer.h"
+#include "adc_trip.h"
+#include "adc_sign_skew.h"
+#include "adc_contact.h"
+#include "adc_history.h"
+#include <esp_cpu.h>
+#include <esp_timer.h>
+
+// Парсер рассчитан на TYPE1 (2 байта на конверсию, ESP32-S2)
+static_assert(SOC_ADC_DIGI_DATA_BYTES_PER_CONV == 2, "adc_frame_parser expects TYPE1 2-byte conversions");
+static_assert((ADC_RING_SIZE & (ADC_RING_SIZE - 1)) == 0, "ADC_RING_SIZE must be a power of two");
+static_assert(ADC_SAMPLE_RATE == SAMPLE_RATE, "DC trip window counts DAC loops in ADC pairs");
+static_assert((uint64_t)ADC_TRIP_DC_WINDOW_PAIRS * 4095 <= INT32_MAX, "DC trip sum must fit int32");
+static_assert(ADC_SAMPLE_RATE * 2 * ADC_OVERSAMPLE <= SOC_ADC_SAMPLE_FREQ_THRES_HIGH,
+              "ADC_OVERSAMPLE_SHIFT exceeds the continuous-mode sample rate limit");
 
 // Глобальные переменные
 adc_continuous_handle_t adc_handle = NULL;
 int16_t* adc_ring_buffer = NULL;
+int16_t* adc_uA_ring_buffer = NULL;
 volatile uint32_t adc_write_index = 0;
+volatile uint32_t adc_sample_seq = 0;
+static volatile uint32_t adc_ring_reset_seq = 0;  // adc_sample_seq на момент сброса кольца
+
+// Сколько сэмплов может быть «в полёте» внутри записи одного блока
+#define ADC_RING_WRITE_SLACK  (ADC_SAMPLES_PER_FRAME + 1)
+volatile uint32_t adc_overrange_count = 0;
+volatile uint32_t adc_pair_desync_count = 0;
+volatile uint32_t adc_pool_overflow_count = 0;
+
+// Задача разбора DMA фреймов (будится из conv_done ISR)
+static TaskHandle_t adc_ingest_task = NULL;
+
+// Управление задержкой запуска записи ADC (loop пишет, ingest читает)
+static volatile bool adc_capture_enabled = false;
+static volatile bool adc_capture_pending = false;
+static volatile uint32_t adc_capture_resume_ms = 0;
+
+// Запись сырых DMA фреймов: буфер выделяется при первой команде "frames"
+#define ADC_FRAME_CAPTURE_BYTES (ADC_FRAME_SIZE * SOC_ADC_DIGI_DATA_BYTES_PER_CONV)
+static uint8_t* frame_cap_buf = NULL;
+static uint16_t frame_cap_len[ADC_FRAME_CAPTURE_MAX];
+static uint8_t frame_cap_shift[ADC_FRAME_CAPTURE_MAX];
+static volatile uint8_t frame_cap_wanted = 0;  // Заказано (loop)
+static volatile uint8_t frame_cap_count = 0;   // Записано (ingest, публикуется после данных)
+static uint8_t frame_cap_printed = 0;          // Выведено (loop)
+
+// Калибровка сменилась — кольцо мкА пересчитывается из кодов в ingest
+static volatile bool adc_uA_rebuild_pending = false;
+
+// Блочный парсер пар sign/mag + фильтр [1,1,1]/3 (состояние между фреймами)
+static AdcPairParser adc_parser;
 
-// Управление задержкой запуска записи ADC
-static bool adc_capture_enabled = false;
-static bool adc_capture_pending = false;
-static uint32_t adc_capture_resume_ms = 0;
+// Прореживание CIC + FIR (при ADC_OVERSAMPLE_SHIFT > 0)
+static AdcDecimator adc_decimator;
 
-// Скользящее среднее по 3 сэмплам (сглаживание)
-static int16_t ma_buffer[3] = {0, 0, 0};  // Кольцевой буфер на 3 элемента
-static uint8_t ma_index = 0;              // Позиция записи
-static float ma_avg = 0.0f;               // Текущее среднее
-static uint32_t last_sign_warn_ms = 0;
+// Профиль частоты: пишет loop, применяет ingest (единственный читатель adc_handle)
+static volatile bool adc_rate_pending = false;
+static volatile uint8_t pending_rate_profile = ADC_RATE_IDLE;
+static uint8_t adc_ratio_shift = ADC_OVERSAMPLE_SHIFT;  // log2(R) последнего активного профиля
+// Байт блока ingest активного профиля: ingest собирает из фреймов DMA ровно блок
+// (×1 блок вчетверо меньше буфера — больший блок вышел бы за ADC_RING_WRITE_SLACK)
+static uint32_t adc_block_bytes = ADC_FRAME_SIZE * SOC_ADC_DIGI_DATA_BYTES_PER_CONV;
+
+// Аварийная защита: детектор в conv_done ISR, пороги пишет loop (применяет ISR)
+static AdcTripDetector adc_trip;
+static volatile bool adc_trip_pending = false;
+static uint16_t pending_trip_code = 0, pending_dc_code = 0;
+// Окна детектора в сырых парах — под текущую частоту пар (то же время)
+static uint32_t trip_confirm_pairs = ADC_TRIP_CONFIRM_PAIRS;
+static uint32_t trip_dc_window_pairs = ADC_TRIP_DC_WINDOW_PAIRS;
+static TaskHandle_t adc_trip_task = NULL;
+static volatile int64_t adc_trip_isr_us = 0;    // Срабатывание в ISR
+static volatile int64_t adc_trip_mute_us = 0;   // Очередь DAC обнулена
+
+// Перекос знака H-моста (adc_sign_skew): детектор в ingest, итоги забирает loop
+static AdcSignSkew adc_skew;
+static portMUX_TYPE skew_mux = portMUX_INITIALIZER_UNLOCKED;
+static int64_t skew_sum_q8 = 0;        // Σ перекосов, пары Q8 (при текущей R)
+static uint64_t skew_sum_sq_q16 = 0;
+static uint32_t skew_edges = 0;
+static uint32_t skew_rejected = 0;
+static uint32_t skew_hold_until_ms = 0;  // loop: после поправки ждём новую задержку в DAC
+// Последняя оценка (отчёт сеанса)
+static bool skew_report_valid = false;
+static float skew_report_us = 0.0f, skew_report_se_us = 0.0f, skew_report_res_us = 0.0f;
+static uint32_t skew_report_edges = 0;
+
+// Оценщик тока alpha-beta (при ADC_ESTIMATOR_ENABLE); модель пишет loop, применяет ingest
+static AdcEstimator adc_estimator;
+static volatile bool adc_estimator_pending = false;
+static uint16_t pending_alpha = 4096, pending_beta = 0, pending_max_run = 0;
+static int16_t pending_floor = ADC_MAX_VALUE;
+static AdcHampel adc_raw_hampel;  // Выбросы на сырых парах (R > 1, до дециматора)
+
+// Стоимость разбора (для оценки на устройстве: циклы CPU на сэмпл)
+static uint64_t adc_ingest_cycles = 0;
+static uint64_t adc_ingest_samples = 0;
+static uint64_t adc_decimator_cycles = 0;   // Только прореживание
+static uint32_t adc_decimator_frames = 0;
 
 // Вспомогательная функция для сброса буфера ADC в запрещенное значение
 static void resetADCRingBufferInternal() {
-  if (adc_ring_buffer) {
-    for (uint32_t i = 0; i < ADC_RING_SIZE; i++) {
-      adc_ring_buffer[i] = ADC_INVALID_VALUE;
-    }
+  for (uint32_t i = 0; i < ADC_RING_SIZE; i++) {
+    if (adc_ring_buffer) adc_ring_buffer[i] = ADC_INVALID_VALUE;
+    if (adc_uA_ring_buffer) adc_uA_ring_buffer[i] = ADC_INVALID_VALUE;
   }
+  adc_uA_rebuild_pending = false;
   adc_write_index = 0;
-  
-  // Сбрасываем скользящее среднее
-  ma_buffer[0] = ma_buffer[1] = ma_buffer[2] = 0;
-  ma_index = 0;
-  ma_avg = 0.0f;
+  // Скачок не меньше размера кольца: все ранее выданные окна становятся
+  // невалидными; выравнивание сохраняет seq & (ADC_RING_SIZE - 1) == индекс
+  adc_sample_seq = (adc_sample_seq + 2 * ADC_RING_SIZE) & ~(uint32_t)(ADC_RING_SIZE - 1);
+  adc_ring_reset_seq = adc_sample_seq;
+  
+  // Сбрасываем фильтр, недособранную пару и скользящие окна
+  resetAdcPairParser(&adc_parser);
+  resetAdcEstimator(&adc_estimator);
+  resetAdcHampel(&adc_raw_hampel);
+#if ADC_OVERSAMPLE_SHIFT > 0
+  if (adc_ratio_shift > 0) resetAdcDecimator(&adc_decimator);
+#endif
+  resetADCWindowStats();
+  resetADCCrossings();
 }
 
-// Применить скользящее среднее по 3 сэмплам (фильтр нижних частот)
-// Формула: new_avg = old_avg + (new_sample - oldest_sample) / N
-static inline int16_t applyMovingAverage(int16_t new_sample) {
-  // Берём самый старый сэмпл (который сейчас будет перезаписан)
-  int16_t oldest = ma_buffer[ma_index];
-  
-  // Обновляем среднее
-  ma_avg = ma_avg + (new_sample - oldest) / 3.0f;
-  
-  // Записываем новое значение поверх самого старого
-  ma_buffer[ma_index] = new_sample;
-  
-  // Двигаем индекс по кругу (0 -> 1 -> 2 -> 0 ...)
-  ma_index = (ma_index + 1) % 3;
-  
-  // Возвращаем округлённое среднее
-  return (int16_t)(ma_avg + 0.5f);
+// Пересчёт кольца мкА из кодов по новой LUT (редко: старт сеанса)
+static void rebuildMicroampRing(uint32_t write_index) {
+  for (uint32_t i = 0; i < ADC_RING_SIZE; i++) {
+    int16_t code = adc_ring_buffer[i];
+    adc_uA_ring_buffer[i] = (code == ADC_INVALID_VALUE) ? ADC_INVALID_VALUE
+                                                        : adcSignedToMicroamps(code);
+  }
+  // Суммы окон и огибающая посчитаны по старым мкА — пересобрать
+  rebuildADCEnvelope(adc_uA_ring_buffer, write_index);
+  requestADCWindowStatsRebuild();
 }
 
-// Вычисление размера окна статистики в сэмплах (не больше размера буфера)
-static uint32_t getStatsWindowSize() {
-  uint32_t window = ADC_STATS_WINDOW_SAMPLES;
-  if (window == 0 || window > ADC_RING_SIZE) {
-    window = (ADC_RING_SIZE < 1) ? 1 : ADC_RING_SIZE;
-  }
-  return window;
+void requestADCMicroampRebuild() {
+  adc_uA_rebuild_pending = true;
 }
 
-// Сбор последних N сэмплов в dest (возвращает количество валидных значений)
-static uint32_t collectRecentSamples(int16_t* dest, uint32_t max_samples) {
-  if (dest == NULL || !adc_capture_enabled) {
-    return 0;
-  }
-  
-  uint32_t window = max_samples;
-  if (window > ADC_RING_SIZE) {
-    window = ADC_RING_SIZE;
-  }
-  
-  uint32_t collected = 0;
-  uint32_t start = (adc_write_index + ADC_RING_SIZE - window) % ADC_RING_SIZE;
-  
-  for (uint32_t i = 0; i < window; i++) {
-    uint32_t idx = (start + i) % ADC_RING_SIZE;
-    int16_t sample = adc_ring_buffer[idx];
-    if (sample == ADC_INVALID_VALUE) {
-      continue;
+// Разбор одного блока ingest: пары sign/mag → кольцевой буфер + дозиметрия
+// Один проход парсера по фрейму, запись в кольцо одним-двумя memcpy
+static void processADCFrame(const uint8_t* dma_buffer, uint32_t bytes_read) {
+  static int16_t block[ADC_FRAME_SIZE / 2 + 1];
+  uint32_t t0 = esp_cpu_get_cycle_count();
+  
+  adc_parser.polarity_invert = current_settings.polarity_invert;
+  uint32_t desync_before = adc_parser.desync_count;
+  uint32_t over_before = adc_parser.overrange_count;
+  uint32_t n = parseAdcFrame(&adc_parser, dma_buffer,
+                             bytes_read / SOC_ADC_DIGI_DATA_BYTES_PER_CONV, block);
+  adc_pair_desync_count += adc_parser.desync_count - desync_before;
+  uint32_t overrange = adc_parser.overrange_count - over_before;
+  adc_overrange_count += overrange;
+  
+#if ADC_OVERSAMPLE_SHIFT > 0
+  // Сырые пары на ADC_SAMPLE_RATE × R → CIC + FIR → ADC_SAMPLE_RATE (на месте)
+  if (adc_ratio_shift > 0) {
+#if ADC_ESTIMATOR_ENABLE
+    // Выброс — одна пара: здесь его видно, после CIC он размазан по сэмплам
+    runAdcHampel(&adc_raw_hampel, block, n);
+#endif
+    uint32_t td = esp_cpu_get_cycle_count();
+    n = decimateAdcBlock(&adc_decimator, block, n);
+    adc_decimator_cycles += esp_cpu_get_cycle_count() - td;
+    adc_decimator_frames++;
+  }
+#endif
+#if ADC_ESTIMATOR_ENABLE
+  // Оценка тока + отбраковка выбросов (на месте, на выходной частоте)
+  if (adc_estimator_pending) {
+    adc_estimator_pending = false;
+    setAdcEstimatorModel(&adc_estimator, pending_alpha, pending_beta,
+                         pending_floor, pending_max_run);
+  }
+  runAdcEstimator(&adc_estimator, block, n);
+#endif
+  if (n == 0) return;
+  
+  // Калибровка — один раз здесь: дальше все читатели работают в целых мкА
+  static int16_t block_uA[ADC_FRAME_SIZE / 2 + 1];  // n ≤ размера block при любом R
+  for (uint32_t i = 0; i < n; i++) {
+    block_uA[i] = adcSignedToMicroamps(block[i]);
+  }
+  
+  uint32_t w = adc_write_index;
+  if (adc_uA_rebuild_pending) {
+    adc_uA_rebuild_pending = false;
+    rebuildMicroampRing(w);
+  }
+  
+  // Скользящие окна — до записи в кольцо (выпадающие сэмплы читаются оттуда)
+  updateADCWindowStats(block, block_uA, n, adc_ring_buffer, adc_uA_ring_buffer, w);
+  updateADCEnvelope(block_uA, n, w);
+  updateADCCrossings(block_uA, n, adc_sample_seq);
+  
+  // Форма и амплитуда постоянны: STABLE на полной амплитуде (не sham/паузы/рампы)
+  bool stable = (current_state == STATE_STABLE && dynamic_dac_gain >= 1.0f);
+  // Перекос знака — по сырым парам того же блока (разрыв вне STABLE)
+  if (stable) {
+    scanAdcSignSkewFrame(&adc_skew, dma_buffer, bytes_read / SOC_ADC_DIGI_DATA_BYTES_PER_CONV);
+  } else {
+    resetAdcSignSkewStream(&adc_skew);
+  }
+  if (adc_skew.count > 0 || adc_skew.rejected > 0) {
+    portENTER_CRITICAL(&skew_mux);
+    skew_sum_q8 += adc_skew.sum_q8;
+    skew_sum_sq_q16 += adc_skew.sum_sq_q16;
+    skew_edges += adc_skew.count;
+    skew_rejected += adc_skew.rejected;
+    portEXIT_CRITICAL(&skew_mux);
+    adc_skew.sum_q8 = 0;
+    adc_skew.sum_sq_q16 = 0;
+    adc_skew.count = 0;
+    adc_skew.rejected = 0;
+  }
+  updateADCLoopAverage(block_uA, n, adc_sample_seq, stable);
+  updateADCSpectrumCapture(block_uA, n, adc_sample_seq, stable);
+  updateADCLockIn(block_uA, n, adc_sample_seq);
+  updateADCContact(block_uA, n, adc_sample_seq, stable, overrange,
+                   bytes_read / SOC_ADC_DIGI_DATA_BYTES_PER_CONV / 2);
+  
+  // Кольца: до конца буфера и (если нужно) с начала
+  uint32_t first = ADC_RING_SIZE - w;
+  if (first > n) first = n;
+  memcpy(&adc_ring_buffer[w], block, first * sizeof(int16_t));
+  memcpy(&adc_uA_ring_buffer[w], block_uA, first * sizeof(int16_t));
+  if (n > first) {
+    memcpy(adc_ring_buffer, block + first, (n - first) * sizeof(int16_t));
+    memcpy(adc_uA_ring_buffer, block_uA + first, (n - first) * sizeof(int16_t));
+  }
+  __sync_synchronize();  // Данные в кольце — до публикации индекса
+  adc_write_index = (w + n) & (ADC_RING_SIZE - 1);
+  adc_sample_seq += n;
+  
+  // Дозиметрия: один вызов на DMA блок (только во время сеанса)
+  // Time-in-spec — только на полной амплитуде (не sham/паузы/частичные hold протокола)
+  if (current_state != STATE_IDLE) {
+    int32_t block_sum_uA = 0;
+    int32_t block_sum_abs_uA = 0;
+    uint64_t block_sum_sq_uA2 = 0;
+    for (uint32_t i = 0; i < n; i++) {
+      int32_t uA = block_uA[i];
+      block_sum_uA += uA;
+      block_sum_abs_uA += (uA < 0) ? -uA : uA;
+      block_sum_sq_uA2 += (uint32_t)(uA * uA);
     }
-    dest[collected++] = sample;
+    accumulateSessionDosimetry(block_sum_uA, block_sum_abs_uA, block_sum_sq_uA2,
+                               n, stable);
+    updateADCHistory(block_uA, n);
   }
   
-  return collected;
+  adc_ingest_cycles += esp_cpu_get_cycle_count() - t0;
+  adc_ingest_samples += n;
 }
 
-// Callback вызывается когда DMA буфер заполнен (опционально)
+// Фреймов DMA с последнего пробуждения ingest (только ISR)
+static uint32_t adc_dma_frames_since_wake = 0;
+
+// Callback вызывается из ISR, когда DMA заполнил фрейм (0.5 мс пар)
+// Защита — по каждому фрейму; ingest будим раз на блок, разбор идёт вне ISR
 static bool IRAM_ATTR adc_dma_conv_done_callback(
     adc_continuous_handle_t handle,
     const adc_continuous_evt_data_t *edata,
     void *user_data) {
-  // DMA заполнил буфер - можем обработать
-  // Но мы будем читать данные в loop() через adc_continuous_read()
-  return false;  // false = не нужно yield из ISR
+  BaseType_t woken = pdFALSE;
+  // Аварийная защита — по каждой паре фрейма, до ingest
+  if (adc_trip_pending) {
+    adc_trip_pending = false;
+    configureAdcTripDetector(&adc_trip, pending_trip_code, trip_confirm_pairs,
+                             pending_dc_code, trip_dc_window_pairs);
+  }
+  if (scanAdcTripFrame(&adc_trip, edata->conv_frame_buffer,
+                       edata->size / SOC_ADC_DIGI_DATA_BYTES_PER_CONV)) {
+    adc_trip_isr_us = esp_timer_get_time();
+    if (adc_trip_task != NULL) {
+      vTaskNotifyGiveFromISR(adc_trip_task, &woken);
+    }
+  }
+  if (++adc_dma_frames_since_wake >= ADC_DMA_FRAMES_PER_BLOCK && adc_ingest_task != NULL) {
+    adc_dma_frames_since_wake = 0;
+    vTaskNotifyGiveFromISR(adc_ingest_task, &woken);
+  }
+  return woken == pdTRUE;  // true = переключиться на ingest (или задачу аварии) сразу после ISR
 }
 
-// Инициализация ADC в continuous mode (DMA!)
-void initADC() {
-  resetADCRingBufferInternal();
-  
-  // Включаем внутренний pull-down на входе magnitude
-  // Это притягивает вход к GND при разрыве цепи (вместо болтанки)
-  // ~45кОм внутренний резистор — должен помочь от наводок
-  // gpio_set_pull_mode((gpio_num_t)ADC_MOD_PIN, GPIO_PULLDOWN_ONLY);
-  
-  // Конфигурация continuous mode
+// Задача аварии: самый высокий приоритет среди наших, не ждёт ни ingest, ни loop()
+static void adcTripTask(void* arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    muteDACOutput();
+    adc_trip_mute_us = esp_timer_get_time();
+  }
+}
+
+// Пул драйвера переполнен — ingest не успел, фрейм потерян
+static bool IRAM_ATTR adc_pool_ovf_callback(
+    adc_continuous_handle_t handle,
+    const adc_continuous_evt_data_t *edata,
+    void *user_data) {
+  adc_pool_overflow_count++;
+  return false;
+}
+
+// Драйвер continuous mode под передискретизацию 2^shift: блок ingest всегда
+// ADC_SAMPLES_PER_FRAME выходных сэмплов (32 мс), фрейм DMA — его 1/64 (0.5 мс)
+// при любой R — реакция защиты та же
+static void startADCDriver(uint8_t shift) {
+  uint32_t block_conv = (uint32_t)ADC_SAMPLES_PER_FRAME * 2 << shift;
   adc_continuous_handle_cfg_t adc_config = {
-    .max_store_buf_size = ADC_FRAME_SIZE * ADC_DMA_BUF_COUNT * SOC_ADC_DIGI_DATA_BYTES_PER_CONV,
-    .conv_frame_size = ADC_FRAME_SIZE * SOC_ADC_DIGI_DATA_BYTES_PER_CONV,
+    .max_store_buf_size = block_conv * ADC_DMA_BUF_COUNT * SOC_ADC_DIGI_DATA_BYTES_PER_CONV,
+    .conv_frame_size = block_conv / ADC_DMA_FRAMES_PER_BLOCK * SOC_ADC_DIGI_DATA_BYTES_PER_CONV,
   };
+  adc_block_bytes = block_conv * SOC_ADC_DIGI_DATA_BYTES_PER_CONV;
+  adc_dma_frames_since_wake = 0;
   
   ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_config, &adc_handle));
   
@@ -133,112 +349,223 @@ void initADC() {
   adc_continuous_config_t dig_cfg = {
     .pattern_num = 2,  // 2 канала!
     .adc_pattern = adc_pattern,
-    .sample_freq_hz = ADC_SAMPLE_RATE * 2,  // ×2 потому что 2 канала
+    .sample_freq_hz = (uint32_t)ADC_SAMPLE_RATE * 2 << shift,  // ×2 потому что 2 канала
     .conv_mode = ADC_CONV_SINGLE_UNIT_1,
     .format = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
   };
   
   ESP_ERROR_CHECK(adc_continuous_config(adc_handle, &dig_cfg));
   
-  // Регистрируем callback (опционально)
+  // Callback: готовый фрейм → будим ingest; переполнение пула → счётчик
   adc_continuous_evt_cbs_t cbs = {
     .on_conv_done = adc_dma_conv_done_callback,
+    .on_pool_ovf = adc_pool_ovf_callback,
   };
   ESP_ERROR_CHECK(adc_continuous_register_event_callbacks(adc_handle, &cbs, NULL));
   
   // Запускаем continuous mode!
   ESP_ERROR_CHECK(adc_continuous_start(adc_handle));
+}
 
+static void stopADCDriver() {
+  if (adc_handle == NULL) return;
+  adc_continuous_stop(adc_handle);
+  adc_continuous_deinit(adc_handle);
+  adc_handle = NULL;
 }
 
-// Чтение данных из ADC DMA и добавление в кольцевой буфер
-void readADCFromDMA() {
-  uint8_t dma_buffer[ADC_FRAME_SIZE * SOC_ADC_DIGI_DATA_BYTES_PER_CONV];
-  uint32_t bytes_read = 0;
-  uint32_t now_ms = millis();
-  
-  if (adc_capture_pending && now_ms >= adc_capture_resume_ms) {
-    adc_capture_pending = false;
-    adc_capture_enabled = true;
-  }
-  
-  // Читаем из DMA (неблокирующе с timeout)
-  esp_err_t ret = adc_continuous_read(adc_handle, dma_buffer, sizeof(dma_buffer), 
-                                       &bytes_read, ADC_READ_TIMEOUT_MS);
-  
-  if (ret == ESP_OK && bytes_read > 0 && adc_capture_enabled) {
-    // Парсим данные из DMA буфера
-    // DMA возвращает данные чередуя каналы: sign, mag, sign, mag, ...
-    uint32_t samples_read = bytes_read / SOC_ADC_DIGI_DATA_BYTES_PER_CONV;
+static void clearSignSkewTotals() {
+  portENTER_CRITICAL(&skew_mux);
+  skew_sum_q8 = 0;
+  skew_sum_sq_q16 = 0;
+  skew_edges = 0;
+  skew_rejected = 0;
+  portEXIT_CRITICAL(&skew_mux);
+}
+
+// Окна детектора перекоса в парах — под частоту пар; накопленное при прежней R сброшено
+static void configureSignSkew(uint8_t shift) {
+  uint32_t pair_rate = (uint32_t)ADC_SAMPLE_RATE << shift;
+  initAdcSignSkew(&adc_skew, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD,
+                  ADC_SKEW_LEVEL_CODE,
+                  (uint16_t)((uint64_t)ADC_SKEW_MAX_DIP_US * pair_rate / 1000000),
+                  (uint16_t)((uint64_t)ADC_SKEW_WINDOW_US * pair_rate / 1000000));
+  clearSignSkewTotals();
+}
+
+// Смена профиля (в ingest): драйвер заново, фильтры и окна защиты — под новую R
+// Кольцо не трогаем: его сбрасывает scheduleADCCaptureStart при старте DAC
+static void applyADCRateProfile(uint8_t profile) {
+  stopADCDriver();
+  if (profile == ADC_RATE_IDLE) return;  // adc_ratio_shift — как было (для отчёта сеанса)
+  
+  uint8_t shift = (profile == ADC_RATE_FULL) ? ADC_OVERSAMPLE_SHIFT : 0;
+  adc_ratio_shift = shift;
+#if ADC_OVERSAMPLE_SHIFT > 0
+  if (shift > 0) initAdcDecimator(&adc_decimator, shift);
+#endif
+  resetAdcHampel(&adc_raw_hampel);
+  // Без дециматора и оценщика — окно [1,1,1]/3 в парсере
+  adc_parser.bypass_filter = (shift > 0) || ADC_ESTIMATOR_ENABLE;
+  resetAdcPairParser(&adc_parser);
+  
+  uint32_t down = ADC_OVERSAMPLE_SHIFT - shift;
+  trip_confirm_pairs = ADC_TRIP_CONFIRM_PAIRS >> down;
+  if (trip_confirm_pairs < 1) trip_confirm_pairs = 1;
+  trip_dc_window_pairs = ADC_TRIP_DC_WINDOW_PAIRS >> down;
+  adc_trip_pending = true;  // ISR перечитает окна с текущими порогами
+  configureSignSkew(shift);
+  
+  startADCDriver(shift);
+}
+
+// Задача ingest: просыпается по уведомлению (раз на блок) и выбирает ВСЕ готовые
+// данные без ожидания (timeout 0), собирая их в блоки ровно по adc_block_bytes.
+// loop() никогда не блокируется на ADC.
+static void adcIngestTask(void* arg) {
+  static uint8_t dma_buffer[ADC_FRAME_SIZE * SOC_ADC_DIGI_DATA_BYTES_PER_CONV];
+  uint32_t assembled = 0;  // Байт недособранного блока
+  for (;;) {
+    // Таймаут — страховка на случай потерянного уведомления
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ADC_INGEST_IDLE_TIMEOUT_MS));
     
-    uint16_t sign_value = 0;
-    uint16_t mag_value = 0;
-    bool has_sign = false;
-    bool has_mag = false;
+    if (adc_rate_pending) {
+      adc_rate_pending = false;
+      applyADCRateProfile(pending_rate_profile);
+      assembled = 0;  // Хвост прежней R — в новый блок не годится
+    }
+    if (adc_capture_pending && (int32_t)(millis() - adc_capture_resume_ms) >= 0) {
+      adc_capture_pending = false;
+      adc_capture_enabled = true;
+    }
+    if (adc_handle == NULL) continue;  // АЦП остановлен (вне сеанса)
     
-    for (uint32_t i = 0; i < samples_read; i++) {
-      adc_digi_output_data_t *p = (adc_digi_output_data_t*)&dma_buffer[i * SOC_ADC_DIGI_DATA_BYTES_PER_CONV];
-      
-      uint32_t chan_num = p->type1.channel;
-      uint32_t data = p->type1.data;
-      
-      // Собираем пару (sign, magnitude)
-      if (chan_num == ADC_SIGN_CHANNEL) {
-        sign_value = data;
-        has_sign = true;
-      } else if (chan_num == ADC_MOD_CHANNEL) {
-        mag_value = data;
-        has_mag = true;
-      }
-      
-      // Когда собрали пару - реконструируем знаковый сигнал
-      if (has_sign && has_mag) {
-        // Определяем знак: если sign > порога, то положительный
-        bool is_positive = (sign_value > ADC_SIGN_THRESHOLD);
-        // Отсекаем аномалии: > 2700 кодов = шум/разрыв цепи (вне калибровки)
-        if (mag_value > 2700) {
-          mag_value = 0;  // Пропускаем мусор, тока нет
-        }
-
-        // Применяем инверсию полярности (если электроды перепутаны)
-        if (current_settings.polarity_invert) {
-          is_positive = !is_positive;
-        }
-        
-        // Реконструируем знаковый сигнал
-        int16_t signed_value = is_positive ? (int16_t)mag_value : -(int16_t)mag_value;
-        
-        // Применяем скользящее среднее (фильтр [1/3, 1/3, 1/3])
-        int16_t filtered = applyMovingAverage(signed_value);
-        
-        // Записываем в кольцевой буфер
-        adc_ring_buffer[adc_write_index] = filtered;
-        adc_write_index = (adc_write_index + 1) % ADC_RING_SIZE;
-        
-        // Сбрасываем флаги для следующей пары
-        has_sign = false;
-        has_mag = false;
+    uint32_t bytes_read = 0;
+    while (adc_continuous_read(adc_handle, dma_buffer + assembled, adc_block_bytes - assembled,
+                               &bytes_read, 0) == ESP_OK) {
+      assembled += bytes_read;
+      if (assembled < adc_block_bytes) continue;
+      assembled = 0;
+      if (!adc_capture_enabled) continue;
+      uint8_t cap = frame_cap_count;
+      if (cap < frame_cap_wanted) {
+        memcpy(frame_cap_buf + (uint32_t)cap * ADC_FRAME_CAPTURE_BYTES, dma_buffer, adc_block_bytes);
+        frame_cap_len[cap] = (uint16_t)adc_block_bytes;
+        frame_cap_shift[cap] = adc_ratio_shift;
+        frame_cap_count = cap + 1;
       }
+      processADCFrame(dma_buffer, adc_block_bytes);
     }
-  } else if (ret == ESP_ERR_TIMEOUT) {
-    // Timeout - нормально, данных просто нет пока
+  }
+}
+
+// Инициализация ADC в continuous mode (DMA!)
+void initADC() {
+  initAdcPairParser(&adc_parser, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL,
+                    ADC_SIGN_THRESHOLD, ADC_MAG_OVERRANGE_CODE);
+#if ADC_OVERSAMPLE_SHIFT > 0
+  adc_parser.bypass_filter = true;  // Антиалиасинг и сглаживание — в дециматоре
+  initAdcDecimator(&adc_decimator, ADC_OVERSAMPLE_SHIFT);
+#endif
+#if ADC_ESTIMATOR_ENABLE
+  adc_parser.bypass_filter = true;  // Сглаживание — в оценщике
+#endif
+  initAdcEstimator(&adc_estimator);
+  initAdcHampel(&adc_raw_hampel, ADC_EST_RAW_FLOOR_CODES);
+  initAdcTripDetector(&adc_trip, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD);
+  configureSignSkew(adc_ratio_shift);
+  initADCWindowStats();
+  initADCEnvelope();
+  initADCLoopAverage();
+  initADCSpectrum();
+  initADCLockIn();
+  initADCTransfer();
+  initADCHistory();
+  resetADCRingBufferInternal();
+  
+  // Включаем внутренний pull-down на входе magnitude
+  // Это притягивает вход к GND при разрыве цепи (вместо болтанки)
+  // ~45кОм внутренний резистор — должен помочь от наводок
+  // gpio_set_pull_mode((gpio_num_t)ADC_MOD_PIN, GPIO_PULLDOWN_ONLY);
+  
+  // Задачи ingest и аварии — до старта драйвера (ISR сразу будит их)
+  xTaskCreate(adcIngestTask, "adc_ingest", 4096, NULL, ADC_INGEST_TASK_PRIORITY, &adc_ingest_task);
+  xTaskCreate(adcTripTask, "adc_trip", 2048, NULL, ADC_TRIP_TASK_PRIORITY, &adc_trip_task);
+  
+#if !ADC_RATE_SCHEDULING
+  // Без расписания — всегда × ADC_OVERSAMPLE, как раньше
+  pending_rate_profile = ADC_RATE_FULL;
+  adc_rate_pending = true;
+#endif
+}
+
+// Окно по одному из колец (индексы у колец общие)
+// end_seq_abs = true: end_offset — абсолютный adc_sample_seq конца окна
+static bool fillRingView(const int16_t* ring, uint32_t samples, uint32_t end_offset,
+                         bool end_seq_abs, AdcRingView* view) {
+  if (view == NULL || ring == NULL) return false;
+  
+  // Согласованная пара (seq, index): ingest выше приоритетом и обновляет обе
+  uint32_t seq, w;
+  do {
+    seq = adc_sample_seq;
+    w = adc_write_index;
+  } while (seq != adc_sample_seq);
+  if (end_seq_abs) end_offset = seq - end_offset;
+  
+  uint32_t filled = seq - adc_ring_reset_seq;
+  if (filled > ADC_RING_SIZE) filled = ADC_RING_SIZE;
+  if (end_offset >= filled) {
+    view->span[0] = view->span[1] = ring;
+    view->len[0] = view->len[1] = view->total = 0;
+    view->seq_start = seq;
+    return false;
+  }
+  uint32_t avail = filled - end_offset;
+  if (samples == 0 || samples > avail) samples = avail;
+  
+  uint32_t end = (w - end_offset) & (ADC_RING_SIZE - 1);
+  uint32_t start = (end - samples) & (ADC_RING_SIZE - 1);
+  view->span[0] = &ring[start];
+  if (start + samples <= ADC_RING_SIZE) {
+    view->len[0] = samples;
+    view->span[1] = ring;
+    view->len[1] = 0;
   } else {
-    // ADC read error
+    view->len[0] = ADC_RING_SIZE - start;
+    view->span[1] = ring;
+    view->len[1] = samples - view->len[0];
   }
+  view->total = samples;
+  view->seq_start = seq - end_offset - samples;
+  return true;
 }
 
-// Получить копию текущего состояния кольцевого буфера
+bool getADCRingView(uint32_t samples, uint32_t end_offset, AdcRingView* view) {
+  return fillRingView(adc_ring_buffer, samples, end_offset, false, view);
+}
+
+bool getADCMicroampView(uint32_t samples, uint32_t end_offset, AdcRingView* view) {
+  return fillRingView(adc_uA_ring_buffer, samples, end_offset, false, view);
+}
+
+bool getADCMicroampViewEndingAt(uint32_t samples, uint32_t end_seq, AdcRingView* view) {
+  return fillRingView(adc_uA_ring_buffer, samples, end_seq, true, view);
+}
+
+bool isADCRingViewIntact(const AdcRingView* view) {
+  // Сэмпл seq перезаписывается, когда ingest доходит до seq + ADC_RING_SIZE
+  return (adc_sample_seq - view->seq_start) + ADC_RING_WRITE_SLACK <= ADC_RING_SIZE;
+}
+
+// Всё кольцо как окно (без копирования 32 КБ)
 // Вызывается по запросу от Android через USB OTG
-void getADCRingBuffer(int16_t* output_buffer, uint32_t* current_write_pos) {
-  // Сохраняем текущую позицию записи (для синхронизации)
-  *current_write_pos = adc_write_index;
-  
-  // Копируем весь буфер (быстро, 80 KB)
-  memcpy(output_buffer, adc_ring_buffer, ADC_RING_SIZE * sizeof(int16_t));
+bool getADCRingBuffer(AdcRingView* view) {
+  return getADCRingView(0, 0, view);
   
   // Android может:
-  // 1. Проверить запрещенные значения (ADC_INVALID_VALUE) - если есть, буфер не полностью заполнен
-  // 2. Использовать current_write_pos чтобы понять, откуда начинаются самые старые данные
+  // 1. Передать span[0], затем span[1] — это уже порядок по времени (старые → новые)
+  // 2. Проверить isADCRingViewIntact() после передачи — иначе повторить запрос
   // 3. Буфер = 1× DAC луп (2 сек) → квадратное окно без растекания спектра!
   // 4. Сделать FFT (любой размер, не обязательно степень 2), FIR фильтрацию, decimation и т.д.
 }
@@ -273,151 +600,44 @@ void printADCStats() {
 }
 
 // Получить минимальное и максимальное напряжение с ADC (в вольтах)
+// O(1): min/max окна статистики поддерживаются в ingest
 bool getADCMinMaxVoltage(float* min_voltage, float* max_voltage) {
   if (min_voltage == NULL || max_voltage == NULL) {
     return false;
   }
   
-  uint32_t window = getStatsWindowSize();
-  int16_t* temp_buffer = (int16_t*)malloc(window * sizeof(int16_t));
-  if (temp_buffer == NULL) {
-    return false;
-  }
-  
-  uint32_t valid_count = collectRecentSamples(temp_buffer, window);
-  if (valid_count == 0) {
-    free(temp_buffer);
+  AdcWindowStats stats;
+  if (!adc_capture_enabled || !getADCWindowStats(ADC_WINDOW_STATS, &stats)) {
     *min_voltage = 0.0f;
     *max_voltage = 0.0f;
     return false;
   }
   
-  int16_t min_val = temp_buffer[0];
-  int16_t max_val = temp_buffer[0];
-  for (uint32_t i = 1; i < valid_count; i++) {
-    if (temp_buffer[i] < min_val) min_val = temp_buffer[i];
-    if (temp_buffer[i] > max_val) max_val = temp_buffer[i];
-  }
-  
-  free(temp_buffer);
-  
   // Конвертация знакового ADC в напряжение
-  *min_voltage = (min_val / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
-  *max_voltage = (max_val / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
+  *min_voltage = (stats.min_code / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
+  *max_voltage = (stats.max_code / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
   return true;
 }
 
-// Вспомогательная функция для quickselect - разделение массива
-static uint32_t partition(int16_t* arr, uint32_t left, uint32_t right, uint32_t pivot_index) {
-  int16_t pivot_value = arr[pivot_index];
-  // Перемещаем pivot в конец
-  int16_t temp = arr[pivot_index];
-  arr[pivot_index] = arr[right];
-  arr[right] = temp;
-  
-  uint32_t store_index = left;
-  for (uint32_t i = left; i < right; i++) {
-    if (arr[i] < pivot_value) {
-      temp = arr[store_index];
-      arr[store_index] = arr[i];
-      arr[i] = temp;
-      store_index++;
-    }
-  }
-  
-  // Перемещаем pivot на правильную позицию
-  temp = arr[right];
-  arr[right] = arr[store_index];
-  arr[store_index] = temp;
-  
-  return store_index;
-}
-
-// Quickselect - находит k-й наименьший элемент за O(n) в среднем
-static int16_t quickselect(int16_t* arr, uint32_t left, uint32_t right, uint32_t k) {
-  if (left == right) {
-    return arr[left];
-  }
-  
-  // Выбираем случайный pivot (для простоты используем средний)
-  uint32_t pivot_index = left + (right - left) / 2;
-  
-  pivot_index = partition(arr, left, right, pivot_index);
-  
-  if (k == pivot_index) {
-    return arr[k];
-  } else if (k < pivot_index) {
-    return quickselect(arr, left, pivot_index - 1, k);
-  } else {
-    return quickselect(arr, pivot_index + 1, right, k);
-  }
-}
-
 // Получить перцентили (1%, 99%) и среднее напряжение с ADC (в вольтах)
+// Из гистограммы кодов окна статистики: без malloc, фиксированная стоимость
 bool getADCPercentiles(float* p1_voltage, float* p99_voltage, float* mean_voltage) {
   if (p1_voltage == NULL || p99_voltage == NULL || mean_voltage == NULL) {
     return false;
   }
   
-  uint32_t window = getStatsWindowSize();
-  int16_t* temp_buffer = (int16_t*)malloc(window * sizeof(int16_t));
-  if (temp_buffer == NULL) {
-    return false;
-  }
-  
-  uint32_t valid_count = collectRecentSamples(temp_buffer, window);
-  if (valid_count == 0) {
-    free(temp_buffer);
+  int16_t p1_raw, p99_raw, mean_raw;
+  if (!getADCPercentilesRaw(&p1_raw, &p99_raw, &mean_raw)) {
     *p1_voltage = 0.0f;
     *p99_voltage = 0.0f;
     *mean_voltage = 0.0f;
     return false;
   }
   
-  double sum = 0.0;
-  for (uint32_t i = 0; i < valid_count; i++) {
-    sum += temp_buffer[i];
-  }
   // Конвертация знакового ADC в напряжение
-  *mean_voltage = (float)((sum / valid_count / (double)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE);
-  
-  uint32_t p1_index = valid_count / 100;
-  uint32_t p99_index = (valid_count * 99) / 100;
-  if (p1_index >= valid_count) p1_index = 0;
-  if (p99_index >= valid_count) p99_index = valid_count - 1;
-  
-  int16_t* temp_p1 = (int16_t*)malloc(valid_count * sizeof(int16_t));
-  int16_t* temp_p99 = (int16_t*)malloc(valid_count * sizeof(int16_t));
-  if (temp_p1 != NULL && temp_p99 != NULL) {
-    memcpy(temp_p1, temp_buffer, valid_count * sizeof(int16_t));
-    memcpy(temp_p99, temp_buffer, valid_count * sizeof(int16_t));
-    
-    int16_t p1_val = quickselect(temp_p1, 0, valid_count - 1, p1_index);
-    int16_t p99_val = quickselect(temp_p99, 0, valid_count - 1, p99_index);
-    
-    // Конвертация знакового ADC в напряжение
-    *p1_voltage = (p1_val / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
-    *p99_voltage = (p99_val / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
-    
-    free(temp_p1);
-    free(temp_p99);
-  } else {
-    // Недостаточно памяти: fallback на min/max
-    int16_t min_val = temp_buffer[0];
-    int16_t max_val = temp_buffer[0];
-    for (uint32_t i = 1; i < valid_count; i++) {
-      if (temp_buffer[i] < min_val) min_val = temp_buffer[i];
-      if (temp_buffer[i] > max_val) max_val = temp_buffer[i];
-    }
-    // Конвертация знакового ADC в напряжение
-    *p1_voltage = (min_val / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
-    *p99_voltage = (max_val / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
-    
-    if (temp_p1 != NULL) free(temp_p1);
-    if (temp_p99 != NULL) free(temp_p99);
-  }
-  
-  free(temp_buffer);
+  *p1_voltage = (p1_raw / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
+  *p99_voltage = (p99_raw / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
+  *mean_voltage = (mean_raw / (float)ADC_MAX_VALUE) * ADC_MAX_VOLTAGE;
   return true;
 }
 
@@ -427,61 +647,15 @@ bool getADCPercentilesRaw(int16_t* p1_raw, int16_t* p99_raw, int16_t* mean_raw)
     return false;
   }
   
-  uint32_t window = getStatsWindowSize();
-  int16_t* temp_buffer = (int16_t*)malloc(window * sizeof(int16_t));
-  if (temp_buffer == NULL) {
-    return false;
-  }
-  
-  uint32_t valid_count = collectRecentSamples(temp_buffer, window);
-  if (valid_count == 0) {
-    free(temp_buffer);
+  AdcWindowStats stats;
+  if (!adc_capture_enabled || !getADCWindowStats(ADC_WINDOW_STATS, &stats) ||
+      !getADCWindowCodePercentiles(ADC_WINDOW_STATS, 10, 990, p1_raw, p99_raw)) {
     *p1_raw = 0;
     *p99_raw = 0;
     *mean_raw = 0;
     return false;
   }
-  
-  // Среднее
-  int32_t sum = 0;
-  for (uint32_t i = 0; i < valid_count; i++) {
-    sum += temp_buffer[i];
-  }
-  *mean_raw = (int16_t)(sum / (int32_t)valid_count);
-  
-  // Перцентили
-  uint32_t p1_index = valid_count / 100;
-  uint32_t p99_index = (valid_count * 99) / 100;
-  if (p1_index >= valid_count) p1_index = 0;
-  if (p99_index >= valid_count) p99_index = valid_count - 1;
-  
-  int16_t* temp_p1 = (int16_t*)malloc(valid_count * sizeof(int16_t));
-  int16_t* temp_p99 = (int16_t*)malloc(valid_count * sizeof(int16_t));
-  if (temp_p1 != NULL && temp_p99 != NULL) {
-    memcpy(temp_p1, temp_buffer, valid_count * sizeof(int16_t));
-    memcpy(temp_p99, temp_buffer, valid_count * sizeof(int16_t));
-    
-    *p1_raw = quickselect(temp_p1, 0, valid_count - 1, p1_index);
-    *p99_raw = quickselect(temp_p99, 0, valid_count - 1, p99_index);
-    
-    free(temp_p1);
-    free(temp_p99);
-  } else {
-    // Fallback на min/max
-    int16_t min_val = temp_buffer[0];
-    int16_t max_val = temp_buffer[0];
-    for (uint32_t i = 1; i < valid_count; i++) {
-      if (temp_buffer[i] < min_val) min_val = temp_buffer[i];
-      if (temp_buffer[i] > max_val) max_val = temp_buffer[i];
-    }
-    *p1_raw = min_val;
-    *p99_raw = max_val;
-    
-    if (temp_p1 != NULL) free(temp_p1);
-    if (temp_p99 != NULL) free(temp_p99);
-  }
-  
-  free(temp_buffer);
+  *mean_raw = stats.mean_code;
   return true;
 }
 
@@ -490,73 +664,217 @@ bool buildADCHistogram(uint16_t* bins, uint8_t num_bins) {
   if (bins == NULL || num_bins == 0) {
     return false;
   }
-  
-  // Инициализируем bins
-  for (uint8_t i = 0; i < num_bins; i++) {
-    bins[i] = 0;
-  }
-  
-  uint32_t window = getStatsWindowSize();
-  int16_t* temp_buffer = (int16_t*)malloc(window * sizeof(int16_t));
-  if (temp_buffer == NULL) {
+  if (!adc_capture_enabled) {
+    memset(bins, 0, num_bins * sizeof(uint16_t));
     return false;
   }
-  
-  uint32_t valid_count = collectRecentSamples(temp_buffer, window);
-  if (valid_count == 0) {
-    free(temp_buffer);
-    return false;
+  return buildADCWindowHistogram(bins, num_bins);
+}
+
+void scheduleADCCaptureStart(uint32_t delay_ms) {
+  // Сначала останавливаем запись (ingest проверяет флаг на каждом фрейме)
+  adc_capture_enabled = false;
+  adc_capture_pending = false;
+  resetADCRingBufferInternal();
+  adc_capture_resume_ms = millis() + delay_ms;
+  adc_capture_pending = true;
+}
+
+void setADCRateProfile(AdcRateProfile profile) {
+#if ADC_RATE_SCHEDULING
+  pending_rate_profile = profile;
+  __sync_synchronize();
+  adc_rate_pending = true;
+  if (adc_ingest_task != NULL) xTaskNotifyGive(adc_ingest_task);  // АЦП мог стоять — не ждать таймаута
+#endif
+}
+
+uint8_t getADCOversampleRatio() {
+  return 1u << adc_ratio_shift;
+}
+
+float getADCIngestCyclesPerSample() {
+  uint64_t samples = adc_ingest_samples;
+  return (samples > 0) ? (float)adc_ingest_cycles / (float)samples : 0.0f;
+}
+
+void configureADCEstimator(uint8_t mode, int32_t peak_uA) {
+  uint8_t floor_pct = ADC_EST_FLOOR_PCT;
+  if (mode == MODE_TDCS) {
+    pending_alpha = ADC_EST_TDCS_ALPHA;
+    pending_beta = ADC_EST_TDCS_BETA;
+  } else if (mode == MODE_TACS) {
+    pending_alpha = ADC_EST_TACS_ALPHA;
+    pending_beta = ADC_EST_TACS_BETA;
+  } else {
+    pending_alpha = ADC_EST_TRNS_ALPHA;
+    pending_beta = ADC_EST_TRNS_BETA;
+    floor_pct = ADC_EST_FLOOR_PCT_TRNS;
+  }
+  // Порог в кодах через LUT: калибровка нелинейна, доля считается в мкА
+  int32_t floor_codes = adcMicroampsToSigned(peak_uA * floor_pct / 100);
+  if (floor_codes < ADC_EST_MIN_FLOOR_CODES) floor_codes = ADC_EST_MIN_FLOOR_CODES;
+  pending_floor = (int16_t)floor_codes;
+  pending_max_run = ADC_EST_MAX_RUN;
+  adc_estimator_pending = true;
+}
+
+void configureADCTrip(uint8_t mode, int32_t peak_uA) {
+  int32_t trip_uA = peak_uA * ADC_TRIP_OVERCURRENT_PCT / 100;
+  if (trip_uA < ADC_TRIP_MIN_UA) trip_uA = ADC_TRIP_MIN_UA;
+  if (trip_uA > ADC_TRIP_MAX_UA) trip_uA = ADC_TRIP_MAX_UA;
+  // Пороги в сырых кодах модуля через LUT (калибровка нелинейна)
+  pending_trip_code = (uint16_t)adcMicroampsToSigned(trip_uA);
+  pending_dc_code = (mode == MODE_TDCS) ? 0 : (uint16_t)adcMicroampsToSigned(ADC_TRIP_DC_UA);
+  __sync_synchronize();
+  adc_trip_pending = true;
+}
+
+bool getADCTrip(AdcTripInfo* info) {
+  if (adc_trip.reason == ADC_TRIP_NONE || adc_trip_pending) return false;
+  if (info != NULL) {
+    info->reason = adc_trip.reason;
+    info->level_uA = adcSignedToMicroamps((int16_t)adc_trip.trip_code);
+    // От начала аварии до ISR: пары до конца фрейма по частоте пар АЦП
+    info->detect_us = (uint32_t)((uint64_t)adc_trip.onset_pairs * 1000000ULL /
+                                 ((uint32_t)ADC_SAMPLE_RATE << adc_ratio_shift));
+    int64_t mute_us = adc_trip_mute_us;
+    info->mute_us = (mute_us >= adc_trip_isr_us) ? (uint32_t)(mute_us - adc_trip_isr_us) : 0;
   }
-  
-  // Преобразуем в mA через калибровку и находим min/max
-  float min_mA = adcSignedToMilliamps(temp_buffer[0]);
-  float max_mA = min_mA;
-  for (uint32_t i = 1; i < valid_count; i++) {
-    float mA = adcSignedToMilliamps(temp_buffer[i]);
-    if (mA < min_mA) min_mA = mA;
-    if (mA > max_mA) max_mA = mA;
+  return true;
+}
+
+uint32_t getADCOutlierCount() {
+  return adc_estimator.outlier_count + adc_raw_hampel.outlier_count;
+}
+
+float getADCDecimatorCyclesPerFrame() {
+  uint32_t frames = adc_decimator_frames;
+  return (frames > 0) ? (float)adc_decimator_cycles / (float)frames : 0.0f;
+}
+
+// === ПЕРЕКОС ЗНАКА H-МОСТА ===
+void pollADCSignSkew() {
+  if ((int32_t)(millis() - skew_hold_until_ms) < 0) {
+    clearSignSkewTotals();  // Ещё играет очередь DAC с прежней задержкой знака
+    return;
   }
-  
-  // Все значения одинаковые (например, tDCS) - все в средний столбец
-  if (max_mA - min_mA < 0.001f) {
-    bins[num_bins / 2] = valid_count;
-    free(temp_buffer);
-    return true;
+  portENTER_CRITICAL(&skew_mux);
+  int64_t sum_q8 = skew_sum_q8;
+  uint64_t sum_sq_q16 = skew_sum_sq_q16;
+  uint32_t edges = skew_edges;
+  portEXIT_CRITICAL(&skew_mux);
+  if (edges < ADC_SKEW_MIN_EDGES) return;
+
+  float pair_us = 1000000.0f / (float)((uint32_t)ADC_SAMPLE_RATE << adc_ratio_shift);
+  float mean_q8 = (float)sum_q8 / edges;
+  float var_q16 = (float)sum_sq_q16 / edges - mean_q8 * mean_q8;
+  float se_us = sqrtf(var_q16 > 0.0f ? var_q16 / edges : 0.0f) * pair_us / 256.0f;
+  if (se_us > ADC_SKEW_MAX_SE_US) return;  // Медленная форма: копим дальше
+  clearSignSkewTotals();
+
+  float skew_us = mean_q8 * pair_us / 256.0f;
+  skew_report_valid = true;
+  skew_report_us = skew_us;
+  skew_report_se_us = se_us;
+  skew_report_res_us = pair_us;
+  skew_report_edges = edges;
+
+  // Знак меняется на сэмплах DAC, синхронных с парами АЦП: меньше пары (+3σ)
+  // замер не различает — такую задержку знака не трогаем
+  if (fabsf(skew_us) <= pair_us + 3.0f * se_us) return;
+  float current = getDACSignDelay();
+  float target = current - skew_us;  // Замер уже с текущей задержкой: перекос → 0
+  if (target > ADC_SKEW_MAX_DELAY_US) target = ADC_SKEW_MAX_DELAY_US;
+  if (target < -ADC_SKEW_MAX_DELAY_US) target = -ADC_SKEW_MAX_DELAY_US;
+  setDACSignDelay(target);
+  skew_hold_until_ms = millis() + ADC_SKEW_SETTLE_MS;
+  Serial.printf("[ADC] sign skew %+.1f us (se %.1f, %lu edges) -> sign delay %.1f -> %.1f us\n",
+                skew_us, se_us, (unsigned long)edges, current, target);
+}
+
+void printADCSignSkew() {
+  portENTER_CRITICAL(&skew_mux);
+  uint32_t edges = skew_edges;
+  uint32_t rejected = skew_rejected;
+  portEXIT_CRITICAL(&skew_mux);
+  if (!skew_report_valid) {
+    Serial.printf("[ADC] sign skew: not enough edges (%lu, %lu rejected), sign delay %.1f us\n",
+                  (unsigned long)edges, (unsigned long)rejected, getDACSignDelay());
+    return;
   }
-  
-  float range = max_mA - min_mA;
-  for (uint32_t i = 0; i < valid_count; i++) {
-    float mA = adcSignedToMilliamps(temp_buffer[i]);
-    float normalized = (mA - min_mA) / range;
-    uint8_t bin_index = (uint8_t)(normalized * num_bins);
-    if (bin_index >= num_bins) bin_index = num_bins - 1;
-    bins[bin_index]++;
+  Serial.printf("[ADC] sign skew: %+.1f us (se %.1f, resolution %.1f us, %lu edges), sign delay %.1f us\n",
+                skew_report_us, skew_report_se_us, skew_report_res_us,
+                (unsigned long)skew_report_edges, getDACSignDelay());
+}
+
+// === ЗАПИСЬ СЫРЫХ DMA ФРЕЙМОВ ===
+void handleADCFrameCommand(const char* args) {
+  char* end;
+  uint32_t n = strtoul(args, &end, 10);
+  if (end == args) {
+    Serial.printf("[FRAME] captured %u/%u, printed %u\n", (unsigned)frame_cap_count,
+                  (unsigned)frame_cap_wanted, (unsigned)frame_cap_printed);
+    return;
   }
-  
-  free(temp_buffer);
-  return true;
+  if (n == 0 || n > ADC_FRAME_CAPTURE_MAX) {
+    Serial.printf("[FRAME] usage: frames <1..%u>\n", (unsigned)ADC_FRAME_CAPTURE_MAX);
+    return;
+  }
+  if (frame_cap_buf == NULL) {
+    frame_cap_buf = (uint8_t*)malloc((size_t)ADC_FRAME_CAPTURE_MAX * ADC_FRAME_CAPTURE_BYTES);
+    if (frame_cap_buf == NULL) {
+      Serial.println("[FRAME] no memory");
+      return;
+    }
+  }
+  // Сначала закрыть запись, потом сбросить счётчики: ingest не пишет в середину
+  frame_cap_wanted = 0;
+  frame_cap_count = 0;
+  frame_cap_printed = 0;
+  frame_cap_wanted = (uint8_t)n;
+  Serial.printf("[FRAME] armed %lu\n", (unsigned long)n);
 }
 
-void scheduleADCCaptureStart(uint32_t delay_ms) {
-  resetADCRingBufferInternal();
-  adc_capture_enabled = false;
-  adc_capture_pending = true;
-  adc_capture_resume_ms = millis() + delay_ms;
+void pollADCFrameCapture() {
+  if (frame_cap_printed >= frame_cap_count) return;
+  uint8_t k = frame_cap_printed;
+  const uint8_t* frame = frame_cap_buf + (uint32_t)k * ADC_FRAME_CAPTURE_BYTES;
+  uint32_t len = frame_cap_len[k];
+  
+  // Hex кусками: без буфера на весь фрейм (8 КБ текста)
+  static const char hex[] = "0123456789abcdef";
+  char chunk[129];
+  Serial.printf("[FRAME] %u ", 1u << frame_cap_shift[k]);
+  for (uint32_t i = 0; i < len; ) {
+    uint32_t n = 0;
+    for (; n < sizeof(chunk) - 1 && i < len; i++) {
+      chunk[n++] = hex[frame[i] >> 4];
+      chunk[n++] = hex[frame[i] & 0x0F];
+    }
+    chunk[n] = '\0';
+    Serial.print(chunk);
+  }
+  Serial.println();
+  frame_cap_printed = k + 1;
 }
 
 // Вывод буфера в Serial для Arduino Plotter
 void dumpADCToSerial(uint16_t decimation) {
   if (decimation == 0) decimation = 1;
   
-  uint32_t write_idx = adc_write_index;  // Снимок текущей позиции
-  
-  // Выводим от старых к новым (по кругу от write_idx)
-  for (uint32_t i = 0; i < ADC_RING_SIZE; i += decimation) {
-    uint32_t idx = (write_idx + i) % ADC_RING_SIZE;
-    int16_t val = adc_ring_buffer[idx];
-    if (val != ADC_INVALID_VALUE) {
-      Serial.println(val);
+  // Выводим от старых к новым: два отрезка подряд, без деления по модулю
+  AdcRingView view;
+  if (!getADCMicroampView(0, 0, &view)) return;
+  for (uint8_t s = 0; s < 2; s++) {
+    const int16_t* span = view.span[s];
+    // Шаг децимации продолжается через границу отрезков
+    uint32_t first = (s == 0) ? 0 : (decimation - view.len[0] % decimation) % decimation;
+    for (uint32_t i = first; i < view.len[s]; i += decimation) {
+      int16_t val = span[i];
+      if (val != ADC_INVALID_VALUE) {
+        Serial.println(val);
+      }
     }
   }
 }
-
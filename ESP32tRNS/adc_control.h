@@ -12,17 +12,78 @@
 // Глобальные переменные
 extern adc_continuous_handle_t adc_handle;
 extern int16_t* adc_ring_buffer;
+// Параллельное кольцо: те же сэмплы в мкА со знаком (калибровка применена в ingest)
+// Индексы и adc_sample_seq общие с adc_ring_buffer
+extern int16_t* adc_uA_ring_buffer;
 extern volatile uint32_t adc_write_index;
+// Счётчики аномалий ingest-пути (накопительные, для журнала сеанса)
+extern volatile uint32_t adc_overrange_count;    // Модуль > ADC_MAG_OVERRANGE_CODE (разрыв/шум)
+extern volatile uint32_t adc_pair_desync_count;  // Пара sign/mag собрана с пропуском канала
+extern volatile uint32_t adc_pool_overflow_count; // Фреймов потеряно: ingest не успел забрать из пула
+
+// Монотонный счётчик сэмплов, записанных в кольцо (номер следующего сэмпла)
+// Всегда adc_sample_seq & (ADC_RING_SIZE - 1) == adc_write_index
+extern volatile uint32_t adc_sample_seq;
+
+// === ПРЕДСТАВЛЕНИЕ ОКНА КОЛЬЦА (без копирования) ===
+// Последние N сэмплов как не более двух непрерывных отрезков в порядке времени.
+// Читатель идёт по span[0], затем по span[1] — без % и memcpy; после чтения
+// isADCRingViewIntact() говорит, не перезаписал ли ingest начало окна.
+struct AdcRingView {
+  const int16_t* span[2];   // Отрезки: старые → новые
+  uint32_t len[2];          // Длины отрезков (len[1] = 0, если окно не переходит через край)
+  uint32_t total;           // len[0] + len[1]
+  uint32_t seq_start;       // adc_sample_seq первого сэмпла окна (& маска = индекс в кольце)
+};
+
+// Окно из samples сэмплов (0 = всё доступное), заканчивающееся за end_offset
+// сэмплов до самого свежего. Окно обрезается по заполненной части кольца.
+// Возвращает false, если данных нет
+bool getADCRingView(uint32_t samples, uint32_t end_offset, AdcRingView* view);
+
+// То же окно по кольцу мкА (adc_uA_ring_buffer): без LUT и float у читателя
+bool getADCMicroampView(uint32_t samples, uint32_t end_offset, AdcRingView* view);
+
+// Окно по кольцу мкА, заканчивающееся перед сэмплом end_seq (абсолютный
+// adc_sample_seq, например фронт из adc_crossing) — без дрожания между вызовами
+bool getADCMicroampViewEndingAt(uint32_t samples, uint32_t end_seq, AdcRingView* view);
+
+// Пересчитать кольцо мкА после смены калибровки (выполнит ingest перед следующим фреймом)
+void requestADCMicroampRebuild();
+
+// true — окно всё ещё не перезаписано (проверять ПОСЛЕ чтения)
+bool isADCRingViewIntact(const AdcRingView* view);
+
+// i-й сэмпл окна (0 = самый старый), без деления по модулю
+static inline int16_t adcRingViewAt(const AdcRingView* view, uint32_t i) {
+  return (i < view->len[0]) ? view->span[0][i] : view->span[1][i - view->len[0]];
+}
+
+// === ПРОФИЛЬ ЧАСТОТЫ АЦП (по режиму и состоянию сеанса) ===
+// Выход ingest всегда ADC_SAMPLE_RATE и ADC_SAMPLES_PER_FRAME сэмплов на блок;
+// меняется только передискретизация (частота конверсий и размер фреймов DMA)
+enum AdcRateProfile : uint8_t {
+  ADC_RATE_IDLE = 0,   // АЦП остановлен: DAC не играет, прерываний нет
+  ADC_RATE_DC = 1,     // ×1: 2 × ADC_SAMPLE_RATE конверсий/с, без CIC/FIR (tDCS)
+  ADC_RATE_FULL = 2    // × ADC_OVERSAMPLE + CIC/FIR (tRNS/tACS)
+};
+
+// Перезапуск драйвера под профиль выполнит ingest (~мс). Вызывать до
+// prefill DAC (scheduleADCCaptureStart): переходные фреймы не пишутся в кольцо
+void setADCRateProfile(AdcRateProfile profile);
+
+// Текущая передискретизация R (последний активный профиль)
+uint8_t getADCOversampleRatio();
 
 // Инициализация ADC в continuous mode (DMA!)
+// Запускает задачу ingest: conv_done ISR будит её, она разбирает все готовые
+// фреймы в кольцевой буфер — loop() ADC не опрашивает
+// Конверсии стартуют с первым setADCRateProfile (до сеанса АЦП стоит)
 void initADC();
 
-// Чтение данных из ADC DMA и добавление в кольцевой буфер
-void readADCFromDMA();
-
-// Получить копию текущего состояния кольцевого буфера
+// Всё кольцо как окно (без копирования 32 КБ)
 // Вызывается по запросу от Android через USB OTG
-void getADCRingBuffer(int16_t* output_buffer, uint32_t* current_write_pos);
+bool getADCRingBuffer(AdcRingView* view);
 
 // Печать статистики ADC буфера (для отладки)
 void printADCStats();
@@ -48,7 +109,51 @@ bool buildADCHistogram(uint16_t* bins, uint8_t num_bins);
 // Запланировать старт записи ADC после задержки (сбрасывает буфер)
 void scheduleADCCaptureStart(uint32_t delay_ms);
 
-// Вывод буфера в Serial для Arduino Plotter (с децимацией)
+// Средняя стоимость разбора DMA фрейма: циклы CPU на сэмпл (включая дозиметрию)
+float getADCIngestCyclesPerSample();
+
+// Модель оценщика тока под режим и амплитуду команды (пиковый ток, мкА)
+// Применяет ingest перед следующим фреймом
+void configureADCEstimator(uint8_t mode, int32_t peak_uA);
+
+// Пороги аварийной защиты под режим и амплитуду команды (пиковый ток, мкА)
+// Сбрасывает защёлку аварии; применяет conv_done ISR перед следующим фреймом
+void configureADCTrip(uint8_t mode, int32_t peak_uA);
+
+// Сработавшая авария (adc_trip): причина, уровень и измеренная задержка реакции
+struct AdcTripInfo {
+  uint8_t reason;      // AdcTripReason
+  int32_t level_uA;    // Модуль (перегрузка) или |среднее| (DC) по LUT
+  uint32_t detect_us;  // От начала аварии до срабатывания в ISR (по парам АЦП)
+  uint32_t mute_us;    // От ISR до обнуления очереди DAC (esp_timer)
+};
+bool getADCTrip(AdcTripInfo* info);
+
+// Заменённых как выбросы (накопительно): сэмплы оценщика + сырые пары Hampel при R > 1
+uint32_t getADCOutlierCount();
+
+// Стоимость прореживания CIC + FIR: циклы CPU на блок ingest (0 — без передискретизации)
+float getADCDecimatorCyclesPerFrame();
+
+// === ПЕРЕКОС ЗНАКА H-МОСТА (adc_sign_skew) ===
+// Из loop(): когда переходов через ноль набралось ADC_SKEW_MIN_EDGES и СКО среднего
+// не больше ADC_SKEW_MAX_SE_US — оценка перекоса; если он больше пары АЦП, задержка
+// знака DAC поправляется на него (setDACSignDelay), во всех режимах
+void pollADCSignSkew();
+
+// Сводка в Serial: последний замер перекоса и задержка знака DAC
+void printADCSignSkew();
+
+// === ЗАПИСЬ СЫРЫХ DMA ФРЕЙМОВ (вход стендов host/) ===
+// "frames <n>": ingest копирует n следующих блоков (32 мс фреймов DMA) как есть (до разбора),
+// "frames" — состояние записи
+void handleADCFrameCommand(const char* args);
+
+// Из loop(): печатает по одному записанному фрейму за проход строкой
+// "[FRAME] <R> <hex>" (R — передискретизация фрейма)
+void pollADCFrameCapture();
+
+// Вывод буфера в Serial для Arduino Plotter (с децимацией), в мкА
 // decimation = 1 — каждый сэмпл, 10 — каждый 10-й, и т.д.
 void dumpADCToSerial(uint16_t decimation = 40);
 
@@ -0,0 +1,99 @@
+#include "adc_crossing.h"
+#include <math.h>
+
+#define CROSS_MASK  (ADC_CROSSING_RING_SIZE - 1)
+static_assert((ADC_CROSSING_RING_SIZE & CROSS_MASK) == 0, "ADC_CROSSING_RING_SIZE must be a power of two");
+
+// Кольца переходов: отдельно вверх и вниз (пишет ingest, читает loop)
+static uint32_t rising_seq[ADC_CROSSING_RING_SIZE];
+static uint32_t falling_seq[ADC_CROSSING_RING_SIZE];
+static volatile uint32_t rising_count = 0;
+static volatile uint32_t falling_count = 0;
+
+// Состояние триггера Шмитта
+static int8_t cross_state = 0;       // +1 выше +H, −1 ниже −H, 0 — ещё не определено
+static uint32_t nonneg_start = 0;    // Первый сэмпл ≥ 0 после последнего отрицательного
+static uint32_t neg_start = 0;       // Первый сэмпл < 0 после последнего неотрицательного
+static bool prev_negative = false;
+
+void resetADCCrossings() {
+  rising_count = 0;
+  falling_count = 0;
+  cross_state = 0;
+  prev_negative = false;
+}
+
+void updateADCCrossings(const int16_t* block_uA, uint32_t n, uint32_t seq) {
+  int8_t state = cross_state;
+  bool was_negative = prev_negative;
+  
+  for (uint32_t i = 0; i < n; i++, seq++) {
+    int16_t uA = block_uA[i];
+    bool negative = (uA < 0);
+    if (negative != was_negative) {
+      if (negative) neg_start = seq;
+      else nonneg_start = seq;
+      was_negative = negative;
+    }
+    
+    if (state <= 0 && uA > ADC_CROSSING_HYST_UA) {
+      if (state < 0) {
+        rising_seq[rising_count & CROSS_MASK] = nonneg_start;
+        __sync_synchronize();
+        rising_count = rising_count + 1;
+      }
+      state = 1;
+    } else if (state >= 0 && uA < -ADC_CROSSING_HYST_UA) {
+      if (state > 0) {
+        falling_seq[falling_count & CROSS_MASK] = neg_start;
+        __sync_synchronize();
+        falling_count = falling_count + 1;
+      }
+      state = -1;
+    }
+  }
+  
+  cross_state = state;
+  prev_negative = was_negative;
+}
+
+bool getLastADCCrossing(bool rising, uint32_t* seq) {
+  const uint32_t* ring = rising ? rising_seq : falling_seq;
+  uint32_t count, value;
+  do {
+    count = rising ? rising_count : falling_count;
+    if (count == 0) return false;
+    value = ring[(count - 1) & CROSS_MASK];
+    __sync_synchronize();
+  } while (count != (rising ? rising_count : falling_count));
+  *seq = value;
+  return true;
+}
+
+bool getADCCycleStats(float* freq_hz, float* jitter_ms) {
+  uint32_t edges[ADC_CROSSING_STAT_CYCLES + 1];
+  uint32_t count, num;
+  do {
+    count = rising_count;
+    num = (count < ADC_CROSSING_STAT_CYCLES + 1) ? count : ADC_CROSSING_STAT_CYCLES + 1;
+    for (uint32_t i = 0; i < num; i++) {
+      edges[i] = rising_seq[(count - num + i) & CROSS_MASK];
+    }
+    __sync_synchronize();
+  } while (count != rising_count);
+  if (num < 2) return false;
+  
+  // Периоды в сэмплах: среднее и σ (целые суммы, float только в конце)
+  uint64_t sum = 0, sum_sq = 0;
+  for (uint32_t i = 1; i < num; i++) {
+    uint32_t period = edges[i] - edges[i - 1];
+    sum += period;
+    sum_sq += (uint64_t)period * period;
+  }
+  uint32_t cycles = num - 1;
+  float mean = (float)sum / cycles;
+  float var = (float)sum_sq / cycles - mean * mean;
+  if (freq_hz) *freq_hz = (mean > 0.0f) ? (float)ADC_SAMPLE_RATE / mean : 0.0f;
+  if (jitter_ms) *jitter_ms = (var > 0.0f) ? sqrtf(var) * 1000.0f / ADC_SAMPLE_RATE : 0.0f;
+  return true;
+}
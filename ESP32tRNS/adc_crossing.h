@@ -0,0 +1,30 @@
+#ifndef ADC_CROSSING_H
+#define ADC_CROSSING_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC ZERO CROSSINGS (индекс переходов через ноль) ===
+// ============================================================================
+// Задача ingest ловит переходы тока через ноль триггером Шмитта
+// (±ADC_CROSSING_HYST_UA) и пишет их номера сэмплов (adc_sample_seq) в
+// маленькое кольцо. Позиция перехода — первый сэмпл ≥ 0 (или < 0) после
+// последнего сэмпла другого знака, так что шум у нуля не сдвигает триггер.
+// Осциллограмма tACS берёт последний фронт за O(1), частота и джиттер
+// периода считаются по уже найденным фронтам.
+
+// Сбросить индекс (вместе со сбросом кольцевого буфера)
+void resetADCCrossings();
+
+// Добавить блок мкА; seq — adc_sample_seq первого сэмпла блока (ingest)
+void updateADCCrossings(const int16_t* block_uA, uint32_t n, uint32_t seq);
+
+// Номер сэмпла последнего перехода вверх (rising) или вниз. false — переходов нет
+bool getLastADCCrossing(bool rising, uint32_t* seq);
+
+// Частота и джиттер (σ периода) по последним ADC_CROSSING_STAT_CYCLES
+// периодам между фронтами вверх. false — меньше двух фронтов
+bool getADCCycleStats(float* freq_hz, float* jitter_ms);
+
+#endif // ADC_CROSSING_H
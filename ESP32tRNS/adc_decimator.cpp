@@ -0,0 +1,62 @@
+#include "adc_decimator.h"
+
+// Компенсатор: a = 123/1024 ≈ 0.12 — подобран для CIC 3-го порядка, R = 4
+#define COMP_A      123
+#define COMP_SHIFT  10
+
+void initAdcDecimator(AdcDecimator* st, uint8_t ratio_shift) {
+  st->ratio_shift = ratio_shift;
+  resetAdcDecimator(st);
+}
+
+void resetAdcDecimator(AdcDecimator* st) {
+  st->phase = 0;
+  for (uint8_t k = 0; k < ADC_CIC_ORDER; k++) {
+    st->integ[k] = 0;
+    st->comb[k] = 0;
+  }
+  st->v1 = 0;
+  st->v2 = 0;
+}
+
+uint32_t decimateAdcBlock(AdcDecimator* st, int16_t* data, uint32_t n) {
+  const uint8_t shift = st->ratio_shift;
+  const uint32_t ratio = 1u << shift;
+  const uint32_t gain_shift = ADC_CIC_ORDER * shift;  // Усиление CIC = R^N
+  uint32_t i0 = st->integ[0], i1 = st->integ[1], i2 = st->integ[2];
+  uint32_t phase = st->phase;
+  int32_t v1 = st->v1;
+  int32_t v2 = st->v2;
+  uint32_t out = 0;
+
+  for (uint32_t i = 0; i < n; i++) {
+    i0 += (uint32_t)(int32_t)data[i];
+    i1 += i0;
+    i2 += i1;
+    if (++phase < ratio) continue;
+    phase = 0;
+
+    // Гребёнки на частоте выхода
+    uint32_t c0 = i2 - st->comb[0]; st->comb[0] = i2;
+    uint32_t c1 = c0 - st->comb[1]; st->comb[1] = c0;
+    uint32_t c2 = c1 - st->comb[2]; st->comb[2] = c1;
+    int32_t v = ((int32_t)c2 + (1 << (gain_shift - 1))) >> gain_shift;
+
+    // FIR [−a, 1+2a, −a] по выходам CIC (задержка 1 сэмпл)
+    int32_t y = ((((1 << COMP_SHIFT) + 2 * COMP_A) * v1 - COMP_A * (v + v2))
+                 + (1 << (COMP_SHIFT - 1))) >> COMP_SHIFT;
+    v2 = v1;
+    v1 = v;
+    if (y > 4095) y = 4095;
+    if (y < -4095) y = -4095;
+    data[out++] = (int16_t)y;  // out ≤ i: запись на месте безопасна
+  }
+
+  st->integ[0] = i0;
+  st->integ[1] = i1;
+  st->integ[2] = i2;
+  st->phase = (uint8_t)phase;
+  st->v1 = v1;
+  st->v2 = v2;
+  return out;
+}
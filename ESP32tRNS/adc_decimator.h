@@ -0,0 +1,38 @@
+#ifndef ADC_DECIMATOR_H
+#define ADC_DECIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// === ADC DECIMATOR (CIC + компенсирующий FIR для передискретизации) ===
+// ============================================================================
+// АЦП работает на ADC_SAMPLE_RATE × R, парсер отдаёт нефильтрованные коды,
+// здесь они прореживаются в R раз до ADC_SAMPLE_RATE:
+//   CIC 3-го порядка (интеграторы → прореживание → гребёнки), всё в целых;
+//   затем 3-отводный FIR [−a, 1+2a, −a] поднимает завал CIC в полосе tRNS.
+// Усреднение R сэмплов снижает шум (~+1 бит на R=4) при плоской АЧХ до 640 Гц:
+// CIC ×0.971 и FIR ×1.030 на 640 Гц (против ×0.917 у окна [1,1,1]/3).
+// Модуль не зависит от Arduino/IDF (как adc_frame_parser) — собирается на хосте.
+
+#define ADC_CIC_ORDER   3
+
+struct AdcDecimator {
+  uint8_t ratio_shift;                // R = 1 << ratio_shift
+  uint8_t phase;                      // Входных сэмплов с последнего выхода
+  uint32_t integ[ADC_CIC_ORDER];      // Интеграторы (переполнение по модулю 2^32 — норма для CIC)
+  uint32_t comb[ADC_CIC_ORDER];       // Задержки гребёнок
+  int32_t v1, v2;                     // Два предыдущих выхода CIC для FIR
+};
+
+// Настройка коэффициента прореживания (R = 1 << ratio_shift, ratio_shift ≥ 1) и сброс
+void initAdcDecimator(AdcDecimator* st, uint8_t ratio_shift);
+
+// Сброс фильтров (при сбросе кольцевого буфера)
+void resetAdcDecimator(AdcDecimator* st);
+
+// Прорядить n знаковых кодов на месте: результат в data[0..return)
+// Выход ограничен ±4095 (как у парсера)
+uint32_t decimateAdcBlock(AdcDecimator* st, int16_t* data, uint32_t n);
+
+#endif // ADC_DECIMATOR_H
@@ -0,0 +1,115 @@
+#include "adc_envelope.h"
+
+#define ENV_MASK  (ADC_RING_SIZE - 1)
+
+struct EnvelopeEntry {
+  int16_t min_uA;
+  int16_t max_uA;
+};
+
+// levels[L][i] — блок сэмплов [i << shift(L), (i + 1) << shift(L))
+static EnvelopeEntry* levels[ADC_ENVELOPE_LEVELS];
+
+static inline uint32_t levelShift(uint8_t level) {
+  return ADC_ENVELOPE_SHIFT * (level + 1);
+}
+
+static_assert(ADC_ENVELOPE_SHIFT * ADC_ENVELOPE_LEVELS < 14, "top envelope block must fit the ring");
+
+void initADCEnvelope() {
+  for (uint8_t l = 0; l < ADC_ENVELOPE_LEVELS; l++) {
+    levels[l] = (EnvelopeEntry*)malloc((ADC_RING_SIZE >> levelShift(l)) * sizeof(EnvelopeEntry));
+    if (levels[l] == NULL) {
+      Serial.printf("[ADC] envelope level %u alloc failed\n", (unsigned)l);
+    }
+  }
+}
+
+void updateADCEnvelope(const int16_t* block_uA, uint32_t n, uint32_t write_index) {
+  for (uint8_t l = 0; l < ADC_ENVELOPE_LEVELS; l++) {
+    EnvelopeEntry* lv = levels[l];
+    if (lv == NULL) continue;
+    const uint32_t shift = levelShift(l);
+    const uint32_t block_mask = (1u << shift) - 1;
+    
+    uint32_t idx = write_index;
+    for (uint32_t i = 0; i < n; i++, idx = (idx + 1) & ENV_MASK) {
+      int16_t uA = block_uA[i];
+      EnvelopeEntry* e = &lv[idx >> shift];
+      if ((idx & block_mask) == 0) {
+        // Первый сэмпл блока: прошлый круг кольца забываем
+        e->min_uA = e->max_uA = uA;
+      } else {
+        if (uA < e->min_uA) e->min_uA = uA;
+        if (uA > e->max_uA) e->max_uA = uA;
+      }
+    }
+  }
+}
+
+void rebuildADCEnvelope(const int16_t* ring_uA, uint32_t write_index) {
+  for (uint8_t l = 0; l < ADC_ENVELOPE_LEVELS; l++) {
+    EnvelopeEntry* lv = levels[l];
+    if (lv == NULL) continue;
+    const uint32_t shift = levelShift(l);
+    
+    for (uint32_t b = 0; b < ((uint32_t)ADC_RING_SIZE >> shift); b++) {
+      uint32_t from = b << shift;
+      uint32_t to = from + (1u << shift);
+      // Текущий блок ingest: только уже записанная часть (дальше — прошлый круг)
+      if (write_index > from && write_index < to) to = write_index;
+      int16_t mn = INT16_MAX;
+      int16_t mx = INT16_MIN;
+      for (uint32_t i = from; i < to; i++) {
+        int16_t uA = ring_uA[i];
+        if (uA == ADC_INVALID_VALUE) continue;
+        if (uA < mn) mn = uA;
+        if (uA > mx) mx = uA;
+      }
+      lv[b].min_uA = mn;  // Пустой блок: min > max
+      lv[b].max_uA = mx;
+    }
+  }
+}
+
+bool getADCEnvelope(const int16_t* ring_uA, uint32_t start, uint32_t count,
+                    int16_t* min_uA, int16_t* max_uA) {
+  if (count == 0) return false;
+  int16_t mn = INT16_MAX;
+  int16_t mx = INT16_MIN;
+  uint32_t pos = start & ENV_MASK;
+  
+  while (count > 0) {
+    // Крупнейший уровень, чей блок начинается в pos и целиком в диапазоне
+    int8_t level = -1;
+    for (int8_t l = ADC_ENVELOPE_LEVELS - 1; l >= 0; l--) {
+      uint32_t size = 1u << levelShift(l);
+      if (levels[l] != NULL && (pos & (size - 1)) == 0 && size <= count) {
+        level = l;
+        break;
+      }
+    }
+    
+    uint32_t step;
+    if (level >= 0) {
+      const EnvelopeEntry* e = &levels[level][pos >> levelShift(level)];
+      if (e->min_uA < mn) mn = e->min_uA;
+      if (e->max_uA > mx) mx = e->max_uA;
+      step = 1u << levelShift(level);
+    } else {
+      int16_t uA = ring_uA[pos];
+      if (uA != ADC_INVALID_VALUE) {
+        if (uA < mn) mn = uA;
+        if (uA > mx) mx = uA;
+      }
+      step = 1;
+    }
+    pos = (pos + step) & ENV_MASK;
+    count -= step;
+  }
+  
+  if (mn > mx) return false;  // Только невалидные сэмплы
+  *min_uA = mn;
+  *max_uA = mx;
+  return true;
+}
@@ -0,0 +1,30 @@
+#ifndef ADC_ENVELOPE_H
+#define ADC_ENVELOPE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC ENVELOPE (пирамида min/max по кольцу мкА) ===
+// ============================================================================
+// Для каждого уровня — min/max блоков по 8, 64, 512 сэмплов, по тем же
+// индексам, что и adc_uA_ring_buffer. Ведётся в задаче ingest.
+// Осциллограмма получает честные min/max каждой колонки (без алиасинга шума)
+// за O(колонок): диапазон колонки покрывается крупнейшими целыми блоками,
+// по краям — блоками мельче и одиночными сэмплами.
+
+// Выделить уровни (вызывается из initADC)
+void initADCEnvelope();
+
+// Добавить блок мкА, записываемый в кольцо с индекса write_index (ingest)
+void updateADCEnvelope(const int16_t* block_uA, uint32_t n, uint32_t write_index);
+
+// Пересобрать пирамиду по всему кольцу мкА (после его пересчёта)
+void rebuildADCEnvelope(const int16_t* ring_uA, uint32_t write_index);
+
+// Min/max мкА по count сэмплам кольца, начиная с индекса start (с переходом через край)
+// Все сэмплы диапазона должны быть уже записаны. false — пустой диапазон
+bool getADCEnvelope(const int16_t* ring_uA, uint32_t start, uint32_t count,
+                    int16_t* min_uA, int16_t* max_uA);
+
+#endif // ADC_ENVELOPE_H
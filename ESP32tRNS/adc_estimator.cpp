@@ -0,0 +1,153 @@
+#include "adc_estimator.h"
+
+// Порог выброса: K·s, s ≈ 0.8σ для гауссова шума → K = 4 ≈ 3.2σ (как у Hampel 3·MAD)
+#define OUTLIER_K          4
+#define SCALE_EMA_SHIFT    6     // s усредняется по ~64 сэмплам
+#define HAMPEL_K           6     // d у медианы трёх: s ≈ 0.5σ → порог ≈ 3σ
+
+void initAdcEstimator(AdcEstimator* st) {
+  st->alpha = 4096;
+  st->beta = 0;
+  st->floor_q8 = 4096 << 8;
+  st->max_run = 0;
+  st->outlier_count = 0;
+  resetAdcEstimator(st);
+}
+
+void resetAdcEstimator(AdcEstimator* st) {
+  st->x = 0;
+  st->v = 0;
+  st->scale = 0;
+  st->run = 0;
+  st->z1 = 0;
+  st->primed = false;
+}
+
+void setAdcEstimatorModel(AdcEstimator* st, uint16_t alpha_q12, uint16_t beta_q12,
+                          int16_t floor_codes, uint16_t max_run) {
+  st->alpha = alpha_q12;
+  st->beta = beta_q12;
+  st->floor_q8 = (int32_t)floor_codes << 8;
+  st->max_run = max_run;
+}
+
+void runAdcEstimator(AdcEstimator* st, int16_t* data, uint32_t n) {
+  int32_t x = st->x;
+  int32_t v = st->v;
+  int32_t scale = st->scale;
+  const int32_t alpha = st->alpha;
+  const int32_t beta = st->beta;
+  const int32_t floor_q8 = st->floor_q8;
+  const uint16_t max_run = st->max_run;
+  uint16_t run = st->run;
+  int32_t z1 = st->z1;
+  uint32_t outliers = 0;
+  uint32_t i = 0;
+
+  if (!st->primed && n > 0) {
+    x = (int32_t)data[0] << 8;
+    z1 = x;
+    v = 0;
+    st->primed = true;
+    i = 1;
+  }
+
+  for (; i < n; i++) {
+    int32_t z = (int32_t)data[i] << 8;
+    int32_t pred = x + v;
+    int32_t r = z - pred;
+    int32_t abs_r = (r < 0) ? -r : r;
+    int32_t threshold = OUTLIER_K * scale;
+    if (threshold < floor_q8) threshold = floor_q8;
+
+    if (abs_r > threshold && run < max_run) {
+      // Выброс: держим прогноз, масштаб шума не раздуваем
+      run++;
+      outliers++;
+      x = pred;
+    } else if (abs_r > threshold) {
+      // Серия длиннее max_run — реальный скачок: оценка заново с измерений
+      // (иначе β·r разогнал бы скорость на весь скачок и дал выброс обратно);
+      // при β = 0 модель без скорости — её и не заводим
+      run = 0;
+      x = z;
+      v = (beta > 0) ? z - z1 : 0;
+    } else {
+      run = 0;
+      x = pred + (int32_t)(((int64_t)alpha * r) >> 12);
+      v += (int32_t)(((int64_t)beta * r) >> 12);
+      // Масштаб — по невязке, обрезанной порогом (скачок тока его не разгоняет)
+      scale += ((abs_r < threshold ? abs_r : threshold) - scale) >> SCALE_EMA_SHIFT;
+    }
+
+    z1 = z;
+
+    int32_t y = (x + 128) >> 8;
+    if (y > 4095) y = 4095;
+    if (y < -4095) y = -4095;
+    data[i] = (int16_t)y;
+  }
+
+  st->x = x;
+  st->v = v;
+  st->scale = scale;
+  st->run = run;
+  st->z1 = z1;
+  st->outlier_count += outliers;
+}
+
+void initAdcHampel(AdcHampel* st, int16_t floor_codes) {
+  st->floor_q8 = (int32_t)floor_codes << 8;
+  st->outlier_count = 0;
+  resetAdcHampel(st);
+}
+
+void resetAdcHampel(AdcHampel* st) {
+  st->z1 = 0;
+  st->z2 = 0;
+  st->scale = 0;
+  st->primed = false;
+}
+
+static inline int32_t median3(int32_t a, int32_t b, int32_t c) {
+  if (a > b) { int32_t t = a; a = b; b = t; }
+  if (b > c) b = c;
+  return (a > b) ? a : b;
+}
+
+void runAdcHampel(AdcHampel* st, int16_t* data, uint32_t n) {
+  if (n == 0) return;
+  if (!st->primed) {
+    st->z1 = st->z2 = data[0];
+    st->primed = true;
+  }
+  int32_t z1 = st->z1;
+  int32_t z2 = st->z2;
+  int32_t scale = st->scale;
+  const int32_t floor_q8 = st->floor_q8;
+  uint32_t outliers = 0;
+
+  for (uint32_t i = 0; i < n; i++) {
+    int32_t z = data[i];
+    int32_t m = median3(z2, z1, z);
+    int32_t d = (int32_t)((uint32_t)(z1 > m ? z1 - m : m - z1) << 8);
+    int32_t threshold = HAMPEL_K * scale;
+    if (threshold < floor_q8) threshold = floor_q8;
+    int32_t y = z1;
+    if (d > threshold) {
+      // Выброс: центр окна — медианой, масштаб шума не раздуваем
+      y = m;
+      outliers++;
+    } else {
+      scale += (d - scale) >> SCALE_EMA_SHIFT;
+    }
+    z2 = z1;
+    z1 = z;
+    data[i] = (int16_t)y;
+  }
+
+  st->z1 = (int16_t)z1;
+  st->z2 = (int16_t)z2;
+  st->scale = scale;
+  st->outlier_count += outliers;
+}
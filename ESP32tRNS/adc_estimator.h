@@ -0,0 +1,77 @@
+#ifndef ADC_ESTIMATOR_H
+#define ADC_ESTIMATOR_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// === ADC ESTIMATOR (alpha-beta оценка тока + отбраковка выбросов) ===
+// ============================================================================
+// Вместо окна [1,1,1]/3: фиксированная точка Q8 (коды ADC × 256).
+//   Прогноз: x̂ = x + v; невязка r = z − x̂
+//   Выброс (Hampel-подобно): |r| > max(K·s, floor), где s — скользящее среднее |r|
+//   (робастный масштаб шума) → сэмпл заменяется прогнозом. Не больше max_run
+//   выбросов подряд: длинная серия — это реальный скачок тока, а не выброс
+//   (оценка перезапускается с измерений).
+//   Иначе: x = x̂ + α·r, v = v + β·r.
+// Коэффициенты задаёт режим стимуляции (модель сигнала), floor — амплитуда
+// команды: невязка больше размаха заданного тока физически невозможна.
+// Модуль не зависит от Arduino/IDF (как adc_frame_parser) — собирается на хосте.
+
+struct AdcEstimator {
+  int32_t x;              // Оценка, Q8
+  int32_t v;              // Скорость (изменение за сэмпл), Q8
+  int32_t scale;          // Скользящее среднее |r|, Q8
+  uint16_t alpha;         // α, Q12 (4096 = 1.0)
+  uint16_t beta;          // β, Q12
+  int32_t floor_q8;       // Нижний порог выброса, Q8
+  uint16_t max_run;       // Выбросов подряд не больше
+  uint16_t run;           // Текущая серия выбросов
+  int32_t z1;             // Предыдущее измерение, Q8 (скорость при пересинхронизации)
+  bool primed;            // Есть начальная оценка
+  uint32_t outlier_count; // Заменено сэмплов (накопительно)
+};
+
+// Сброс состояния и модель по умолчанию (α = 1: без сглаживания)
+void initAdcEstimator(AdcEstimator* st);
+
+// Сброс оценки (счётчик выбросов не трогается)
+void resetAdcEstimator(AdcEstimator* st);
+
+// Модель: α, β в Q12, нижний порог выброса в кодах, максимум выбросов подряд
+void setAdcEstimatorModel(AdcEstimator* st, uint16_t alpha_q12, uint16_t beta_q12,
+                          int16_t floor_codes, uint16_t max_run);
+
+// Оценить n знаковых кодов на месте (выход ограничен ±4095)
+void runAdcEstimator(AdcEstimator* st, int16_t* data, uint32_t n);
+
+// ============================================================================
+// === ADC HAMPEL (отбраковка выбросов на сырых парах, до дециматора) ===
+// ============================================================================
+// При R > 1 выброс после CIC + FIR размазан на несколько сэмплов и по невязке
+// оценщика неотличим от быстрого сигнала (tRNS). На сырых парах он — одна пара:
+//   медиана окна из трёх пар m; d = |z − m|
+//   выброс: d > max(K·s, floor), где s — скользящее среднее d (локальный σ
+//   шума пары) → пара заменяется медианой.
+// Ступень (сэмпл DAC держится несколько пар) медиану не сдвигает — d = 0,
+// поэтому порог идёт по шуму, а не по амплитуде сигнала. Выход задержан на
+// одну пару (центр окна).
+
+struct AdcHampel {
+  int16_t z1, z2;         // Два предыдущих измерения (z1 — центр окна)
+  int32_t scale;          // Скользящее среднее d, Q8
+  int32_t floor_q8;       // Нижний порог выброса, Q8
+  bool primed;
+  uint32_t outlier_count; // Заменено пар (накопительно)
+};
+
+// Сброс состояния и нижний порог в кодах
+void initAdcHampel(AdcHampel* st, int16_t floor_codes);
+
+// Сброс окна (счётчик выбросов не трогается)
+void resetAdcHampel(AdcHampel* st);
+
+// Отфильтровать n знаковых кодов на месте (выход задержан на одну пару)
+void runAdcHampel(AdcHampel* st, int16_t* data, uint32_t n);
+
+#endif // ADC_ESTIMATOR_H
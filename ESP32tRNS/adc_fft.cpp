@@ -0,0 +1,89 @@
+#include "adc_fft.h"
+#include <math.h>
+
+#define FFT_N          (ADC_FFT_SIZE / 2)      // Комплексных точек (пары сэмплов)
+#define FFT_QUARTER    (ADC_FFT_SIZE / 4)      // Четверть периода таблицы синуса
+static_assert((FFT_N & (FFT_N - 1)) == 0, "SIGNAL_SAMPLES must be a power of two");
+
+// sin(2π·k/ADC_FFT_SIZE), k = 0..FFT_QUARTER, Q15
+static int16_t* sin_table = NULL;
+
+static inline int32_t twSin(uint32_t k) {
+  k &= ADC_FFT_SIZE - 1;
+  if (k <= FFT_QUARTER) return sin_table[k];
+  if (k <= 2 * FFT_QUARTER) return sin_table[2 * FFT_QUARTER - k];
+  if (k <= 3 * FFT_QUARTER) return -sin_table[k - 2 * FFT_QUARTER];
+  return -sin_table[ADC_FFT_SIZE - k];
+}
+
+static inline int32_t twCos(uint32_t k) {
+  return twSin(k + FFT_QUARTER);
+}
+
+static inline int32_t mulQ15(int32_t a, int32_t w) {
+  return (int32_t)(((int64_t)a * w + (1 << 14)) >> 15);
+}
+
+bool initADCFFT() {
+  if (sin_table != NULL) return true;
+  int16_t* table = (int16_t*)malloc((FFT_QUARTER + 1) * sizeof(int16_t));
+  if (table == NULL) return false;
+  for (uint32_t k = 0; k <= FFT_QUARTER; k++) {
+    table[k] = (int16_t)lroundf(32767.0f * sinf(2.0f * PI * k / ADC_FFT_SIZE));
+  }
+  sin_table = table;
+  return true;
+}
+
+// Комплексный FFT по месту (прореживание по времени), yield после каждой стадии
+void adcFFTReal(int32_t* x, void (*yield_fn)()) {
+  for (uint32_t i = 1, j = 0; i < FFT_N; i++) {
+    uint32_t bit = FFT_N >> 1;
+    for (; j & bit; bit >>= 1) j ^= bit;
+    j ^= bit;
+    if (i < j) {
+      int32_t tr = x[2 * i], ti = x[2 * i + 1];
+      x[2 * i] = x[2 * j];
+      x[2 * i + 1] = x[2 * j + 1];
+      x[2 * j] = tr;
+      x[2 * j + 1] = ti;
+    }
+  }
+  if (yield_fn) yield_fn();
+
+  for (uint32_t len = 2; len <= FFT_N; len <<= 1) {
+    uint32_t half = len >> 1;
+    uint32_t step = ADC_FFT_SIZE / len;  // Шаг по таблице ADC_FFT_SIZE точек
+    for (uint32_t k = 0; k < half; k++) {
+      int32_t wr = twCos(k * step);
+      int32_t wi = -twSin(k * step);     // e^(−jθ)
+      for (uint32_t a = k; a < FFT_N; a += len) {
+        uint32_t b = a + half;
+        int32_t br = x[2 * b], bi = x[2 * b + 1];
+        int32_t tr = mulQ15(br, wr) - mulQ15(bi, wi);
+        int32_t ti = mulQ15(br, wi) + mulQ15(bi, wr);
+        int32_t ar = x[2 * a], ai = x[2 * a + 1];
+        x[2 * a] = ar + tr;
+        x[2 * a + 1] = ai + ti;
+        x[2 * b] = ar - tr;
+        x[2 * b + 1] = ai - ti;
+      }
+    }
+    if (yield_fn) yield_fn();
+  }
+}
+
+// 2·X[k] = (Z[k] + Z*[N−k]) − j·W^k·(Z[k] − Z*[N−k]),  W = e^(−j2π/ADC_FFT_SIZE)
+void adcFFTBin(const int32_t* z, uint32_t k, int64_t* re2, int64_t* im2) {
+  uint32_t k1 = k & (FFT_N - 1);
+  uint32_t k2 = (FFT_N - k) & (FFT_N - 1);
+  int64_t zr = z[2 * k1], zi = z[2 * k1 + 1];
+  int64_t cr = z[2 * k2], ci = -(int64_t)z[2 * k2 + 1];
+  int64_t dr = zr - cr, di = zi - ci;
+  int64_t wr = twCos(k), wi = -twSin(k);
+  // W·D, затем −j·(a + jb) = b − ja
+  int64_t tr = (wr * dr - wi * di + (1 << 14)) >> 15;
+  int64_t ti = (wr * di + wi * dr + (1 << 14)) >> 15;
+  *re2 = zr + cr + ti;
+  *im2 = zi + ci - tr;
+}
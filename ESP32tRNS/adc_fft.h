@@ -0,0 +1,28 @@
+#ifndef ADC_FFT_H
+#define ADC_FFT_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC FFT (вещественный FFT на один DAC луп в целых) ===
+// ============================================================================
+// SIGNAL_SAMPLES вещественных сэмплов (int32, |x| ≤ 2^15) упакованы парами в
+// комплексный FFT половинной длины, по месту, без масштабирования: рост ≤ 2^13·√2
+// → |Z| < 2^29. Поворотные множители Q15 из четверти периода синуса.
+// Фоновые задачи (adc_spectrum, adc_transfer) уступают CPU между стадиями.
+
+#define ADC_FFT_SIZE   SIGNAL_SAMPLES          // Вещественных точек
+#define ADC_FFT_BINS   (ADC_FFT_SIZE / 2 + 1)  // Бины 0..Найквист
+
+// Таблица синуса (повторный вызов ничего не делает). false — нет памяти
+bool initADCFFT();
+
+// FFT по месту: buf — ADC_FFT_SIZE сэмплов, на выходе упакованный спектр
+// yield_fn вызывается после каждой стадии (может быть NULL)
+void adcFFTReal(int32_t* buf, void (*yield_fn)());
+
+// Удвоенный бин k (0..ADC_FFT_SIZE/2) из упакованного спектра: 2·X[k]
+void adcFFTBin(const int32_t* z, uint32_t k, int64_t* re2, int64_t* im2);
+
+#endif // ADC_FFT_H
@@ -0,0 +1,87 @@
+#include "adc_frame_parser.h"
+
+// TYPE1: младшие 12 бит — код, старшие 4 — канал
+#define TYPE1_DATA(w)     ((w) & 0x0FFF)
+#define TYPE1_CHANNEL(w)  ((w) >> 12)
+
+void initAdcPairParser(AdcPairParser* st, uint8_t sign_channel, uint8_t mag_channel,
+                       uint16_t sign_threshold, uint16_t mag_overrange) {
+  st->sign_channel = sign_channel;
+  st->mag_channel = mag_channel;
+  st->sign_threshold = sign_threshold;
+  st->mag_overrange = mag_overrange;
+  st->polarity_invert = false;
+  st->bypass_filter = false;
+  st->desync_count = 0;
+  st->overrange_count = 0;
+  resetAdcPairParser(st);
+}
+
+void resetAdcPairParser(AdcPairParser* st) {
+  st->has_sign = false;
+  st->sign_value = 0;
+  st->x1 = 0;
+  st->x2 = 0;
+}
+
+uint32_t parseAdcFrame(AdcPairParser* st, const uint8_t* data, uint32_t conv_count, int16_t* out) {
+  const uint8_t sign_ch = st->sign_channel;
+  const uint8_t mag_ch = st->mag_channel;
+  const uint16_t threshold = st->sign_threshold;
+  const uint16_t overrange = st->mag_overrange;
+  const bool invert = st->polarity_invert;
+  const bool bypass = st->bypass_filter;
+  bool has_sign = st->has_sign;
+  uint16_t sign_value = st->sign_value;
+  int32_t x1 = st->x1;
+  int32_t x2 = st->x2;
+  uint32_t desync = 0;
+  uint32_t over = 0;
+  uint32_t n = 0;
+
+  for (uint32_t i = 0; i < conv_count; i++) {
+    // Little-endian 16-бит слово без требований к выравниванию буфера
+    uint16_t w = (uint16_t)(data[2 * i] | (data[2 * i + 1] << 8));
+    uint8_t ch = TYPE1_CHANNEL(w);
+    uint16_t code = TYPE1_DATA(w);
+
+    if (ch == sign_ch) {
+      if (has_sign) desync++;  // Второй sign подряд — mag потерян, пересобираем пару
+      sign_value = code;
+      has_sign = true;
+      continue;
+    }
+    if (ch != mag_ch) continue;  // Чужой канал — игнорируем
+    if (!has_sign) {
+      desync++;                  // mag без sign — пропускаем до следующего sign
+      continue;
+    }
+    has_sign = false;
+
+    // Отсекаем аномалии: модуль вне калибровки = шум/разрыв цепи, тока нет
+    if (code > overrange) {
+      code = 0;
+      over++;
+    }
+    bool positive = (sign_value > threshold) != invert;
+    int32_t x = positive ? (int32_t)code : -(int32_t)code;
+    if (bypass) {
+      out[n++] = (int16_t)x;
+      continue;
+    }
+
+    // Окно [1,1,1]/3: ×21846/65536 с округлением (floor для отрицательных)
+    int32_t sum = x + x1 + x2;
+    out[n++] = (int16_t)((sum * 21846 + 32768) >> 16);
+    x2 = x1;
+    x1 = x;
+  }
+
+  st->has_sign = has_sign;
+  st->sign_value = sign_value;
+  st->x1 = (int16_t)x1;
+  st->x2 = (int16_t)x2;
+  st->desync_count += desync;
+  st->overrange_count += over;
+  return n;
+}
@@ -0,0 +1,43 @@
+#ifndef ADC_FRAME_PARSER_H
+#define ADC_FRAME_PARSER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// === ADC FRAME PARSER (блочный разбор DMA фрейма sign/mag) ===
+// ============================================================================
+// Весь DMA фрейм разбирается за один проход: пары (sign, mag) собираются
+// строго в порядке паттерна, рассинхрон детектируется и пара пересобирается
+// со следующего sign. Фильтр — целочисленное окно [1,1,1]/3 без float.
+// Модуль не зависит от Arduino/IDF: его можно собрать на хосте и прогнать
+// по записанным фреймам (циклы на сэмпл, совпадение с эталоном).
+
+// Состояние парсера между фреймами (пара может разорваться границей фрейма)
+struct AdcPairParser {
+  uint8_t sign_channel;       // Канал знака (первый в паттерне)
+  uint8_t mag_channel;        // Канал модуля (второй в паттерне)
+  uint16_t sign_threshold;    // Порог знака (код)
+  uint16_t mag_overrange;     // Модуль выше — мусор/разрыв, считается нулём
+  bool polarity_invert;       // Инверсия полярности
+  bool bypass_filter;         // Без окна [1,1,1]/3 (передискретизация: фильтрует дециматор)
+  bool has_sign;              // Есть sign, ждём mag
+  uint16_t sign_value;
+  int16_t x1, x2;             // Два предыдущих сэмпла для окна фильтра
+  uint32_t desync_count;      // Пар, собранных с пропуском канала (накопительно)
+  uint32_t overrange_count;   // Модулей выше mag_overrange (накопительно)
+};
+
+// Настройка каналов/порогов и сброс состояния
+void initAdcPairParser(AdcPairParser* st, uint8_t sign_channel, uint8_t mag_channel,
+                       uint16_t sign_threshold, uint16_t mag_overrange);
+
+// Сброс фильтра и недособранной пары (счётчики не трогаются)
+void resetAdcPairParser(AdcPairParser* st);
+
+// Разобрать фрейм из conv_count конверсий (формат TYPE1, 2 байта на конверсию)
+// Отфильтрованные (или сырые при bypass_filter) знаковые коды пишутся подряд в out (не больше conv_count / 2 + 1)
+// Возвращает число записанных сэмплов
+uint32_t parseAdcFrame(AdcPairParser* st, const uint8_t* data, uint32_t conv_count, int16_t* out);
+
+#endif // ADC_FRAME_PARSER_H
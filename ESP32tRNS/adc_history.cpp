@@ -0,0 +1,254 @@
+#include "adc_history.h"
+#include <stdlib.h>
+
+#define MID_DIV   (ADC_SAMPLE_RATE / ADC_HISTORY_MID_HZ)   // Сэмплов на запись яруса 1
+#define SLOW_DIV  ADC_HISTORY_MID_HZ                       // Записей яруса 1 на запись яруса 2
+static_assert(ADC_SAMPLE_RATE % ADC_HISTORY_MID_HZ == 0, "MID_HZ must divide ADC_SAMPLE_RATE");
+
+static const uint32_t tier_rate[ADC_HISTORY_TIERS] = { ADC_SAMPLE_RATE, ADC_HISTORY_MID_HZ, 1 };
+static const uint32_t tier_size[ADC_HISTORY_TIERS] = {
+  (uint32_t)ADC_HISTORY_RAW_SEC * ADC_SAMPLE_RATE,
+  (uint32_t)ADC_HISTORY_MID_SEC * ADC_HISTORY_MID_HZ,
+  (uint32_t)ADC_HISTORY_SLOW_SEC
+};
+
+// Запись ярусов 1–2: время — из номера записи, не хранится (6 байт)
+struct HistoryEntry {
+  int16_t min_uA;
+  int16_t max_uA;
+  int16_t mean_uA;
+};
+
+// Кольца ярусов (PSRAM). Запись с номером e лежит в [e % tier_size]
+static int16_t* raw_ring = NULL;
+static HistoryEntry* mid_ring = NULL;
+static HistoryEntry* slow_ring = NULL;
+static AdcHistoryPoint* query_buf = NULL;  // Для handleADCHistoryCommand
+
+// Записей в ярусе с начала сеанса (публикуются после данных)
+static volatile uint32_t tier_count[ADC_HISTORY_TIERS] = { 0, 0, 0 };
+static volatile uint32_t history_epoch = 0;  // +1 на каждый сброс: читатель видит смену сеанса
+static volatile bool history_reset_pending = false;
+
+// Позиции записи (только ingest) и незакрытые корзины
+static uint32_t raw_w = 0, mid_w = 0, slow_w = 0;
+static int16_t mid_min, mid_max, slow_min, slow_max;
+static int32_t mid_sum, slow_sum;
+static uint32_t mid_n, slow_n;
+
+// Среднее с округлением к ближайшему (без float)
+static inline int16_t roundedMean(int32_t sum, uint32_t n) {
+  int32_t half = (int32_t)(n / 2);
+  return (int16_t)((sum >= 0 ? sum + half : sum - half) / (int32_t)n);
+}
+
+static void resetBuckets() {
+  mid_min = slow_min = INT16_MAX;
+  mid_max = slow_max = INT16_MIN;
+  mid_sum = slow_sum = 0;
+  mid_n = slow_n = 0;
+}
+
+void initADCHistory() {
+  raw_ring = (int16_t*)malloc(tier_size[ADC_HISTORY_RAW] * sizeof(int16_t));          // PSRAM
+  mid_ring = (HistoryEntry*)malloc(tier_size[ADC_HISTORY_MID] * sizeof(HistoryEntry));
+  slow_ring = (HistoryEntry*)malloc(tier_size[ADC_HISTORY_SLOW] * sizeof(HistoryEntry));
+  query_buf = (AdcHistoryPoint*)malloc(ADC_HISTORY_MAX_POINTS * sizeof(AdcHistoryPoint));
+  if (raw_ring == NULL || mid_ring == NULL || slow_ring == NULL || query_buf == NULL) {
+    Serial.println("[HIST] alloc failed");
+    free(raw_ring); free(mid_ring); free(slow_ring); free(query_buf);
+    raw_ring = NULL; mid_ring = NULL; slow_ring = NULL; query_buf = NULL;
+    return;
+  }
+  history_reset_pending = true;
+}
+
+void resetADCHistory() {
+  history_reset_pending = true;
+}
+
+// Закрыть корзину яруса 1 (и, по заполнении, яруса 2)
+static void pushMidBucket() {
+  HistoryEntry* e = &mid_ring[mid_w];
+  e->min_uA = mid_min;
+  e->max_uA = mid_max;
+  e->mean_uA = roundedMean(mid_sum, mid_n);
+  if (++mid_w == tier_size[ADC_HISTORY_MID]) mid_w = 0;
+  
+  if (mid_min < slow_min) slow_min = mid_min;
+  if (mid_max > slow_max) slow_max = mid_max;
+  slow_sum += e->mean_uA;  // Корзины равные — среднее средних точное
+  
+  __sync_synchronize();  // Запись — до публикации счётчика
+  tier_count[ADC_HISTORY_MID]++;
+  mid_min = INT16_MAX; mid_max = INT16_MIN; mid_sum = 0; mid_n = 0;
+  
+  if (++slow_n < SLOW_DIV) return;
+  HistoryEntry* s = &slow_ring[slow_w];
+  s->min_uA = slow_min;
+  s->max_uA = slow_max;
+  s->mean_uA = roundedMean(slow_sum, slow_n);
+  if (++slow_w == tier_size[ADC_HISTORY_SLOW]) slow_w = 0;
+  __sync_synchronize();
+  tier_count[ADC_HISTORY_SLOW]++;
+  slow_min = INT16_MAX; slow_max = INT16_MIN; slow_sum = 0; slow_n = 0;
+}
+
+void updateADCHistory(const int16_t* block_uA, uint32_t n) {
+  if (raw_ring == NULL) return;
+  
+  if (history_reset_pending) {
+    history_reset_pending = false;
+    history_epoch++;
+    raw_w = mid_w = slow_w = 0;
+    resetBuckets();
+    for (uint8_t t = 0; t < ADC_HISTORY_TIERS; t++) tier_count[t] = 0;
+    __sync_synchronize();
+  }
+  
+  // Ярус 0: до конца кольца и (если нужно) с начала
+  uint32_t first = tier_size[ADC_HISTORY_RAW] - raw_w;
+  if (first > n) first = n;
+  memcpy(&raw_ring[raw_w], block_uA, first * sizeof(int16_t));
+  if (n > first) memcpy(raw_ring, block_uA + first, (n - first) * sizeof(int16_t));
+  raw_w += n;
+  if (raw_w >= tier_size[ADC_HISTORY_RAW]) raw_w -= tier_size[ADC_HISTORY_RAW];
+  
+  // Ярусы 1–2: min/max/сумма на сэмпл, запись — раз в MID_DIV сэмплов
+  for (uint32_t i = 0; i < n; i++) {
+    int16_t v = block_uA[i];
+    if (v < mid_min) mid_min = v;
+    if (v > mid_max) mid_max = v;
+    mid_sum += v;
+    if (++mid_n == MID_DIV) pushMidBucket();
+  }
+  
+  __sync_synchronize();
+  tier_count[ADC_HISTORY_RAW] += n;
+}
+
+uint32_t getADCHistoryDurationMs() {
+  return (uint32_t)((uint64_t)tier_count[ADC_HISTORY_RAW] * 1000 / ADC_SAMPLE_RATE);
+}
+
+// Диапазон записей яруса под [from_ms, to_ms), обрезанный по записанному.
+// false — начало уже перезаписано или данных ещё нет
+static bool tierRange(uint8_t t, uint32_t count, uint32_t from_ms, uint32_t to_ms,
+                      uint32_t* a, uint32_t* b) {
+  uint32_t lo = (count > tier_size[t]) ? count - tier_size[t] : 0;
+  *a = (uint32_t)((uint64_t)from_ms * tier_rate[t] / 1000);
+  *b = (uint32_t)(((uint64_t)to_ms * tier_rate[t] + 999) / 1000);
+  if (*b > count) *b = count;
+  return *a >= lo && *a < *b;
+}
+
+// Свёртка записей [e0, e1) яруса в одну точку
+static void foldTier(uint8_t t, uint32_t e0, uint32_t e1, AdcHistoryPoint* p) {
+  int16_t mn = INT16_MAX, mx = INT16_MIN;
+  int32_t sum = 0;
+  uint32_t idx = e0 % tier_size[t];
+  if (t == ADC_HISTORY_RAW) {
+    for (uint32_t e = e0; e < e1; e++) {
+      int16_t v = raw_ring[idx];
+      if (v < mn) mn = v;
+      if (v > mx) mx = v;
+      sum += v;
+      if (++idx == tier_size[t]) idx = 0;
+    }
+  } else {
+    const HistoryEntry* ring = (t == ADC_HISTORY_MID) ? mid_ring : slow_ring;
+    for (uint32_t e = e0; e < e1; e++) {
+      const HistoryEntry* q = &ring[idx];
+      if (q->min_uA < mn) mn = q->min_uA;
+      if (q->max_uA > mx) mx = q->max_uA;
+      sum += q->mean_uA;
+      if (++idx == tier_size[t]) idx = 0;
+    }
+  }
+  p->t_ms = (uint32_t)((uint64_t)e0 * 1000 / tier_rate[t]);
+  p->min_uA = mn;
+  p->max_uA = mx;
+  p->mean_uA = roundedMean(sum, e1 - e0);
+}
+
+uint16_t getADCHistory(uint32_t from_ms, uint32_t to_ms, uint16_t points,
+                       AdcHistoryPoint* out, uint8_t* tier) {
+  if (raw_ring == NULL || out == NULL || points == 0 || to_ms <= from_ms) return 0;
+  
+  uint32_t epoch = history_epoch;
+  uint32_t count[ADC_HISTORY_TIERS];
+  for (uint8_t t = 0; t < ADC_HISTORY_TIERS; t++) count[t] = tier_count[t];
+  __sync_synchronize();  // Счётчики — до чтения данных
+  
+  // Самый точный ярус, где точка сворачивает ≤ ADC_HISTORY_MAX_FOLD записей;
+  // если такого нет — самый грубый из хранящих начало диапазона
+  int8_t sel = -1;
+  uint32_t a = 0, b = 0;
+  for (uint8_t t = 0; t < ADC_HISTORY_TIERS; t++) {
+    uint32_t ta, tb;
+    if (!tierRange(t, count[t], from_ms, to_ms, &ta, &tb)) continue;
+    sel = t; a = ta; b = tb;
+    if ((tb - ta + points - 1) / points <= ADC_HISTORY_MAX_FOLD) break;
+  }
+  if (sel < 0) return 0;
+  
+  uint32_t span = b - a;
+  if (points > span) points = span;  // Не меньше одной записи на точку
+  for (uint16_t p = 0; p < points; p++) {
+    uint32_t e0 = a + (uint32_t)((uint64_t)span * p / points);
+    uint32_t e1 = a + (uint32_t)((uint64_t)span * (p + 1) / points);
+    foldTier(sel, e0, e1, &out[p]);
+  }
+  
+  // Ingest мог дописать кольцо поверх начала диапазона или начать новый сеанс
+  __sync_synchronize();
+  if (history_epoch != epoch || tier_count[sel] > a + tier_size[sel]) return 0;
+  if (tier) *tier = sel;
+  return points;
+}
+
+void handleADCHistoryCommand(const char* args) {
+  if (query_buf == NULL) {
+    Serial.println("[HIST] not available");
+    return;
+  }
+  char* end;
+  uint32_t from_s = strtoul(args, &end, 10);
+  if (end == args) {
+    // Без аргументов — сводка: что и с каким разрешением ещё хранится
+    Serial.printf("[HIST] session %lu ms\n", (unsigned long)getADCHistoryDurationMs());
+    for (uint8_t t = 0; t < ADC_HISTORY_TIERS; t++) {
+      uint32_t count = tier_count[t];
+      uint32_t lo = (count > tier_size[t]) ? count - tier_size[t] : 0;
+      Serial.printf("[HIST] tier %u: %lu Hz, %lu..%lu ms\n", (unsigned)t,
+                    (unsigned long)tier_rate[t],
+                    (unsigned long)((uint64_t)lo * 1000 / tier_rate[t]),
+                    (unsigned long)((uint64_t)count * 1000 / tier_rate[t]));
+    }
+    return;
+  }
+  const char* p = end;
+  uint32_t to_s = strtoul(p, &end, 10);
+  if (end == p) {
+    Serial.println("[HIST] usage: hist [<from_s> <to_s> [points]]");
+    return;
+  }
+  p = end;
+  uint32_t points = strtoul(p, &end, 10);
+  if (end == p || points == 0) points = 100;
+  if (points > ADC_HISTORY_MAX_POINTS) points = ADC_HISTORY_MAX_POINTS;
+  
+  uint8_t tier = 0;
+  uint16_t got = getADCHistory(from_s * 1000, to_s * 1000, (uint16_t)points, query_buf, &tier);
+  if (got == 0) {
+    Serial.println("[HIST] no data in range");
+    return;
+  }
+  Serial.printf("[HIST] tier %u, %u points: t_ms,min_uA,max_uA,mean_uA\n",
+                (unsigned)tier, (unsigned)got);
+  for (uint16_t i = 0; i < got; i++) {
+    const AdcHistoryPoint* q = &query_buf[i];
+    Serial.printf("%lu,%d,%d,%d\n", (unsigned long)q->t_ms,
+                  (int)q->min_uA, (int)q->max_uA, (int)q->mean_uA);
+  }
+}
@@ -0,0 +1,56 @@
+#ifndef ADC_HISTORY_H
+#define ADC_HISTORY_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC HISTORY (ток за весь сеанс: ярусы разрешения в PSRAM) ===
+// ============================================================================
+// adc_ring_buffer помнит 2 с; здесь — весь сеанс с убывающим разрешением:
+//   ярус 0: мкА на ADC_SAMPLE_RATE за последние ADC_HISTORY_RAW_SEC;
+//   ярус 1: min/max/mean на ADC_HISTORY_MID_HZ за ADC_HISTORY_MID_SEC;
+//   ярус 2: min/max/mean на 1 Гц за ADC_HISTORY_SLOW_SEC.
+// Ingest дописывает блок: memcpy в ярус 0 + min/max/сумма на сэмпл, запись
+// яруса 1 раз в корзину, яруса 2 — из корзин яруса 1. Память фиксирована
+// (кольца), запрос читает самый точный ярус, где на точку ≤ ADC_HISTORY_MAX_FOLD
+// записей и данные ещё не перезаписаны — без пересчёта по сырым сэмплам.
+// Время — от начала записи сеанса (первый сэмпл после resetADCHistory).
+
+enum AdcHistoryTier : uint8_t {
+  ADC_HISTORY_RAW = 0,
+  ADC_HISTORY_MID = 1,
+  ADC_HISTORY_SLOW = 2,
+  ADC_HISTORY_TIERS = 3
+};
+
+struct AdcHistoryPoint {
+  uint32_t t_ms;     // Начало интервала точки от начала сеанса
+  int16_t min_uA;
+  int16_t max_uA;
+  int16_t mean_uA;
+};
+
+// Выделить кольца в PSRAM (вызывается из initADC)
+void initADCHistory();
+
+// Новый сеанс: история с нуля (выполнит ingest перед следующим блоком)
+void resetADCHistory();
+
+// Добавить блок мкА (ingest, после калибровки)
+void updateADCHistory(const int16_t* block_uA, uint32_t n);
+
+// Сколько записано с начала сеанса, мс
+uint32_t getADCHistoryDurationMs();
+
+// До points точек на [from_ms, to_ms): каждая — min/max/mean своего интервала.
+// Конец обрезается по записанному в выбранном ярусе (грубый ярус отстаёт на
+// свою незакрытую корзину). tier — использованный ярус.
+// Возвращает число точек; 0 — данных нет или ярус перезаписан во время чтения
+uint16_t getADCHistory(uint32_t from_ms, uint32_t to_ms, uint16_t points,
+                       AdcHistoryPoint* out, uint8_t* tier);
+
+// Команда Serial: "hist" — сводка, "hist <from_s> <to_s> [points]" — точки CSV
+void handleADCHistoryCommand(const char* args);
+
+#endif // ADC_HISTORY_H
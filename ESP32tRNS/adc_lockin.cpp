@@ -0,0 +1,159 @@
+#include "adc_lockin.h"
+#include "adc_loop_average.h"
+#include <math.h>
+
+#define LOCKIN_TABLE_SIZE  (1 << ADC_LOCKIN_TABLE_BITS)
+#define LOCKIN_PHASE_SHIFT (32 - ADC_LOCKIN_TABLE_BITS)
+#define LOOP_BITS          14  // log2(SIGNAL_SAMPLES)
+static_assert(SIGNAL_SAMPLES == (1 << LOOP_BITS), "Lock-in phase assumes 16384-sample loop");
+static_assert((uint32_t)ADC_LOCKIN_MAX_BLOCKS * ADC_SAMPLES_PER_FRAME >= 2 * SIGNAL_SAMPLES,
+              "Lock-in block ring must cover one loop with short blocks");
+
+// sin(2π·k/LOCKIN_TABLE_SIZE), Q15
+static int16_t lockin_sin[LOCKIN_TABLE_SIZE];
+
+// Периодов опоры за луп (getValidTACSFrequency даёт целое число); 0 — выключен
+static uint32_t lockin_cycles = 0;
+static volatile uint32_t pending_cycles = 0;
+static volatile bool config_pending = false;
+
+// Скользящее окно по блокам: суммы x·sin и x·cos каждого блока
+struct LockInBlock {
+  int64_t i_sum;
+  int64_t q_sum;
+  uint32_t n;
+};
+static LockInBlock lockin_blocks[ADC_LOCKIN_MAX_BLOCKS];
+static uint32_t block_head = 0;    // Следующий блок
+static uint32_t block_count = 0;
+static int64_t window_i = 0;
+static int64_t window_q = 0;
+static uint32_t window_n = 0;
+
+// Снимок окна для читателя
+static int64_t result_i = 0;
+static int64_t result_q = 0;
+static uint32_t result_n = 0;
+static uint32_t result_cycles = 0;
+static portMUX_TYPE result_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void resetWindow() {
+  block_head = 0;
+  block_count = 0;
+  window_i = 0;
+  window_q = 0;
+  window_n = 0;
+  portENTER_CRITICAL(&result_mux);
+  result_n = 0;
+  portEXIT_CRITICAL(&result_mux);
+}
+
+void initADCLockIn() {
+  for (uint32_t k = 0; k < LOCKIN_TABLE_SIZE; k++) {
+    lockin_sin[k] = (int16_t)lroundf(32767.0f * sinf(2.0f * PI * k / LOCKIN_TABLE_SIZE));
+  }
+  resetWindow();
+}
+
+void configureADCLockIn(float freq_hz) {
+  pending_cycles = (freq_hz > 0.0f) ? (uint32_t)lroundf(freq_hz * SIGNAL_SAMPLES / SAMPLE_RATE) : 0;
+  config_pending = true;
+}
+
+void updateADCLockIn(const int16_t* block_uA, uint32_t n, uint32_t seq) {
+  if (config_pending) {
+    config_pending = false;
+    lockin_cycles = pending_cycles;
+    resetWindow();
+  }
+  if (lockin_cycles == 0 || n == 0) return;
+
+  uint32_t phase;
+  if (!getADCLoopPhase(seq, &phase)) {
+    if (window_n > 0) resetWindow();  // Без фазы лупа опоры нет
+    return;
+  }
+
+  // DDS: фаза опоры = фаза лупа × периодов в лупе, полный оборот = 2^32
+  uint32_t acc = (phase * lockin_cycles) << (32 - LOOP_BITS);
+  uint32_t inc = lockin_cycles << (32 - LOOP_BITS);
+  int64_t i_sum = 0, q_sum = 0;
+  for (uint32_t k = 0; k < n; k++) {
+    uint32_t idx = (acc + (1u << (LOCKIN_PHASE_SHIFT - 1))) >> LOCKIN_PHASE_SHIFT;
+    int32_t s = lockin_sin[idx & (LOCKIN_TABLE_SIZE - 1)];
+    int32_t c = lockin_sin[(idx + LOCKIN_TABLE_SIZE / 4) & (LOCKIN_TABLE_SIZE - 1)];
+    i_sum += (int32_t)block_uA[k] * s;
+    q_sum += (int32_t)block_uA[k] * c;
+    acc += inc;
+  }
+
+  // В окно; вытесняем старые блоки, пока без них остаётся целый луп
+  LockInBlock* b = &lockin_blocks[block_head];
+  if (block_count == ADC_LOCKIN_MAX_BLOCKS) {
+    window_i -= b->i_sum;
+    window_q -= b->q_sum;
+    window_n -= b->n;
+    block_count--;
+  }
+  b->i_sum = i_sum;
+  b->q_sum = q_sum;
+  b->n = n;
+  window_i += i_sum;
+  window_q += q_sum;
+  window_n += n;
+  block_head = (block_head + 1) % ADC_LOCKIN_MAX_BLOCKS;
+  block_count++;
+
+  for (;;) {
+    LockInBlock* oldest = &lockin_blocks[(block_head + ADC_LOCKIN_MAX_BLOCKS - block_count) % ADC_LOCKIN_MAX_BLOCKS];
+    if (window_n - oldest->n < SIGNAL_SAMPLES) break;
+    window_i -= oldest->i_sum;
+    window_q -= oldest->q_sum;
+    window_n -= oldest->n;
+    block_count--;
+  }
+
+  if (window_n >= SIGNAL_SAMPLES) {
+    portENTER_CRITICAL(&result_mux);
+    result_i = window_i;
+    result_q = window_q;
+    result_n = window_n;
+    result_cycles = lockin_cycles;
+    portEXIT_CRITICAL(&result_mux);
+  }
+}
+
+bool getADCLockIn(float* amplitude_uA, float* phase_deg) {
+  portENTER_CRITICAL(&result_mux);
+  int64_t i_sum = result_i;
+  int64_t q_sum = result_q;
+  uint32_t n = result_n;
+  portEXIT_CRITICAL(&result_mux);
+  if (n == 0) return false;
+
+  // x = A·sin(θ + φ): Σx·sin θ = N·A/2·cos φ, Σx·cos θ = N·A/2·sin φ (опора Q15)
+  float i_avg = (float)i_sum / (32767.0f * n);
+  float q_avg = (float)q_sum / (32767.0f * n);
+  if (amplitude_uA) *amplitude_uA = 2.0f * sqrtf(i_avg * i_avg + q_avg * q_avg);
+  if (phase_deg) *phase_deg = atan2f(q_avg, i_avg) * (180.0f / PI);
+  return true;
+}
+
+void printADCLockIn() {
+  float amp_uA, phase_deg;
+  if (!getADCLockIn(&amp_uA, &phase_deg)) {
+    Serial.println("[ADC] lock-in: no data");
+    return;
+  }
+  portENTER_CRITICAL(&result_mux);
+  uint32_t cycles = result_cycles;
+  portEXIT_CRITICAL(&result_mux);
+  float freq = (float)cycles * SAMPLE_RATE / SIGNAL_SAMPLES;
+
+  // Отставание тока от команды — вся цепочка DAC → VCCS → АЦП → дециматор.
+  // Перекос знака относительно модуля внутри H-моста отсюда не виден: фаза
+  // основной гармоники от него почти не зависит
+  float delay_us = -phase_deg / 360.0f / freq * 1000000.0f;
+  Serial.printf("[ADC] lock-in: %.2f Hz, %.0f uA, phase %+.2f deg, chain delay %.0f us\n",
+                freq, amp_uA, phase_deg, delay_us);
+}
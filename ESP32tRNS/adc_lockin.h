@@ -0,0 +1,33 @@
+#ifndef ADC_LOCKIN_H
+#define ADC_LOCKIN_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC LOCK-IN (амплитуда и фаза тока tACS синхронным детектированием) ===
+// ============================================================================
+// Опорный сигнал — та же синусоида, что generateTACS кладёт в signal_buffer:
+// фаза лупа сэмпла (adc_loop_average) × число периодов в лупе → фазовый
+// аккумулятор DDS, без float. Каждый сэмпл мкА умножается на sin/cos опоры
+// (Q15), суммы блока ingest идут в скользящее окно ровно в один луп: целое
+// число периодов → DC, гармоники и шум вне f подавлены точно, а не как у
+// sqrt(rms² − mean²). Результат обновляется каждый блок.
+
+// Таблица синуса (вызывается из initADC)
+void initADCLockIn();
+
+// Частота опоры (tACS: tacs_active_frequency; 0 — выключен); применит ingest
+void configureADCLockIn(float freq_hz);
+
+// Добавить блок мкА (ingest); seq — adc_sample_seq первого сэмпла
+void updateADCLockIn(const int16_t* block_uA, uint32_t n, uint32_t seq);
+
+// Амплитуда (мкА, пик) и фаза тока относительно команды (градусы, + = опережает)
+// false — окно ещё не заполнено целым лупом
+bool getADCLockIn(float* amplitude_uA, float* phase_deg);
+
+// Сводка в Serial: амплитуда, фаза и задержка тока (вся цепочка, не перекос знака)
+void printADCLockIn();
+
+#endif // ADC_LOCKIN_H
@@ -0,0 +1,179 @@
+#include "adc_loop_average.h"
+#include <esp_timer.h>
+#include <math.h>
+
+#define LOOP_MASK  (SIGNAL_SAMPLES - 1)
+static_assert(ADC_RING_SIZE == SIGNAL_SAMPLES, "ADC ring must hold exactly one DAC loop");
+static_assert((SIGNAL_SAMPLES & LOOP_MASK) == 0, "SIGNAL_SAMPLES must be a power of two");
+
+// Аккумуляторы по фазе: чётные и нечётные лупы отдельно — их разность даёт
+// шум среднего без второго прохода и без Σx² (всё так же одно сложение на сэмпл)
+static int32_t* loop_acc[2] = { NULL, NULL };
+static uint32_t acc_samples = 0;          // Сэмплов накоплено (с фазы 0, без разрывов по фазе)
+static uint32_t acc_next_phase = 0;       // Фаза следующего сэмпла в аккумулятор
+static bool acc_running = false;          // false — ждём acc_next_phase после паузы
+static volatile bool acc_reset_pending = false;
+
+// Фаза лупа: phase(seq) = (seq − loop_anchor) & LOOP_MASK
+static volatile uint32_t loop_anchor = 0;
+static volatile bool loop_locked = false;
+
+// Время последнего блока ingest (для оценки «текущего» seq из loop)
+static volatile uint32_t time_version = 0;  // Seqlock: нечётный — идёт запись
+static volatile uint32_t last_block_end_seq = 0;
+static volatile int64_t last_block_us = 0;
+
+void initADCLoopAverage() {
+  for (uint8_t k = 0; k < 2; k++) {
+    loop_acc[k] = (int32_t*)malloc(SIGNAL_SAMPLES * sizeof(int32_t));  // PSRAM
+    if (loop_acc[k] == NULL) {
+      Serial.println("[ADC] loop average alloc failed");
+      return;
+    }
+  }
+  acc_reset_pending = true;
+}
+
+void noteDACLoopStart(int32_t frames_until_play) {
+  uint32_t version, end_seq;
+  int64_t block_us;
+  do {
+    version = time_version;
+    end_seq = last_block_end_seq;
+    block_us = last_block_us;
+  } while ((version & 1) || version != time_version);
+  if (block_us == 0) return;  // ADC ещё не пишет
+  
+  // Последний сэмпл блока оцифрован примерно в момент его разбора
+  int64_t elapsed_us = esp_timer_get_time() - block_us;
+  uint32_t now_seq = end_seq + (uint32_t)(elapsed_us * ADC_SAMPLE_RATE / 1000000);
+  uint32_t measured = now_seq + frames_until_play + ADC_LOOP_LATENCY_SAMPLES;
+  
+  if (!loop_locked) {
+    loop_anchor = measured;
+    loop_locked = true;
+    acc_reset_pending = true;
+    return;
+  }
+  
+  // Ошибка фазы в [−SIGNAL_SAMPLES/2, SIGNAL_SAMPLES/2)
+  int32_t err = (int32_t)((measured - loop_anchor) & LOOP_MASK);
+  if (err >= SIGNAL_SAMPLES / 2) err -= SIGNAL_SAMPLES;
+  if (err > ADC_LOOP_RELOCK_SAMPLES || err < -ADC_LOOP_RELOCK_SAMPLES) {
+    // DAC перезапущен с начала лупа — фаза другая, среднее заново
+    Serial.printf("[ADC] loop phase relock (err %ld)\n", (long)err);
+    loop_anchor = measured;
+    acc_reset_pending = true;
+  } else {
+    // Джиттер записи в I2S (до одного DMA буфера) — сглаживаем
+    loop_anchor = loop_anchor + (err >> ADC_LOOP_TRACK_SHIFT);
+  }
+}
+
+void resetADCLoopAverage() {
+  acc_reset_pending = true;
+}
+
+void updateADCLoopAverage(const int16_t* block_uA, uint32_t n, uint32_t seq, bool coherent) {
+  time_version++;
+  __sync_synchronize();
+  last_block_end_seq = seq + n;
+  last_block_us = esp_timer_get_time();
+  __sync_synchronize();
+  time_version++;
+  
+  if (loop_acc[0] == NULL || loop_acc[1] == NULL) return;
+  if (acc_reset_pending) {
+    acc_reset_pending = false;
+    memset(loop_acc[0], 0, SIGNAL_SAMPLES * sizeof(int32_t));
+    memset(loop_acc[1], 0, SIGNAL_SAMPLES * sizeof(int32_t));
+    acc_samples = 0;
+    acc_next_phase = 0;
+    acc_running = false;
+  }
+  if (!coherent || !loop_locked) {
+    acc_running = false;  // Пауза: продолжим ровно с той же фазы
+    return;
+  }
+  
+  uint32_t i = 0;
+  if (!acc_running) {
+    uint32_t phase = (seq - loop_anchor) & LOOP_MASK;
+    i = (acc_next_phase - phase) & LOOP_MASK;
+    if (i >= n) return;
+    acc_running = true;
+  }
+  
+  // Дальше фаза идёт своим счётчиком: подстройка якоря не рвёт накопление
+  uint32_t p = acc_next_phase;
+  int32_t* acc = loop_acc[(acc_samples / SIGNAL_SAMPLES) & 1];
+  acc_samples += n - i;
+  for (; i < n; i++) {
+    acc[p] += block_uA[i];
+    p = (p + 1) & LOOP_MASK;
+    if (p == 0) acc = (acc == loop_acc[0]) ? loop_acc[1] : loop_acc[0];
+  }
+  acc_next_phase = p;
+}
+
+bool getADCLoopPhase(uint32_t seq, uint32_t* phase) {
+  if (!loop_locked) return false;
+  *phase = (seq - loop_anchor) & LOOP_MASK;
+  return true;
+}
+
+uint32_t getADCLoopAverageCount() {
+  return acc_samples / SIGNAL_SAMPLES;
+}
+
+// Сколько лупов попало в бин p: чётных и нечётных
+static void binCounts(uint32_t samples, uint32_t p, uint32_t* even, uint32_t* odd) {
+  uint32_t full = samples / SIGNAL_SAMPLES;
+  uint32_t rem = samples % SIGNAL_SAMPLES;
+  *even = (full + 1) / 2;
+  *odd = full / 2;
+  if (p < rem) {
+    if (full & 1) (*odd)++;
+    else (*even)++;
+  }
+}
+
+bool getADCLoopAverage(int16_t* out_uA, uint32_t* loops) {
+  uint32_t samples = acc_samples;
+  if (samples < SIGNAL_SAMPLES || loop_acc[0] == NULL || loop_acc[1] == NULL) return false;
+  for (uint32_t p = 0; p < SIGNAL_SAMPLES; p++) {
+    uint32_t even, odd;
+    binCounts(samples, p, &even, &odd);
+    int32_t count = (int32_t)(even + odd);
+    int32_t sum = loop_acc[0][p] + loop_acc[1][p];
+    out_uA[p] = (int16_t)((sum + ((sum < 0) ? -count / 2 : count / 2)) / count);
+  }
+  if (loops) *loops = samples / SIGNAL_SAMPLES;
+  return true;
+}
+
+void printADCLoopAverage() {
+  uint32_t samples = acc_samples;
+  uint32_t loops = samples / SIGNAL_SAMPLES;
+  if (loops < 2 || loop_acc[0] == NULL || loop_acc[1] == NULL) {
+    Serial.printf("[ADC] loop average: %lu loops (need 2+)\n", (unsigned long)loops);
+    return;
+  }
+  
+  // Шум среднего ≈ RMS(среднее чётных − среднее нечётных) / 2 при поровну лупов
+  double sum_sq_avg = 0.0, sum_sq_diff = 0.0;
+  for (uint32_t p = 0; p < SIGNAL_SAMPLES; p++) {
+    uint32_t even, odd;
+    binCounts(samples, p, &even, &odd);
+    double mean_even = (double)loop_acc[0][p] / even;
+    double mean_odd = (double)loop_acc[1][p] / odd;
+    double avg = (double)(loop_acc[0][p] + loop_acc[1][p]) / (even + odd);
+    sum_sq_avg += avg * avg;
+    sum_sq_diff += (mean_even - mean_odd) * (mean_even - mean_odd);
+  }
+  double rms_avg = sqrt(sum_sq_avg / SIGNAL_SAMPLES);
+  double noise_avg = sqrt(sum_sq_diff / SIGNAL_SAMPLES) / 2.0;
+  double noise_loop = noise_avg * sqrt((double)loops);
+  Serial.printf("[ADC] loop average: %lu loops, waveform RMS %.0f uA, noise %.1f uA/loop -> %.1f uA averaged\n",
+                (unsigned long)loops, rms_avg, noise_loop, noise_avg);
+}
@@ -0,0 +1,44 @@
+#ifndef ADC_LOOP_AVERAGE_H
+#define ADC_LOOP_AVERAGE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC LOOP AVERAGE (когерентное усреднение по DAC лупам) ===
+// ============================================================================
+// DAC крутит один и тот же луп SIGNAL_SAMPLES; ADC_RING_SIZE == SIGNAL_SAMPLES.
+// DAC отмечает начало лупа при переходе stereo_buffer_pos через 0, отсюда
+// оценивается adc_sample_seq сэмпла, на котором этот фрейм выйдет на электроды
+// (очередь I2S DMA + задержка фильтров). Оценка сглаживается от лупа к лупу.
+// В STABLE на полной амплитуде ingest прибавляет каждый сэмпл мкА в бин своей
+// фазы (одно сложение на сэмпл): среднее по N лупам — форма реального тока
+// с шумом в √N раз меньше (калибровка, контроль качества).
+
+// Выделить аккумулятор (вызывается из initADC)
+void initADCLoopAverage();
+
+// Начало лупа DAC выйдет на выход через frames_until_play фреймов (loop, из dac_control)
+void noteDACLoopStart(int32_t frames_until_play);
+
+// Добавить блок мкА (ingest); seq — adc_sample_seq первого сэмпла,
+// coherent — форма и амплитуда постоянны (STABLE, gain = 1)
+void updateADCLoopAverage(const int16_t* block_uA, uint32_t n, uint32_t seq, bool coherent);
+
+// Начать усреднение заново (новая форма сигнала); выполнит ingest
+void resetADCLoopAverage();
+
+// Фаза лупа (0..SIGNAL_SAMPLES-1) для сэмпла seq. false — фаза ещё не захвачена
+bool getADCLoopPhase(uint32_t seq, uint32_t* phase);
+
+// Число полных лупов в среднем
+uint32_t getADCLoopAverageCount();
+
+// Средний ток по фазам лупа (out — SIGNAL_SAMPLES мкА, out[0] = начало лупа)
+// false — ещё нет ни одного полного лупа
+bool getADCLoopAverage(int16_t* out_uA, uint32_t* loops);
+
+// Сводка в Serial: число лупов, RMS средней формы, шум одного лупа и после усреднения
+void printADCLoopAverage();
+
+#endif // ADC_LOOP_AVERAGE_H
@@ -0,0 +1,146 @@
+#include "adc_sign_skew.h"
+
+// TYPE1: младшие 12 бит — код, старшие 4 — канал
+#define TYPE1_DATA(w)     ((w) & 0x0FFF)
+#define TYPE1_CHANNEL(w)  ((w) >> 12)
+
+#define MAG_OFFSET_Q8 128  // Модуль — вторая конверсия пары: на полпары позже знака
+
+enum SkewDipState : uint8_t {
+  DIP_IDLE = 0,     // Модуль ещё не поднимался до 2 × level
+  DIP_ARMED = 1,    // Выше 2 × level — ждём спада
+  DIP_LOW = 2,      // Ниже level
+  DIP_RISING = 3    // Снова ≥ level, ждём 2 × level (или шум — обратно в LOW)
+};
+
+void initAdcSignSkew(AdcSignSkew* sk, uint8_t sign_channel, uint8_t mag_channel,
+                     uint16_t sign_threshold, uint16_t level_code,
+                     uint16_t max_dip_pairs, uint16_t window_pairs) {
+  sk->sign_channel = sign_channel;
+  sk->mag_channel = mag_channel;
+  sk->sign_threshold = sign_threshold;
+  sk->level_code = (level_code > 0) ? level_code : 1;
+  sk->max_dip_pairs = max_dip_pairs;
+  sk->window_pairs = window_pairs;
+  sk->sum_q8 = 0;
+  sk->sum_sq_q16 = 0;
+  sk->count = 0;
+  sk->rejected = 0;
+  sk->pair = 0;
+  resetAdcSignSkewStream(sk);
+}
+
+void resetAdcSignSkewStream(AdcSignSkew* sk) {
+  sk->has_sign = false;
+  sk->sign_value = 0;
+  sk->has_prev = false;
+  sk->prev_sign = 0;
+  sk->prev_mag = 0;
+  sk->dip_state = DIP_IDLE;
+  sk->fall_q8 = 0;
+  sk->rise_q8 = 0;
+  sk->dip_pending = false;
+  sk->edge_head = 0;
+  sk->edge_count = 0;
+}
+
+// Провал закончен: ровно одна смена знака в [lo, hi] — засчитываем перекос
+static void finishDip(AdcSignSkew* sk) {
+  sk->dip_pending = false;
+  uint32_t found = 0;
+  uint32_t edge = 0;
+  for (uint8_t k = 0; k < sk->edge_count; k++) {
+    uint32_t e = sk->edge_q8[(uint8_t)(sk->edge_head - 1 - k) & 3];
+    if ((int32_t)(e - sk->dip_lo_q8) >= 0 && (int32_t)(sk->dip_hi_q8 - e) >= 0) {
+      found++;
+      edge = e;
+    }
+  }
+  if (found != 1) {
+    sk->rejected++;
+    return;
+  }
+  int32_t d = (int32_t)(edge - sk->dip_center_q8);
+  sk->sum_q8 += d;
+  sk->sum_sq_q16 += (uint64_t)((int64_t)d * d);
+  sk->count++;
+}
+
+void scanAdcSignSkewFrame(AdcSignSkew* sk, const uint8_t* data, uint32_t conv_count) {
+  const uint8_t sign_ch = sk->sign_channel;
+  const uint8_t mag_ch = sk->mag_channel;
+  const int32_t threshold = sk->sign_threshold;
+  const int32_t level = sk->level_code;
+  const int32_t armed = 2 * level;
+  const uint32_t max_dip_q8 = (uint32_t)sk->max_dip_pairs << 8;
+  const uint32_t window_q8 = (uint32_t)sk->window_pairs << 8;
+
+  for (uint32_t i = 0; i < conv_count; i++) {
+    uint16_t w = (uint16_t)(data[2 * i] | (data[2 * i + 1] << 8));
+    uint8_t ch = TYPE1_CHANNEL(w);
+    int32_t code = TYPE1_DATA(w);
+    if (ch == sign_ch) {
+      sk->sign_value = (uint16_t)code;
+      sk->has_sign = true;
+      continue;
+    }
+    if (ch != mag_ch || !sk->has_sign) continue;
+    sk->has_sign = false;
+
+    const int32_t s = sk->sign_value;
+    const int32_t m = code;
+    const uint32_t t_sign = ++sk->pair << 8;
+    const uint32_t t_mag = t_sign + MAG_OFFSET_Q8;
+    if (!sk->has_prev) {
+      sk->has_prev = true;
+      sk->prev_sign = (uint16_t)s;
+      sk->prev_mag = (uint16_t)m;
+      continue;
+    }
+    const int32_t s0 = sk->prev_sign;
+    const int32_t m0 = sk->prev_mag;
+    sk->prev_sign = (uint16_t)s;
+    sk->prev_mag = (uint16_t)m;
+
+    // Смена знака: момент пересечения порога между парами
+    if ((s > threshold) != (s0 > threshold)) {
+      uint32_t frac = (uint32_t)(((threshold - s0) << 8) / (s - s0));
+      sk->edge_q8[sk->edge_head & 3] = t_sign - 256 + frac;
+      sk->edge_head++;
+      if (sk->edge_count < 4) sk->edge_count++;
+    }
+    if (sk->dip_pending && (int32_t)(t_sign - sk->dip_hi_q8) > 0) finishDip(sk);
+
+    // Провал модуля: спад ниже level и подъём обратно, середина — минимум
+    switch (sk->dip_state) {
+      case DIP_IDLE:
+        if (m >= armed) sk->dip_state = DIP_ARMED;
+        break;
+      case DIP_ARMED:
+        if (m < level) {
+          sk->fall_q8 = t_mag - 256 + (uint32_t)(((m0 - level) << 8) / (m0 - m));
+          sk->dip_state = DIP_LOW;
+        }
+        break;
+      case DIP_LOW:
+      case DIP_RISING:
+        if ((t_mag - sk->fall_q8) > max_dip_q8) {
+          sk->dip_state = DIP_IDLE;  // Долго у нуля — пауза, не переход
+        } else if (m < level) {
+          sk->dip_state = DIP_LOW;   // Шум на подъёме: ждём следующего пересечения
+        } else if (sk->dip_state == DIP_LOW) {
+          sk->rise_q8 = t_mag - 256 + (uint32_t)(((level - m0) << 8) / (m - m0));
+          sk->dip_state = DIP_RISING;
+        }
+        if (sk->dip_state == DIP_RISING && m >= armed) {
+          if (sk->dip_pending) finishDip(sk);  // Провалы теснее окна: прежний — с тем, что есть
+          sk->dip_center_q8 = sk->fall_q8 + (sk->rise_q8 - sk->fall_q8) / 2;
+          sk->dip_lo_q8 = sk->fall_q8 - window_q8;
+          sk->dip_hi_q8 = sk->rise_q8 + window_q8;
+          sk->dip_pending = true;
+          sk->dip_state = DIP_ARMED;
+        }
+        break;
+    }
+  }
+}
@@ -0,0 +1,65 @@
+#ifndef ADC_SIGN_SKEW_H
+#define ADC_SIGN_SKEW_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// === ADC SIGN SKEW (перекос знака H-моста относительно модуля, по сырым парам) ===
+// ============================================================================
+// Прямой замер того, что компенсирует задержка канала знака DAC: в каждом
+// переходе тока через ноль сравниваются
+//  - момент смены знака на канале знака (порог sign_threshold, линейная
+//    интерполяция между соседними парами);
+//  - минимум модуля: середина между спадом ниже level_code и подъёмом обратно
+//    (V у нуля симметрична, так что середина — минимум без подгонки).
+// Переход засчитывается, только если в окне провала (± window_pairs) ровно
+// одна смена знака: касания нуля без смены знака (tRNS) и дребезг компаратора
+// отбрасываются. Модуль оцифрован на полпары позже знака — это учтено.
+// Времена в парах Q8; перекос = знак − минимум (+ = знак отстаёт).
+// Как adc_trip и adc_frame_parser, модуль не зависит от Arduino/IDF: на хосте
+// его гоняют по синтетике с известным перекосом.
+
+struct AdcSignSkew {
+  uint8_t sign_channel;       // Каналы и порог знака — как у парсера
+  uint8_t mag_channel;
+  uint16_t sign_threshold;
+  uint16_t level_code;        // Провал модуля: ниже level, вооружение — от 2 × level
+  uint16_t max_dip_pairs;     // Провал дольше — пауза, а не переход через ноль
+  uint16_t window_pairs;      // Смена знака ищется в [спад − окно, подъём + окно]
+  // Состояние между фреймами
+  bool has_sign;
+  uint16_t sign_value;
+  bool has_prev;              // Есть предыдущая пара (для интерполяции)
+  uint16_t prev_sign;
+  uint16_t prev_mag;
+  uint32_t pair;              // Номер пары (по модулю 2^32)
+  uint8_t dip_state;
+  uint32_t fall_q8;           // Спад ниже level
+  uint32_t rise_q8;           // Подъём до level (кандидат)
+  bool dip_pending;           // Провал закончен, ждём смен знака до hi
+  uint32_t dip_center_q8;
+  uint32_t dip_lo_q8;
+  uint32_t dip_hi_q8;
+  uint32_t edge_q8[4];        // Последние смены знака
+  uint8_t edge_head;
+  uint8_t edge_count;
+  // Накопление (забирает вызывающий)
+  int64_t sum_q8;
+  uint64_t sum_sq_q16;
+  uint32_t count;             // Засчитанных переходов
+  uint32_t rejected;          // Провалов без единственной смены знака
+};
+
+// Каналы, порог знака и параметры провала; накопление пустое
+void initAdcSignSkew(AdcSignSkew* sk, uint8_t sign_channel, uint8_t mag_channel,
+                     uint16_t sign_threshold, uint16_t level_code,
+                     uint16_t max_dip_pairs, uint16_t window_pairs);
+
+// Сброс состояния между фреймами (разрыв потока: пауза, смена R); накопление не трогается
+void resetAdcSignSkewStream(AdcSignSkew* sk);
+
+// Разобрать фрейм из conv_count конверсий (TYPE1)
+void scanAdcSignSkewFrame(AdcSignSkew* sk, const uint8_t* data, uint32_t conv_count);
+
+#endif // ADC_SIGN_SKEW_H
@@ -0,0 +1,249 @@
+#include "adc_spectrum.h"
+#include "adc_loop_average.h"
+#include "adc_fft.h"
+#include "dac_control.h"
+#include "session_control.h"
+#include <esp_timer.h>
+#include <math.h>
+
+#define FFT_REAL_N     ADC_FFT_SIZE            // 16384 вещественных сэмпла
+#define FFT_N          (FFT_REAL_N / 2)        // Бин Найквиста
+#define FFT_BINS       ADC_FFT_BINS
+#define FFT_BIN_SLICE  2048                    // Бинов за один срез расчёта мощности
+
+// Рабочий буфер FFT: FFT_N комплексных int32 (re, im подряд = сэмплы подряд)
+static int32_t* fft_buf = NULL;
+// Мощность по бинам 0..Найквист (односторонняя, с учётом парных бинов)
+static float* meas_power = NULL;
+static float* cmd_power = NULL;     // Нормирована: Σ = 1
+static float cmd_band_pct = 0.0f;
+static volatile bool cmd_dirty = true;
+static volatile uint32_t reference_gen = 0;  // Растёт при смене формы: отчёт по старой отбрасывается
+
+// Снимок лупа: задача запрашивает, ingest заполняет fft_buf
+enum SpectrumCapture : uint8_t {
+  CAPTURE_IDLE = 0,
+  CAPTURE_REQUESTED,   // Ждём фазу 0 лупа
+  CAPTURE_RUNNING,     // Копируем
+  CAPTURE_DONE         // fft_buf принадлежит задаче
+};
+static volatile uint8_t capture_state = CAPTURE_IDLE;
+static uint32_t capture_count = 0;
+
+static AdcSpectrumReport spectrum_report;
+static portMUX_TYPE report_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t spectrum_task_handle = NULL;
+
+// Учёт времени расчёта
+static uint32_t run_cpu_us = 0;
+static uint32_t run_max_slice_us = 0;
+static int64_t slice_start_us = 0;
+
+// Конец среза: учёт времени, уступаем CPU loop()
+static void sliceEnd() {
+  uint32_t dt = (uint32_t)(esp_timer_get_time() - slice_start_us);
+  run_cpu_us += dt;
+  if (dt > run_max_slice_us) run_max_slice_us = dt;
+  vTaskDelay(1);
+  slice_start_us = esp_timer_get_time();
+}
+
+// === FFT ===
+
+// FFT уже упакованного fft_buf → односторонняя мощность по бинам (в единицах |X|²)
+static void computePower(float* power) {
+  adcFFTReal(fft_buf, sliceEnd);
+  for (uint32_t k = 0; k <= FFT_N; k++) {
+    int64_t re, im;
+    adcFFTBin(fft_buf, k, &re, &im);
+    float fr = (float)re, fi = (float)im;
+    float p = 0.25f * (fr * fr + fi * fi);
+    power[k] = (k == 0 || k == FFT_N) ? p : 2.0f * p;  // Бин k и N−k
+    if ((k & (FFT_BIN_SLICE - 1)) == FFT_BIN_SLICE - 1) sliceEnd();
+  }
+  sliceEnd();
+}
+
+// === ПОЛОСА РЕЖИМА ===
+
+static void modeBand(float* lo_hz, float* hi_hz) {
+  if (session_mode == MODE_TACS) {
+    *lo_hz = max(0.0f, tacs_active_frequency - SPECTRUM_TACS_HALF_BW_HZ);
+    *hi_hz = tacs_active_frequency + SPECTRUM_TACS_HALF_BW_HZ;
+  } else if (session_mode == MODE_TDCS) {
+    *lo_hz = 0.0f;  // Полезное — только DC
+    *hi_hz = 0.0f;
+  } else {
+    *lo_hz = SPECTRUM_TRNS_LO_HZ;
+    *hi_hz = SPECTRUM_TRNS_HI_HZ;
+  }
+}
+
+static inline uint32_t hzToBin(float hz) {
+  uint32_t k = (uint32_t)(hz * FFT_REAL_N / SAMPLE_RATE + 0.5f);
+  return (k > FFT_N) ? FFT_N : k;
+}
+
+// Доля мощности в бинах [lo, hi], %; *total — полная мощность
+static float bandPercent(const float* power, uint32_t lo, uint32_t hi, float* total) {
+  float sum = 0.0f, band = 0.0f;
+  for (uint32_t k = 0; k <= FFT_N; k++) {
+    sum += power[k];
+    if (k >= lo && k <= hi) band += power[k];
+  }
+  *total = sum;
+  return (sum > 0.0f) ? 100.0f * band / sum : 0.0f;
+}
+
+// === ФОНОВАЯ ЗАДАЧА ===
+
+static void spectrumTask(void* arg) {
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(SPECTRUM_PERIOD_MS));
+    if (current_state != STATE_STABLE) continue;
+
+    uint32_t gen = reference_gen;
+    // Снимок одного лупа: ingest заполняет fft_buf за SIGNAL_SAMPLES / SAMPLE_RATE ≈ 2 с
+    capture_state = CAPTURE_REQUESTED;
+    while (capture_state == CAPTURE_REQUESTED || capture_state == CAPTURE_RUNNING) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+    }
+    if (capture_state != CAPTURE_DONE) continue;  // Сорван: вышли из STABLE или сменили форму
+
+    run_cpu_us = 0;
+    run_max_slice_us = 0;
+    slice_start_us = esp_timer_get_time();
+
+    float lo_hz, hi_hz;
+    modeBand(&lo_hz, &hi_hz);
+    uint32_t lo = hzToBin(lo_hz);
+    uint32_t hi = hzToBin(hi_hz);
+
+    // DC: 2·X[0] = 2·Σ сэмплов
+    int64_t dc_re, dc_im;
+    computePower(meas_power);
+    adcFFTBin(fft_buf, 0, &dc_re, &dc_im);
+    float total;
+    float band_pct = bandPercent(meas_power, lo, hi, &total);
+
+    // Эталон команды: тот же FFT по signal_buffer (fft_buf уже свободен)
+    if (cmd_dirty) {
+      cmd_dirty = false;
+      for (uint32_t i = 0; i < FFT_REAL_N; i++) fft_buf[i] = signal_buffer[i];
+      computePower(cmd_power);
+      float cmd_total;
+      cmd_band_pct = bandPercent(cmd_power, lo, hi, &cmd_total);
+      float inv = (cmd_total > 0.0f) ? 1.0f / cmd_total : 0.0f;
+      for (uint32_t k = 0; k <= FFT_N; k++) cmd_power[k] *= inv;
+    }
+
+    // Расхождение формы: ½·Σ|p_изм − p_ком| по нормированным спектрам
+    float shape = 0.0f;
+    float inv = (total > 0.0f) ? 1.0f / total : 0.0f;
+    for (uint32_t k = 0; k <= FFT_N; k++) {
+      shape += fabsf(meas_power[k] * inv - cmd_power[k]);
+    }
+    sliceEnd();
+    if (gen != reference_gen) {
+      capture_state = CAPTURE_IDLE;
+      continue;  // Форма сменилась во время расчёта
+    }
+
+    AdcSpectrumReport r;
+    portENTER_CRITICAL(&report_mux);
+    r = spectrum_report;
+    portEXIT_CRITICAL(&report_mux);
+    r.valid = true;
+    r.runs++;
+    r.band_lo_hz = lo_hz;
+    r.band_hi_hz = hi_hz;
+    r.dc_uA = (float)dc_re * 0.5f / FFT_REAL_N;
+    r.ac_rms_uA = sqrtf(max(0.0f, total - meas_power[0])) / FFT_REAL_N;
+    r.band_pct = band_pct;
+    r.leak_pct = (total > 0.0f) ? 100.0f - band_pct : 0.0f;
+    r.cmd_band_pct = cmd_band_pct;
+    r.shape_error = 0.5f * shape;
+    r.cpu_us = run_cpu_us;
+    r.max_slice_us = run_max_slice_us;
+    portENTER_CRITICAL(&report_mux);
+    spectrum_report = r;
+    portEXIT_CRITICAL(&report_mux);
+    capture_state = CAPTURE_IDLE;
+  }
+}
+
+// === ПУБЛИЧНЫЕ ФУНКЦИИ ===
+
+void initADCSpectrum() {
+  fft_buf = (int32_t*)malloc(FFT_REAL_N * sizeof(int32_t));       // PSRAM
+  meas_power = (float*)malloc(FFT_BINS * sizeof(float));
+  cmd_power = (float*)malloc(FFT_BINS * sizeof(float));
+  if (!initADCFFT() || !fft_buf || !meas_power || !cmd_power) {
+    Serial.println("[ADC] spectrum alloc failed, spectral check disabled");
+    return;
+  }
+  memset(&spectrum_report, 0, sizeof(spectrum_report));
+
+  xTaskCreate(spectrumTask, "adc_spectrum", 4096, NULL, SPECTRUM_TASK_PRIORITY, &spectrum_task_handle);
+}
+
+void updateADCSpectrumCapture(const int16_t* block_uA, uint32_t n, uint32_t seq, bool coherent) {
+  uint8_t state = capture_state;
+  if (state != CAPTURE_REQUESTED && state != CAPTURE_RUNNING) return;
+  if (!coherent) {
+    capture_state = CAPTURE_IDLE;  // Амплитуда меняется — снимок не сравним с командой
+    return;
+  }
+
+  uint32_t i = 0;
+  if (state == CAPTURE_REQUESTED) {
+    // Начинаем с фазы 0 лупа; без захвата фазы — с любого сэмпла
+    // (целый луп периодичен, растекания нет — сдвигается только фаза бинов)
+    uint32_t phase;
+    if (getADCLoopPhase(seq, &phase) && phase != 0) {
+      i = SIGNAL_SAMPLES - phase;
+      if (i >= n) return;
+    }
+    capture_count = 0;
+    capture_state = CAPTURE_RUNNING;
+  }
+
+  for (; i < n && capture_count < FFT_REAL_N; i++) {
+    fft_buf[capture_count++] = block_uA[i];
+  }
+  if (capture_count >= FFT_REAL_N) {
+    capture_state = CAPTURE_DONE;
+  }
+}
+
+void resetADCSpectrumReference() {
+  cmd_dirty = true;
+  reference_gen++;
+  // Незавершённый снимок относится к старой форме
+  if (capture_state == CAPTURE_REQUESTED || capture_state == CAPTURE_RUNNING) {
+    capture_state = CAPTURE_IDLE;
+  }
+  portENTER_CRITICAL(&report_mux);
+  spectrum_report.valid = false;
+  portEXIT_CRITICAL(&report_mux);
+}
+
+void getADCSpectrumReport(AdcSpectrumReport* report) {
+  portENTER_CRITICAL(&report_mux);
+  *report = spectrum_report;
+  portEXIT_CRITICAL(&report_mux);
+}
+
+void printADCSpectrum() {
+  AdcSpectrumReport r;
+  getADCSpectrumReport(&r);
+  if (!r.valid) {
+    Serial.printf("[ADC] spectrum: no data (%lu runs)\n", (unsigned long)r.runs);
+    return;
+  }
+  Serial.printf("[ADC] spectrum: band %.0f-%.0f Hz %.1f%% (cmd %.1f%%), leak %.1f%%, DC %.0f uA, AC RMS %.0f uA, shape err %.3f\n",
+                r.band_lo_hz, r.band_hi_hz, r.band_pct, r.cmd_band_pct, r.leak_pct,
+                r.dc_uA, r.ac_rms_uA, r.shape_error);
+  Serial.printf("[ADC] spectrum: %lu runs, cpu %.1f ms, max slice %.1f ms\n",
+                (unsigned long)r.runs, r.cpu_us / 1000.0f, r.max_slice_us / 1000.0f);
+}
@@ -0,0 +1,48 @@
+#ifndef ADC_SPECTRUM_H
+#define ADC_SPECTRUM_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC SPECTRUM (фоновый FFT доставленного тока по одному DAC лупу) ===
+// ============================================================================
+// Раз в SPECTRUM_PERIOD_MS в STABLE ingest снимает ровно SIGNAL_SAMPLES сэмплов
+// мкА, начиная с фазы 0 лупа (adc_loop_average). Сигнал периодичен с лупом →
+// прямоугольное окно без растекания спектра. Фоновая задача считает
+// 16384-точечный вещественный FFT в целых (adc_fft) по стадиям с уступкой
+// CPU между ними. Тот же FFT по signal_buffer — эталон команды.
+// Итог: доля мощности в полосе режима, утечка вне полосы, DC, расхождение
+// формы спектра с командой, время расчёта (суммарное и худшая стадия).
+
+struct AdcSpectrumReport {
+  bool valid;               // Есть хотя бы один расчёт
+  uint32_t runs;            // Расчётов с начала сеанса
+  float band_lo_hz;         // Полоса режима
+  float band_hi_hz;
+  float dc_uA;              // Постоянная составляющая
+  float ac_rms_uA;          // RMS без DC
+  float band_pct;           // Доля AC мощности в полосе, %
+  float leak_pct;           // Вне полосы, %
+  float cmd_band_pct;       // То же для команды (signal_buffer)
+  float shape_error;        // Полное расхождение нормированных спектров (0 — совпадают, 1 — не пересекаются)
+  uint32_t cpu_us;          // CPU время последнего расчёта (сумма стадий)
+  uint32_t max_slice_us;    // Худшая стадия: столько loop() мог ждать подряд
+};
+
+// Выделить буферы и запустить фоновую задачу
+void initADCSpectrum();
+
+// Ingest: снимок лупа (копирует блок, пока идёт захват); coherent — как у усреднения
+void updateADCSpectrumCapture(const int16_t* block_uA, uint32_t n, uint32_t seq, bool coherent);
+
+// Новая форма сигнала: пересчитать эталонный спектр команды, сбросить отчёт
+void resetADCSpectrumReference();
+
+// Последний отчёт (копия)
+void getADCSpectrumReport(AdcSpectrumReport* report);
+
+// Отчёт в Serial
+void printADCSpectrum();
+
+#endif // ADC_SPECTRUM_H
@@ -0,0 +1,204 @@
+#include "adc_transfer.h"
+#include "adc_fft.h"
+#include "adc_loop_average.h"
+#include "dac_control.h"
+#include "session_control.h"
+#include <esp_timer.h>
+#include <math.h>
+
+#define TF_HALF       (ADC_FFT_SIZE / 2)   // Бин Найквиста
+#define TF_BIN_SLICE  1024                 // Бинов между уступками CPU
+
+static int16_t* avg_uA = NULL;       // Среднее по лупам (мкА)
+static int32_t* fft_cmd = NULL;      // Спектр команды (упакованный)
+static int32_t* fft_meas = NULL;     // Спектр тока (упакованный)
+
+static AdcTransferReport tf_report;
+static portMUX_TYPE tf_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t tf_task_handle = NULL;
+static volatile uint32_t tf_gen = 0;  // Растёт при смене формы
+
+static void tfYield() {
+  vTaskDelay(1);
+}
+
+// Взаимный спектр в бине k: Sxx = |X|², Sxy = X*·Y (удвоенные бины → ×4, общий множитель)
+static inline void crossBin(uint32_t k, float* sxx, float* sxy_re, float* sxy_im) {
+  int64_t xr, xi, yr, yi;
+  adcFFTBin(fft_cmd, k, &xr, &xi);
+  adcFFTBin(fft_meas, k, &yr, &yi);
+  float fxr = (float)xr, fxi = (float)xi, fyr = (float)yr, fyi = (float)yi;
+  *sxx = fxr * fxr + fxi * fxi;
+  *sxy_re = fxr * fyr + fxi * fyi;
+  *sxy_im = fxr * fyi - fxi * fyr;
+}
+
+static void publish(const AdcTransferReport* r, uint32_t gen) {
+  portENTER_CRITICAL(&tf_mux);
+  if (gen == tf_gen) tf_report = *r;
+  portEXIT_CRITICAL(&tf_mux);
+}
+
+static void runEstimate(uint32_t gen) {
+  int64_t t0 = esp_timer_get_time();
+  uint32_t loops;
+  if (!getADCLoopAverage(avg_uA, &loops)) return;
+  float uA_per_code = getAmplitudeScale() * 1000.0f / current_settings.dac_code_to_mA;
+  if (!(uA_per_code > 0.0f)) return;
+
+  for (uint32_t i = 0; i < ADC_FFT_SIZE; i++) {
+    fft_cmd[i] = signal_buffer[i];
+    fft_meas[i] = avg_uA[i];
+  }
+  tfYield();
+  adcFFTReal(fft_cmd, tfYield);
+  adcFFTReal(fft_meas, tfYield);
+  if (gen != tf_gen) return;  // Форма сменилась — signal_buffer уже другой
+
+  AdcTransferReport r;
+  memset(&r, 0, sizeof(r));
+  r.loops = loops;
+
+  if (session_mode == MODE_TDCS) {
+    // Только DC: H(0) = Y[0] / X[0]
+    int64_t xr, xi, yr, yi;
+    adcFFTBin(fft_cmd, 0, &xr, &xi);
+    adcFFTBin(fft_meas, 0, &yr, &yi);
+    if (xr == 0) return;
+    r.gain = (float)yr / (float)xr / uA_per_code;
+    r.bins = 1;
+  } else {
+    // Проход 1: порог по мощности команды
+    float max_sxx = 0.0f;
+    for (uint32_t k = 1; k < TF_HALF; k++) {
+      int64_t xr, xi;
+      adcFFTBin(fft_cmd, k, &xr, &xi);
+      float p = (float)xr * (float)xr + (float)xi * (float)xi;
+      if (p > max_sxx) max_sxx = p;
+      if ((k & (TF_BIN_SLICE - 1)) == 0) tfYield();
+    }
+    if (max_sxx <= 0.0f) return;
+    float min_sxx = max_sxx * ADC_TF_MIN_REL_POWER;
+
+    // Проход 2: φ(k) = −2π·k·τ/N, МНК через 0 с весом |X|²
+    // (фаза без развёртки: |τ| < N / (2·k_max) сэмплов, для 640 Гц ≈ 780 мкс)
+    double num = 0.0, den = 0.0;
+    float band_sxx[ADC_TF_BANDS] = { 0 };
+    float band_re[ADC_TF_BANDS] = { 0 };
+    float band_im[ADC_TF_BANDS] = { 0 };
+    for (uint32_t k = 1; k < TF_HALF; k++) {
+      float sxx, sre, sim;
+      crossBin(k, &sxx, &sre, &sim);
+      if (sxx >= min_sxx) {
+        float phi = atan2f(sim, sre);
+        num += (double)sxx * k * phi;
+        den += (double)sxx * k * k;
+        r.bins++;
+        uint32_t band = (uint32_t)((float)k * SAMPLE_RATE / ADC_FFT_SIZE / ADC_TF_BAND_HZ);
+        if (band < ADC_TF_BANDS) {
+          band_sxx[band] += sxx;
+          band_re[band] += sre;
+          band_im[band] += sim;
+        }
+      }
+      if ((k & (TF_BIN_SLICE - 1)) == 0) tfYield();
+    }
+    if (den <= 0.0) return;
+    float tau = (float)(-num / den * ADC_FFT_SIZE / (2.0 * PI));  // Сэмплы
+    r.delay_us = tau * 1000000.0f / SAMPLE_RATE;
+    r.has_delay = true;
+
+    // Проход 3: усиление после снятия задержки
+    double g_num = 0.0, g_den = 0.0;
+    for (uint32_t k = 1; k < TF_HALF; k++) {
+      float sxx, sre, sim;
+      crossBin(k, &sxx, &sre, &sim);
+      if (sxx >= min_sxx) {
+        float w = 2.0f * PI * k * tau / ADC_FFT_SIZE;
+        g_num += sre * cosf(w) - sim * sinf(w);
+        g_den += sxx;
+      }
+      if ((k & (TF_BIN_SLICE - 1)) == 0) tfYield();
+    }
+    r.gain = (float)(g_num / g_den) / uA_per_code;
+
+    for (uint8_t b = 0; b < ADC_TF_BANDS; b++) {
+      if (band_sxx[b] <= 0.0f) continue;
+      r.band_gain[b] = sqrtf(band_re[b] * band_re[b] + band_im[b] * band_im[b]) / band_sxx[b] / uA_per_code;
+      r.band_phase_deg[b] = atan2f(band_im[b], band_re[b]) * (180.0f / PI);
+    }
+  }
+
+  r.valid = true;
+  r.cpu_us = (uint32_t)(esp_timer_get_time() - t0);
+  publish(&r, gen);
+}
+
+static void transferTask(void* arg) {
+  uint32_t last_loops = 0;
+  uint32_t last_gen = tf_gen;
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(ADC_TF_PERIOD_MS));
+    uint32_t gen = tf_gen;
+    if (gen != last_gen) {
+      last_gen = gen;
+      last_loops = 0;
+    }
+    if (current_state != STATE_STABLE) continue;
+    uint32_t loops = getADCLoopAverageCount();
+    if (loops < ADC_TF_MIN_LOOPS || loops == last_loops) continue;
+    last_loops = loops;
+    runEstimate(gen);
+  }
+}
+
+// === ПУБЛИЧНЫЕ ФУНКЦИИ ===
+
+void initADCTransfer() {
+  avg_uA = (int16_t*)malloc(ADC_FFT_SIZE * sizeof(int16_t));    // PSRAM
+  fft_cmd = (int32_t*)malloc(ADC_FFT_SIZE * sizeof(int32_t));
+  fft_meas = (int32_t*)malloc(ADC_FFT_SIZE * sizeof(int32_t));
+  if (!initADCFFT() || !avg_uA || !fft_cmd || !fft_meas) {
+    Serial.println("[ADC] transfer alloc failed");
+    return;
+  }
+  memset(&tf_report, 0, sizeof(tf_report));
+
+  xTaskCreate(transferTask, "adc_transfer", 4096, NULL, SPECTRUM_TASK_PRIORITY, &tf_task_handle);
+}
+
+void resetADCTransfer() {
+  portENTER_CRITICAL(&tf_mux);
+  tf_gen++;
+  tf_report.valid = false;
+  portEXIT_CRITICAL(&tf_mux);
+}
+
+void getADCTransferReport(AdcTransferReport* report) {
+  portENTER_CRITICAL(&tf_mux);
+  *report = tf_report;
+  portEXIT_CRITICAL(&tf_mux);
+}
+
+void printADCTransfer() {
+  AdcTransferReport r;
+  getADCTransferReport(&r);
+  if (!r.valid) {
+    Serial.println("[ADC] transfer: no data");
+    return;
+  }
+  if (r.has_delay) {
+    Serial.printf("[ADC] transfer: %lu loops, %u bins, gain %.3f, chain delay %.1f us (sign delay %.1f us), %.0f ms\n",
+                  (unsigned long)r.loops, (unsigned)r.bins, r.gain, r.delay_us, getDACSignDelay(),
+                  r.cpu_us / 1000.0f);
+  } else {
+    Serial.printf("[ADC] transfer: %lu loops, DC gain %.3f, %.0f ms\n",
+                  (unsigned long)r.loops, r.gain, r.cpu_us / 1000.0f);
+  }
+  for (uint8_t b = 0; b < ADC_TF_BANDS; b++) {
+    if (r.band_gain[b] <= 0.0f) continue;
+    Serial.printf("[ADC] transfer %u-%u Hz: |H| %.3f, %+.1f deg\n",
+                  (unsigned)(b * ADC_TF_BAND_HZ), (unsigned)((b + 1) * ADC_TF_BAND_HZ),
+                  r.band_gain[b], r.band_phase_deg[b]);
+  }
+}
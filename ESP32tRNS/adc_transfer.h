@@ -0,0 +1,44 @@
+#ifndef ADC_TRANSFER_H
+#define ADC_TRANSFER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC TRANSFER (передаточная функция VCCS/H-моста и задержка знака) ===
+// ============================================================================
+// Фоновая задача сравнивает команду (signal_buffer) с когерентным средним тока
+// по лупам (adc_loop_average, фаза 0 = начало лупа): оба через FFT в целых
+// (adc_fft), затем взаимный спектр Sxy = X*·Y по бинам, где команда несёт
+// мощность. Наклон фазы Sxy по частоте (взвешенный МНК) — групповая задержка
+// с долей сэмпла, Σ Re(Sxy·e^(jωτ)) / Σ|X|² — усиление относительно ожидаемого
+// (amplitude_scale / dac_code_to_mA), по полосам — АЧХ и ФЧХ.
+// Задержка — вся цепочка (DAC, VCCS, АЦП, дециматор, оценщик) и только в отчёт:
+// перекос знака и модуля внутри H-моста отсюда не виден, его меряет по сырым
+// парам adc_sign_skew. tDCS: возбуждения нет, только усиление по DC.
+
+struct AdcTransferReport {
+  bool valid;                          // Есть оценка для текущей формы
+  bool has_delay;                      // Задержка измерена (есть AC возбуждение)
+  uint32_t loops;                      // Лупов в среднем на момент оценки
+  uint16_t bins;                       // Бинов в оценке
+  float delay_us;                      // Групповая задержка тока (+ = отстаёт)
+  float gain;                          // Измеренный / ожидаемый ток (1.0 = точно)
+  float band_gain[ADC_TF_BANDS];       // |H| по полосам ADC_TF_BAND_HZ (0 — нет бинов)
+  float band_phase_deg[ADC_TF_BANDS];  // arg H по полосам
+  uint32_t cpu_us;                     // Время расчёта
+};
+
+// Выделить буферы и запустить фоновую задачу
+void initADCTransfer();
+
+// Новая форма сигнала: прежние оценки не сравнимы
+void resetADCTransfer();
+
+// Последний отчёт (копия)
+void getADCTransferReport(AdcTransferReport* report);
+
+// Отчёт в Serial
+void printADCTransfer();
+
+#endif // ADC_TRANSFER_H
@@ -0,0 +1,114 @@
+#include "adc_trip.h"
+
+// Вызывается из ISR: на ESP32 код в IRAM (работает и при отключённом кэше flash)
+#if defined(ESP_PLATFORM)
+#include <esp_attr.h>
+#define TRIP_ISR_ATTR IRAM_ATTR
+#else
+#define TRIP_ISR_ATTR
+#endif
+
+// TYPE1: младшие 12 бит — код, старшие 4 — канал
+#define TYPE1_DATA(w)     ((w) & 0x0FFF)
+#define TYPE1_CHANNEL(w)  ((w) >> 12)
+
+void initAdcTripDetector(AdcTripDetector* det, uint8_t sign_channel, uint8_t mag_channel,
+                         uint16_t sign_threshold) {
+  det->sign_channel = sign_channel;
+  det->mag_channel = mag_channel;
+  det->sign_threshold = sign_threshold;
+  configureAdcTripDetector(det, 0, 1, 0, 1);
+}
+
+void TRIP_ISR_ATTR configureAdcTripDetector(AdcTripDetector* det, uint16_t mag_trip_code, uint16_t confirm_pairs,
+                              uint16_t dc_limit_code, uint32_t dc_window_pairs) {
+  det->mag_trip_code = mag_trip_code;
+  det->confirm_pairs = (confirm_pairs > 0) ? confirm_pairs : 1;
+  det->dc_limit_code = dc_limit_code;
+  det->dc_window_pairs = (dc_window_pairs > 0) ? dc_window_pairs : 1;
+  det->has_sign = false;
+  det->sign_value = 0;
+  det->over_run = 0;
+  det->dc_sum = 0;
+  det->dc_count = 0;
+  det->reason = ADC_TRIP_NONE;
+  det->trip_code = 0;
+  det->onset_pairs = 0;
+}
+
+bool TRIP_ISR_ATTR scanAdcTripFrame(AdcTripDetector* det, const uint8_t* data, uint32_t conv_count) {
+  if (det->reason != ADC_TRIP_NONE) return false;
+  const uint8_t sign_ch = det->sign_channel;
+  const uint8_t mag_ch = det->mag_channel;
+  const uint16_t threshold = det->sign_threshold;
+  const uint16_t trip_code = det->mag_trip_code;
+  bool has_sign = det->has_sign;
+  uint16_t sign_value = det->sign_value;
+  uint32_t over_run = det->over_run;
+  int32_t dc_sum = det->dc_sum;
+  uint32_t dc_count = det->dc_count;
+  uint8_t reason = ADC_TRIP_NONE;
+  uint16_t code_at_trip = 0;
+  uint32_t onset = 0;
+  uint32_t trip_pair = 0;
+  uint32_t pairs = 0;
+
+  for (uint32_t i = 0; i < conv_count; i++) {
+    uint16_t w = (uint16_t)(data[2 * i] | (data[2 * i + 1] << 8));
+    uint8_t ch = TYPE1_CHANNEL(w);
+    uint16_t code = TYPE1_DATA(w);
+    if (ch == sign_ch) {
+      sign_value = code;
+      has_sign = true;
+      continue;
+    }
+    if (ch != mag_ch || !has_sign) continue;
+    has_sign = false;
+    pairs++;
+
+    if (reason != ADC_TRIP_NONE) continue;  // Досчитываем пары до конца фрейма
+
+    // Перегрузка: N пар подряд
+    if (trip_code > 0 && code >= trip_code) {
+      if (++over_run >= det->confirm_pairs) {
+        reason = ADC_TRIP_OVERCURRENT;
+        code_at_trip = code;
+        onset = over_run;
+        trip_pair = pairs;
+      }
+    } else {
+      over_run = 0;
+    }
+
+    // DC: среднее знакового кода за окно (полярность не важна — берём модуль)
+    if (det->dc_limit_code > 0 && reason == ADC_TRIP_NONE) {
+      dc_sum += (sign_value > threshold) ? (int32_t)code : -(int32_t)code;
+      if (++dc_count >= det->dc_window_pairs) {
+        int32_t mean = dc_sum / (int32_t)dc_count;
+        if (mean < 0) mean = -mean;
+        if (mean > det->dc_limit_code) {
+          reason = ADC_TRIP_DC_FAULT;
+          code_at_trip = (uint16_t)mean;
+          onset = dc_count;
+          trip_pair = pairs;
+        }
+        dc_sum = 0;
+        dc_count = 0;
+      }
+    }
+  }
+
+  det->has_sign = has_sign;
+  det->sign_value = sign_value;
+  det->over_run = (uint16_t)((over_run > 0xFFFF) ? 0xFFFF : over_run);
+  det->dc_sum = dc_sum;
+  det->dc_count = dc_count;
+  if (reason == ADC_TRIP_NONE) return false;
+
+  // Реакция начнётся по концу фрейма: до неё от начала аварии прошли onset пар
+  // плюс оставшиеся во фрейме после точки срабатывания
+  det->reason = reason;
+  det->trip_code = code_at_trip;
+  det->onset_pairs = onset + (pairs - trip_pair);
+  return true;
+}
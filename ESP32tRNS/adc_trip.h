@@ -0,0 +1,58 @@
+#ifndef ADC_TRIP_H
+#define ADC_TRIP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// ============================================================================
+// === ADC TRIP (аварийная защита по сырым парам sign/mag) ===
+// ============================================================================
+// Детектор идёт по DMA фрейму прямо в conv_done ISR, до ingest: каждая пара
+// (sign, mag) в сырых кодах, без фильтров и LUT. Два вида аварии:
+//  - перегрузка: модуль ≥ mag_trip_code confirm_pairs пар подряд (включая
+//    коды вне калибровки — насыщение тоже перегрузка);
+//  - DC авария в AC режимах: |среднее знакового кода| за окно dc_window_pairs
+//    (целое число лупов DAC) выше dc_limit_code (залипший знак H-моста, пробой).
+// Сработав, детектор защёлкивается до configureAdcTripDetector.
+// Как и adc_frame_parser, модуль не зависит от Arduino/IDF: на хосте его
+// гоняют по фреймам с подмешанной аварией и меряют задержку в парах.
+
+enum AdcTripReason : uint8_t {
+  ADC_TRIP_NONE = 0,
+  ADC_TRIP_OVERCURRENT = 1,
+  ADC_TRIP_DC_FAULT = 2
+};
+
+struct AdcTripDetector {
+  uint8_t sign_channel;       // Каналы и порог знака — как у парсера
+  uint8_t mag_channel;
+  uint16_t sign_threshold;
+  uint16_t mag_trip_code;     // Порог перегрузки (0 — выключен)
+  uint16_t confirm_pairs;     // Пар подряд выше порога до срабатывания
+  uint16_t dc_limit_code;     // Порог DC: |Σ знаковых кодов| / окно (0 — выключен)
+  uint32_t dc_window_pairs;   // Окно DC в парах
+  // Состояние между фреймами
+  bool has_sign;
+  uint16_t sign_value;
+  uint16_t over_run;          // Пар подряд выше mag_trip_code
+  int32_t dc_sum;
+  uint32_t dc_count;
+  // Защёлка
+  uint8_t reason;             // AdcTripReason
+  uint16_t trip_code;         // Модуль (перегрузка) или |среднее| (DC) в момент срабатывания
+  uint32_t onset_pairs;       // Пар от начала аварии до конца фрейма срабатывания
+};
+
+// Каналы и порог знака; защита выключена до configureAdcTripDetector
+void initAdcTripDetector(AdcTripDetector* det, uint8_t sign_channel, uint8_t mag_channel,
+                         uint16_t sign_threshold);
+
+// Пороги (коды) и сброс состояния и защёлки
+void configureAdcTripDetector(AdcTripDetector* det, uint16_t mag_trip_code, uint16_t confirm_pairs,
+                              uint16_t dc_limit_code, uint32_t dc_window_pairs);
+
+// Проверить фрейм из conv_count конверсий (TYPE1). true — сработал в этом фрейме
+// (reason/trip_code/onset_pairs заполнены); после срабатывания — всегда false
+bool scanAdcTripFrame(AdcTripDetector* det, const uint8_t* data, uint32_t conv_count);
+
+#endif // ADC_TRIP_H
@@ -0,0 +1,355 @@
+#include "adc_window_stats.h"
+#include "adc_calibration.h"
+
+// Элемент деки: старшие 16 бит — номер сэмпла (mod 2^16), младшие — код
+#define DQ_PACK(seq, code)  (((uint32_t)(uint16_t)(seq) << 16) | (uint16_t)(code))
+#define DQ_SEQ(e)           ((uint16_t)((e) >> 16))
+#define DQ_CODE(e)          ((int16_t)((e) & 0xFFFF))
+
+// Монотонная дека на кольцевом массиве (ёмкость = размер окна)
+struct MonoDeque {
+  uint32_t* buf;
+  uint32_t head;   // Индекс первого элемента
+  uint32_t len;    // Число элементов
+};
+
+struct WindowState {
+  uint32_t size;
+  int32_t sum_code;
+  int64_t sum_uA;
+  uint64_t sum_sq_uA2;
+  uint32_t count;
+  MonoDeque min_dq;   // Возрастающая: front = минимум
+  MonoDeque max_dq;   // Убывающая: front = максимум
+};
+
+static const uint32_t window_sizes[ADC_WINDOW_COUNT] = ADC_WINDOW_SIZES;
+static WindowState windows[ADC_WINDOW_COUNT];
+static uint32_t sample_seq = 0;                 // Номер следующего сэмпла
+static volatile uint32_t stats_version = 0;     // Seqlock: нечётный — идёт запись
+static volatile bool rebuild_pending = false;
+
+// Гистограммы окон ADC_WINDOW_HIST (счётчики ≤ размера окна → uint16)
+#define HIST_BLOCKS  (ADC_HIST_BINS >> ADC_HIST_BLOCK_SHIFT)
+#define HIST_INDEX(code)  ((uint32_t)((code) + (ADC_HIST_BINS / 2)))
+static const bool window_hist[ADC_WINDOW_COUNT] = ADC_WINDOW_HIST;
+static uint16_t* hist_bins[ADC_WINDOW_COUNT] = {};
+static uint16_t hist_blocks[ADC_WINDOW_COUNT][HIST_BLOCKS];
+static_assert(ADC_STATS_WINDOW_SAMPLES < 65536 && ADC_SAMPLE_RATE < 65536, "histogram counters are 16-bit");
+
+static inline uint32_t dqIndex(const MonoDeque* dq, uint32_t size, uint32_t i) {
+  uint32_t idx = dq->head + i;
+  return (idx >= size) ? idx - size : idx;
+}
+
+// Добавить код в деку: less=true — дека минимума, иначе максимума
+static inline void dqPush(MonoDeque* dq, uint32_t size, uint32_t seq, int16_t code, bool less) {
+  // Выпавшие из окна — с головы
+  while (dq->len > 0 && (uint16_t)(seq - DQ_SEQ(dq->buf[dq->head])) >= size) {
+    dq->head = (dq->head + 1 == size) ? 0 : dq->head + 1;
+    dq->len--;
+  }
+  // Доминируемые новым — с хвоста
+  while (dq->len > 0) {
+    int16_t back = DQ_CODE(dq->buf[dqIndex(dq, size, dq->len - 1)]);
+    if (less ? (back < code) : (back > code)) break;
+    dq->len--;
+  }
+  dq->buf[dqIndex(dq, size, dq->len)] = DQ_PACK(seq, code);
+  dq->len++;
+}
+
+// Целочисленный квадратный корень (floor)
+static uint32_t isqrt64(uint64_t x) {
+  uint64_t result = 0;
+  uint64_t bit = 1ULL << 62;
+  while (bit > x) bit >>= 2;
+  while (bit != 0) {
+    if (x >= result + bit) {
+      x -= result + bit;
+      result = (result >> 1) + bit;
+    } else {
+      result >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)result;
+}
+
+void initADCWindowStats() {
+  for (uint8_t w = 0; w < ADC_WINDOW_COUNT; w++) {
+    WindowState* ws = &windows[w];
+    ws->size = window_sizes[w];
+    // Большие деки уходят в PSRAM (malloc > 4 КБ)
+    ws->min_dq.buf = (uint32_t*)malloc(ws->size * sizeof(uint32_t));
+    ws->max_dq.buf = (uint32_t*)malloc(ws->size * sizeof(uint32_t));
+    if (ws->min_dq.buf == NULL || ws->max_dq.buf == NULL) {
+      Serial.printf("[ADC] window %u alloc failed\n", (unsigned)w);
+      ws->size = 0;
+    }
+    if (window_hist[w]) {
+      hist_bins[w] = (uint16_t*)malloc(ADC_HIST_BINS * sizeof(uint16_t));
+      if (hist_bins[w] == NULL) {
+        Serial.printf("[ADC] window %u histogram alloc failed\n", (unsigned)w);
+      }
+    }
+  }
+  resetADCWindowStats();
+}
+
+void resetADCWindowStats() {
+  stats_version++;
+  __sync_synchronize();
+  for (uint8_t w = 0; w < ADC_WINDOW_COUNT; w++) {
+    WindowState* ws = &windows[w];
+    ws->sum_code = 0;
+    ws->sum_uA = 0;
+    ws->sum_sq_uA2 = 0;
+    ws->count = 0;
+    ws->min_dq.head = ws->min_dq.len = 0;
+    ws->max_dq.head = ws->max_dq.len = 0;
+    if (hist_bins[w] != NULL) {
+      memset(hist_bins[w], 0, ADC_HIST_BINS * sizeof(uint16_t));
+    }
+  }
+  memset(hist_blocks, 0, sizeof(hist_blocks));
+  sample_seq = 0;
+  rebuild_pending = false;
+  __sync_synchronize();
+  stats_version++;
+}
+
+void requestADCWindowStatsRebuild() {
+  rebuild_pending = true;
+}
+
+// Пересчёт сумм по содержимому кольца мкА (LUT поменялась)
+static void rebuildSums(const int16_t* ring_uA, uint32_t write_index) {
+  for (uint8_t w = 0; w < ADC_WINDOW_COUNT; w++) {
+    WindowState* ws = &windows[w];
+    ws->sum_uA = 0;
+    ws->sum_sq_uA2 = 0;
+    for (uint32_t i = 0; i < ws->count; i++) {
+      int32_t uA = ring_uA[(write_index - 1 - i) & (ADC_RING_SIZE - 1)];
+      ws->sum_uA += uA;
+      ws->sum_sq_uA2 += (uint32_t)(uA * uA);
+    }
+  }
+}
+
+void updateADCWindowStats(const int16_t* block, const int16_t* block_uA, uint32_t n,
+                          const int16_t* ring, const int16_t* ring_uA, uint32_t write_index) {
+  stats_version++;
+  __sync_synchronize();
+  
+  if (rebuild_pending) {
+    rebuild_pending = false;
+    rebuildSums(ring_uA, write_index);
+  }
+  
+  for (uint8_t w = 0; w < ADC_WINDOW_COUNT; w++) {
+    WindowState* ws = &windows[w];
+    const uint32_t size = ws->size;
+    if (size == 0) continue;
+    int32_t sum_code = ws->sum_code;
+    int64_t sum = ws->sum_uA;
+    uint64_t sum_sq = ws->sum_sq_uA2;
+    uint32_t count = ws->count;
+    uint32_t seq = sample_seq;
+    uint16_t* hist = hist_bins[w];
+    uint16_t* blocks = hist_blocks[w];
+    
+    for (uint32_t i = 0; i < n; i++, seq++) {
+      int16_t code = block[i];
+      int32_t uA = block_uA[i];
+      sum_code += code;
+      sum += uA;
+      sum_sq += (uint32_t)(uA * uA);
+      if (hist) {
+        hist[HIST_INDEX(code)]++;
+        blocks[HIST_INDEX(code) >> ADC_HIST_BLOCK_SHIFT]++;
+      }
+      
+      // Выпадающий сэмпл ещё в кольце: позиция нового минус размер окна
+      uint32_t old_idx = (write_index + i - size) & (ADC_RING_SIZE - 1);
+      int16_t old_code = ring[old_idx];
+      if (count >= size && old_code != ADC_INVALID_VALUE) {
+        int32_t old_uA = ring_uA[old_idx];
+        sum_code -= old_code;
+        sum -= old_uA;
+        sum_sq -= (uint32_t)(old_uA * old_uA);
+        if (hist) {
+          hist[HIST_INDEX(old_code)]--;
+          blocks[HIST_INDEX(old_code) >> ADC_HIST_BLOCK_SHIFT]--;
+        }
+      } else if (count < size) {
+        count++;
+      }
+      
+      dqPush(&ws->min_dq, size, seq, code, true);
+      dqPush(&ws->max_dq, size, seq, code, false);
+    }
+    ws->sum_code = sum_code;
+    ws->sum_uA = sum;
+    ws->sum_sq_uA2 = sum_sq;
+    ws->count = count;
+  }
+  sample_seq += n;
+  
+  __sync_synchronize();
+  stats_version++;
+}
+
+bool getADCWindowStats(AdcWindow window, AdcWindowStats* out) {
+  if (out == NULL || window >= ADC_WINDOW_COUNT) return false;
+  const WindowState* ws = &windows[window];
+  
+  int32_t sum_code;
+  int64_t sum;
+  uint64_t sum_sq;
+  uint32_t count;
+  int16_t min_code = 0, max_code = 0;
+  uint32_t version;
+  do {
+    // Ждём конца записи (писатель выше приоритетом — не крутимся долго)
+    version = stats_version;
+    __sync_synchronize();
+    sum_code = ws->sum_code;
+    sum = ws->sum_uA;
+    sum_sq = ws->sum_sq_uA2;
+    count = ws->count;
+    if (count > 0 && ws->min_dq.len > 0 && ws->max_dq.len > 0) {
+      min_code = DQ_CODE(ws->min_dq.buf[ws->min_dq.head]);
+      max_code = DQ_CODE(ws->max_dq.buf[ws->max_dq.head]);
+    }
+    __sync_synchronize();
+  } while ((version & 1) || version != stats_version);
+  
+  if (count == 0) return false;
+  
+  int32_t mean = (int32_t)(sum / (int64_t)count);
+  uint64_t mean_sq = sum_sq / count;
+  uint64_t mean2 = (uint64_t)((int64_t)mean * mean);
+  out->count = count;
+  out->mean_uA = mean;
+  out->rms_uA = isqrt64(mean_sq);
+  out->sigma_uA = isqrt64((mean_sq > mean2) ? mean_sq - mean2 : 0);
+  out->min_code = min_code;
+  out->max_code = max_code;
+  out->mean_code = (int16_t)(sum_code / (int32_t)count);
+  // LUT монотонна: min/max кода = min/max тока
+  out->min_uA = adcSignedToMicroamps(min_code);
+  out->max_uA = adcSignedToMicroamps(max_code);
+  return true;
+}
+
+// === ГИСТОГРАММА КОДОВ (окна ADC_WINDOW_HIST) ===
+
+// k-й код без seqlock (вызывающий повторяет при смене версии)
+static bool codeRankUnlocked(uint8_t w, uint32_t k, int16_t* code) {
+  const uint16_t* bins = hist_bins[w];
+  const uint16_t* blocks = hist_blocks[w];
+  uint32_t acc = 0;
+  uint32_t b = 0;
+  // Грубый проход: блок, в котором лежит k-й сэмпл
+  while (b < HIST_BLOCKS && acc + blocks[b] <= k) {
+    acc += blocks[b];
+    b++;
+  }
+  if (b >= HIST_BLOCKS) return false;
+  // Точный проход внутри блока
+  uint32_t i = b << ADC_HIST_BLOCK_SHIFT;
+  uint32_t end = i + (1u << ADC_HIST_BLOCK_SHIFT);
+  while (i < end && acc + bins[i] <= k) {
+    acc += bins[i];
+    i++;
+  }
+  if (i >= end) return false;  // Блок и бины разошлись (запись в процессе)
+  *code = (int16_t)((int32_t)i - (ADC_HIST_BINS / 2));
+  return true;
+}
+
+bool getADCWindowCodeRank(AdcWindow window, uint32_t k, int16_t* code) {
+  if (window >= ADC_WINDOW_COUNT || hist_bins[window] == NULL || code == NULL) return false;
+  bool ok;
+  uint32_t version;
+  do {
+    version = stats_version;
+    __sync_synchronize();
+    ok = (k < windows[window].count) && codeRankUnlocked(window, k, code);
+    __sync_synchronize();
+  } while ((version & 1) || version != stats_version);
+  return ok;
+}
+
+bool getADCWindowCodePercentiles(AdcWindow window, uint16_t lo_permille, uint16_t hi_permille,
+                                 int16_t* lo_code, int16_t* hi_code) {
+  if (window >= ADC_WINDOW_COUNT || hist_bins[window] == NULL || lo_code == NULL || hi_code == NULL) {
+    return false;
+  }
+  bool ok;
+  uint32_t version;
+  do {
+    version = stats_version;
+    __sync_synchronize();
+    uint32_t count = windows[window].count;
+    ok = false;
+    if (count > 0) {
+      uint32_t lo_k = (count * lo_permille) / 1000;
+      uint32_t hi_k = (count * hi_permille) / 1000;
+      if (lo_k >= count) lo_k = count - 1;
+      if (hi_k >= count) hi_k = count - 1;
+      ok = codeRankUnlocked(window, lo_k, lo_code) && codeRankUnlocked(window, hi_k, hi_code);
+    }
+    __sync_synchronize();
+  } while ((version & 1) || version != stats_version);
+  return ok;
+}
+
+bool buildADCWindowHistogram(uint16_t* bins, uint8_t num_bins) {
+  const uint16_t* hist = hist_bins[ADC_WINDOW_STATS];
+  const uint16_t* blocks = hist_blocks[ADC_WINDOW_STATS];
+  if (bins == NULL || num_bins == 0 || hist == NULL) return false;
+  
+  AdcWindowStats stats;
+  if (!getADCWindowStats(ADC_WINDOW_STATS, &stats)) return false;
+  
+  float min_mA = adcSignedToMilliamps(stats.min_code);
+  float max_mA = adcSignedToMilliamps(stats.max_code);
+  float range = max_mA - min_mA;
+  uint32_t first = HIST_INDEX(stats.min_code);
+  uint32_t last = HIST_INDEX(stats.max_code);
+  
+  uint32_t version;
+  do {
+    version = stats_version;
+    __sync_synchronize();
+    memset(bins, 0, num_bins * sizeof(uint16_t));
+    
+    if (range < 0.001f) {
+      // Все значения одинаковые (например, tDCS) - все в средний столбец
+      bins[num_bins / 2] = (uint16_t)stats.count;
+    } else {
+      uint32_t i = first;
+      while (i <= last) {
+        // Пустой грубый блок — перескакиваем целиком
+        if (blocks[i >> ADC_HIST_BLOCK_SHIFT] == 0) {
+          i = ((i >> ADC_HIST_BLOCK_SHIFT) + 1) << ADC_HIST_BLOCK_SHIFT;
+          continue;
+        }
+        uint16_t c = hist[i];
+        if (c != 0) {
+          float mA = adcSignedToMilliamps((int16_t)((int32_t)i - (ADC_HIST_BINS / 2)));
+          float normalized = (mA - min_mA) / range;
+          int bin_index = (int)(normalized * num_bins);
+          if (bin_index < 0) bin_index = 0;
+          if (bin_index >= num_bins) bin_index = num_bins - 1;
+          bins[bin_index] += c;
+        }
+        i++;
+      }
+    }
+    __sync_synchronize();
+  } while ((version & 1) || version != stats_version);
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef ADC_WINDOW_STATS_H
+#define ADC_WINDOW_STATS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === ADC WINDOW STATS (скользящие окна: сумма, Σx², min/max) ===
+// ============================================================================
+// Поддерживаются инкрементально в задаче ingest: на каждый сэмпл — добавить
+// новый, вычесть выпавший из окна (он ещё лежит в adc_ring_buffer).
+// Min/max — монотонные деки (амортизированно O(1) на сэмпл).
+// Запрос mean/RMS/σ/min/max по любому окну — O(1), целочисленно.
+// Для окон ADC_WINDOW_STATS и ADC_WINDOW_SECOND ещё и гистограмма по кодам ADC
+// (+1 новый, −1 выпавший): перцентили и гистограммы для дисплея — кумулятивным
+// проходом по грубым блокам и одному блоку бинов, без malloc и сортировок.
+// Читатель (loop) и писатель (ingest) разведены счётчиком-seqlock.
+
+// Окна (размеры — ADC_WINDOW_SIZES в config.h)
+enum AdcWindow : uint8_t {
+  ADC_WINDOW_STATS = 0,   // ADC_STATS_WINDOW_MS (200 мс)
+  ADC_WINDOW_RING = 1,    // Весь кольцевой буфер (1× DAC луп, 2.048 с)
+  ADC_WINDOW_SECOND = 2   // 1 с (перцентили посекундного журнала сеанса)
+};
+
+struct AdcWindowStats {
+  uint32_t count;         // Валидных сэмплов в окне (≤ размера окна)
+  int32_t mean_uA;        // Среднее
+  uint32_t rms_uA;        // √(Σx²/n)
+  uint32_t sigma_uA;      // √(Σx²/n − mean²)
+  int32_t min_uA;         // Минимум в окне
+  int32_t max_uA;         // Максимум в окне
+  int16_t min_code;       // Минимум/максимум в знаковых кодах ADC
+  int16_t max_code;
+  int16_t mean_code;      // Среднее в знаковых кодах ADC
+};
+
+// Выделить деки (вызывается из initADC)
+void initADCWindowStats();
+
+// Сбросить окна (вместе со сбросом кольцевого буфера)
+void resetADCWindowStats();
+
+// Пересчитать суммы по кольцу мкА (после его пересчёта под новую калибровку)
+void requestADCWindowStatsRebuild();
+
+// Добавить блок сэмплов (ingest, ДО записи блока в кольца: выпавшие читаются оттуда)
+// block/ring — коды ADC, block_uA/ring_uA — те же сэмплы в мкА (уже откалиброваны)
+void updateADCWindowStats(const int16_t* block, const int16_t* block_uA, uint32_t n,
+                          const int16_t* ring, const int16_t* ring_uA, uint32_t write_index);
+
+// Статистика окна: O(1). false — в окне ещё нет данных
+bool getADCWindowStats(AdcWindow window, AdcWindowStats* out);
+
+// k-й по возрастанию код в окне с гистограммой (k от 0), ≤ 128 + 64 шагов
+// false — k вне числа сэмплов в окне или у окна нет гистограммы
+bool getADCWindowCodeRank(AdcWindow window, uint32_t k, int16_t* code);
+
+// Перцентили окна с гистограммой (permille: 10 = 1%, 990 = 99%) в кодах
+bool getADCWindowCodePercentiles(AdcWindow window, uint16_t lo_permille, uint16_t hi_permille,
+                                 int16_t* lo_code, int16_t* hi_code);
+
+// Гистограмма окна ADC_WINDOW_STATS в равных интервалах тока (мА) между min и max
+// Обходит только непустые коды (пустые грубые блоки пропускаются)
+bool buildADCWindowHistogram(uint16_t* bins, uint8_t num_bins);
+
+#endif // ADC_WINDOW_STATS_H
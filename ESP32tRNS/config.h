@@ -29,6 +29,8 @@
 // Это ускоряет отклик на gain и уменьшает задержку
 #define DMA_BUFFER_COUNT    8    // Количество DMA дескрипторов (8×400 = 3200 фреймов = 0.40 сек @ 8kHz)
 #define DMA_BUFFER_LEN      400  // Стерео-фреймов в каждом буфере (400 фреймов × 4 байта = 1600 байт)
+// Фреймов в очереди I2S DMA между записью и фактическим выходом на DAC
+#define DAC_PIPELINE_FRAMES (DMA_BUFFER_COUNT * DMA_BUFFER_LEN)
 
 // === PIN CONFIGURATION ===
 
@@ -39,8 +41,9 @@
 #define DEF_ENC_DIRECTION (-1)  // +1 или -1 для инверсии направления
 
 // --- I2S → PCM5102A (стерео DAC) ---
-// Компенсация задержки VCCS для tACS (фазовый сдвиг знака в микросекундах)
+// Компенсация задержки VCCS (сдвиг знака в микросекундах), все режимы
 // Отрицательный = знак отстаёт от модуля (типичный случай для VCCS)
+// Начальное значение: в сеансе его поправляет замер перекоса (ADC_SKEW_*)
 #define TACS_SIGN_SHIFT_US     (-1.5f)    // мкс, задержка VCCS?
 #define TACS_SIGN_SHIFT_CODES  50     // в кодах, компенсируем срабатывание компаратора
 #define I2S_BCLK               33          // BCK (Bit clock) PCM5102A
@@ -64,9 +67,76 @@
 // Sign-magnitude ADC: 2 канала синхронно (знак + модуль)
 // Для tRNS (100-640 Hz) достаточно 10 kHz
 #define ADC_SAMPLE_RATE      8000   // Частота семплирования (8000 kHz - оптимально)
-#define ADC_FRAME_SIZE       512     // Размер фрейма DMA (×2 канала = 1024 сэмпла)
+
+// Передискретизация: АЦП на ADC_SAMPLE_RATE × 2^SHIFT, ingest прореживает
+// CIC + компенсирующим FIR обратно до ADC_SAMPLE_RATE (меньше шума, плоская АЧХ)
+// 0 — без передискретизации, окно [1,1,1]/3 в парсере (как раньше)
+// Предел ESP32-S2: 83333 конверсий/с на 2 канала → SHIFT ≤ 2
+#define ADC_OVERSAMPLE_SHIFT 2
+#define ADC_OVERSAMPLE       (1 << ADC_OVERSAMPLE_SHIFT)
+
+#define ADC_FRAME_SIZE       (512 * ADC_OVERSAMPLE)  // Конверсий в блоке ingest (×2 канала; ~31 блок/с)
+// Блок ingest собирается из мелких фреймов DMA: conv_done ISR (аварийная защита)
+// видит каждые 32 мс / 64 = 0.5 мс пар при любой R, ingest будится раз на блок
+#define ADC_DMA_FRAMES_PER_BLOCK 64
+
+// Частота конверсий по режиму (выход ingest всегда ADC_SAMPLE_RATE, блок всегда 32 мс):
+// tDCS — без передискретизации (×1, в 4 раза меньше конверсий и разбора),
+// tRNS/tACS — × ADC_OVERSAMPLE; вне сеанса АЦП остановлен. 0 — всегда ×R, как раньше
+#define ADC_RATE_SCHEDULING  1
+#define ADC_SAMPLES_PER_FRAME (ADC_FRAME_SIZE / 2 / ADC_OVERSAMPLE)  // Сэмплов на выходе ingest
+
+// Оценка тока alpha-beta + отбраковка выбросов (вместо окна [1,1,1]/3)
+// 0 — как раньше: окно в парсере (или только дециматор при передискретизации)
+// α, β в Q12 по модели сигнала режима; порог выброса — доля амплитуды команды
+#define ADC_ESTIMATOR_ENABLE     1
+#define ADC_EST_TDCS_ALPHA       512   // 0.125: постоянный ток — сильное сглаживание
+#define ADC_EST_TDCS_BETA        40    //   (шум ×0.55 к окну, фронт 10–90% за ~3 мс)
+#define ADC_EST_TACS_ALPHA       1638  // 0.4: синус до ~100 Гц
+#define ADC_EST_TACS_BETA        410
+#define ADC_EST_TRNS_ALPHA       4096  // 1.0: широкополосный шум — без сглаживания
+#define ADC_EST_TRNS_BETA        0     //   (выбросы отсекает ступень сырых пар, ниже)
+#define ADC_EST_FLOOR_PCT_TRNS   100   // Порог выброса, % амплитуды: tRNS (скачки сэмпл-в-сэмпл)
+#define ADC_EST_FLOOR_PCT        25    //   tDCS/tACS (гладкий сигнал)
+#define ADC_EST_MIN_FLOOR_CODES  200   // Не ниже (кодов ADC)
+#define ADC_EST_MAX_RUN          4     // Выбросов подряд (дольше — реальный скачок/разрыв)
+// При передискретизации выбросы отсекаются ещё до дециматора, на сырых парах
+// (Hampel по трём парам): после него выброс размазан на несколько сэмплов и в
+// tRNS неотличим от сигнала. Порог — по локальному σ шума пары, не по амплитуде
+#define ADC_EST_RAW_FLOOR_CODES  60    // Нижний предел порога на сырых парах (шум пары ~30 кодов)
 #define ADC_DMA_BUF_COUNT    4       // Количество DMA буферов
-#define ADC_READ_TIMEOUT_MS  10      // Небольшой timeout для ADC
+#define ADC_INGEST_TASK_PRIORITY 2   // Выше loopTask: фрейм забирается сразу после ISR
+#define ADC_INGEST_IDLE_TIMEOUT_MS 50 // Страховочный опрос, если уведомление потерялось
+#define ADC_FRAME_CAPTURE_MAX 16     // Сырых DMA фреймов за одну команду "frames" (PSRAM, по требованию)
+
+// === АВАРИЙНАЯ ЗАЩИТА ПО ТОКУ (conv_done ISR, сырые пары sign/mag) ===
+// Реакция: фрейм DMA (0.5 мс, ADC_DMA_FRAMES_PER_BLOCK) + подтверждение
+// + пробуждение задачи аварии и обнуление очереди I2S — меньше 1 мс
+#define ADC_TRIP_TASK_PRIORITY    10    // Выше ingest и loop: обнуляет DMA очередь DAC
+#define ADC_TRIP_OVERCURRENT_PCT  130   // Порог перегрузки, % от пика команды
+#define ADC_TRIP_MIN_UA           500   // Не ниже (малые амплитуды: шум не должен срабатывать)
+#define ADC_TRIP_MAX_UA           2600  // Не выше — абсолютный предел устройства (MAX_AMPLITUDE_MA × 1.3)
+#define ADC_TRIP_CONFIRM_PAIRS    8     // Пар подряд выше порога (¼ мс при ×4 передискретизации)
+#define ADC_TRIP_DC_UA            500   // DC авария в tRNS/tACS: |среднее| за окно выше
+// Окно DC — целое число лупов DAC: в нём целое число периодов tACS (getValidTACSFrequency)
+// и весь луп tRNS, среднее исправной формы ≈ 0 при любой фазе начала окна
+// (окно ~1 с на tACS 1.46 Гц — полтора периода, остаток до 0.2 пика)
+#define ADC_TRIP_DC_WINDOW_LOOPS  1
+#define ADC_TRIP_DC_WINDOW_PAIRS  ((uint32_t)SIGNAL_SAMPLES * ADC_TRIP_DC_WINDOW_LOOPS * ADC_OVERSAMPLE)  // При ×R (2.048 с)
+
+// === КАЧЕСТВО КОНТАКТА (ingest, по блокам; решение за ~100 мс) ===
+#define ADC_CONTACT_WINDOW_BLOCKS  2     // Окно: последние 2 блока ingest (~64 мс)
+#define ADC_CONTACT_BAD_WINDOWS    2     // Плохих окон подряд до остановки (~96 мс)
+#define ADC_CONTACT_MIN_CMD_UA     100   // Команда слабее (средний |I|) — не оцениваем
+#define ADC_CONTACT_OPEN_RATIO_PCT 20    // Измеренный/заданный ниже — обрыв
+#define ADC_CONTACT_MIN_RATIO_PCT  60    // Ниже — VCCS не держит ток (потеря регулирования)
+#define ADC_CONTACT_MAX_ANOMALY_PCT 10   // Пар вне калибровки больше — обрыв (шум на входе)
+#define ADC_CONTACT_SIGN_FLOOR_PCT 20    // Знак сравнивается, где |команда| выше % пика ...
+#define ADC_CONTACT_SIGN_GUARD     200   // ... на ±GUARD сэмплов вокруг фазы (шире ошибки привязки
+                                         // фазы лупа): tDCS и tACS до ~10 Гц; в tRNS знак не сравнивается
+#define ADC_CONTACT_MIN_SIGN_PCT   60    // Совпадений знака меньше — авария H-моста
+#define ADC_CONTACT_SHIFT_TOL_PCT  20    // Сдвиг фазы на ±GUARD меняет Σ|команды| окна больше —
+                                         // отношение тока в окне не оценивается (tACS < ~10 Гц у нуля)
 
 // Битность ADC: ESP32-S2 continuous mode поддерживает только 12-bit
 // (10/11-bit вызывает crash, нелинейность на краях — известная проблема ESP32)
@@ -84,13 +154,72 @@
 #define ADC_STATS_WINDOW_MS  200      // Окно статистики/гистограммы для ADC (мс)
 #define ADC_STATS_WINDOW_SAMPLES ((ADC_STATS_WINDOW_MS * ADC_SAMPLE_RATE) / 1000)
 
+// Скользящие окна статистики (обновляются в ingest, запрос O(1))
+// Окно ≤ 65535 сэмплов (возраст в деке min/max — 16 бит) и больше DMA фрейма
+#define ADC_WINDOW_COUNT     3
+#define ADC_WINDOW_SIZES     { ADC_STATS_WINDOW_SAMPLES, ADC_RING_SIZE, ADC_SAMPLE_RATE }
+#define ADC_WINDOW_HIST      { true, false, true }  // Окна с гистограммой кодов (перцентили)
+
+// Гистограмма кодов окна (ADC_WINDOW_HIST): бин на каждый знаковый код
+// (−4095..4095) + грубые блоки для быстрого кумулятивного поиска
+#define ADC_HIST_BINS        8192    // Индекс = код + 4096 (×2 байта, PSRAM)
+#define ADC_HIST_BLOCK_SHIFT 6       // 64 кода в грубом блоке → 128 блоков
+
+// Пирамида огибающей min/max по кольцу мкА (для осциллограммы)
+// Уровень L: блоки по 2^(SHIFT·(L+1)) сэмплов → 8, 64, 512
+#define ADC_ENVELOPE_LEVELS  3
+#define ADC_ENVELOPE_SHIFT   3
+
+// Индекс переходов через ноль (триггер осциллограммы tACS, частота/джиттер)
+#define ADC_CROSSING_RING_SIZE   32    // Последних переходов (степень 2)
+#define ADC_CROSSING_HYST_UA     100   // Гистерезис триггера Шмитта ±0.1 мА
+#define ADC_CROSSING_STAT_CYCLES 16    // Периодов для средней частоты и джиттера
+
+// Когерентное усреднение тока по DAC лупам (фаза лупа ↔ номер сэмпла ADC)
+#define ADC_LOOP_LATENCY_SAMPLES 2     // Групповая задержка CIC + FIR/оценщика (сэмплы ADC)
+#define ADC_LOOP_RELOCK_SAMPLES  1000  // Ошибка фазы больше — перезахват (DAC перезапущен)
+#define ADC_LOOP_TRACK_SHIFT     3     // Подстройка фазы: 1/8 ошибки за луп (джиттер ≤ 1 DMA буфера)
+
+// === LOCK-IN tACS (синхронное детектирование по фазе лупа) ===
+#define ADC_LOCKIN_TABLE_BITS    10    // Таблица синуса опорного сигнала: 1024 точки Q15
+#define ADC_LOCKIN_MAX_BLOCKS    128   // Блоков ingest в кольце окна (окно = ровно один луп, 64 полных блока)
+
+// === ПЕРЕДАТОЧНАЯ ФУНКЦИЯ VCCS/H-МОСТА (команда → среднее по лупам) ===
+#define ADC_TF_PERIOD_MS         10000 // Период оценки в STABLE
+#define ADC_TF_MIN_LOOPS         4     // Лупов в когерентном среднем до первой оценки
+#define ADC_TF_MIN_REL_POWER     1e-3f // Бины с мощностью команды ниже доли максимума не учитываются
+#define ADC_TF_BANDS             8     // Полос АЧХ/ФЧХ в отчёте
+#define ADC_TF_BAND_HZ           100   // Ширина полосы (0..800 Гц)
+
+// === ПЕРЕКОС ЗНАКА H-МОСТА (adc_sign_skew: сырые пары в STABLE) ===
+// Смена знака на канале знака против минимума модуля в каждом переходе через ноль
+#define ADC_SKEW_LEVEL_CODE      40    // Провал модуля — ниже (коды, выше шума у нуля)
+#define ADC_SKEW_MAX_DIP_US      20000 // Провал дольше — пауза, а не переход
+#define ADC_SKEW_WINDOW_US       500   // Смена знака ищется до/после провала (предел перекоса)
+#define ADC_SKEW_MIN_EDGES       200   // Переходов в оценке не меньше (tACS 10 Гц — 10 с) ...
+#define ADC_SKEW_MAX_SE_US       5.0f  // ... и СКО среднего не больше (tACS 1.46 Гц — минуты)
+#define ADC_SKEW_MAX_DELAY_US    250.0f // Предел поправки задержки знака DAC
+#define ADC_SKEW_SETTLE_MS       1000  // После поправки: очередь DAC (400 мс) доигрывает старую
+
+// Дозиметрия сеанса: допуск «ток в норме» (±% от целевого) для экрана SCR_FINISH
+#define DOSE_SPEC_TOLERANCE_PCT  10
+// Окно решения «в допуске» — целое число лупов DAC (2.048 с): RMS/среднее tACS и tRNS
+// по всей форме лупа, а не по блоку 32 мс (в блоке — кусок периода или выборка шума)
+#define DOSE_SPEC_WINDOW_LOOPS   1
+
+// tRNS: амплитуда ≈ 3.38σ (распределение пресета не совсем гауссово)
+#define TRNS_SIGMA_TO_AMPLITUDE  3.38f
+
+// Модуль выше этого кода = шум/разрыв цепи (вне калибровки)
+#define ADC_MAG_OVERRANGE_CODE  2700
+
 // Порог детектирования знака (если sign > этого, то положительный)
 #define ADC_SIGN_THRESHOLD   2048  // Середина диапазона 12-bit (4096/2)
 
 // Кольцевой буфер для накопления данных
 // ВАЖНО: Буфер согласован с DAC лупом (2.048 сек)! 
 // ADC = 1× DAC луп → квадратное окно без растекания спектра
-#define ADC_RING_SIZE       16384  // ~2 сек @ 8kHz
+#define ADC_RING_SIZE       16384  // ~2 сек @ 8kHz (степень 2: индекс по маске)
 #define ADC_INVALID_VALUE   -32768 // Запрещенное значение (метка "данных ещё нет")
 
 // === DAC SIGNAL PARAMETERS (Sign-Magnitude для H-моста) ===
@@ -112,6 +241,13 @@
 // === FADE-IN / FADE-OUT ПАРАМЕТРЫ ===
 #define DEF_FADE_DURATION_SEC   10.0f   // Длительность fadein и fadeout (секунды) по умолчанию
 
+// === ПРОТОКОЛ СТИМУЛЯЦИИ (stim_protocol) ===
+#define PROTOCOL_MAX_SEGMENTS   32      // Сегментов в протоколе (×16 байт)
+#define PROTOCOL_MAX_TEXT       2048    // Максимальный размер /protocol.txt (байт)
+#define PROTOCOL_SWITCH_RAMP_MS 500     // Рампа вниз/вверх вокруг смены формы сигнала
+#define PROTOCOL_SWITCH_GAP_MS  500     // Пауза с нулевым током на перегенерацию (> очередь DMA 0.4с)
+#define PROTOCOL_UPLOAD_TIMEOUT_MS 2000 // Пауза в приёме файла по Serial, после которой приём отменяется
+
 // === ДЕФОЛТНЫЕ НАСТРОЙКИ РЕЖИМОВ ===
 #define DEF_AMPLITUDE_MA        1.0f    // Амплитуда по умолчанию для всех режимов (мА)
 #define DEF_DURATION_MIN        20      // Длительность сеанса по умолчанию (минуты)
@@ -121,6 +257,18 @@
 // ADC калибровка через таблицу в adc_calibration.cpp
 #define DEF_DAC_CODE_TO_MA      11000.0f  // DAC: коды/мА (1В=1мА, ~10000 кодов)
 
+// === АВТОКАЛИБРОВКА ADC (лестница DAC в эталонную нагрузку, adc_autocal) ===
+// Луп = ADC_CAL_STEPS ступеней постоянного тока 0..ADC_CAL_MAX_MA; ток ступени
+// задаёт DAC (dac_code_to_mA — опорный), ADC усредняется когерентно по лупам
+#define ADC_CAL_MAX_MA          2.0f  // Верх лестницы (диапазон CALIB_TABLE)
+#define ADC_CAL_STEPS           16    // Ступеней на луп (по 1024 сэмпла = 128 мс)
+#define ADC_CAL_LOOPS           3     // Лупов в среднем (~6 с)
+#define ADC_CAL_SETTLE_PCT      25    // Начало ступени пропускаем (VCCS + FIR)
+#define ADC_CAL_FADE_MS         300   // Рампа в начале и в конце
+#define ADC_CAL_MIN_STEP_CODES  4     // Ступень ближе к предыдущей по коду — отбрасываем
+#define ADC_CAL_MIN_POINTS      4     // Меньше точек — калибровка не принимается
+#define ADC_CAL_MAX_POINTS      24    // Ёмкость рабочей таблицы (NVS)
+
 // === ПРЕДЕЛЫ НАСТРОЙКИ ПАРАМЕТРОВ (для редактора) ===
 // Амплитуда (мА)
 #define MIN_AMPLITUDE_MA        0.1f
@@ -159,5 +307,49 @@
 #define MAX_TRNS_MULTIPLIER       1.80f
 #define TRNS_MULTIPLIER_INCREMENT 0.01f
 
+// === ЖУРНАЛ СЕАНСА (раздел ffat) ===
+#define SESSION_LOG_RING_RECORDS   256   // RAM-кольцо записей (×24 байт, ~4 мин)
+#define SESSION_LOG_FLUSH_RECORDS  120   // Сбрасывать во флеш пачками по ~2 мин
+#define SESSION_LOG_WRITE_CHUNK    512   // Максимум байт за одну запись во флеш
+#define SESSION_LOG_CHUNK_PAUSE_MS 20    // Пауза между порциями (отдаём CPU loop)
+#define SESSION_LOG_MAX_FILES      64    // Сколько последних сеансов хранить
+#define SESSION_LOG_TASK_PRIORITY  1     // Как у loopTask: работает, пока loop ждёт I2S
+
+// === ВОССТАНОВЛЕНИЕ СЕАНСА ПОСЛЕ СБОЯ (RTC память) ===
+#define SESSION_RESUME_SAVE_MS     250   // Период снимка позиции сеанса в RTC slow memory
+#define SESSION_RESUME_RAMP_MS     1000  // Защитная рампа 0 → gain при продолжении
+#define SESSION_RESUME_MAX_ATTEMPTS 3    // Подряд сбоев — дальше холодный старт в меню
+
+// === РЕГУЛЯТОР ТОКА (медленный внешний контур поверх amplitude_scale) ===
+// Шаг — раз в период, когда окно-луп целиком снято после прошлого шага
+// (очередь DAC 400 мс + луп 2.048 с), поэтому объект для контура статический
+#define SESSION_REG_ENABLE         1     // 0 — чисто разомкнутый масштаб, как раньше
+#define SESSION_REG_PERIOD_MS      3000  // Период шага (≥ DAC очередь + окно лупа)
+#define SESSION_REG_GAIN           0.5f  // Интегральный коэффициент (доля ошибки за шаг)
+#define SESSION_REG_MAX_STEP       0.02f // Ограничение скорости: |Δtrim| за шаг
+#define SESSION_REG_TRIM_MIN       0.85f // Пределы подстройки (антинасыщение интегратора)
+#define SESSION_REG_TRIM_MAX       1.15f
+#define SESSION_REG_DEADBAND_PCT   1.0f  // Ошибка меньше — не трогаем
+#define SESSION_REG_MIN_TARGET_UA  100   // Цель ниже — не регулируем (sham, шум)
+#define SESSION_REG_DC_GAIN        0.5f  // tRNS/tACS: коэффициент DC-баланса полуволн
+#define SESSION_REG_DC_MAX_STEP    0.01f // |Δbalance| за шаг
+#define SESSION_REG_DC_MAX         0.05f // |balance| ≤ 5% модуля
+#define SESSION_REG_DC_DEADBAND_UA 5     // |DC| меньше — не трогаем
+
+// === ИСТОРИЯ ТОКА ЗА СЕАНС (PSRAM, ярусы min/max/mean, adc_history) ===
+#define ADC_HISTORY_RAW_SEC        20    // Полная частота: последние 20 с (×2 байта/сэмпл, 320 КБ)
+#define ADC_HISTORY_MID_HZ         100   // Средний ярус: 100 Гц ...
+#define ADC_HISTORY_MID_SEC        600   // ... последние 10 мин (×6 байт, 360 КБ)
+#define ADC_HISTORY_SLOW_SEC       14400 // 1 Гц: 4 ч — весь сеанс/протокол (×6 байт, 86 КБ)
+#define ADC_HISTORY_MAX_FOLD       64    // Записей яруса на точку запроса — иначе ярус грубее
+#define ADC_HISTORY_MAX_POINTS     512   // Точек в одном запросе по Serial
+
+// === СПЕКТРАЛЬНЫЙ КОНТРОЛЬ ТОКА (фоновый FFT по одному лупу) ===
+#define SPECTRUM_PERIOD_MS         5000  // Период анализа во время STABLE
+#define SPECTRUM_TASK_PRIORITY     1     // Как у loopTask; между стадиями FFT — vTaskDelay(1)
+#define SPECTRUM_TRNS_LO_HZ        100   // Полоса tRNS пресета
+#define SPECTRUM_TRNS_HI_HZ        640
+#define SPECTRUM_TACS_HALF_BW_HZ   2     // tACS: полоса f ± 2 Гц
+
 #endif // CONFIG_H
 
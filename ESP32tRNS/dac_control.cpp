@@ -1,15 +1,23 @@
 #include "dac_control.h"
 #include "display_control.h"
 #include "adc_control.h"
+#include "adc_loop_average.h"
 #include "session_control.h"
 #include <math.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 
 // Глобальные переменные
 int16_t* signal_buffer = NULL;  // МОНО знаковый буфер (исходный сигнал)
 bool dma_prefilled = false;
 char current_preset_name[PRESET_NAME_MAX_LEN] = "No preset loaded";
-float dynamic_dac_gain = 0.0f;  // Динамический gain для fadein/fadeout (начинаем с 0)
+float dynamic_dac_gain = 0.0f;  // Gain сеанса на последнем отданном фрейме (для дисплея/журнала)
 static float amplitude_scale = 1.0f;  // Масштаб амплитуды (0..1) для мА → DAC
+static int16_t stereo_peak = 0;       // Пиковый модуль стерео-буфера (запас для регулятора)
+
+// Подстройка регулятора: пишет loop, применяется в начале фрагмента
+static volatile float pending_trim_pos = 1.0f;
+static volatile float pending_trim_neg = 1.0f;
 
 // Временный стерео-буфер для отправки в I2S DMA
 // Формируется из МОНО signal_buffer → СТЕРЕО [sign, magnitude]
@@ -19,120 +27,195 @@ static const uint32_t STEREO_BUFFER_SIZE = SIGNAL_SAMPLES * 2;
 // Позиция в stereo_buffer для кольцевого доступа (в стерео-сэмплах)
 static uint32_t stereo_buffer_pos = 0;
 
+// Сколько стерео-фреймов принято I2S за всё время (часы сеанса, только растёт)
+static uint64_t dac_frames_written = 0;
+
 // Буфер для фрагмента (FRAGMENT_SAMPLES стерео-сэмплов)
 static int16_t* stereo_buffer_fragment = NULL;
+// Фрагмент готовится один раз и отдаётся в I2S по частям, сколько влезло:
+// запись неблокирующая, остаток ждёт следующего вызова
+static bool fragment_ready = false;
+static bool fragment_muted = false;       // Подготовлен уже тишиной (или остаток затёрт)
+static uint32_t fragment_start_pos = 0;   // Позиция stereo_buffer начала фрагмента
+static uint32_t fragment_sent = 0;        // Стерео-сэмплов фрагмента уже принято I2S
+
+// Очередь I2S: запись фрагмента и аварийное обнуление — только под мьютексом
+// (наследование приоритета: задача аварии ждёт не дольше одного memcpy фрагмента,
+// i2s_write под ним никогда не блокируется). Ожидание места — вне мьютекса,
+// по событиям TX_DONE драйвера
+static SemaphoreHandle_t dac_i2s_mutex = NULL;
+static QueueHandle_t dac_i2s_events = NULL;
 static bool dac_active = false;
+static uint32_t dac_loop_gap_max_ms = 0;  // Максимальный gap между keepDMAFilled (для журнала)
+static volatile bool dac_muted = false;   // Авария (adc_trip): тишина до следующего сеанса
 
-// Заполнить стерео-буфер из МОНО с амплитудным масштабом (без fade gain)
-// Формирование sign-magnitude стерео для H-моста:
-// Левый канал = знак (32767=положительный, 0=отрицательный)
-// Правый канал = модуль * amplitude_scale (без dynamic_dac_gain)
-static void fillStereoBuffer() {
-  // Для tACS: вычисляем фазовый сдвиг для компенсации задержки VCCS
-  // phase_shift = 2π × freq × (delay_us / 1_000_000)
-  float phase_shift = 0.0f;
-  bool is_tacs = (current_settings.mode == MODE_TACS && tacs_active_frequency > 0.0f);
-  if (is_tacs) {
-    phase_shift = 2.0f * PI * tacs_active_frequency * (TACS_SIGN_SHIFT_US / 1000000.0f);
-  }
+// Задержка знака относительно модуля (мкс, + = знак отстаёт), общая для всех режимов.
+// Начальная — ручная TACS_SIGN_SHIFT_US, дальше её подстраивает замер перекоса
+// знака H-моста по АЦП (adc_control, adc_sign_skew). Задержка всей цепочки
+// (adc_transfer, lock-in) сюда не идёт — это не перекос знака и модуля
+static float sign_delay_us = -TACS_SIGN_SHIFT_US;
+static volatile float pending_sign_delay_us = 0.0f;
+static volatile bool sign_delay_pending = false;
+
+static inline bool isTACSSign() {
+  return session_mode == MODE_TACS && tacs_active_frequency > 0.0f;
+}
+
+// Левый канал = знак сигнала, задержанного на sign_delay_us (дробная задержка:
+// 4-точечная интерполяция Лагранжа по кольцу лупа — луп периодичен)
+// + для tACS порог TACS_SIGN_SHIFT_CODES компенсирует гистерезис компаратора
+static void fillSignChannel() {
+  bool is_tacs = isTACSSign();
+  float threshold = is_tacs ? (float)TACS_SIGN_SHIFT_CODES : 0.0f;
+  
+  // x(i − d) = Σ c[t]·x(i − ⌈d⌉ − 1 + t), mu — дробная часть −d (d = 0 → сэмпл как есть)
+  float d = sign_delay_us * SAMPLE_RATE / 1000000.0f;
+  int32_t shift = (int32_t)floorf(-d);
+  float mu = -d - (float)shift;
+  float c[4] = {
+    -mu * (mu - 1.0f) * (mu - 2.0f) / 6.0f,
+    (mu + 1.0f) * (mu - 1.0f) * (mu - 2.0f) / 2.0f,
+    -(mu + 1.0f) * mu * (mu - 2.0f) / 2.0f,
+    (mu + 1.0f) * mu * (mu - 1.0f) / 6.0f
+  };
   
   for (int i = 0; i < SIGNAL_SAMPLES; i++) {
-    int16_t sample = signal_buffer[i];
-    bool is_positive;
-    
-    if (is_tacs) {
-      // tACS: знак из сдвинутой по фазе синусоиды
-      // + порог TACS_SIGN_SHIFT_CODES для компенсации гистерезиса компаратора
-      float omega = 2.0f * PI * tacs_active_frequency / SAMPLE_RATE;
-      float sign_value = sinf(omega * i + phase_shift) * 32767.0f;  // В кодах
-      is_positive = (sign_value > (float)TACS_SIGN_SHIFT_CODES);
-    } else {
-      // tRNS/tDCS: знак напрямую из сэмпла
-      is_positive = (sample >= 0);
+    uint32_t first = (uint32_t)(i + shift - 1) & (SIGNAL_SAMPLES - 1);
+    float value = 0.0f;
+    for (int t = 0; t < 4; t++) {
+      value += c[t] * signal_buffer[(first + t) & (SIGNAL_SAMPLES - 1)];
     }
+    bool is_positive = is_tacs ? (value > threshold) : (value >= threshold);
     
     // Применяем инверсию полярности (если электроды перепутаны)
     if (current_settings.polarity_invert) {
       is_positive = !is_positive;
     }
-    
-    // Левый канал = знак
     stereo_buffer[i * 2] = is_positive ? DAC_SIGN_POSITIVE : DAC_SIGN_NEGATIVE;
-    
+  }
+}
+
+// Заполнить стерео-буфер из МОНО с амплитудным масштабом (без fade gain)
+// Формирование sign-magnitude стерео для H-моста:
+// Левый канал = знак (32767=положительный, 0=отрицательный), см. fillSignChannel
+// Правый канал = модуль * amplitude_scale (без dynamic_dac_gain)
+static void fillStereoBuffer() {
+  stereo_peak = 0;
+  for (int i = 0; i < SIGNAL_SAMPLES; i++) {
     // Правый канал = модуль * amplitude_scale
+    int16_t sample = signal_buffer[i];
     int16_t mag = (sample >= 0) ? sample : -sample;
     float scaled = mag * amplitude_scale;
     if (scaled > 32767.0f) scaled = 32767.0f;
     stereo_buffer[i * 2 + 1] = (int16_t)scaled;
+    if (stereo_buffer[i * 2 + 1] > stereo_peak) stereo_peak = stereo_buffer[i * 2 + 1];
   }
+  fillSignChannel();
 }
 
 // Копировать фрагмент из stereo_buffer в stereo_buffer_fragment с кольцевым доступом
-// ВАЖНО: dynamic_dac_gain применяется ТОЛЬКО на выходе (fadein/fadeout)
+// ВАЖНО: gain сеанса применяется ТОЛЬКО на выходе (fadein/fadeout)
+// Gain берётся из таймлайна сеанса по номеру фрейма: внутри фрагмента он
+// меняется посэмплово (линейные участки), переходы точны до фрейма
 // ВАЖНО: i % 2 определяет L/R в выходном fragment, НЕ src_idx!
-static void copyFragmentFromStereoBuffer(uint32_t start_pos) {
-  float gain = dynamic_dac_gain;  // Копируем локально для консистентности
-  
-  // В IDLE (gain=0) выводим тишину на оба канала!
-  if (gain <= 0.0f) {
-    for (uint32_t i = 0; i < FRAGMENT_SAMPLES; i++) {
-      stereo_buffer_fragment[i] = 0;
-    }
-    return;
-  }
-  
+static void copyFragmentFromStereoBuffer(uint32_t start_pos, uint64_t start_frame) {
   // ГАРАНТИРУЕМ что start_pos чётный (начинаем с L канала)!
   start_pos = start_pos & ~1u;
   
-  for (uint32_t i = 0; i < FRAGMENT_SAMPLES; i++) {
-    uint32_t src_idx = (start_pos + i) % STEREO_BUFFER_SIZE;
+  if (dac_muted) {
+    memset(stereo_buffer_fragment, 0, FRAGMENT_SAMPLES * sizeof(int16_t));
+    return;
+  }
+  // Подстройка на весь фрагмент: по уровню канала знака (он уже с учётом инверсии)
+  float trim_pos = pending_trim_pos;
+  float trim_neg = pending_trim_neg;
+  if (current_settings.polarity_invert) {
+    float t = trim_pos;
+    trim_pos = trim_neg;
+    trim_neg = t;
+  }
+  const uint32_t frames = FRAGMENT_SAMPLES / 2;
+  uint32_t f = 0;
+  while (f < frames) {
+    float gain, slope;
+    uint32_t run;
+    getSessionGainSegment(start_frame + f, &gain, &slope, &run);
+    uint32_t seg_end = (run < frames - f) ? f + run : frames;
+    
+    if (gain <= 0.0f && slope <= 0.0f) {
+      // В IDLE (gain=0) выводим тишину на оба канала!
+      for (; f < seg_end; f++) {
+        stereo_buffer_fragment[f * 2] = 0;
+        stereo_buffer_fragment[f * 2 + 1] = 0;
+      }
+      continue;
+    }
     
-    // i % 2 == 0 = левый канал (знак) - НЕ масштабируем!
-    // i % 2 == 1 = правый канал (модуль) - применяем dynamic_dac_gain!
-    if (i % 2 == 0) {
+    for (; f < seg_end; f++) {
+      uint32_t src_idx = (start_pos + f * 2) % STEREO_BUFFER_SIZE;
       // Левый канал = знак, копируем как есть (ВСЕГДА полный уровень!)
-      stereo_buffer_fragment[i] = stereo_buffer[src_idx];
-    } else {
-      // Правый канал = модуль, применяем gain
-      float scaled = stereo_buffer[src_idx] * gain;
-      stereo_buffer_fragment[i] = (scaled > 32767.0f) ? 32767 : (int16_t)scaled;
+      stereo_buffer_fragment[f * 2] = stereo_buffer[src_idx];
+      // Правый канал = модуль, применяем gain и подстройку полуволны
+      float g = (gain < 0.0f) ? 0.0f : gain;
+      g *= (stereo_buffer[src_idx] == DAC_SIGN_POSITIVE) ? trim_pos : trim_neg;
+      float scaled = stereo_buffer[src_idx + 1] * g;
+      stereo_buffer_fragment[f * 2 + 1] = (scaled > 32767.0f) ? 32767 : (int16_t)scaled;
+      gain += slope;
     }
   }
 }
 
-// Записать подготовленный фрагмент во внутренний DMA буфер I2S
-// timeout_ticks = 0 → неблокирующий; больше 0 → ждём указанное время
-static bool writeFragmentToDMA(TickType_t timeout_ticks) {
-  // Стартуем только с чётной позиции (L канал)
-  const uint32_t start_pos = stereo_buffer_pos & ~1u;
-  copyFragmentFromStereoBuffer(start_pos);
+// Отдать в DMA буфер I2S сколько влезет от текущего фрагмента (без ожидания)
+// Новый фрагмент готовится, только когда прежний принят целиком.
+// true — что-то записано; false — очередь DMA полна
+static bool writeFragmentToDMA() {
+  if (!fragment_ready) {
+    // Стартуем только с чётной позиции (L канал)
+    fragment_start_pos = stereo_buffer_pos & ~1u;
+    fragment_muted = dac_muted;
+    copyFragmentFromStereoBuffer(fragment_start_pos, dac_frames_written);
+    fragment_sent = 0;
+    fragment_ready = true;
+  }
   
   size_t bytes_written = 0;
-  const size_t bytes_to_write = FRAGMENT_SAMPLES * sizeof(int16_t);
-  
+  xSemaphoreTake(dac_i2s_mutex, portMAX_DELAY);
+  // Авария пришла после подготовки фрагмента — остаток уходит тишиной
+  if (dac_muted && !fragment_muted) {
+    memset(stereo_buffer_fragment + fragment_sent, 0,
+           (FRAGMENT_SAMPLES - fragment_sent) * sizeof(int16_t));
+    fragment_muted = true;
+  }
   esp_err_t result = i2s_write(I2S_NUM,
-                               stereo_buffer_fragment,
-                               bytes_to_write,
+                               stereo_buffer_fragment + fragment_sent,
+                               (FRAGMENT_SAMPLES - fragment_sent) * sizeof(int16_t),
                                &bytes_written,
-                               timeout_ticks);
+                               0);
+  xSemaphoreGive(dac_i2s_mutex);
   
-  if (result == ESP_OK && bytes_written > 0) {
-    uint32_t samples_written = bytes_written / sizeof(int16_t);
-    // Всегда сохраняем выравнивание по L/R
-    samples_written &= ~1u;
-    if (samples_written > 0) {
-      stereo_buffer_pos = (start_pos + samples_written) % STEREO_BUFFER_SIZE;
-    }
-    return true;
-  }
-  
-  if (result == ESP_ERR_TIMEOUT || bytes_written == 0) {
+  // Всегда сохраняем выравнивание по L/R
+  uint32_t samples_written = (bytes_written / sizeof(int16_t)) & ~1u;
+  if (result != ESP_OK || samples_written == 0) {
     // DMA заполнен - ничего страшного, позицию не меняем
     return false;
   }
   
-
-  return false;
+  // Начало лупа попало в записанную часть → когда оно выйдет на DAC
+  // (очередь DMA после записи полна: ~DAC_PIPELINE_FRAMES впереди)
+  const uint32_t start_pos = (fragment_start_pos + fragment_sent) % STEREO_BUFFER_SIZE;
+  uint32_t loop_start = STEREO_BUFFER_SIZE;  // Смещение начала лупа в записанной части
+  if (start_pos == 0) loop_start = 0;
+  else if (start_pos + samples_written > STEREO_BUFFER_SIZE) loop_start = STEREO_BUFFER_SIZE - start_pos;
+  
+  stereo_buffer_pos = (start_pos + samples_written) % STEREO_BUFFER_SIZE;
+  dac_frames_written += samples_written / 2;
+  fragment_sent += samples_written;
+  if (fragment_sent >= FRAGMENT_SAMPLES) fragment_ready = false;
+  
+  if (loop_start < STEREO_BUFFER_SIZE) {
+    noteDACLoopStart((int32_t)DAC_PIPELINE_FRAMES - (int32_t)((samples_written - loop_start) / 2));
+  }
+  return true;
 }
 
 // Инициализация I2S и DMA для DAC
@@ -174,7 +257,8 @@ void initDAC() {
     .data_in_num = I2S_PIN_NO_CHANGE
   };
 
-  i2s_driver_install(I2S_NUM, &i2s_config, 0, NULL);
+  dac_i2s_mutex = xSemaphoreCreateMutex();
+  i2s_driver_install(I2S_NUM, &i2s_config, DMA_BUFFER_COUNT, &dac_i2s_events);
   i2s_set_pin(I2S_NUM, &pin_config);
   i2s_set_clk(I2S_NUM, SAMPLE_RATE, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
 
@@ -214,16 +298,18 @@ void setSignalBuffer(int16_t* new_buffer, int num_samples) {
 // Предзаполнение DMA буферов
 void prefillDMABuffers() {
   
-  // Сбрасываем позицию
+  // Сбрасываем позицию и недописанный фрагмент
   stereo_buffer_pos = 0;
-  int fragments_written = 0;
+  fragment_ready = false;
+  int writes = 0;
   
   // Пытаемся заполнить DMA до отказа
-  while (writeFragmentToDMA(pdMS_TO_TICKS(1))) {
-    fragments_written++;
+  while (writeFragmentToDMA()) {
+    writes++;
   }
+  if (dac_i2s_events != NULL) xQueueReset(dac_i2s_events);  // Места больше нет — старые события не нужны
   
-  dma_prefilled = fragments_written > 0;
+  dma_prefilled = writes > 0;
   
   // Запускаем сбор ADC после небольшой задержки, чтобы исключить стартовые переходные процессы
   scheduleADCCaptureStart(ADC_CAPTURE_DELAY_MS);
@@ -249,18 +335,31 @@ bool keepDMAFilled() {
       Serial.printf("[DAC @%lus] LOOP GAP: %lu ms! UNDERRUN RISK\n", session_sec, gap_ms);
     }
   }
+  if (dac_active && last_call_ms > 0 && gap_ms > dac_loop_gap_max_ms) {
+    dac_loop_gap_max_ms = gap_ms;
+  }
   last_call_ms = now;
   
   if (!dac_active) {
     return false;
   }
-  // Timeout 10ms — достаточно чтобы дождаться места в буфере, но не блокировать надолго
+  // Новая задержка знака (замер перекоса): перезаписываем только левый канал
+  // (~30 мс на весь луп, DMA запас 400 мс)
+  if (sign_delay_pending) {
+    sign_delay_pending = false;
+    sign_delay_us = pending_sign_delay_us;
+    fillSignChannel();
+  }
+  // Очередь полна — ждём освобождения DMA буфера до 10 мс (вне мьютекса записи:
+  // задача аварии не ждёт loop), но не блокируем надолго
   // Заполняем все доступные DMA слоты, но ограничиваем число попыток
   bool result = false;
   const int kMaxWritesPerLoop = 4;
   for (int i = 0; i < kMaxWritesPerLoop; i++) {
-    if (!writeFragmentToDMA(pdMS_TO_TICKS(10))) {
-      break;
+    if (!writeFragmentToDMA()) {
+      i2s_event_t event;
+      if (xQueueReceive(dac_i2s_events, &event, pdMS_TO_TICKS(10)) != pdTRUE) break;
+      continue;
     }
     result = true;
   }
@@ -279,6 +378,51 @@ void setAmplitudeScale(float scale) {
   amplitude_scale = scale;
 }
 
+float getAmplitudeScale() {
+  return amplitude_scale;
+}
+
+void setDACCurrentTrim(float trim, float balance) {
+  pending_trim_pos = trim * (1.0f - balance);
+  pending_trim_neg = trim * (1.0f + balance);
+}
+
+float getDACTrimHeadroom() {
+  return (stereo_peak > 0) ? 32767.0f / stereo_peak : 1.0f;
+}
+
+int16_t getDACStereoPeak() {
+  return stereo_peak;
+}
+
+// Вызывается из задачи аварии (adc_control), не из loop: обнуляем всю очередь
+// DMA прямо в буферах драйвера (memset, без ожидания I2S), дальше — тишина.
+// Под мьютексом записи: недописанный i2s_write не продолжит копировать звук
+// в только что обнулённые буферы (ждём его конца, он не блокируется)
+void muteDACOutput() {
+  xSemaphoreTake(dac_i2s_mutex, portMAX_DELAY);
+  dac_muted = true;
+  i2s_zero_dma_buffer(I2S_NUM);
+  xSemaphoreGive(dac_i2s_mutex);
+}
+
+void clearDACMute() {
+  dac_muted = false;
+}
+
+bool isDACMuted() {
+  return dac_muted;
+}
+
+void setDACSignDelay(float delay_us) {
+  pending_sign_delay_us = delay_us;
+  sign_delay_pending = true;
+}
+
+float getDACSignDelay() {
+  return sign_delay_pending ? pending_sign_delay_us : sign_delay_us;
+}
+
 void resetDacPlayback() {
   // Полный перезапуск I2S, чтобы гарантированно убрать старые данные
   i2s_stop(I2S_NUM);
@@ -307,3 +451,12 @@ void stopDacPlayback() {
   }
 }
 
+uint32_t consumeDacLoopGapMax() {
+  uint32_t gap = dac_loop_gap_max_ms;
+  dac_loop_gap_max_ms = 0;
+  return gap;
+}
+
+uint64_t getDacFramesWritten() {
+  return dac_frames_written;
+}
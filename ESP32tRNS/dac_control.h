@@ -17,11 +17,31 @@ extern bool dma_prefilled;
 // Имя текущего пресета (например, "tACS 250Hz 1mA demo")
 extern char current_preset_name[PRESET_NAME_MAX_LEN];
 
-// Динамический коэффициент усиления (меняется на лету для fadein/fadeout)
-// fadein: 0.0 → 1.0, stable: 1.0, fadeout: 1.0 → 0.0
+// Динамический коэффициент усиления (fadein: 0.0 → 1.0, stable: 1.0, fadeout: 1.0 → 0.0)
+// Сам gain считается по таймлайну сеанса при заполнении фрагмента,
+// здесь — его значение на последнем отданном в I2S фрейме (для дисплея/журнала)
 extern float dynamic_dac_gain;
+// Монотонный счётчик стерео-фреймов, реально принятых I2S (часы сеанса)
+uint64_t getDacFramesWritten();
+
 // Масштаб амплитуды (0..1) для мА → код DAC
 void setAmplitudeScale(float scale);
+float getAmplitudeScale();
+
+// Подстройка тока регулятором (session_regulator) поверх amplitude_scale:
+// модуль × trim × (1 ∓ balance) для положительной/отрицательной полуволны
+// (balance > 0 убирает положительное DC). Применяется со следующего фрагмента
+void setDACCurrentTrim(float trim, float balance);
+// Запас до насыщения DAC: 32767 / пиковый модуль стерео-буфера (≥ 1)
+float getDACTrimHeadroom();
+// Пиковый модуль стерео-буфера, коды DAC (signal_buffer × amplitude_scale, без gain/trim)
+int16_t getDACStereoPeak();
+
+// Задержка канала знака относительно модуля, мкс (+ = знак отстаёт), во всех режимах:
+// начальная −TACS_SIGN_SHIFT_US, поправки — по замеру перекоса (pollADCSignSkew).
+// Применяется в keepDMAFilled (перезапись левого канала стерео-буфера)
+void setDACSignDelay(float delay_us);
+float getDACSignDelay();
 
 // Инициализация I2S и DMA для DAC
 void initDAC();
@@ -44,6 +64,12 @@ bool keepDMAFilled();
 // ВАЖНО: вызывать после generateSignal()!
 void updateStereoBuffer();
 
+// Аварийная тишина: обнулить очередь I2S DMA сейчас и выводить нули до clearDACMute
+// Безопасно из задачи выше loop (аварийная защита ADC)
+void muteDACOutput();
+void clearDACMute();
+bool isDACMuted();
+
 // Полный сброс DAC DMA и повторное заполнение буфера
 void resetDacPlayback();
 
@@ -51,5 +77,9 @@ void resetDacPlayback();
 void startDacPlayback();
 void stopDacPlayback();
 
+// Максимальный интервал между вызовами keepDMAFilled (мс) с прошлого вызова
+// (читается и сбрасывается журналом сеанса раз в секунду)
+uint32_t consumeDacLoopGapMax();
+
 #endif // DAC_CONTROL_H
 
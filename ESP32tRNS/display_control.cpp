@@ -4,6 +4,11 @@
 #include "adc_calibration.h"
 #include "menu_control.h"
 #include "session_control.h"
+#include "session_dosimetry.h"
+#include "adc_window_stats.h"
+#include "adc_envelope.h"
+#include "adc_crossing.h"
+#include "adc_lockin.h"
 #include "version.h"
 #include <Wire.h>
 #include <U8g2lib.h>
@@ -113,10 +118,10 @@ static void drawDottedHLine(uint8_t x, uint8_t y, uint8_t w) {
 // y_min, y_max — лимиты в мА
 // tick_positions[] — Y позиции для тиков (в мА), tick_labels[] — подписи
 // num_ticks — количество тиков
-// samples — сколько сэмплов показать (0 = весь буфер), start_offset — смещение от конца
+// view — окно кольца мкА (getADCMicroampView*); NULL — только сетка
 static void drawOscilloscope(float y_min, float y_max, 
                              const float* tick_positions, const char* const* tick_labels, uint8_t num_ticks,
-                             uint32_t samples, uint32_t start_offset) {
+                             const AdcRingView* view) {
   float y_range = y_max - y_min;
   if (y_range < 0.01f) y_range = 0.01f;
   
@@ -134,56 +139,53 @@ static void drawOscilloscope(float y_min, float y_max,
     }
   }
   
-  // Децимация: буфер → экран
-  if (samples == 0) samples = ADC_RING_SIZE;
-  uint32_t decimation = samples / SCOPE_W;
-  if (decimation < 1) decimation = 1;
-  
-  uint32_t buf_end = adc_write_index;
-  uint32_t buf_start = (buf_end + ADC_RING_SIZE - samples - start_offset) % ADC_RING_SIZE;
-  
-  int16_t prev_py = -1;
-  for (uint8_t x = 0; x < SCOPE_W; x++) {
-    uint32_t idx = (buf_start + x * decimation) % ADC_RING_SIZE;
-    int16_t raw = adc_ring_buffer[idx];
-    if (raw == ADC_INVALID_VALUE) continue;
-    
-    float mA = adcSignedToMilliamps(raw);
+  // Окно кольца мкА без копирования (индексы кольца — из seq_start)
+  if (view == NULL || view->total == 0) return;
+  uint32_t start = view->seq_start & (ADC_RING_SIZE - 1);
+  
+  // Масштаб в целых мкА: без LUT и float на каждую колонку
+  int32_t y_min_uA = (int32_t)(y_min * 1000.0f);
+  int32_t y_range_uA = (int32_t)(y_range * 1000.0f);
+  if (y_range_uA < 1) y_range_uA = 1;
+  
+  // Колонка = честные min/max своего отрезка окна (из пирамиды огибающей):
+  // шум выше частоты колонок рисуется полосой, а не алиасится в ложный сигнал
+  uint32_t columns = (view->total < SCOPE_W) ? view->total : SCOPE_W;
+  int16_t prev_top = -1, prev_bottom = -1;
+  for (uint32_t x = 0; x < columns; x++) {
+    uint32_t a = x * view->total / columns;
+    uint32_t b = (x + 1) * view->total / columns;
+    int16_t lo_uA, hi_uA;
+    if (!getADCEnvelope(adc_uA_ring_buffer, start + a, b - a, &lo_uA, &hi_uA)) continue;
     
-    // Нормализация в пиксели
-    float normalized = (mA - y_min) / y_range;
-    int16_t py = SCOPE_Y + SCOPE_H - 1 - (int16_t)(normalized * (SCOPE_H - 1));
-    if (py < SCOPE_Y) py = SCOPE_Y;
-    if (py > SCOPE_Y + SCOPE_H - 1) py = SCOPE_Y + SCOPE_H - 1;
+    // Нормализация в пиксели (верх = максимум)
+    int16_t top = SCOPE_Y + SCOPE_H - 1 - (int16_t)(((int32_t)hi_uA - y_min_uA) * (SCOPE_H - 1) / y_range_uA);
+    int16_t bottom = SCOPE_Y + SCOPE_H - 1 - (int16_t)(((int32_t)lo_uA - y_min_uA) * (SCOPE_H - 1) / y_range_uA);
+    if (top < SCOPE_Y) top = SCOPE_Y;
+    if (bottom > SCOPE_Y + SCOPE_H - 1) bottom = SCOPE_Y + SCOPE_H - 1;
+    if (top > SCOPE_Y + SCOPE_H - 1) top = SCOPE_Y + SCOPE_H - 1;
+    if (bottom < SCOPE_Y) bottom = SCOPE_Y;
     
-    // Рисуем линию от предыдущей точки
-    if (prev_py >= 0) {
-      u8g2.drawLine(SCOPE_X + x - 1, prev_py, SCOPE_X + x, py);
+    // Стыкуем с предыдущей колонкой, чтобы фронты не рвались
+    if (prev_top >= 0) {
+      if (top > prev_bottom) top = prev_bottom;
+      if (bottom < prev_top) bottom = prev_top;
     }
-    prev_py = py;
+    u8g2.drawVLine(SCOPE_X + x, top, bottom - top + 1);
+    prev_top = top;
+    prev_bottom = bottom;
   }
 }
 
-// Вычисление RMS и среднего из буфера
-static void calcBufferStats(float* mean_mA, float* rms_mA) {
-  double sum = 0, sum_sq = 0;
-  uint32_t count = 0;
-  
-  for (uint32_t i = 0; i < ADC_RING_SIZE; i++) {
-    int16_t raw = adc_ring_buffer[i];
-    if (raw == ADC_INVALID_VALUE) continue;
-    float mA = adcSignedToMilliamps(raw);
-    sum += mA;
-    sum_sq += mA * mA;
-    count++;
-  }
-  
-  if (count > 0) {
-    *mean_mA = sum / count;
-    *rms_mA = sqrtf(sum_sq / count);
+// Среднее и σ по всему кольцевому буферу (O(1): окно ведётся в ingest)
+static void calcBufferStats(float* mean_mA, float* sigma_mA) {
+  AdcWindowStats stats;
+  if (getADCWindowStats(ADC_WINDOW_RING, &stats)) {
+    *mean_mA = stats.mean_uA / 1000.0f;
+    *sigma_mA = stats.sigma_uA / 1000.0f;
   } else {
     *mean_mA = 0;
-    *rms_mA = 0;
+    *sigma_mA = 0;
   }
 }
 
@@ -204,13 +206,7 @@ static void drawMetricsAndProgress(const char* metric_str) {
   u8g2.drawStr(0, 52, line);
   
   // Тонкий прогресс-бар (1 пиксель) внизу экрана
-  uint16_t duration_min = current_settings.duration_tRNS_min;
-  switch (current_settings.mode) {
-    case MODE_TDCS: duration_min = current_settings.duration_tDCS_min; break;
-    case MODE_TACS: duration_min = current_settings.duration_tACS_min; break;
-    default: break;
-  }
-  uint32_t total_sec = duration_min * 60;
+  uint32_t total_sec = getSessionDurationSec();
   float progress = (total_sec > 0) ? ((float)elapsed_sec / total_sec) : 0;
   if (progress > 1.0f) progress = 1.0f;
   
@@ -235,16 +231,17 @@ static void renderDashboardTRNS() {
   snprintf(tick_minus, sizeof(tick_minus), "%.1f", -amp);
   const char* labels[] = { tick_plus, tick_zero, tick_minus };
   
-  drawOscilloscope(-amp * 1.2f, amp * 1.2f, ticks, labels, 3, 0, 0);
+  AdcRingView view;
+  bool have_view = getADCMicroampView(0, 0, &view);
+  drawOscilloscope(-amp * 1.2f, amp * 1.2f, ticks, labels, 3, have_view ? &view : NULL);
   
   // Метрики: 3σ
-  float mean_mA, rms_mA;
-  calcBufferStats(&mean_mA, &rms_mA);
-  float sigma = sqrtf(rms_mA * rms_mA - mean_mA * mean_mA);
+  float mean_mA, sigma;
+  calcBufferStats(&mean_mA, &sigma);
   
   char metric[16];
   // какая-то магическая константа вместо 3сигма -> 3.38сигма, потому что распределение не совсем гауссовое
-  snprintf(metric, sizeof(metric), "%.1fmA", sigma * 3.38);
+  snprintf(metric, sizeof(metric), "%.1fmA", sigma * TRNS_SIGMA_TO_AMPLITUDE);
   drawMetricsAndProgress(metric);
 }
 
@@ -264,11 +261,13 @@ static void renderDashboardTDCS() {
   snprintf(tick_amp, sizeof(tick_amp), "%.1f", amp);
   const char* labels[] = { tick_amp, tick_zero };
   
-  drawOscilloscope(-amp * 0.1f, amp * 1.2f, ticks, labels, 2, 0, 0);
+  AdcRingView view;
+  bool have_view = getADCMicroampView(0, 0, &view);
+  drawOscilloscope(-amp * 0.1f, amp * 1.2f, ticks, labels, 2, have_view ? &view : NULL);
   
   // Метрики: средний ток
-  float mean_mA, rms_mA;
-  calcBufferStats(&mean_mA, &rms_mA);
+  float mean_mA, sigma_mA;
+  calcBufferStats(&mean_mA, &sigma_mA);
   
   char metric[16];
   snprintf(metric, sizeof(metric), "%.1fmA", mean_mA);
@@ -278,7 +277,7 @@ static void renderDashboardTDCS() {
 // === ДАШБОРД tACS ===
 static void renderDashboardTACS() {
   float amp = current_settings.amplitude_tACS_mA;
-  float freq = current_settings.frequency_tACS_Hz;
+  float freq = (tacs_active_frequency > 0.0f) ? tacs_active_frequency : current_settings.frequency_tACS_Hz;
   
   // Строка 1: Конфиг
   u8g2.setFont(u8g2_font_6x12_t_cyrillic);
@@ -290,27 +289,14 @@ static void renderDashboardTACS() {
   uint32_t period_samples = (uint32_t)(ADC_SAMPLE_RATE / freq);
   uint32_t two_periods = period_samples * 2;
   
-  // Поиск фронта от конца буфера
-  uint32_t start_offset = 0;
-  uint32_t search_start = (adc_write_index + ADC_RING_SIZE - two_periods - 100) % ADC_RING_SIZE;
-  int16_t prev_raw = adc_ring_buffer[search_start];
-  uint8_t crossings_found = 0;
-  
-  for (uint32_t i = 1; i < two_periods + 100 && crossings_found < 3; i++) {
-    uint32_t idx = (search_start + i) % ADC_RING_SIZE;
-    int16_t raw = adc_ring_buffer[idx];
-    if (raw == ADC_INVALID_VALUE || prev_raw == ADC_INVALID_VALUE) {
-      prev_raw = raw;
-      continue;
-    }
-    if (prev_raw < 0 && raw >= 0) {
-      crossings_found++;
-      if (crossings_found == 1) {
-        start_offset = ADC_RING_SIZE - (search_start + i - adc_write_index + ADC_RING_SIZE) % ADC_RING_SIZE;
-      }
-    }
-    prev_raw = raw;
-  }
+  // Окно заканчивается на последнем фронте вверх (индекс переходов из ingest, O(1))
+  // Нет фронта или он уже вытеснен из кольца — просто последние 2 периода
+  AdcRingView view;
+  uint32_t edge_seq;
+  bool have_view = (getLastADCCrossing(true, &edge_seq) &&
+                    getADCMicroampViewEndingAt(two_periods, edge_seq, &view) &&
+                    view.total == two_periods) ||
+                   getADCMicroampView(two_periods, 0, &view);
   
   // Осциллограмма: 2 периода, ylim = ±amp*1.2, тики на ±amp и 0
   float ticks[] = { amp, 0, -amp };
@@ -319,12 +305,27 @@ static void renderDashboardTACS() {
   snprintf(tick_minus, sizeof(tick_minus), "%.1f", -amp);
   const char* labels[] = { tick_plus, tick_zero, tick_minus };
   
-  drawOscilloscope(-amp * 1.2f, amp * 1.2f, ticks, labels, 3, two_periods, start_offset);
+  drawOscilloscope(-amp * 1.2f, amp * 1.2f, ticks, labels, 3, have_view ? &view : NULL);
   
-  // Метрики: амплитуда
-  float mean_mA, rms_mA;
-  calcBufferStats(&mean_mA, &rms_mA);
-  float amplitude_mA = sqrtf(rms_mA * rms_mA - mean_mA * mean_mA) * 1.414f;
+  // Измеренная частота и джиттер периода (по фронтам из ingest)
+  float measured_hz, jitter_ms;
+  if (getADCCycleStats(&measured_hz, &jitter_ms)) {
+    char cycle[20];
+    snprintf(cycle, sizeof(cycle), "%.1fHz j%.1fms", measured_hz, jitter_ms);
+    u8g2.setFont(u8g2_font_4x6_tr);
+    u8g2.drawStr(128 - 4 * strlen(cycle), SCOPE_Y, cycle);
+  }
+  
+  // Метрики: амплитуда на частоте стимуляции (lock-in по фазе лупа)
+  // Пока окно lock-in не заполнено — грубая оценка по RMS
+  float amplitude_mA, amplitude_uA;
+  if (getADCLockIn(&amplitude_uA, NULL)) {
+    amplitude_mA = amplitude_uA / 1000.0f;
+  } else {
+    float mean_mA, sigma_mA;
+    calcBufferStats(&mean_mA, &sigma_mA);
+    amplitude_mA = sigma_mA * 1.414f;
+  }
   
   char metric[16];
   snprintf(metric, sizeof(metric), "%.1fmA", amplitude_mA);
@@ -335,7 +336,8 @@ static void renderDashboardTACS() {
 void refreshDisplay() {
   u8g2.clearBuffer();
   
-  switch (current_settings.mode) {
+  // Во время сеанса — режим, который играет (протокол может его менять)
+  switch (current_state == STATE_IDLE ? current_settings.mode : session_mode) {
     case MODE_TRNS:
       renderDashboardTRNS();
       break;
@@ -458,8 +460,8 @@ void renderCurrentScreen() {
       
     case SCR_MAIN_MENU:
       {
-        const char* choices[] = { "tRNS", "tDCS", "tACS", "Настройки" };
-        renderMenu("Главное меню", choices, 4, menu_selected);
+        const char* choices[] = { "tRNS", "tDCS", "tACS", "Протокол", "Настройки" };
+        renderMenu("Главное меню", choices, 5, menu_selected);
       }
       break;
       
@@ -504,8 +506,8 @@ void renderCurrentScreen() {
         snprintf(adc_str, sizeof(adc_str), "ADC mult: %.2f", current_settings.adc_multiplier);
         snprintf(trns_str, sizeof(trns_str), "tRNS mult: %.2f", current_settings.trns_multiplier);
         snprintf(ver_str, sizeof(ver_str), "v%s", FIRMWARE_VERSION);
-        const char* choices[] = { "<-Назад", enc_str, pol_str, dac_str, fade_str, adc_str, trns_str, "СБРОС на заводские", ver_str, ">>> ОБНОВЛЕНИЕ <<<" };
-        renderMenu("НАСТРОЙКИ", choices, 10, menu_selected);
+        const char* choices[] = { "<-Назад", enc_str, pol_str, dac_str, fade_str, adc_str, trns_str, "Автокалибровка ADC", "СБРОС на заводские", ver_str, ">>> ОБНОВЛЕНИЕ <<<" };
+        renderMenu("НАСТРОЙКИ", choices, 11, menu_selected);
       }
       break;
       
@@ -522,14 +524,18 @@ void renderCurrentScreen() {
         u8g2.clearBuffer();
         u8g2.setFont(u8g2_font_7x13_t_cyrillic);
         u8g2.setCursor(0, 0);
-        u8g2.print("СЕАНС ЗАВЕРШЕН");
+        // Авария/плохой контакт — причина вместо заголовка
+        SessionStopReason reason = getSessionStopReason();
+        if (reason >= STOP_OVERCURRENT) {
+          u8g2.print("СТОП: ");
+          u8g2.print(getStopReasonName(reason));
+        } else {
+          u8g2.print("СЕАНС ЗАВЕРШЕН");
+        }
 
         
         u8g2.setFont(u8g2_font_6x12_t_cyrillic);
         char info_str[32];
-        snprintf(info_str, sizeof(info_str), "%s", getModeName(current_settings.mode));
-        u8g2.setCursor(10, 35);
-        u8g2.print(info_str);
         
         // Показываем фактическое время сеанса в формате MM:SS
         extern uint32_t session_elapsed_sec;
@@ -538,14 +544,28 @@ void renderCurrentScreen() {
         
         // Выбираем амплитуду в зависимости от режима
         float amplitude = DEF_AMPLITUDE_MA;  // дефолт из config.h
-        switch (current_settings.mode) {
+        switch (session_mode) {
           case MODE_TRNS: amplitude = current_settings.amplitude_tRNS_mA; break;
           case MODE_TDCS: amplitude = current_settings.amplitude_tDCS_mA; break;
           case MODE_TACS: amplitude = current_settings.amplitude_tACS_mA; break;
         }
         
-        snprintf(info_str, sizeof(info_str), "%.1fmA %u:%02u", amplitude, mins, secs);
-        u8g2.setCursor(10, 47);
+        snprintf(info_str, sizeof(info_str), "%s %.1fmA %u:%02u",
+                 getModeName(session_mode), amplitude, mins, secs);
+        u8g2.setCursor(0, 16);
+        u8g2.print(info_str);
+        
+        // Дозиметрия: заряд, DC-баланс, RMS, время в допуске
+        DosimetryReport dose;
+        getSessionDosimetry(&dose);
+        snprintf(info_str, sizeof(info_str), "Q %.1fmC", dose.abs_charge_mC);
+        u8g2.setCursor(0, 28);
+        u8g2.print(info_str);
+        snprintf(info_str, sizeof(info_str), "DC %+.2fmC", dose.net_charge_mC);
+        u8g2.setCursor(0, 40);
+        u8g2.print(info_str);
+        snprintf(info_str, sizeof(info_str), "RMS %.2fmA  %.0f%%", dose.rms_mA, dose.in_spec_pct);
+        u8g2.setCursor(0, 52);
         u8g2.print(info_str);
         u8g2.sendBuffer();
       }
@@ -1,6 +1,7 @@
 #include "menu_control.h"
 #include "session_control.h"
 #include "display_control.h"
+#include "adc_autocal.h"
 #include "esp32s2/rom/rtc.h"
 #include <esp_system.h>
 #include <rom/rtc.h>
@@ -114,8 +115,8 @@ void handleRotate(int8_t delta) {
       break;
       
     case SCR_MAIN_MENU:
-      // Выбор: tRNS, tDCS, tACS, Настройки (4 опции, 0-3)
-      menu_selected = constrain(menu_selected - delta, 0, 3);
+      // Выбор: tRNS, tDCS, tACS, Протокол, Настройки (5 опций, 0-4)
+      menu_selected = constrain(menu_selected - delta, 0, 4);
       break;
       
     case SCR_TRNS_MENU:
@@ -131,8 +132,8 @@ void handleRotate(int8_t delta) {
       break;
       
     case SCR_SETTINGS_MENU:
-      // Общие настройки: 10 опций (0-9)
-      menu_selected = constrain(menu_selected - delta, 0, 9);
+      // Общие настройки: 11 опций (0-10)
+      menu_selected = constrain(menu_selected - delta, 0, 10);
       break;
       
     case SCR_EDITOR:
@@ -235,7 +236,14 @@ void executeMainMenuChoice() {
     case 0: pushScreen(SCR_TRNS_MENU); break;
     case 1: pushScreen(SCR_TDCS_MENU); break;
     case 2: pushScreen(SCR_TACS_MENU); break;
-    case 3: pushScreen(SCR_SETTINGS_MENU); break;
+    case 3:
+      // Протокол из ffat: при ошибке остаёмся в меню (причина — в Serial)
+      if (startProtocolSession()) {
+        stack_depth = 0;
+        screen_stack[0] = SCR_DASHBOARD;
+      }
+      break;
+    case 4: pushScreen(SCR_SETTINGS_MENU); break;
   }
 }
 
@@ -325,7 +333,7 @@ void executeSessionMenuChoice(StimMode mode) {
 // === ВЫПОЛНЕНИЕ ВЫБОРА В МЕНЮ ОБЩИХ НАСТРОЕК ===
 void executeSettingsMenuChoice() {
   // Структура меню:
-  // const char* choices[] = { "<-Назад", enc_str, pol_str, dac_str, fade_str, adc_str, trns_str, "СБРОС на заводские" };
+  // const char* choices[] = { "<-Назад", enc_str, pol_str, dac_str, fade_str, adc_str, trns_str, "Автокалибровка ADC", "СБРОС на заводские", ver_str, ">>> ОБНОВЛЕНИЕ <<<" };
   // 0: Назад
   // 1: Энкодер: toggle
   // 2: Полярность: toggle
@@ -333,7 +341,8 @@ void executeSettingsMenuChoice() {
   // 4: Плавный пуск, с
   // 5: ADC множитель (калибровка показометра)
   // 6: tRNS множитель (компенсация 3σ)
-  // 7: Сбросить на заводские
+  // 7: Автокалибровка ADC (лестница DAC в эталонную нагрузку)
+  // 8: Сбросить на заводские
   
   switch (menu_selected) {
     case 0:  // Назад
@@ -363,13 +372,19 @@ void executeSettingsMenuChoice() {
       openEditor("tRNS mult", &current_settings.trns_multiplier, 
                  TRNS_MULTIPLIER_INCREMENT, MIN_TRNS_MULTIPLIER, MAX_TRNS_MULTIPLIER, false);
       break;
-    case 7:  // Сбросить на заводские
+    case 7:  // Автокалибровка ADC: идёт как сеанс, итог — в Serial и на SCR_FINISH
+      if (startADCAutoCalibration()) {
+        stack_depth = 0;
+        screen_stack[0] = SCR_DASHBOARD;
+      }
+      break;
+    case 8:  // Сбросить на заводские
       resetToDefaults();
       popScreen();  // Вернуться в главное меню
       break;
-    case 8:  // Версия (только просмотр)
+    case 9:  // Версия (только просмотр)
       break;
-    case 9:  // Обновление прошивки → TinyUF2 bootloader
+    case 10:  // Обновление прошивки → TinyUF2 bootloader
       Serial.printf("[UF2] Menu update click, screen=%d, selected=%d\n", current_screen, menu_selected);
       rebootToUF2Partition();
       break;
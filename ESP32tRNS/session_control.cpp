@@ -1,18 +1,33 @@
 #include "session_control.h"
 #include "dac_control.h"
 #include "preset_storage.h"
+#include "adc_calibration.h"
+#include "adc_control.h"
+#include "adc_loop_average.h"
+#include "adc_spectrum.h"
+#include "adc_lockin.h"
+#include "adc_transfer.h"
+#include "adc_trip.h"
+#include "adc_contact.h"
+#include "adc_history.h"
+#include "session_dosimetry.h"
+#include "session_regulator.h"
+#include "adc_autocal.h"
+#include "session_log.h"
+#include "stim_protocol.h"
+#include "session_resume.h"
+#include <esp_timer.h>
 #include <EEPROM.h>
 #include <math.h>
 
 // === ГЛОБАЛЬНЫЕ ПЕРЕМЕННЫЕ ===
 SessionSettings current_settings;
 SessionState current_state = STATE_IDLE;
+StimMode session_mode = MODE_TRNS;
 uint32_t session_elapsed_sec = 0;  // Фактическое время последнего сеанса (секунды)
 uint32_t session_timer_start_ms = 0;  // Время старта сеанса для таймера на дисплее
 float tacs_active_frequency = 0.0f;  // Текущая частота tACS (для фазовой компенсации)
-
-// === ВНУТРЕННИЕ ПЕРЕМЕННЫЕ ===
-static uint32_t session_start_time = 0;     // Время старта текущего состояния сеанса
+static bool calibration_session = false;  // Калибровочный сеанс: лестница adc_autocal вместо tDCS
 
 // EEPROM адреса
 #define EEPROM_SIZE 512
@@ -49,6 +64,7 @@ void initSession() {
   // EEPROM.begin() уже вызван в setup() до аллокации буферов!
   loadSettings();
   current_state = STATE_IDLE;
+  session_mode = current_settings.mode;
   Serial.println("[SESSION] initSession() done");
 }
 
@@ -91,6 +107,7 @@ void saveSettings() {
 void resetToDefaults() {
   current_settings = default_settings;
   saveSettings();
+  resetADCCalibrationTable();  // Заводская таблица показометра (adc_multiplier уже по умолчанию)
 }
 
 // === ГЕНЕРАЦИЯ СИГНАЛОВ ===
@@ -106,8 +123,8 @@ static void generateTDCS() {
 }
 
 // Генератор tACS - синусоида
-static void generateTACS() {
-  float freq = getValidTACSFrequency(current_settings.frequency_tACS_Hz);
+static void generateTACS(float target_Hz) {
+  float freq = getValidTACSFrequency(target_Hz);
   tacs_active_frequency = freq;  // Сохраняем для фазовой компенсации в DAC
   float omega = 2.0f * PI * freq / SAMPLE_RATE;
   
@@ -121,9 +138,9 @@ static void generateTACS() {
            freq, current_settings.amplitude_tACS_mA);
 }
 
-// Главная функция генерации
-void generateSignal() {
-  switch (current_settings.mode) {
+// Генерация формы сигнала по режиму (частота — только для tACS)
+static void generateWaveform(StimMode mode, float freq_Hz) {
+  switch (mode) {
     case MODE_TRNS:
       // Загружаем tRNS пресет из PROGMEM при каждом старте
       if (!loadPresetFromFlash(signal_buffer, current_preset_name, PRESET_NAME_MAX_LEN)) {
@@ -134,161 +151,507 @@ void generateSignal() {
       break;
       
     case MODE_TDCS:
-      generateTDCS();
+      if (calibration_session) fillADCCalibrationLadder(signal_buffer);
+      else generateTDCS();
       break;
       
     case MODE_TACS:
-      generateTACS();
+      generateTACS(freq_Hz);
       break;
   }
+}
+
+// Главная функция генерации
+void generateSignal() {
+  generateWaveform(current_settings.mode, current_settings.frequency_tACS_Hz);
   
   // ВАЖНО: dynamic_dac_gain НЕ трогаем здесь!
   // Он управляется автоматически в updateSession() для fadein/fadeout
   // Амплитуда регулируется через scaling в signal_buffer (уже учтено в генераторах)
 }
 
+// Амплитуда текущего режима (мА)
+static float getModeAmplitude(StimMode mode) {
+  if (calibration_session) return ADC_CAL_MAX_MA;
+  switch (mode) {
+    case MODE_TDCS: return current_settings.amplitude_tDCS_mA;
+    case MODE_TACS: return current_settings.amplitude_tACS_mA;
+    case MODE_TRNS: default: return current_settings.amplitude_tRNS_mA;
+  }
+}
+
+// Масштаб DAC (мА → код) и цель дозиметрии для текущего режима
+static void applyModeScaling() {
+  float amplitude_mA = getModeAmplitude(session_mode);
+  
+  // dac_code_to_mA = сколько КОДОВ на 1 мА
+  float target_code;
+  if (session_mode == MODE_TRNS) {
+    // tRNS: применяем trns_multiplier для компенсации того, что 3σ шума < amplitude
+    // При Гауссовом шуме ~99.7% значений в пределах ±3σ, но пресет обрезан по ±32767
+    // trns_multiplier ~1.2 подтягивает 3σ ближе к заданной amplitude
+    target_code = amplitude_mA * current_settings.dac_code_to_mA * current_settings.trns_multiplier;
+  } else {
+    target_code = amplitude_mA * current_settings.dac_code_to_mA;
+  }
+  if (current_settings.dac_code_to_mA <= 0.0f) target_code = 0.0f;
+  if (target_code < 0.0f) target_code = 0.0f;
+  if (target_code > 32767.0f) target_code = 32767.0f;
+  setAmplitudeScale(target_code / 32767.0f);
+  // Стерео-буфер под новый масштаб — пик команды ниже берётся из него
+  updateStereoBuffer();
+  
+  // Пик команды (мкА): фактический модуль стерео-буфера, а не amplitude_mA —
+  // в tRNS масштаб включает trns_multiplier, форма пресета обрезана по ±32767
+  float peak_uA = (current_settings.dac_code_to_mA > 0.0f)
+                    ? getDACStereoPeak() * 1000.0f / current_settings.dac_code_to_mA : 0.0f;
+  // Регулятор может поднять полуволну до trim × (1 + balance), но не выше 32767
+  float trip_peak_uA = peak_uA;
+#if SESSION_REG_ENABLE
+  if (!calibration_session && current_settings.dac_code_to_mA > 0.0f) {
+    float reg_peak_code = getDACStereoPeak() * SESSION_REG_TRIM_MAX * (1.0f + SESSION_REG_DC_MAX);
+    if (reg_peak_code > 32767.0f) reg_peak_code = 32767.0f;
+    trip_peak_uA = reg_peak_code * 1000.0f / current_settings.dac_code_to_mA;
+  }
+#endif
+  
+  // Цель дозиметрии: tDCS — средний ток, tACS — RMS синуса, tRNS — σ
+  // (amp × trns_multiplier / 3.38 — тот же множитель, что и в разомкнутом масштабе,
+  // иначе регулятор тянул бы trim к 1 / trns_multiplier и упирался в TRIM_MIN)
+  float target_metric_mA = amplitude_mA;
+  if (session_mode == MODE_TACS) target_metric_mA = amplitude_mA / sqrtf(2.0f);
+  if (session_mode == MODE_TRNS) {
+    target_metric_mA = amplitude_mA * current_settings.trns_multiplier / TRNS_SIGMA_TO_AMPLITUDE;
+  }
+  setSessionDosimetryTarget((int32_t)(target_metric_mA * 1000.0f + 0.5f));
+  // Замкнутый контур тока — к той же цели (trim/balance с нуля под новую форму)
+  // (калибровка: цель 0 — контур выключен, лестница идёт как задана)
+  configureSessionRegulator(session_mode,
+                            calibration_session ? 0 : (int32_t)(target_metric_mA * 1000.0f + 0.5f));
+  // Модель оценщика тока ADC: форма сигнала режима + размах команды
+  configureADCEstimator(session_mode, (int32_t)(peak_uA + 0.5f));
+  // Аварийная защита: порог от наибольшего пика, который может выйти из DAC (сбрасывает защёлку)
+  configureADCTrip(session_mode, (int32_t)(trip_peak_uA + 0.5f));
+  // Контроль контакта: мкА на код signal_buffer (сбрасывает защёлку)
+  // (калибровка: 0 — выключен, показометр ещё не откалиброван)
+  float uA_per_code = (current_settings.dac_code_to_mA > 0.0f && !calibration_session)
+                        ? getAmplitudeScale() * 1000.0f / current_settings.dac_code_to_mA : 0.0f;
+  configureADCContact(uA_per_code);
+}
+
+// === ТАЙМЛАЙН СЕАНСА (в DAC-фреймах) ===
+// Вся временная логика считается по счётчику фреймов, реально отданных в I2S
+// (getDacFramesWritten), а не по millis(). Gain — чистая функция номера фрейма,
+// поэтому рампы/удержания/конец сеанса точны до сэмпла и не зависят от джиттера loop().
+// Сеанс исполняет протокол (stim_protocol): обычный сеанс — протокол из трёх
+// сегментов fadein → stable → fadeout. Ручной стоп накладывается поверх протокола.
+struct SessionTimeline {
+  bool active;                 // Сеанс запущен (до конца fadeout)
+  uint64_t start_frame;        // Фрейм начала протокола
+  uint32_t fade_frames;        // Длительность полного fadeout при ручном стопе
+  bool stopped;                // Ручной стоп: fadeout с произвольного фрейма
+  uint64_t fadeout_frame;      // Фрейм начала fadeout
+  float fadeout_gain;          // Gain в момент начала fadeout
+  uint32_t fadeout_frames;     // Длительность fadeout (∝ fadeout_gain)
+  uint8_t fadeout_waveform;    // Форма сигнала, которая доигрывает fadeout
+};
+
+static StimProtocol session_protocol;          // Протокол текущего сеанса
+static ProtocolTimeline protocol_timeline;     // Развёрнутые шаги протокола
+static SessionTimeline timeline = {};
+static uint8_t loaded_waveform = 0;            // Форма сигнала в signal_buffer
+static bool dac_drain_pending = false;   // Ждём, пока хвост fadeout доиграет из DMA
+static uint64_t session_end_frame = 0;
+static SessionStopReason stop_reason = STOP_COMPLETED;
+static uint64_t session_offset_frames = 0;     // Сыграно до сбоя (продолжение сеанса)
+static uint8_t session_resume_attempts = 0;    // Сколько раз подряд сеанс продолжали
+static bool resume_latency_pending = false;     // Ждём первый ненулевой фрейм после resume
+static uint64_t next_snapshot_frame = 0;       // Следующий снимок в RTC память
+
+// Минимальная длительность fadeout (0.1 с)
+#define MIN_FADEOUT_FRAMES  (SAMPLE_RATE / 10)
+
+static uint32_t fadeoutFramesFor(uint32_t fade_frames, float start_gain) {
+  // Время fadeout пропорционально текущему gain: если gain=0.5, то fadeout=fade/2
+  uint32_t frames = (uint32_t)(start_gain * fade_frames);
+  return (frames < MIN_FADEOUT_FRAMES) ? MIN_FADEOUT_FRAMES : frames;
+}
+
+// Состояние и линейный участок gain на фрейме frame (чистая функция таймлайна)
+// gain — значение на frame, slope — приращение на фрейм,
+// run — сколько фреймов участок остаётся линейным (до следующего излома),
+// waveform — индекс формы сигнала, которая должна звучать на этом фрейме
+static SessionState timelineAt(const SessionTimeline* tl, ProtocolTimeline* ptl, uint64_t frame,
+                               float* gain, float* slope, uint32_t* run, uint8_t* waveform) {
+  *gain = 0.0f;
+  *slope = 0.0f;
+  *run = UINT32_MAX;
+  *waveform = loaded_waveform;
+  if (!tl->active || frame < tl->start_frame) {
+    return STATE_IDLE;
+  }
+
+  if (tl->stopped && frame >= tl->fadeout_frame) {
+    uint64_t fadeout_end = tl->fadeout_frame + tl->fadeout_frames;
+    if (frame >= fadeout_end) {
+      return STATE_IDLE;
+    }
+    float g0 = tl->fadeout_gain;
+    *slope = -g0 / (float)tl->fadeout_frames;
+    *gain = g0 + *slope * (float)(frame - tl->fadeout_frame);
+    *run = (uint32_t)(fadeout_end - frame);
+    *waveform = tl->fadeout_waveform;
+    return STATE_FADEOUT;
+  }
+
+  int idx = findProtocolStep(ptl, frame - tl->start_frame);
+  if (idx < 0) {
+    return STATE_IDLE;
+  }
+  const ProtocolStep* step = &ptl->steps[idx];
+  uint32_t offset = (uint32_t)(frame - tl->start_frame - step->start_frame);
+  *slope = step->slope;
+  *gain = step->gain + step->slope * (float)offset;
+  *run = step->frames - offset;
+  *waveform = step->waveform;
+  if (tl->stopped && tl->fadeout_frame - frame < *run) {
+    *run = (uint32_t)(tl->fadeout_frame - frame);
+  }
+
+  if (step->kind == SEG_RAMP && step->slope > 0.0f) return STATE_FADEIN;
+  if (step->kind == SEG_RAMP && step->slope < 0.0f) return STATE_FADEOUT;
+  return STATE_STABLE;
+}
+
+static uint64_t getSessionEndFrame(const SessionTimeline* tl) {
+  if (tl->stopped) {
+    return tl->fadeout_frame + tl->fadeout_frames;
+  }
+  return tl->start_frame + protocol_timeline.total_frames;
+}
+
+void getSessionGainSegment(uint64_t frame, float* gain, float* slope, uint32_t* run) {
+  uint8_t waveform;
+  timelineAt(&timeline, &protocol_timeline, frame, gain, slope, run, &waveform);
+  if (waveform != loaded_waveform) {
+    // Форма ещё не перегенерирована (loop не успел) — тишина вместо чужого сигнала
+    *gain = 0.0f;
+    *slope = 0.0f;
+  }
+}
+
+uint64_t getSessionPlayedFrames() {
+  uint64_t written = getDacFramesWritten() - timeline.start_frame;
+  uint64_t played = (written > DAC_PIPELINE_FRAMES) ? written - DAC_PIPELINE_FRAMES : 0;
+  return played + session_offset_frames;
+}
+
+uint32_t getSessionDurationSec() {
+  if (timeline.active || session_end_frame > timeline.start_frame) {
+    return (uint32_t)((getSessionEndFrame(&timeline) - timeline.start_frame + session_offset_frames) / SAMPLE_RATE);
+  }
+  uint16_t duration_min = current_settings.duration_tRNS_min;
+  switch (current_settings.mode) {
+    case MODE_TDCS: duration_min = current_settings.duration_tDCS_min; break;
+    case MODE_TACS: duration_min = current_settings.duration_tACS_min; break;
+    default: break;
+  }
+  return (uint32_t)duration_min * 60;
+}
+
+// Загрузить форму сигнала протокола в signal_buffer (вне real-time пути)
+static void loadProtocolWaveform(uint8_t index) {
+  const ProtocolWaveform* wf = &protocol_timeline.waveforms[index];
+  session_mode = (StimMode)wf->mode;
+  generateWaveform(session_mode, wf->freq_Hz);
+  // Стерео-буфер обновляется внутри: пик команды нужен для порогов аварии
+  applyModeScaling();
+  loaded_waveform = index;
+  // Новая форма — когерентное среднее по лупам с нуля
+  resetADCLoopAverage();
+  resetADCSpectrumReference();
+  configureADCLockIn(session_mode == MODE_TACS ? tacs_active_frequency : 0.0f);
+  resetADCTransfer();
+}
+
+// Частота АЦП на весь сеанс: смена формы внутри протокола не перезапускает
+// драйвер (иначе разрыв в adc_sample_seq сбил бы фазу лупа), поэтому ×R,
+// если хоть одна форма широкополосная; чистый tDCS — ×1
+static AdcRateProfile protocolRateProfile() {
+  for (uint16_t i = 0; i < protocol_timeline.waveform_count; i++) {
+    if (protocol_timeline.waveforms[i].mode != MODE_TDCS) return ADC_RATE_FULL;
+  }
+  return ADC_RATE_DC;
+}
+
 // === УПРАВЛЕНИЕ СЕАНСОМ ===
+
+// Запуск подготовленного session_protocol с текущего DAC-фрейма
+static void runSessionProtocol() {
+  prepareProtocolTimeline(&session_protocol, &protocol_timeline);
+  resume_latency_pending = false;  // Выставит resumeSession()
+  clearDACMute();  // Тишина после аварии держится до нового сеанса
+  
+  // Калибровка ADC (мкА) с актуальным adc_multiplier + сброс дозиметрии
+  updateADCCalibrationScale();
+  resetSessionDosimetry(0, ADC_SAMPLE_RATE);
+  
+  // Первая форма сигнала протокола (масштаб амплитуды и цель дозиметрии — внутри)
+  loadProtocolWaveform(protocol_timeline.steps[0].waveform);
+
+  // Старт — со следующего фрейма, который уйдёт в I2S (до prefill!)
+  uint32_t fade_frames = (uint32_t)(current_settings.fade_duration_sec * SAMPLE_RATE);
+  if (fade_frames < 1) fade_frames = 1;
+  timeline.active = true;
+  timeline.start_frame = getDacFramesWritten();
+  timeline.fade_frames = fade_frames;
+  timeline.stopped = false;
+  timeline.fadeout_frame = 0;
+  timeline.fadeout_gain = 0.0f;
+  timeline.fadeout_frames = 0;
+  timeline.fadeout_waveform = loaded_waveform;
+  dac_drain_pending = false;
+  session_end_frame = 0;
+  stop_reason = STOP_COMPLETED;
+  
+  // Снимок для продолжения после сбоя: протокол — сейчас, позиция — в updateSession()
+  armResumeSnapshot(&session_protocol, session_offset_frames, session_resume_attempts);
+  next_snapshot_frame = timeline.start_frame;
+  
+  // НАЧИНАЕМ с нулевого gain!
+  dynamic_dac_gain = 0.0f;
+  current_state = STATE_FADEIN;
+  
+  // АЦП под режимы протокола — до prefill: перезапуск драйвера укладывается
+  // в ADC_CAPTURE_DELAY_MS, переходные фреймы в кольцо не попадают
+  setADCRateProfile(protocolRateProfile());
+  resetADCHistory();  // История тока — с первого сэмпла этого сеанса
+  
+  // Сбрасываем DMA и заполняем заново, чтобы не играть старый мусор
+  // (prefill уже идёт по таймлайну — первые фреймы протокола)
+  resetDacPlayback();
+
+  // Включаем DAC только при старте сеанса
+  startDacPlayback();
+  
+  // СБРАСЫВАЕМ ТАЙМЕР СЕАНСА! (при продолжении — с учётом уже сыгранного)
+  session_timer_start_ms = millis() - (uint32_t)(session_offset_frames * 1000 / SAMPLE_RATE);
+  
+  // Новый файл журнала сеанса (открывается фоновой задачей)
+  startSessionLog();
+}
+
 void startSession() {
   if (current_state == STATE_IDLE) {
-    // Генерируем сигнал для текущего режима
-    generateSignal();  // Всегда вызываем - и для tRNS обновит имя
-    
-    // Настраиваем масштаб амплитуды по мА → код DAC
-    float amplitude_mA = current_settings.amplitude_tRNS_mA;
+    calibration_session = false;
+    uint16_t duration_min = current_settings.duration_tRNS_min;
     switch (current_settings.mode) {
-      case MODE_TDCS: amplitude_mA = current_settings.amplitude_tDCS_mA; break;
-      case MODE_TACS: amplitude_mA = current_settings.amplitude_tACS_mA; break;
+      case MODE_TDCS: duration_min = current_settings.duration_tDCS_min; break;
+      case MODE_TACS: duration_min = current_settings.duration_tACS_min; break;
       case MODE_TRNS: default: break;
     }
     
-    // dac_code_to_mA = сколько КОДОВ на 1 мА
-    float target_code;
-    if (current_settings.mode == MODE_TRNS) {
-      // tRNS: применяем trns_multiplier для компенсации того, что 3σ шума < amplitude
-      // При Гауссовом шуме ~99.7% значений в пределах ±3σ, но пресет обрезан по ±32767
-      // trns_multiplier ~1.2 подтягивает 3σ ближе к заданной amplitude
-      target_code = amplitude_mA * current_settings.dac_code_to_mA * current_settings.trns_multiplier;
-    } else {
-      target_code = amplitude_mA * current_settings.dac_code_to_mA;
-    }
-    if (current_settings.dac_code_to_mA <= 0.0f) target_code = 0.0f;
-    if (target_code < 0.0f) target_code = 0.0f;
-    if (target_code > 32767.0f) target_code = 32767.0f;
-    setAmplitudeScale(target_code / 32767.0f);
-    
-    // ВАЖНО: Обновляем стерео-буфер после генерации сигнала!
-    updateStereoBuffer();
+    // Протокол из одного цикла: fadein + stable + fadeout = duration
+    uint32_t fade_frames = (uint32_t)(current_settings.fade_duration_sec * SAMPLE_RATE);
+    if (fade_frames < 1) fade_frames = 1;
+    uint64_t total_frames = (uint64_t)duration_min * 60 * SAMPLE_RATE;
+    uint64_t stable_frames = (total_frames > 2ULL * fade_frames) ? (total_frames - 2ULL * fade_frames) : 0;
+    buildSingleCycleProtocol(current_settings.mode,
+                             getValidTACSFrequency(current_settings.frequency_tACS_Hz),
+                             fade_frames, (uint32_t)stable_frames, &session_protocol);
+    session_offset_frames = 0;
+    session_resume_attempts = 0;
+    runSessionProtocol();
+  }
+}
 
-    // Сбрасываем DMA и заполняем заново, чтобы не играть старый мусор
-    resetDacPlayback();
+bool startProtocolSession() {
+  if (current_state != STATE_IDLE) return false;
+  
+  // Файл протокола читается и компилируется здесь, до старта DAC
+  char err[48];
+  if (!loadProtocolFromFlash(&session_protocol, err, sizeof(err))) {
+    Serial.printf("[SESSION] Protocol error: %s\n", err);
+    return false;
+  }
+  Serial.printf("[SESSION] Protocol: %u segments\n", (unsigned)session_protocol.count);
+  calibration_session = false;
+  session_offset_frames = 0;
+  session_resume_attempts = 0;
+  runSessionProtocol();
+  return true;
+}
 
-    // Включаем DAC только при старте сеанса
-    startDacPlayback();
-    
-    // СБРАСЫВАЕМ ТАЙМЕР СЕАНСА!
-    session_timer_start_ms = millis();
-    
-    // НАЧИНАЕМ FADEIN с нулевого gain!
-    dynamic_dac_gain = 0.0f;
-    session_start_time = millis();
-    current_state = STATE_FADEIN;
+bool resumeSession() {
+  const ResumeSnapshot* snap = getResumeSnapshot();
+  if (snap == NULL || current_state != STATE_IDLE) return false;
+  
+  // Остаток протокола с сохранённой позиции + защитная рампа 0 → gain
+  uint32_t ramp_frames = (uint32_t)(((uint64_t)SESSION_RESUME_RAMP_MS * SAMPLE_RATE) / 1000);
+  if (!sliceProtocol(&snap->protocol, snap->position_frames, ramp_frames, &session_protocol)) {
+    Serial.println("[RESUME] Snapshot past protocol end, cold start");
+    clearResumeSnapshot();
+    return false;
+  }
+  calibration_session = false;
+  session_offset_frames = snap->offset_frames + snap->position_frames;
+  session_resume_attempts = snap->attempts + 1;
+  runSessionProtocol();
+  // Время до тока — когда защитная рампа выйдет из очереди DAC (продолжение
+  // внутри sham/паузы тока не даёт — его не меряем)
+  const ProtocolSegment* first = &session_protocol.segments[0];
+  resume_latency_pending = (first->kind == SEG_RAMP && first->gain_start_q15 == 0 &&
+                            first->gain_end_q15 > 0);
+  
+  Serial.printf("[RESUME] %s at %lus gain=%.2f attempt=%u\n",
+                getModeName((StimMode)snap->mode),
+                (unsigned long)(session_offset_frames / SAMPLE_RATE),
+                snap->gain, (unsigned)session_resume_attempts);
+  return true;
+}
+
+// Продолжение после сброса: от сброса до первого ненулевого фрейма рампы на
+// выходе DAC. Он второй в протоколе и выходит, когда записано больше prefill
+// (очередь DMA) + 2 фреймов; опрос из loop — точность до итерации loop
+static void pollResumeLatency(uint64_t frame) {
+  if (!resume_latency_pending || frame - timeline.start_frame <= DAC_PIPELINE_FRAMES + 1) return;
+  resume_latency_pending = false;
+  uint32_t app_ms = (uint32_t)(esp_timer_get_time() / 1000);
+  uint32_t boot_us;
+  if (getBootTimeUs(&boot_us)) {
+    Serial.printf("[RESUME] reset->first non-zero DAC frame %lums (boot %lums at last power-on + app %lums)\n",
+                  (unsigned long)(app_ms + boot_us / 1000), (unsigned long)(boot_us / 1000),
+                  (unsigned long)app_ms);
+  } else {
+    Serial.printf("[RESUME] app start->first non-zero DAC frame %lums (boot time not measured yet)\n",
+                  (unsigned long)app_ms);
   }
 }
 
-// Начальный gain при входе в FADEOUT (для плавного спуска с текущего значения)
-static float fadeout_start_gain = 1.0f;
+// УНИВЕРСАЛЬНАЯ ОСТАНОВКА: просто переводим в FADEOUT
+// gain начинает убывать С ТЕКУЩЕГО значения — со следующего фрейма для I2S
+static void fadeoutSession(SessionStopReason reason) {
+  if (!timeline.active || timeline.stopped) {
+    return;  // Если уже в ручном FADEOUT - ничего не делаем (непрерываемый fadeout!)
+  }
+  uint64_t frame = getDacFramesWritten();
+  float gain, slope;
+  uint32_t run;
+  uint8_t waveform;
+  SessionState state = timelineAt(&timeline, &protocol_timeline, frame, &gain, &slope, &run, &waveform);
+  if (state == STATE_IDLE) return;
+  if (waveform != loaded_waveform) gain = 0.0f;  // Смена формы: уже тишина
+  clearResumeSnapshot();  // Ручной стоп после сбоя не продолжаем
+  timeline.stopped = true;
+  timeline.fadeout_frame = frame;
+  timeline.fadeout_gain = gain;
+  timeline.fadeout_frames = fadeoutFramesFor(timeline.fade_frames, gain);
+  timeline.fadeout_waveform = loaded_waveform;
+  current_state = STATE_FADEOUT;
+  stop_reason = reason;
+}
+
+bool startCalibrationSession(uint32_t fade_frames, uint32_t stable_frames) {
+  if (current_state != STATE_IDLE) return false;
+  calibration_session = true;
+  buildSingleCycleProtocol(MODE_TDCS, 0.0f, fade_frames, stable_frames, &session_protocol);
+  session_offset_frames = 0;
+  session_resume_attempts = 0;
+  runSessionProtocol();
+  clearResumeSnapshot();  // Калибровку после сбоя не продолжаем
+  return true;
+}
+
+bool isCalibrationSession() {
+  return calibration_session;
+}
 
 void stopSession() {
-  // УНИВЕРСАЛЬНАЯ ОСТАНОВКА: просто переводим в FADEOUT
-  // dynamic_dac_gain начинает декрементироваться С ТЕКУЩЕГО значения!
-  if (current_state == STATE_FADEIN || current_state == STATE_STABLE) {
-    // Сохраняем фактическое время сеанса ОТ НАЧАЛА (session_timer_start_ms)!
-    session_elapsed_sec = (millis() - session_timer_start_ms) / 1000;
-    
-    // ЗАПОМИНАЕМ текущий gain для плавного спуска!
-    fadeout_start_gain = dynamic_dac_gain;
-    
-    // Переходим в FADEOUT (gain начнёт падать с текущего значения)
-    current_state = STATE_FADEOUT;
-    session_start_time = millis();  // Для отсчёта времени fadeout
-  }
-  // Если уже в FADEOUT - ничего не делаем (непрерываемый fadeout!)
+  fadeoutSession(STOP_USER);
+}
+
+// Аварийная защита ADC уже обнулила очередь DAC (задача аварии, не loop):
+// здесь только закрываем сеанс без fadeout и без продолжения после сброса
+static void abortSessionOnTrip(const AdcTripInfo* trip) {
+  uint64_t frame = getDacFramesWritten();
+  Serial.printf("[TRIP] %s %ld uA: fault->ISR %.2f ms, ISR->DAC mute %lu us\n",
+                (trip->reason == ADC_TRIP_DC_FAULT) ? "DC fault" : "Overcurrent",
+                (long)trip->level_uA, trip->detect_us / 1000.0f, (unsigned long)trip->mute_us);
+  session_end_frame = frame;
+  session_elapsed_sec = (uint32_t)((frame - timeline.start_frame + session_offset_frames) / SAMPLE_RATE);
+  stop_reason = (trip->reason == ADC_TRIP_DC_FAULT) ? STOP_DC_FAULT : STOP_OVERCURRENT;
+  clearResumeSnapshot();
+  timeline.active = false;
+  dac_drain_pending = false;
+  dynamic_dac_gain = 0.0f;
+  current_state = STATE_IDLE;
+  stopDacPlayback();
+  setADCRateProfile(ADC_RATE_IDLE);
 }
 
 void updateSession() {
-  uint32_t now = millis();
-  float elapsed_sec = (now - session_start_time) / 1000.0f;
+  AdcTripInfo trip;
+  if (timeline.active && getADCTrip(&trip)) {
+    abortSessionOnTrip(&trip);
+    return;
+  }
   
-  // Используем fade_duration_sec из настроек!
-  float fade_duration = current_settings.fade_duration_sec;
+  // Плохой контакт (ingest, ~100 мс): плавный стоп с причиной, не авария
+  if (timeline.active && !timeline.stopped) {
+    AdcContactStatus contact;
+    getADCContactStatus(&contact);
+    if (contact.fault != ADC_CONTACT_OK) {
+      Serial.printf("[CONTACT] %s: I/Icmd %.0f%%, anomalies %.1f%%, sign %.0f%% -> fadeout\n",
+                    getADCContactFaultName(contact.fault), contact.ratio_pct,
+                    contact.anomaly_pct, contact.sign_pct);
+      SessionStopReason reason = STOP_CONTACT_OPEN;
+      if (contact.fault == ADC_CONTACT_REGULATION) reason = STOP_CONTACT_REGULATION;
+      if (contact.fault == ADC_CONTACT_SIGN) reason = STOP_CONTACT_SIGN;
+      fadeoutSession(reason);
+    }
+  }
   
-  switch (current_state) {
-    case STATE_IDLE:
-      // Ничего не делаем, gain = 0
-      dynamic_dac_gain = 0.0f;
-      break;
-      
-    case STATE_FADEIN:
-      // Линейное нарастание 0.0 → 1.0 за fade_duration
-      dynamic_dac_gain = elapsed_sec / fade_duration;
-      
-      // Проверка перехода в STABLE при достижении 1.0
-      if (dynamic_dac_gain >= 1.0f) {
-        dynamic_dac_gain = 1.0f;  // Насыщение
-        current_state = STATE_STABLE;
-        session_start_time = now;  // Сброс таймера для stable
-      }
-      break;
-      
-    case STATE_STABLE:
-      // Gain постоянно = 1.0
-      dynamic_dac_gain = 1.0f;
-      
-      // Проверка окончания сеанса по заданной длительности
-      {
-        // Выбираем длительность в зависимости от режима
-        uint16_t duration_min = DEF_DURATION_MIN;  // дефолт из config.h
-        switch (current_settings.mode) {
-          case MODE_TRNS: duration_min = current_settings.duration_tRNS_min; break;
-          case MODE_TDCS: duration_min = current_settings.duration_tDCS_min; break;
-          case MODE_TACS: duration_min = current_settings.duration_tACS_min; break;
-        }
-        
-        uint32_t total_duration_sec = duration_min * 60;
-        // Общее время = fadein + stable + fadeout
-        // Время в STABLE = total - fadein - fadeout = total - 2*fade
-        float stable_time = total_duration_sec - 2.0f * fade_duration;
-        if (stable_time < 0) stable_time = 0;  // Защита от отрицательного времени
-        if (elapsed_sec >= stable_time) {
-          // Автоматический переход в fadeout
-          fadeout_start_gain = 1.0f;  // Из STABLE всегда начинаем с 1.0
-          current_state = STATE_FADEOUT;
-          session_start_time = now;  // Сброс таймера для fadeout
-        }
-      }
-      break;
-      
-    case STATE_FADEOUT:
-      {
-        // Линейное убывание С ТЕКУЩЕГО gain до 0.0
-        // Время fadeout пропорционально текущему gain: если gain=0.5, то fadeout=10сек (не 20)
-        float fadeout_time = fadeout_start_gain * fade_duration;
-        if (fadeout_time < 0.1f) fadeout_time = 0.1f;  // Минимум 0.1 сек
-        
-        dynamic_dac_gain = fadeout_start_gain * (1.0f - elapsed_sec / fadeout_time);
-        
-        // Проверка перехода в IDLE при достижении 0.0
-        if (dynamic_dac_gain <= 0.0f) {
-          dynamic_dac_gain = 0.0f;  // Насыщение
-          // Сохраняем фактическое время сеанса ПЕРЕД переходом в IDLE!
-          session_elapsed_sec = (millis() - session_timer_start_ms) / 1000;
-          current_state = STATE_IDLE;
-          // Останавливаем DAC в idle, чтобы не было мусора
-          stopDacPlayback();
-          // Автоматически покажется SCR_FINISH через isSessionJustFinished()
-        }
-      }
-      break;
+  // Состояние — по последнему фрейму, отданному в I2S
+  uint64_t frame = getDacFramesWritten();
+  if (timeline.active) pollResumeLatency(frame);
+  float gain, slope;
+  uint32_t run;
+  uint8_t waveform;
+  SessionState state = timelineAt(&timeline, &protocol_timeline, frame, &gain, &slope, &run, &waveform);
+  
+  // Протокол перешёл на другую форму сигнала (сегмент SWITCH с нулевым gain):
+  // перегенерируем signal_buffer, пока в I2S уходит тишина
+  if (state != STATE_IDLE && waveform != loaded_waveform) {
+    loadProtocolWaveform(waveform);
+    Serial.printf("[SESSION] Waveform -> %s\n", current_preset_name);
+  }
+  dynamic_dac_gain = gain;
+  
+  // Позиция сеанса в RTC память (поля позиции + CRC, ~мкс)
+  if (timeline.active && !timeline.stopped && state != STATE_IDLE && frame >= next_snapshot_frame) {
+    updateResumeSnapshot(frame - timeline.start_frame, gain, (uint8_t)session_mode);
+    next_snapshot_frame = frame + ((uint64_t)SESSION_RESUME_SAVE_MS * SAMPLE_RATE) / 1000;
+  }
+  
+  if (timeline.active && state == STATE_IDLE && current_state != STATE_IDLE) {
+    // Фактическое время сеанса — точно по фреймам (включая сыгранное до сбоя)
+    session_end_frame = getSessionEndFrame(&timeline);
+    session_elapsed_sec = (uint32_t)((session_end_frame - timeline.start_frame + session_offset_frames) / SAMPLE_RATE);
+    clearResumeSnapshot();
+    timeline.active = false;
+    dac_drain_pending = true;
+    // Автоматически покажется SCR_FINISH через isSessionJustFinished()
+  }
+  current_state = state;
+  
+  // Медленный контур тока: шаг раз в SESSION_REG_PERIOD_MS в STABLE
+  updateSessionRegulator();
+  
+  // Останавливаем DAC, когда хвост fadeout доиграл из DMA очереди (тишина уже записана)
+  if (dac_drain_pending && frame >= session_end_frame + DAC_PIPELINE_FRAMES) {
+    dac_drain_pending = false;
+    stopDacPlayback();
+    setADCRateProfile(ADC_RATE_IDLE);
   }
 }
 
@@ -300,7 +663,24 @@ bool isSessionJustFinished() {
   return just_finished;
 }
 
+SessionStopReason getSessionStopReason() {
+  return stop_reason;
+}
+
 // === УТИЛИТЫ ===
+const char* getStopReasonName(SessionStopReason reason) {
+  switch (reason) {
+    case STOP_COMPLETED: return "completed";
+    case STOP_USER: return "user stop";
+    case STOP_OVERCURRENT: return "overcurrent";
+    case STOP_DC_FAULT: return "DC fault";
+    case STOP_CONTACT_OPEN: return "open circuit";
+    case STOP_CONTACT_REGULATION: return "low current";
+    case STOP_CONTACT_SIGN: return "sign error";
+    default: return "Unknown";
+  }
+}
+
 const char* getModeName(StimMode mode) {
   switch (mode) {
     case MODE_TRNS: return "tRNS";
@@ -309,25 +689,3 @@ const char* getModeName(StimMode mode) {
     default: return "Unknown";
   }
 }
-
-float getValidTACSFrequency(float target_Hz) {
-  // Период пресета = SIGNAL_SAMPLES / SAMPLE_RATE секунд
-  // Допустимые частоты: n * SAMPLE_RATE / SIGNAL_SAMPLES, где n = 1, 2, 3, ...
-  // Минимум: 1 * 8000 / 16384 ≈ 0.488 Гц
-  // Для tACS разумный минимум ~0.5 Гц
-  
-  float min_freq = 0.5f;  // Минимум 0.5 Гц
-  float max_freq = 250.0f;  // Максимум 250 Гц
-  
-  // Ограничиваем диапазон
-  if (target_Hz < min_freq) target_Hz = min_freq;
-  if (target_Hz > max_freq) target_Hz = max_freq;
-  
-  // Находим ближайшую кратную частоту
-  float fundamental = (float)SAMPLE_RATE / SIGNAL_SAMPLES;  // ~0.488 Гц
-  float n = roundf(target_Hz / fundamental);
-  if (n < 1.0f) n = 1.0f;
-  
-  return n * fundamental;
-}
-
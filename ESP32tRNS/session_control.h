@@ -23,6 +23,17 @@ enum SessionState {
   STATE_FADEOUT = 3   // Плавный стоп (рампа вниз)
 };
 
+// === ПРИЧИНА ОКОНЧАНИЯ СЕАНСА ===
+enum SessionStopReason {
+  STOP_COMPLETED = 0,          // Протокол доигран
+  STOP_USER = 1,               // Ручной стоп
+  STOP_OVERCURRENT = 2,        // Авария ADC: перегрузка (без fadeout)
+  STOP_DC_FAULT = 3,           // Авария ADC: DC в AC режиме (без fadeout)
+  STOP_CONTACT_OPEN = 4,       // Контакт: обрыв (fadeout)
+  STOP_CONTACT_REGULATION = 5, // Контакт: ток ниже заданного (fadeout)
+  STOP_CONTACT_SIGN = 6        // Контакт: знак тока не совпадает (fadeout)
+};
+
 // === НАСТРОЙКИ РЕЖИМОВ ===
 struct SessionSettings {
   StimMode mode;                   // Текущий режим
@@ -50,6 +61,9 @@ struct SessionSettings {
 
 // === ГЛОБАЛЬНЫЕ ПЕРЕМЕННЫЕ ===
 extern SessionSettings current_settings;  // Текущие настройки
+// Режим, который играет сеанс (форма протокола). current_settings.mode — выбор
+// меню: протокол его не меняет, в EEPROM не попадает режим чужого сегмента
+extern StimMode session_mode;
 extern SessionState current_state;        // Текущее состояние сеанса
 extern uint32_t session_elapsed_sec;      // Фактическое время сеанса (секунды)
 extern uint32_t session_timer_start_ms;   // Время старта сеанса для отображения таймера
@@ -76,22 +90,51 @@ void generateSignal();
 // Старт сеанса (переход в STATE_FADEIN)
 void startSession();
 
+// Старт сеанса по протоколу из ffat (/protocol.bin или /protocol.txt)
+// Возвращает false, если протокола нет или он с ошибкой (текст — в Serial)
+bool startProtocolSession();
+
+// Продолжить сеанс из снимка в RTC памяти (после brownout/panic/WDT)
+// Возвращает false, если снимка нет — тогда обычный старт в меню
+bool resumeSession();
+
+// Калибровочный сеанс (adc_autocal): tDCS с лестницей вместо константы,
+// без регулятора тока, контроля контакта и продолжения после сбоя
+bool startCalibrationSession(uint32_t fade_frames, uint32_t stable_frames);
+bool isCalibrationSession();
+
 // Остановка сеанса (переход в STATE_FADEOUT)
 void stopSession();
 
 // Обновление состояния сеанса (вызывать в loop)
-// Управляет переходами между состояниями и таймерами
+// Состояние и gain считаются по счётчику DAC-фреймов, а не по millis()
 void updateSession();
 
+// Линейный участок gain сеанса начиная с DAC-фрейма frame (для заполнения фрагмента)
+// gain — значение на frame, slope — приращение на фрейм, run — длина участка во фреймах
+void getSessionGainSegment(uint64_t frame, float* gain, float* slope, uint32_t* run);
+
+// Полная длительность текущего (или последнего) сеанса в секундах
+uint32_t getSessionDurationSec();
+
+// Фреймов сеанса, уже вышедших на DAC (отданные в I2S минус очередь DMA),
+// включая сыгранное до сбоя — часы журнала сеанса по DAC, не по millis()
+uint64_t getSessionPlayedFrames();
+
 // Получить строковое название режима
 const char* getModeName(StimMode mode);
 
 // Получить ближайшую допустимую частоту для tACS
 // Возвращает частоту, период которой кратен длине пресета
+// (определена в stim_protocol.cpp: компилятор протокола собирается и на хосте)
 float getValidTACSFrequency(float target_Hz);
 
 // Проверка завершения сеанса (для автоперехода на SCR_FINISH)
 bool isSessionJustFinished();
 
+// Почему закончился текущий (или последний) сеанс
+SessionStopReason getSessionStopReason();
+const char* getStopReasonName(SessionStopReason reason);
+
 #endif // SESSION_CONTROL_H
 
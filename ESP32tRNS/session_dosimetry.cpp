@@ -0,0 +1,154 @@
+#include "session_dosimetry.h"
+#include "session_control.h"
+#include <math.h>
+
+// === АККУМУЛЯТОРЫ (мкА·сэмпл) ===
+static int64_t dose_sum_uA = 0;          // Σ I
+static int64_t dose_sum_abs_uA = 0;      // Σ |I|
+static uint64_t dose_sum_sq_uA2 = 0;     // Σ I²
+static uint64_t dose_samples = 0;        // Всего сэмплов
+static uint64_t dose_stable_samples = 0; // Сэмплов в STABLE
+static uint64_t dose_in_spec_samples = 0;// Из них в допуске
+
+// Окно time-in-spec: блоки STABLE подряд до целого числа лупов DAC
+// (ADC_SAMPLE_RATE == SAMPLE_RATE: сэмплов ADC в лупе столько же, сколько в DAC)
+static const uint32_t DOSE_WINDOW_SAMPLES = (uint32_t)SIGNAL_SAMPLES * DOSE_SPEC_WINDOW_LOOPS;
+static int64_t win_sum_uA = 0;
+static uint64_t win_sum_sq_uA2 = 0;
+static uint32_t win_samples = 0;
+
+static int32_t dose_target_uA = 0;       // Целевая метрика окна
+static uint32_t dose_sample_rate = ADC_SAMPLE_RATE;
+static bool dose_use_mean = false;       // tDCS: сравниваем |mean|, иначе RMS
+
+// Аккумуляторы пишет задача ADC ingest, читает loop() — 64-бит поля под замком
+static portMUX_TYPE dose_mux = portMUX_INITIALIZER_UNLOCKED;
+
+void resetSessionDosimetry(int32_t target_uA, uint32_t sample_rate_hz) {
+  portENTER_CRITICAL(&dose_mux);
+  dose_sum_uA = 0;
+  dose_sum_abs_uA = 0;
+  dose_sum_sq_uA2 = 0;
+  dose_samples = 0;
+  dose_stable_samples = 0;
+  dose_in_spec_samples = 0;
+  win_sum_uA = 0;
+  win_sum_sq_uA2 = 0;
+  win_samples = 0;
+  dose_target_uA = target_uA;
+  dose_sample_rate = (sample_rate_hz > 0) ? sample_rate_hz : ADC_SAMPLE_RATE;
+  dose_use_mean = (session_mode == MODE_TDCS);
+  portEXIT_CRITICAL(&dose_mux);
+}
+
+void setSessionDosimetryTarget(int32_t target_uA) {
+  portENTER_CRITICAL(&dose_mux);
+  dose_target_uA = target_uA;
+  dose_use_mean = (session_mode == MODE_TDCS);
+  win_samples = 0;  // Окно со старой формой/целью не оцениваем
+  win_sum_uA = 0;
+  win_sum_sq_uA2 = 0;
+  portEXIT_CRITICAL(&dose_mux);
+}
+
+static void accumulateLocked(int64_t sum_uA, int64_t sum_abs_uA, uint64_t sum_sq_uA2,
+                             uint32_t samples, bool stable) {
+  if (samples == 0) return;
+
+  dose_sum_uA += sum_uA;
+  dose_sum_abs_uA += sum_abs_uA;
+  dose_sum_sq_uA2 += sum_sq_uA2;
+  dose_samples += samples;
+
+  if (!stable || dose_target_uA <= 0) {
+    win_samples = 0;  // Окно должно быть целиком в STABLE
+    win_sum_uA = 0;
+    win_sum_sq_uA2 = 0;
+    return;
+  }
+  win_sum_uA += sum_uA;
+  win_sum_sq_uA2 += sum_sq_uA2;
+  win_samples += samples;
+  if (win_samples < DOSE_WINDOW_SAMPLES) return;
+
+  // Окно набрано (блоки делят луп: ровно DOSE_WINDOW_SAMPLES)
+  uint32_t n = win_samples;
+  int64_t w_sum = win_sum_uA;
+  uint64_t w_sum_sq = win_sum_sq_uA2;
+  win_samples = 0;
+  win_sum_uA = 0;
+  win_sum_sq_uA2 = 0;
+  dose_stable_samples += n;
+
+  // Метрика окна сравнивается с целью в квадратах — без sqrt
+  // tDCS: |Σ I| / n в пределах ±10%  →  mean² vs target²·(1±tol)²
+  // tRNS/tACS: Σ I² / n в пределах ±10%  →  Σ I² / n vs target²·(1±tol)²
+  const int64_t lo_pct = 100 - DOSE_SPEC_TOLERANCE_PCT;
+  const int64_t hi_pct = 100 + DOSE_SPEC_TOLERANCE_PCT;
+  uint64_t metric;
+  uint64_t ref;
+  if (dose_use_mean) {
+    int64_t mean_uA = w_sum / (int64_t)n;
+    if (mean_uA < 0) mean_uA = -mean_uA;
+    metric = (uint64_t)(mean_uA * mean_uA);
+    ref = (uint64_t)dose_target_uA * (uint64_t)dose_target_uA;
+  } else {
+    metric = w_sum_sq / n;
+    ref = (uint64_t)dose_target_uA * (uint64_t)dose_target_uA;
+  }
+  // Сравнение metric·100² с ref·pct² (все величины < 2^63)
+  uint64_t metric_scaled = metric * 10000ULL;
+  if (metric_scaled >= ref * (uint64_t)(lo_pct * lo_pct) &&
+      metric_scaled <= ref * (uint64_t)(hi_pct * hi_pct)) {
+    dose_in_spec_samples += n;
+  }
+}
+
+void accumulateSessionDosimetry(int64_t sum_uA, int64_t sum_abs_uA, uint64_t sum_sq_uA2,
+                                uint32_t samples, bool stable) {
+  portENTER_CRITICAL(&dose_mux);
+  accumulateLocked(sum_uA, sum_abs_uA, sum_sq_uA2, samples, stable);
+  portEXIT_CRITICAL(&dose_mux);
+}
+
+void getSessionDosimetry(DosimetryReport* report) {
+  if (report == NULL) return;
+
+  portENTER_CRITICAL(&dose_mux);
+  int64_t sum_uA = dose_sum_uA;
+  int64_t sum_abs_uA = dose_sum_abs_uA;
+  uint64_t sum_sq_uA2 = dose_sum_sq_uA2;
+  uint64_t samples = dose_samples;
+  uint64_t stable_samples = dose_stable_samples;
+  uint64_t in_spec_samples = dose_in_spec_samples;
+  portEXIT_CRITICAL(&dose_mux);
+
+  // мкА·сэмпл / (сэмпл/с) = мкКл → /1000 = мКл
+  double rate = (double)dose_sample_rate;
+  report->abs_charge_mC = (float)((double)sum_abs_uA / rate / 1000.0);
+  report->net_charge_mC = (float)((double)sum_uA / rate / 1000.0);
+  report->rms_mA = (samples > 0)
+      ? (float)(sqrt((double)sum_sq_uA2 / (double)samples) / 1000.0)
+      : 0.0f;
+  report->in_spec_pct = (stable_samples > 0)
+      ? (float)(100.0 * (double)in_spec_samples / (double)stable_samples)
+      : 0.0f;
+  report->duration_sec = (float)((double)samples / rate);
+}
+
+void getSessionDosimetryTotals(DosimetryTotals* totals) {
+  if (totals == NULL) return;
+  portENTER_CRITICAL(&dose_mux);
+  totals->sum_uA = dose_sum_uA;
+  totals->sum_sq_uA2 = dose_sum_sq_uA2;
+  totals->samples = dose_samples;
+  portEXIT_CRITICAL(&dose_mux);
+}
+
+void printSessionDosimetry() {
+  DosimetryReport r;
+  getSessionDosimetry(&r);
+  Serial.printf("[DOSE] %s: Q=%.3f mC, Qnet=%+.4f mC, RMS=%.3f mA, in-spec=%.1f%%, measured %.1f s\n",
+                getModeName(session_mode),
+                r.abs_charge_mC, r.net_charge_mC, r.rms_mA, r.in_spec_pct, r.duration_sec);
+}
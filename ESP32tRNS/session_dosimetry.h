@@ -0,0 +1,53 @@
+#ifndef SESSION_DOSIMETRY_H
+#define SESSION_DOSIMETRY_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === SESSION DOSIMETRY (доставленный заряд, DC-баланс, время в допуске) ===
+// ============================================================================
+// Инкрементальные 64-битные аккумуляторы, обновляются из ADC ingest-пути
+// один раз на DMA блок — без повторных проходов по adc_ring_buffer.
+// Единицы внутри: мкА·сэмпл (заряд) и мкА²·сэмпл (RMS), целочисленно.
+// Time-in-spec решается по окну DOSE_SPEC_WINDOW_LOOPS лупов DAC из блоков
+// STABLE подряд; неполное окно (выход из STABLE, смена цели) не учитывается.
+
+// Итоги сеанса в физических единицах (для экрана SCR_FINISH и Serial)
+struct DosimetryReport {
+  float abs_charge_mC;     // ∫|I|dt — суммарный доставленный заряд
+  float net_charge_mC;     // ∫I dt — чистый заряд (DC-смещение для tRNS/tACS)
+  float rms_mA;            // RMS тока за весь сеанс
+  float in_spec_pct;       // % окон-лупов STABLE, где ток в пределах ±DOSE_SPEC_TOLERANCE_PCT
+  float duration_sec;      // Время, покрытое измерениями
+};
+
+// Сырые накопительные суммы (для посекундных разностей в журнале)
+struct DosimetryTotals {
+  int64_t sum_uA;
+  uint64_t sum_sq_uA2;
+  uint64_t samples;
+};
+
+// Сбросить аккумуляторы (вызывается в startSession)
+// target_uA — целевая метрика окна: mean для tDCS, RMS для tRNS/tACS
+void resetSessionDosimetry(int32_t target_uA, uint32_t sample_rate_hz);
+
+// Сменить цель time-in-spec без сброса аккумуляторов (смена режима в протоколе)
+void setSessionDosimetryTarget(int32_t target_uA);
+
+// Добавить DMA блок: суммы по блоку (мкА) и число сэмплов
+// stable = true — блок пришёлся на STATE_STABLE (учитывается в time-in-spec)
+void accumulateSessionDosimetry(int64_t sum_uA, int64_t sum_abs_uA, uint64_t sum_sq_uA2,
+                                uint32_t samples, bool stable);
+
+// Получить текущие итоги (можно вызывать и во время сеанса)
+void getSessionDosimetry(DosimetryReport* report);
+
+// Получить сырые накопительные суммы
+void getSessionDosimetryTotals(DosimetryTotals* totals);
+
+// Вывести итоги в Serial
+void printSessionDosimetry();
+
+#endif // SESSION_DOSIMETRY_H
@@ -0,0 +1,335 @@
+#include "session_log.h"
+#include "session_control.h"
+#include "session_dosimetry.h"
+#include "adc_control.h"
+#include "adc_calibration.h"
+#include "adc_window_stats.h"
+#include "dac_control.h"
+#include <FFat.h>
+
+// === RAM-КОЛЬЦО ЗАПИСЕЙ (SPSC: loop пишет, задача читает) ===
+// Индексы не сбрасываются: новый сеанс начинается с позиции log_open_head,
+// хвост прошлого до неё задача дописывает в его файл
+static SessionLogRecord log_ring[SESSION_LOG_RING_RECORDS];
+static volatile uint32_t log_head = 0;   // Следующая позиция записи (loop)
+static volatile uint32_t log_tail = 0;   // Следующая позиция чтения (задача)
+static uint16_t log_dropped = 0;
+
+// Команды для фоновой задачи
+static volatile uint32_t log_open_head = 0;  // Первая запись нового сеанса
+static volatile bool log_open_requested = false;
+static volatile bool log_close_requested = false;
+static volatile bool log_flush_requested = false;
+
+static bool log_mounted = false;
+static TaskHandle_t log_task_handle = NULL;
+static File log_file;
+static char log_path[24] = "";
+
+// Состояние посекундного агрегатора
+static bool log_active = false;
+static uint32_t log_next_sec = 0;
+static DosimetryTotals log_prev_totals;
+static uint32_t log_prev_overrange = 0;
+static uint32_t log_prev_desync = 0;
+
+// Номер следующего файла журнала (хранится в /log_index)
+static uint16_t readNextLogIndex() {
+  uint16_t index = 0;
+  File f = FFat.open("/log_index", FILE_READ);
+  if (f) {
+    f.read((uint8_t*)&index, sizeof(index));
+    f.close();
+  }
+  return index;
+}
+
+static void writeNextLogIndex(uint16_t index) {
+  File f = FFat.open("/log_index", FILE_WRITE);
+  if (f) {
+    f.write((const uint8_t*)&index, sizeof(index));
+    f.close();
+  }
+}
+
+// Открыть новый файл: удаляем самый старый журнал, пишем заголовок
+static void openLogFile() {
+  uint16_t index = readNextLogIndex();
+  writeNextLogIndex(index + 1);
+
+  if (index >= SESSION_LOG_MAX_FILES) {
+    char old_path[24];
+    snprintf(old_path, sizeof(old_path), "/sess_%05u.bin", (unsigned)(index - SESSION_LOG_MAX_FILES));
+    if (FFat.exists(old_path)) {
+      FFat.remove(old_path);
+    }
+  }
+
+  snprintf(log_path, sizeof(log_path), "/sess_%05u.bin", (unsigned)index);
+  log_file = FFat.open(log_path, FILE_WRITE);
+  if (!log_file) {
+    Serial.printf("[LOG] Cannot open %s\n", log_path);
+    return;
+  }
+
+  SessionLogHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "TRNSLOG1", 8);
+  header.record_size = sizeof(SessionLogRecord);
+  header.mode = (uint8_t)session_mode;  // Первая форма сеанса (протокол может сменить)
+  switch (session_mode) {
+    case MODE_TDCS:
+      header.amplitude_mA = current_settings.amplitude_tDCS_mA;
+      header.duration_min = current_settings.duration_tDCS_min;
+      break;
+    case MODE_TACS:
+      header.amplitude_mA = current_settings.amplitude_tACS_mA;
+      header.duration_min = current_settings.duration_tACS_min;
+      break;
+    case MODE_TRNS:
+    default:
+      header.amplitude_mA = current_settings.amplitude_tRNS_mA;
+      header.duration_min = current_settings.duration_tRNS_min;
+      break;
+  }
+  header.sample_rate = ADC_SAMPLE_RATE;
+  strncpy(header.preset_name, current_preset_name, sizeof(header.preset_name) - 1);
+  log_file.write((const uint8_t*)&header, sizeof(header));
+  log_file.flush();
+  Serial.printf("[LOG] Session log %s\n", log_path);
+}
+
+// Сбросить записи до позиции head в файл порциями не больше SESSION_LOG_WRITE_CHUNK
+static void drainLogRing(uint32_t head) {
+  const uint32_t records_per_chunk = SESSION_LOG_WRITE_CHUNK / sizeof(SessionLogRecord);
+  bool wrote = false;
+
+  while (log_tail != head) {
+    uint32_t tail = log_tail;
+    // Непрерывный участок кольца (без перехода через конец массива)
+    uint32_t available = (head > tail) ? (head - tail) : (SESSION_LOG_RING_RECORDS - tail);
+    uint32_t count = (available < records_per_chunk) ? available : records_per_chunk;
+
+    if (log_file) {
+      log_file.write((const uint8_t*)&log_ring[tail], count * sizeof(SessionLogRecord));
+      wrote = true;
+    }
+    log_tail = (tail + count) % SESSION_LOG_RING_RECORDS;
+
+    // Пауза между порциями — отдаём CPU loop() и ограничиваем длину флеш-окна
+    vTaskDelay(pdMS_TO_TICKS(SESSION_LOG_CHUNK_PAUSE_MS));
+  }
+
+  if (wrote) {
+    log_file.flush();
+  }
+}
+
+// Фоновая задача: ждёт уведомления, открывает/пишет/закрывает файл
+static void sessionLogTask(void* arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (log_open_requested) {
+      log_open_requested = false;
+      // Хвост прошлого сеанса — в его файл, затем новый файл
+      drainLogRing(log_open_head);
+      if (log_file) {
+        log_file.close();
+      }
+      openLogFile();
+    }
+
+    drainLogRing(log_head);
+    log_flush_requested = false;
+
+    if (log_close_requested) {
+      log_close_requested = false;
+      if (log_file) {
+        log_file.close();
+        Serial.printf("[LOG] Closed %s\n", log_path);
+      }
+    }
+  }
+}
+
+void initSessionLog() {
+  // formatOnFail = true: при первом старте раздел ffat будет отформатирован
+  log_mounted = FFat.begin(true);
+  if (!log_mounted) {
+    Serial.println("[LOG] FFat mount failed, session log disabled");
+    return;
+  }
+  Serial.printf("[LOG] FFat: %u / %u bytes used\n",
+                (unsigned)FFat.usedBytes(), (unsigned)FFat.totalBytes());
+
+  xTaskCreate(sessionLogTask, "session_log", 4096, NULL, SESSION_LOG_TASK_PRIORITY, &log_task_handle);
+}
+
+void startSessionLog() {
+  if (!log_mounted || log_task_handle == NULL) return;
+
+  // Кольцо сбрасывает задача: она может ещё дописывать прошлый сеанс
+  log_dropped = 0;
+  log_next_sec = 1;
+  getSessionDosimetryTotals(&log_prev_totals);
+  log_prev_overrange = adc_overrange_count;
+  log_prev_desync = adc_pair_desync_count;
+  consumeDacLoopGapMax();
+  log_active = true;
+
+  log_open_head = log_head;
+  log_close_requested = false;  // Прошлый файл закроется при открытии нового
+  log_open_requested = true;
+  xTaskNotifyGive(log_task_handle);
+}
+
+// Перцентили 1/99% за последнюю секунду — из гистограммы кодов окна
+// ADC_WINDOW_SECOND (ingest ведёт её вместе с дозиметрией), в мкА через LUT
+static bool secondPercentiles(int16_t* p1_uA, int16_t* p99_uA) {
+  int16_t p1_code, p99_code;
+  if (!getADCWindowCodePercentiles(ADC_WINDOW_SECOND, 10, 990, &p1_code, &p99_code)) return false;
+  *p1_uA = adcSignedToMicroamps(p1_code);
+  *p99_uA = adcSignedToMicroamps(p99_code);
+  return true;
+}
+
+void updateSessionLog() {
+  if (!log_active) return;
+
+  // Секунда — по фреймам, вышедшим на DAC (millis() уходит от часов I2S)
+  uint32_t t_sec = (uint32_t)(getSessionPlayedFrames() / SAMPLE_RATE);
+  if (t_sec < log_next_sec) return;
+  log_next_sec = t_sec + 1;
+
+  SessionLogRecord rec;
+  rec.t_sec = t_sec;
+
+  // Среднее и RMS за секунду — разность накопительных сумм дозиметрии (O(1))
+  DosimetryTotals totals;
+  getSessionDosimetryTotals(&totals);
+  uint64_t n = totals.samples - log_prev_totals.samples;
+  // Перцентили — по последней секунде сэмплов (окно заканчивается тем же блоком ingest)
+  int16_t p1_uA = 0, p99_uA = 0;
+  secondPercentiles(&p1_uA, &p99_uA);
+  rec.p1_uA = p1_uA;
+  rec.p99_uA = p99_uA;
+  if (n > 0) {
+    int64_t mean = (totals.sum_uA - log_prev_totals.sum_uA) / (int64_t)n;
+    uint64_t ms = (totals.sum_sq_uA2 - log_prev_totals.sum_sq_uA2) / n;
+    rec.mean_uA = (int16_t)constrain(mean, (int64_t)-32768, (int64_t)32767);
+    rec.rms_uA = (uint16_t)constrain((int64_t)sqrtf((float)ms), (int64_t)0, (int64_t)65535);
+  } else {
+    rec.mean_uA = 0;
+    rec.rms_uA = 0;
+  }
+  log_prev_totals = totals;
+
+  float gain = dynamic_dac_gain;
+  rec.gain_q15 = (uint16_t)(constrain(gain, 0.0f, 1.0f) * 32767.0f);
+  rec.state = (uint8_t)current_state;
+  rec.mode = (uint8_t)session_mode;
+
+  uint32_t overrange = adc_overrange_count;
+  uint32_t desync = adc_pair_desync_count;
+  rec.adc_overrange = (uint16_t)min(overrange - log_prev_overrange, (uint32_t)65535);
+  rec.adc_desync = (uint16_t)min(desync - log_prev_desync, (uint32_t)65535);
+  log_prev_overrange = overrange;
+  log_prev_desync = desync;
+  rec.loop_gap_max_ms = (uint16_t)min(consumeDacLoopGapMax(), (uint32_t)65535);
+  rec.dropped = log_dropped;
+
+  // Кладём в кольцо; при переполнении запись теряется (loop никогда не ждёт флеш)
+  uint32_t next_head = (log_head + 1) % SESSION_LOG_RING_RECORDS;
+  if (next_head == log_tail) {
+    if (log_dropped < 65535) log_dropped++;
+    return;
+  }
+  log_ring[log_head] = rec;
+  log_head = next_head;
+
+  // Будим задачу, когда накопилась большая пачка
+  uint32_t pending = (log_head + SESSION_LOG_RING_RECORDS - log_tail) % SESSION_LOG_RING_RECORDS;
+  if (pending >= SESSION_LOG_FLUSH_RECORDS && !log_flush_requested) {
+    log_flush_requested = true;
+    xTaskNotifyGive(log_task_handle);
+  }
+}
+
+void finishSessionLog() {
+  if (!log_active) return;
+  log_active = false;
+  log_close_requested = true;
+  xTaskNotifyGive(log_task_handle);
+}
+
+// Путь файла журнала по номеру
+static void logPathFor(uint16_t index, char* path, size_t len) {
+  snprintf(path, len, "/sess_%05u.bin", (unsigned)index);
+}
+
+void handleSessionLogCommand(const char* args) {
+  if (!log_mounted) {
+    Serial.println("[LOG] not available");
+    return;
+  }
+  if (current_state != STATE_IDLE) {
+    Serial.println("[LOG] busy: session running");
+    return;
+  }
+  char path[24];
+  uint16_t next = readNextLogIndex();
+  char* end;
+  unsigned long index = strtoul(args, &end, 10);
+  if (end == args) {
+    // Без аргументов — список хранящихся журналов
+    uint16_t first = (next > SESSION_LOG_MAX_FILES) ? next - SESSION_LOG_MAX_FILES : 0;
+    for (uint16_t i = first; i < next; i++) {
+      logPathFor(i, path, sizeof(path));
+      File f = FFat.open(path, FILE_READ);
+      if (!f) continue;
+      SessionLogHeader header;
+      size_t size = f.size();
+      bool ok = (f.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+                 memcmp(header.magic, "TRNSLOG1", 8) == 0 && header.record_size > 0);
+      f.close();
+      if (!ok) continue;
+      Serial.printf("[LOG] %u: %s %.1fmA %umin, %lu s, %s\n", (unsigned)i,
+                    getModeName((StimMode)header.mode), header.amplitude_mA,
+                    (unsigned)header.duration_min,
+                    (unsigned long)((size - sizeof(header)) / header.record_size),
+                    header.preset_name);
+    }
+    return;
+  }
+
+  logPathFor((uint16_t)index, path, sizeof(path));
+  File f = FFat.open(path, FILE_READ);
+  if (!f) {
+    Serial.printf("[LOG] no log %lu\n", index);
+    return;
+  }
+  SessionLogHeader header;
+  if (f.read((uint8_t*)&header, sizeof(header)) != sizeof(header) ||
+      memcmp(header.magic, "TRNSLOG1", 8) != 0 ||
+      header.record_size != sizeof(SessionLogRecord)) {
+    f.close();
+    Serial.printf("[LOG] %s: bad header\n", path);
+    return;
+  }
+  Serial.printf("[LOG] %s: t_sec,mean_uA,rms_uA,p1_uA,p99_uA,gain_q15,state,mode,"
+                "overrange,desync,loop_gap_ms,dropped\n", path);
+  SessionLogRecord recs[16];
+  size_t got;
+  while ((got = f.read((uint8_t*)recs, sizeof(recs)) / sizeof(SessionLogRecord)) > 0) {
+    for (size_t i = 0; i < got; i++) {
+      const SessionLogRecord* r = &recs[i];
+      Serial.printf("%lu,%d,%u,%d,%d,%u,%u,%u,%u,%u,%u,%u\n", (unsigned long)r->t_sec,
+                    (int)r->mean_uA, (unsigned)r->rms_uA, (int)r->p1_uA, (int)r->p99_uA,
+                    (unsigned)r->gain_q15, (unsigned)r->state, (unsigned)r->mode,
+                    (unsigned)r->adc_overrange, (unsigned)r->adc_desync,
+                    (unsigned)r->loop_gap_max_ms, (unsigned)r->dropped);
+    }
+  }
+  f.close();
+}
@@ -0,0 +1,59 @@
+#ifndef SESSION_LOG_H
+#define SESSION_LOG_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === SESSION LOG (посекундный журнал сеанса в разделе ffat) ===
+// ============================================================================
+// loop() раз в секунду кладёт запись в RAM-кольцо (O(1), без файловых операций).
+// Фоновая задача сбрасывает записи в файл большими пачками, порциями по
+// SESSION_LOG_WRITE_CHUNK байт с паузой между ними — длительность одной
+// флеш-операции ограничена и не даёт DAC loop gap.
+
+// Одна запись = одна секунда сеанса (24 байта, little-endian)
+struct __attribute__((packed)) SessionLogRecord {
+  uint32_t t_sec;            // Секунда от старта сеанса
+  int16_t mean_uA;           // Средний ток за секунду
+  uint16_t rms_uA;           // RMS тока за секунду
+  int16_t p1_uA;             // 1-й перцентиль тока за секунду
+  int16_t p99_uA;            // 99-й перцентиль тока за секунду
+  uint16_t gain_q15;         // dynamic_dac_gain × 32767
+  uint8_t state;             // SessionState
+  uint8_t mode;              // StimMode
+  uint16_t adc_overrange;    // Аномалий ADC (модуль вне калибровки) за секунду
+  uint16_t adc_desync;       // Рассинхронизаций пар sign/mag за секунду
+  uint16_t loop_gap_max_ms;  // Максимальный интервал между keepDMAFilled за секунду
+  uint16_t dropped;          // Записей, потерянных из-за переполнения кольца (накопительно)
+};
+
+// Заголовок файла журнала
+struct __attribute__((packed)) SessionLogHeader {
+  char magic[8];             // "TRNSLOG1"
+  uint16_t record_size;      // sizeof(SessionLogRecord)
+  uint8_t mode;              // StimMode
+  uint8_t reserved;
+  float amplitude_mA;        // Заданная амплитуда
+  uint16_t duration_min;     // Заданная длительность
+  uint16_t sample_rate;      // ADC_SAMPLE_RATE
+  char preset_name[32];      // Имя пресета (обрезается)
+};
+
+// Смонтировать ffat и запустить фоновую задачу записи (вызвать один раз в setup)
+void initSessionLog();
+
+// Начать новый файл журнала (вызывается в startSession)
+void startSessionLog();
+
+// Вызывать в loop: раз в секунду формирует запись и кладёт в RAM-кольцо
+void updateSessionLog();
+
+// Завершить журнал: дописать остаток и закрыть файл (после перехода в IDLE)
+void finishSessionLog();
+
+// Команда Serial: "log" — список журналов, "log <номер>" — записи файла CSV
+// (только вне сеанса: чтение флеша блокирует loop)
+void handleSessionLogCommand(const char* args);
+
+#endif // SESSION_LOG_H
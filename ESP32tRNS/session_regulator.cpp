@@ -0,0 +1,106 @@
+#include "session_regulator.h"
+#include "session_control.h"
+#include "dac_control.h"
+#include "adc_window_stats.h"
+
+static uint8_t reg_mode = MODE_TRNS;
+static int32_t reg_target_uA = 0;
+static float reg_trim = 1.0f;
+static float reg_balance = 0.0f;
+static uint32_t reg_stable_since_ms = 0;  // 0 — сейчас не STABLE на полной амплитуде
+static uint32_t reg_last_step_ms = 0;
+
+static RegulatorReport reg_report;
+
+static float clampf(float x, float lo, float hi) {
+  return (x < lo) ? lo : ((x > hi) ? hi : x);
+}
+
+void configureSessionRegulator(uint8_t mode, int32_t target_uA) {
+  reg_mode = mode;
+  reg_target_uA = target_uA;
+  reg_trim = 1.0f;
+  reg_balance = 0.0f;
+  reg_stable_since_ms = 0;
+  memset(&reg_report, 0, sizeof(reg_report));
+  reg_report.trim = 1.0f;
+  setDACCurrentTrim(reg_trim, reg_balance);
+}
+
+void updateSessionRegulator() {
+#if SESSION_REG_ENABLE
+  uint32_t now = millis();
+  if (current_state != STATE_STABLE || dynamic_dac_gain < 1.0f) {
+    reg_stable_since_ms = 0;
+    return;
+  }
+  if (reg_stable_since_ms == 0) {
+    reg_stable_since_ms = now;
+    reg_last_step_ms = now;
+    return;
+  }
+  // Окно-луп должно целиком прийтись на выход после прошлого шага
+  if (now - reg_last_step_ms < SESSION_REG_PERIOD_MS) return;
+  reg_last_step_ms = now;
+  if (reg_target_uA < SESSION_REG_MIN_TARGET_UA) return;
+  
+  AdcWindowStats st;
+  if (!getADCWindowStats(ADC_WINDOW_RING, &st) || st.count < ADC_RING_SIZE) return;
+  
+  bool ac = (reg_mode != MODE_TDCS);
+  int32_t measured = ac ? (int32_t)st.sigma_uA : ((st.mean_uA < 0) ? -st.mean_uA : st.mean_uA);
+  if (measured <= 0) return;  // Обрыв — дело adc_contact, не регулятора
+  
+  // Амплитуда: интегратор относительной ошибки, ограничение шага и пределов
+  float error = (float)reg_target_uA / measured - 1.0f;
+  float trim_max = SESSION_REG_TRIM_MAX;
+  float headroom = getDACTrimHeadroom() / (1.0f + fabsf(reg_balance));
+  if (headroom < trim_max) trim_max = headroom;
+  bool changed = false;
+  bool limited = false;
+  if (fabsf(error) * 100.0f > SESSION_REG_DEADBAND_PCT) {
+    float step = clampf(SESSION_REG_GAIN * error * reg_trim, -SESSION_REG_MAX_STEP, SESSION_REG_MAX_STEP);
+    float trim = clampf(reg_trim + step, SESSION_REG_TRIM_MIN, trim_max);
+    limited = (trim != reg_trim + step);
+    changed = (trim != reg_trim);
+    reg_trim = trim;
+  }
+  
+  // DC: полуволны с разным усилением, Δmean ≈ −balance × mean|I| (mean|I| ~ RMS)
+  if (ac && st.rms_uA > 0 &&
+      (st.mean_uA > SESSION_REG_DC_DEADBAND_UA || st.mean_uA < -SESSION_REG_DC_DEADBAND_UA)) {
+    float step = clampf(SESSION_REG_DC_GAIN * (float)st.mean_uA / st.rms_uA,
+                        -SESSION_REG_DC_MAX_STEP, SESSION_REG_DC_MAX_STEP);
+    float balance = clampf(reg_balance + step, -SESSION_REG_DC_MAX, SESSION_REG_DC_MAX);
+    limited = limited || (balance != reg_balance + step);
+    changed = changed || (balance != reg_balance);
+    reg_balance = balance;
+  }
+  // Новый balance поднимает полуволну: trim под запас DAC с ним (а не с прошлым)
+  float drive_max = getDACTrimHeadroom() / (1.0f + fabsf(reg_balance));
+  if (reg_trim > drive_max && drive_max >= SESSION_REG_TRIM_MIN) {
+    reg_trim = drive_max;
+    limited = true;
+    changed = true;
+  }
+  if (changed) setDACCurrentTrim(reg_trim, reg_balance);
+  
+  reg_report.trim = reg_trim;
+  reg_report.balance = reg_balance;
+  reg_report.error_pct = error * 100.0f;
+  reg_report.dc_uA = st.mean_uA;
+  reg_report.limited = limited;
+  if (changed) reg_report.steps++;
+#endif
+}
+
+void getSessionRegulator(RegulatorReport* report) {
+  *report = reg_report;
+}
+
+void printSessionRegulator() {
+  Serial.printf("[REG] trim %.3f balance %+.3f, error %+.1f%%, DC %+ld uA, %lu steps%s\n",
+                reg_report.trim, reg_report.balance, reg_report.error_pct,
+                (long)reg_report.dc_uA, (unsigned long)reg_report.steps,
+                reg_report.limited ? " (limited)" : "");
+}
@@ -0,0 +1,39 @@
+#ifndef SESSION_REGULATOR_H
+#define SESSION_REGULATOR_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === SESSION REGULATOR (замкнутый контур тока поверх разомкнутого масштаба) ===
+// ============================================================================
+// amplitude_scale остаётся разомкнутым расчётом мА → код. Регулятор в loop раз
+// в SESSION_REG_PERIOD_MS берёт окно-луп из adc_window_stats (O(1), суммы
+// ведёт ingest) и сравнивает с целью дозиметрии: tDCS — |mean|, tRNS/tACS — σ.
+//  - trim: интегратор относительной ошибки, шаг ≤ SESSION_REG_MAX_STEP,
+//    пределы TRIM_MIN..min(TRIM_MAX, запас DAC) — в насыщение не интегрирует;
+//  - balance (tRNS/tACS): остаточное DC гасится разным усилением полуволн
+//    (канал знака не трогаем), |balance| ≤ SESSION_REG_DC_MAX.
+// Шаг — только если с прошлого шага всё время был STABLE на полной амплитуде;
+// вне STABLE подстройка заморожена (fadeout идёт с последним trim).
+
+// Цель (из applyModeScaling): сбрасывает trim/balance в 1/0 для новой формы
+void configureSessionRegulator(uint8_t mode, int32_t target_uA);
+
+// Шаг регулятора (из updateSession, в loop)
+void updateSessionRegulator();
+
+struct RegulatorReport {
+  float trim;            // Текущая подстройка амплитуды (1 = разомкнутый масштаб)
+  float balance;         // DC-баланс полуволн
+  float error_pct;       // Ошибка метрики на последнем шаге
+  int32_t dc_uA;         // Среднее тока на последнем шаге
+  uint32_t steps;        // Шагов с изменением подстройки
+  bool limited;          // Последний шаг упёрся в предел / запас DAC
+};
+void getSessionRegulator(RegulatorReport* report);
+
+// Вывести состояние в Serial
+void printSessionRegulator();
+
+#endif // SESSION_REGULATOR_H
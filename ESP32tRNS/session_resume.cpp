@@ -0,0 +1,82 @@
+#include "session_resume.h"
+#include <esp_attr.h>
+#include <esp_system.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <esp_rtc_time.h>
+
+#define SESSION_RESUME_MAGIC 0x52534D31  // "RSM1"
+#define BOOT_TIME_MAGIC      0x42544D31  // "BTM1"
+
+// Не инициализируется при старте — содержимое переживает warm reset
+static RTC_NOINIT_ATTR ResumeSnapshot resume_snapshot;
+static bool resume_valid = false;
+
+// ROM + 2nd stage bootloader (до старта esp_timer): RTC таймер считает от
+// включения питания и warm reset его не сбрасывает — после panic/WDT он несёт
+// весь прошлый аптайм. Поэтому замер — только при power-on, и он переживает
+// последующие warm reset в RTC памяти
+static RTC_NOINIT_ATTR uint32_t boot_time_magic;
+static RTC_NOINIT_ATTR uint32_t boot_time_us;
+
+static uint32_t snapshotCrc(const ResumeSnapshot* snap) {
+  return esp_rom_crc32_le(0, (const uint8_t*)snap, offsetof(ResumeSnapshot, crc));
+}
+
+void armResumeSnapshot(const StimProtocol* protocol, uint64_t offset_frames, uint8_t attempts) {
+  resume_snapshot.magic = SESSION_RESUME_MAGIC;
+  resume_snapshot.protocol = *protocol;
+  resume_snapshot.position_frames = 0;
+  resume_snapshot.offset_frames = offset_frames;
+  resume_snapshot.gain = 0.0f;
+  resume_snapshot.mode = 0;
+  resume_snapshot.attempts = attempts;
+  resume_snapshot.crc = snapshotCrc(&resume_snapshot);
+}
+
+void updateResumeSnapshot(uint64_t position_frames, float gain, uint8_t mode) {
+  if (resume_snapshot.magic != SESSION_RESUME_MAGIC) return;
+  resume_snapshot.position_frames = position_frames;
+  resume_snapshot.gain = gain;
+  resume_snapshot.mode = mode;
+  resume_snapshot.crc = snapshotCrc(&resume_snapshot);
+}
+
+void clearResumeSnapshot() {
+  resume_snapshot.magic = 0;
+  resume_snapshot.crc = 0;
+}
+
+bool checkResumeSnapshot() {
+  // Продолжаем только после незапланированного сброса:
+  // power-on — RTC память не сохранилась, SW reset — это ESP.restart() из меню
+  esp_reset_reason_t reason = esp_reset_reason();
+  if (reason == ESP_RST_POWERON) {
+    boot_time_us = (uint32_t)(esp_rtc_get_time_us() - (uint64_t)esp_timer_get_time());
+    boot_time_magic = BOOT_TIME_MAGIC;
+  }
+  bool unplanned = (reason == ESP_RST_BROWNOUT || reason == ESP_RST_PANIC ||
+                    reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT ||
+                    reason == ESP_RST_WDT);
+
+  resume_valid = unplanned &&
+                 resume_snapshot.magic == SESSION_RESUME_MAGIC &&
+                 resume_snapshot.crc == snapshotCrc(&resume_snapshot) &&
+                 resume_snapshot.protocol.count > 0 &&
+                 resume_snapshot.protocol.count <= PROTOCOL_MAX_SEGMENTS &&
+                 resume_snapshot.attempts < SESSION_RESUME_MAX_ATTEMPTS;
+  if (!resume_valid) {
+    clearResumeSnapshot();
+  }
+  return resume_valid;
+}
+
+const ResumeSnapshot* getResumeSnapshot() {
+  return resume_valid ? &resume_snapshot : NULL;
+}
+
+bool getBootTimeUs(uint32_t* us) {
+  if (boot_time_magic != BOOT_TIME_MAGIC) return false;
+  *us = boot_time_us;
+  return true;
+}
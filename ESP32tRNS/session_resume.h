@@ -0,0 +1,49 @@
+#ifndef SESSION_RESUME_H
+#define SESSION_RESUME_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "stim_protocol.h"
+
+// ============================================================================
+// === SESSION RESUME (снимок сеанса в RTC slow memory) ===
+// ============================================================================
+// RTC slow memory переживает brownout/panic/watchdog reset (но не power-on).
+// Во время сеанса loop() раз в SESSION_RESUME_SAVE_MS пишет туда позицию в
+// протоколе и gain; сам протокол копируется один раз при старте.
+// После незапланированного сброса setup() идёт по быстрому пути (без
+// заставок и задержек) и продолжает сеанс с защитной рампой.
+
+// Снимок сеанса (RTC_NOINIT, проверяется magic + CRC32)
+struct ResumeSnapshot {
+  uint32_t magic;               // SESSION_RESUME_MAGIC
+  StimProtocol protocol;        // Исполняемый протокол (в т.ч. обычный сеанс из 3 сегментов)
+  uint64_t position_frames;     // Позиция в протоколе (DAC-фреймы от старта)
+  uint64_t offset_frames;       // Сколько сеанса было до протокола (после прошлых resume)
+  float gain;                   // Gain на позиции (для лога)
+  uint8_t mode;                 // StimMode на позиции
+  uint8_t attempts;             // Сколько раз подряд сеанс уже продолжали
+  uint32_t crc;                 // CRC32 всего, что выше
+};
+
+// Запомнить протокол нового сеанса (attempts — счётчик подряд идущих resume)
+void armResumeSnapshot(const StimProtocol* protocol, uint64_t offset_frames, uint8_t attempts);
+
+// Обновить позицию/gain (дёшево: только поля позиции + CRC)
+void updateResumeSnapshot(uint64_t position_frames, float gain, uint8_t mode);
+
+// Сеанс завершён или остановлен вручную — продолжать нечего
+void clearResumeSnapshot();
+
+// Проверить причину сброса и снимок: true — есть что продолжать
+// (вызывать в начале setup(), до любых задержек)
+bool checkResumeSnapshot();
+
+// Прочитать валидный снимок (после checkResumeSnapshot() == true)
+const ResumeSnapshot* getResumeSnapshot();
+
+// Время загрузки от сброса до старта приложения (ROM + 2nd stage), мкс —
+// замер последнего power-on; false — с прошивки питание не включалось заново
+bool getBootTimeUs(uint32_t* us);
+
+#endif // SESSION_RESUME_H
@@ -0,0 +1,560 @@
+#include "stim_protocol.h"
+#include "session_control.h"
+#include <FFat.h>
+
+// ============================================================================
+// === СЕТКА ЧАСТОТ tACS ===
+// ============================================================================
+
+float getValidTACSFrequency(float target_Hz) {
+  // Период пресета = SIGNAL_SAMPLES / SAMPLE_RATE секунд
+  // Допустимые частоты: n * SAMPLE_RATE / SIGNAL_SAMPLES, где n = 1, 2, 3, ...
+  // Минимум: 1 * 8000 / 16384 ≈ 0.488 Гц
+  // Для tACS разумный минимум ~0.5 Гц
+  
+  float min_freq = 0.5f;  // Минимум 0.5 Гц
+  float max_freq = 250.0f;  // Максимум 250 Гц
+  
+  // Ограничиваем диапазон
+  if (target_Hz < min_freq) target_Hz = min_freq;
+  if (target_Hz > max_freq) target_Hz = max_freq;
+  
+  // Находим ближайшую кратную частоту
+  float fundamental = (float)SAMPLE_RATE / SIGNAL_SAMPLES;  // ~0.488 Гц
+  float n = roundf(target_Hz / fundamental);
+  if (n < 1.0f) n = 1.0f;
+  
+  return n * fundamental;
+}
+
+// ============================================================================
+// === КОМПИЛЯТОР ТЕКСТОВОЙ СПЕЦИФИКАЦИИ ===
+// ============================================================================
+
+struct ProtocolCompiler {
+  StimProtocol* out;
+  uint8_t mode;               // Текущий режим
+  uint16_t freq_centi_hz;     // Текущая частота tACS
+  int16_t gain_q15;           // Gain на конце последнего сегмента
+  bool overflow;
+  bool too_long;              // Длительность сегмента больше MAX_DURATION_MIN
+};
+
+static int16_t gainToQ15(float gain) {
+  if (gain < 0.0f) gain = 0.0f;
+  if (gain > 1.0f) gain = 1.0f;
+  return (int16_t)(gain * 32767.0f + 0.5f);
+}
+
+static uint32_t msToFrames(uint32_t ms) {
+  return (uint32_t)(((uint64_t)ms * SAMPLE_RATE) / 1000);
+}
+
+static void emitSegment(ProtocolCompiler* c, uint8_t kind, uint32_t frames,
+                        int16_t g0, int16_t g1) {
+  if (frames == 0) return;
+  if (c->out->count >= PROTOCOL_MAX_SEGMENTS) {
+    c->overflow = true;
+    return;
+  }
+  ProtocolSegment* seg = &c->out->segments[c->out->count++];
+  seg->frames = frames;
+  seg->gain_start_q15 = g0;
+  seg->gain_end_q15 = g1;
+  seg->kind = kind;
+  seg->mode = c->mode;
+  seg->freq_centi_hz = (c->mode == MODE_TACS) ? c->freq_centi_hz : 0;
+  seg->reserved = 0;
+  c->gain_q15 = g1;
+}
+
+// Смена формы сигнала: рампа вниз → пауза SWITCH (новая форма) → рампа обратно
+static void switchWaveform(ProtocolCompiler* c, uint8_t mode, uint16_t freq_centi_hz) {
+  bool same = (mode == c->mode) &&
+              (mode != MODE_TACS || freq_centi_hz == c->freq_centi_hz);
+  if (same) return;
+
+  if (c->out->count == 0) {
+    // Ещё ничего не играло — просто выбираем стартовую форму
+    c->mode = mode;
+    c->freq_centi_hz = freq_centi_hz;
+    return;
+  }
+
+  int16_t resume_gain = c->gain_q15;
+  if (resume_gain > 0) {
+    emitSegment(c, SEG_RAMP, msToFrames(PROTOCOL_SWITCH_RAMP_MS), resume_gain, 0);
+  }
+  c->mode = mode;
+  c->freq_centi_hz = freq_centi_hz;
+  emitSegment(c, SEG_SWITCH, msToFrames(PROTOCOL_SWITCH_GAP_MS), 0, 0);
+  if (resume_gain > 0) {
+    emitSegment(c, SEG_RAMP, msToFrames(PROTOCOL_SWITCH_RAMP_MS), 0, resume_gain);
+  }
+}
+
+// Длительность: "500ms", "30s", "20m", "1.5m" → фреймы
+// Сегмент не длиннее сеанса (MAX_DURATION_MIN): дальше фреймы не влезли бы в
+// uint32_t, а приведение float → uint32_t за пределами диапазона не определено
+static bool parseDuration(ProtocolCompiler* c, const char* tok, uint32_t* frames) {
+  char* end = NULL;
+  float value = strtof(tok, &end);
+  if (end == tok || !(value >= 0.0f)) return false;  // И NaN
+  float sec;
+  if (strcmp(end, "ms") == 0) sec = value / 1000.0f;
+  else if (strcmp(end, "s") == 0 || *end == '\0') sec = value;
+  else if (strcmp(end, "m") == 0 || strcmp(end, "min") == 0) sec = value * 60.0f;
+  else return false;
+  if (!(sec <= MAX_DURATION_MIN * 60.0f)) {
+    c->too_long = true;
+    return false;
+  }
+  *frames = (uint32_t)(sec * SAMPLE_RATE + 0.5f);
+  return true;
+}
+
+// Gain: "0.8" или "80%"
+static bool parseGain(const char* tok, int16_t* q15) {
+  char* end = NULL;
+  float value = strtof(tok, &end);
+  if (end == tok) return false;
+  if (*end == '%') value /= 100.0f;
+  else if (*end != '\0') return false;
+  if (value < 0.0f || value > 1.0f) return false;
+  *q15 = gainToQ15(value);
+  return true;
+}
+
+static bool parseMode(const char* tok, uint8_t* mode) {
+  if (strcasecmp(tok, "trns") == 0) { *mode = MODE_TRNS; return true; }
+  if (strcasecmp(tok, "tdcs") == 0) { *mode = MODE_TDCS; return true; }
+  if (strcasecmp(tok, "tacs") == 0) { *mode = MODE_TACS; return true; }
+  return false;
+}
+
+static bool parseFreq(const char* tok, uint16_t* centi_hz) {
+  char* end = NULL;
+  float hz = strtof(tok, &end);
+  if (end == tok) return false;
+  if (strcasecmp(end, "hz") != 0 && *end != '\0') return false;
+  if (hz < MIN_TACS_FREQ_HZ || hz > MAX_TACS_FREQ_HZ) return false;
+  *centi_hz = (uint16_t)(getValidTACSFrequency(hz) * 100.0f + 0.5f);
+  return true;
+}
+
+bool compileProtocol(const char* text, uint8_t initial_mode, float initial_freq_Hz,
+                     StimProtocol* out, char* err, size_t err_len) {
+  ProtocolCompiler c;
+  c.out = out;
+  c.mode = initial_mode;
+  c.freq_centi_hz = (uint16_t)(getValidTACSFrequency(initial_freq_Hz) * 100.0f + 0.5f);
+  c.gain_q15 = 0;
+  c.overflow = false;
+  c.too_long = false;
+  out->count = 0;
+
+  char line[64];
+  uint16_t line_no = 0;
+  const char* p = text;
+  while (*p) {
+    // Выделяем одну команду (до '\n' или ';')
+    size_t len = 0;
+    while (p[len] && p[len] != '\n' && p[len] != ';') len++;
+    line_no++;
+    // Обрезать можно только комментарий: команду длиннее буфера — ошибкой
+    const char* hash_at = (const char*)memchr(p, '#', len);
+    size_t code_len = hash_at ? (size_t)(hash_at - p) : len;
+    if (code_len > sizeof(line) - 1) {
+      snprintf(err, err_len, "line %u: too long (> %u chars)", (unsigned)line_no,
+               (unsigned)(sizeof(line) - 1));
+      return false;
+    }
+    size_t copy = (len < sizeof(line) - 1) ? len : sizeof(line) - 1;
+    memcpy(line, p, copy);
+    line[copy] = '\0';
+    p += len;
+    if (*p) p++;
+
+    char* hash = strchr(line, '#');
+    if (hash) *hash = '\0';
+
+    char* argv[4];
+    int argc = 0;
+    char* save = NULL;
+    for (char* tok = strtok_r(line, " \t\r", &save); tok && argc < 4; tok = strtok_r(NULL, " \t\r", &save)) {
+      argv[argc++] = tok;
+    }
+    if (argc == 0) continue;
+
+    bool ok = false;
+    uint32_t frames = 0;
+    if (strcasecmp(argv[0], "mode") == 0 && argc >= 2) {
+      uint8_t mode;
+      uint16_t freq = c.freq_centi_hz;
+      ok = parseMode(argv[1], &mode) && (argc < 3 || parseFreq(argv[2], &freq));
+      if (ok) switchWaveform(&c, mode, freq);
+    } else if (strcasecmp(argv[0], "freq") == 0 && argc == 2) {
+      uint16_t freq;
+      ok = (c.mode == MODE_TACS) && parseFreq(argv[1], &freq);
+      if (ok) switchWaveform(&c, c.mode, freq);
+    } else if (strcasecmp(argv[0], "ramp") == 0 && argc == 3) {
+      int16_t target;
+      ok = parseDuration(&c, argv[1], &frames) && parseGain(argv[2], &target);
+      if (ok) emitSegment(&c, SEG_RAMP, frames, c.gain_q15, target);
+    } else if (strcasecmp(argv[0], "hold") == 0 && argc == 2) {
+      ok = parseDuration(&c, argv[1], &frames);
+      if (ok) emitSegment(&c, SEG_HOLD, frames, c.gain_q15, c.gain_q15);
+    } else if (strcasecmp(argv[0], "sham") == 0 && argc == 2) {
+      ok = parseDuration(&c, argv[1], &frames);
+      if (ok) {
+        // Gain непрерывен по построению: с тока — сначала рампа вниз
+        if (c.gain_q15 > 0) {
+          emitSegment(&c, SEG_RAMP, msToFrames(PROTOCOL_SWITCH_RAMP_MS), c.gain_q15, 0);
+        }
+        emitSegment(&c, SEG_SHAM, frames, 0, 0);
+      }
+    }
+
+    if (c.too_long) {
+      snprintf(err, err_len, "line %u: duration > %u min", (unsigned)line_no,
+               (unsigned)MAX_DURATION_MIN);
+      return false;
+    }
+    if (!ok) {
+      snprintf(err, err_len, "line %u: bad command", (unsigned)line_no);
+      return false;
+    }
+    if (c.overflow) {
+      snprintf(err, err_len, "line %u: > %u segments", (unsigned)line_no, (unsigned)PROTOCOL_MAX_SEGMENTS);
+      return false;
+    }
+  }
+
+  // Протокол всегда заканчивается нулевым током
+  if (c.gain_q15 > 0) {
+    emitSegment(&c, SEG_RAMP, (uint32_t)(DEF_FADE_DURATION_SEC * SAMPLE_RATE), c.gain_q15, 0);
+  }
+  if (c.overflow || out->count == 0) {
+    snprintf(err, err_len, c.overflow ? "too many segments" : "empty protocol");
+    return false;
+  }
+  return validateProtocol(out, err, err_len);
+}
+
+void buildSingleCycleProtocol(uint8_t mode, float freq_Hz, uint32_t fade_frames,
+                              uint32_t stable_frames, StimProtocol* out) {
+  ProtocolCompiler c;
+  c.out = out;
+  c.mode = mode;
+  c.freq_centi_hz = (uint16_t)(freq_Hz * 100.0f + 0.5f);
+  c.gain_q15 = 0;
+  c.overflow = false;
+  c.too_long = false;
+  out->count = 0;
+
+  emitSegment(&c, SEG_RAMP, fade_frames, 0, 32767);
+  emitSegment(&c, SEG_HOLD, stable_frames, 32767, 32767);
+  emitSegment(&c, SEG_RAMP, fade_frames, 32767, 0);
+}
+
+bool sliceProtocol(const StimProtocol* src, uint64_t position_frames, uint32_t ramp_frames,
+                   StimProtocol* out) {
+  uint64_t frame = 0;
+  uint16_t i = 0;
+  while (i < src->count && frame + src->segments[i].frames <= position_frames) {
+    frame += src->segments[i].frames;
+    i++;
+  }
+  if (i >= src->count) return false;
+
+  // Текущий сегмент обрезается по позиции, gain интерполируется
+  ProtocolSegment cut = src->segments[i];
+  uint32_t offset = (uint32_t)(position_frames - frame);
+  int32_t g0 = cut.gain_start_q15;
+  int32_t g1 = cut.gain_end_q15;
+  cut.gain_start_q15 = (int16_t)(g0 + (int32_t)(((int64_t)(g1 - g0) * offset) / cut.frames));
+  cut.frames -= offset;
+  bool silent = (cut.kind == SEG_SHAM || cut.kind == SEG_SWITCH);
+
+  uint16_t count = (uint16_t)(src->count - i);
+  bool need_ramp = (!silent && cut.gain_start_q15 > 0 && ramp_frames > 0);
+  if (count + (need_ramp ? 1 : 0) > PROTOCOL_MAX_SEGMENTS) return false;
+
+  out->count = 0;
+  if (need_ramp) {
+    ProtocolSegment ramp = cut;
+    ramp.frames = ramp_frames;
+    ramp.gain_start_q15 = 0;
+    ramp.gain_end_q15 = cut.gain_start_q15;
+    ramp.kind = SEG_RAMP;
+    out->segments[out->count++] = ramp;
+  }
+  out->segments[out->count++] = cut;
+  for (uint16_t j = i + 1; j < src->count; j++) {
+    out->segments[out->count++] = src->segments[j];
+  }
+  return true;
+}
+
+bool validateProtocol(const StimProtocol* protocol, char* err, size_t err_len) {
+  if (protocol->count == 0 || protocol->count > PROTOCOL_MAX_SEGMENTS) {
+    snprintf(err, err_len, "bad segment count");
+    return false;
+  }
+  // Частоты tACS, которые генератор может сыграть (кратные частоте лупа)
+  uint16_t freq_min = (uint16_t)(getValidTACSFrequency(0.0f) * 100.0f);
+  uint16_t freq_max = (uint16_t)(getValidTACSFrequency(MAX_TACS_FREQ_HZ) * 100.0f + 0.5f);
+  int16_t gain = 0;               // Протокол начинается с нулевого тока
+  uint8_t mode = protocol->segments[0].mode;
+  uint16_t freq = protocol->segments[0].freq_centi_hz;
+  for (uint16_t i = 0; i < protocol->count; i++) {
+    const ProtocolSegment* seg = &protocol->segments[i];
+    const char* what = NULL;
+    bool silent = (seg->kind == SEG_SHAM || seg->kind == SEG_SWITCH);
+    bool tacs_freq_ok = (seg->freq_centi_hz >= freq_min && seg->freq_centi_hz <= freq_max);
+    if (seg->frames == 0) what = "zero length";
+    else if (seg->kind > SEG_SWITCH) what = "bad kind";
+    else if (seg->mode > MODE_TACS) what = "bad mode";
+    else if (seg->mode == MODE_TACS ? !tacs_freq_ok : seg->freq_centi_hz != 0) what = "bad freq";
+    else if (seg->gain_start_q15 < 0 || seg->gain_end_q15 < 0) what = "negative gain";
+    else if (seg->gain_start_q15 != gain) what = "gain step";
+    else if (seg->kind == SEG_HOLD && seg->gain_end_q15 != seg->gain_start_q15) what = "hold not flat";
+    else if (silent && (seg->gain_start_q15 != 0 || seg->gain_end_q15 != 0)) what = "silent with current";
+    else if ((seg->mode != mode || seg->freq_centi_hz != freq) && seg->kind != SEG_SWITCH) {
+      what = "mode change outside SWITCH";
+    }
+    if (what) {
+      snprintf(err, err_len, "segment %u: %s", (unsigned)i, what);
+      return false;
+    }
+    gain = seg->gain_end_q15;
+    mode = seg->mode;
+    freq = seg->freq_centi_hz;
+  }
+  if (gain != 0) {
+    snprintf(err, err_len, "ends with current");
+    return false;
+  }
+  return true;
+}
+
+bool loadProtocolBinary(const uint8_t* data, size_t len, StimProtocol* out,
+                        char* err, size_t err_len) {
+  ProtocolFileHeader header;
+  if (data == NULL || len < sizeof(header)) {
+    snprintf(err, err_len, "protocol.bin truncated");
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, "TRNSPRT1", 8) != 0 ||
+      header.segment_size != sizeof(ProtocolSegment) ||
+      header.segment_count == 0 ||
+      header.segment_count > PROTOCOL_MAX_SEGMENTS ||
+      len < sizeof(header) + header.segment_count * sizeof(ProtocolSegment)) {
+    snprintf(err, err_len, "protocol.bin bad header");
+    return false;
+  }
+  memcpy(out->segments, data + sizeof(header), header.segment_count * sizeof(ProtocolSegment));
+  out->count = header.segment_count;
+  return validateProtocol(out, err, err_len);
+}
+
+// ============================================================================
+// === ИСПОЛНЯЕМЫЙ ТАЙМЛАЙН ===
+// ============================================================================
+
+void prepareProtocolTimeline(const StimProtocol* protocol, ProtocolTimeline* tl) {
+  uint64_t frame = 0;
+  tl->count = 0;
+  tl->waveform_count = 0;
+  tl->cursor = 0;
+
+  for (uint16_t i = 0; i < protocol->count; i++) {
+    const ProtocolSegment* seg = &protocol->segments[i];
+    if (seg->frames == 0) continue;
+
+    // Форма сигнала: переиспользуем индекс, если режим/частота совпадают с предыдущей
+    float freq = seg->freq_centi_hz / 100.0f;
+    uint8_t wf = tl->waveform_count;
+    if (wf > 0) {
+      const ProtocolWaveform* last = &tl->waveforms[wf - 1];
+      if (last->mode == seg->mode && (seg->mode != MODE_TACS || last->freq_Hz == freq)) {
+        wf = wf - 1;
+      }
+    }
+    if (wf == tl->waveform_count) {
+      tl->waveforms[wf].mode = seg->mode;
+      tl->waveforms[wf].freq_Hz = freq;
+      tl->waveform_count++;
+    }
+
+    ProtocolStep* step = &tl->steps[tl->count++];
+    step->start_frame = frame;
+    step->frames = seg->frames;
+    step->kind = seg->kind;
+    step->waveform = wf;
+    if (seg->kind == SEG_SHAM || seg->kind == SEG_SWITCH) {
+      step->gain = 0.0f;
+      step->slope = 0.0f;
+    } else {
+      step->gain = seg->gain_start_q15 / 32767.0f;
+      step->slope = ((seg->gain_end_q15 - seg->gain_start_q15) / 32767.0f) / (float)seg->frames;
+    }
+    frame += seg->frames;
+  }
+  tl->total_frames = frame;
+}
+
+int findProtocolStep(ProtocolTimeline* tl, uint64_t frame) {
+  if (frame >= tl->total_frames || tl->count == 0) return -1;
+
+  // Запрос «назад» (редко) — поиск с начала
+  uint16_t i = tl->cursor;
+  if (i >= tl->count || frame < tl->steps[i].start_frame) i = 0;
+  while (frame >= tl->steps[i].start_frame + tl->steps[i].frames) i++;
+  tl->cursor = i;
+  return i;
+}
+
+// ============================================================================
+// === ЗАГРУЗКА ИЗ ffat ===
+// ============================================================================
+
+bool loadProtocolFromFlash(StimProtocol* out, char* err, size_t err_len) {
+  // Предкомпилированный на хосте бинарь имеет приоритет над текстом
+  File f = FFat.open("/protocol.bin", FILE_READ);
+  if (f) {
+    static uint8_t buf[sizeof(ProtocolFileHeader) + PROTOCOL_MAX_SEGMENTS * sizeof(ProtocolSegment)];
+    size_t len = f.read(buf, sizeof(buf));
+    f.close();
+    return loadProtocolBinary(buf, len, out, err, err_len);
+  }
+
+  f = FFat.open("/protocol.txt", FILE_READ);
+  if (!f) {
+    snprintf(err, err_len, "no protocol file");
+    return false;
+  }
+  static char text[PROTOCOL_MAX_TEXT];
+  size_t len = f.read((uint8_t*)text, sizeof(text) - 1);
+  f.close();
+  text[len] = '\0';
+  return compileProtocol(text, current_settings.mode, current_settings.frequency_tACS_Hz,
+                         out, err, err_len);
+}
+
+// ============================================================================
+// === ЗАГРУЗКА ПО Serial ===
+// ============================================================================
+// Файл принимается целиком в RAM, проверяется (компиляция текста или
+// validateProtocol для бинаря) и только потом пишется в ffat — битый или
+// оборванный файл не заменяет рабочий протокол.
+
+static uint8_t upload_buf[PROTOCOL_MAX_TEXT];
+static bool upload_active = false;
+static bool upload_binary = false;
+static uint32_t upload_size = 0;
+static uint32_t upload_received = 0;
+static uint32_t upload_last_ms = 0;
+
+static bool writeProtocolFile(const char* path, const uint8_t* data, size_t len) {
+  File f = FFat.open(path, FILE_WRITE);
+  if (!f) return false;
+  size_t written = f.write(data, len);
+  f.close();
+  return written == len;
+}
+
+// Проверить принятый файл и записать его вместо текущего протокола
+static void finishProtocolUpload() {
+  upload_active = false;
+  StimProtocol protocol;
+  char err[48];
+  bool ok;
+  if (upload_binary) {
+    ok = loadProtocolBinary(upload_buf, upload_size, &protocol, err, sizeof(err));
+  } else {
+    upload_buf[upload_size] = '\0';
+    ok = compileProtocol((const char*)upload_buf, current_settings.mode,
+                         current_settings.frequency_tACS_Hz, &protocol, err, sizeof(err));
+  }
+  if (!ok) {
+    Serial.printf("[PROTO] error: %s\n", err);
+    return;
+  }
+  const char* path = upload_binary ? "/protocol.bin" : "/protocol.txt";
+  const char* other = upload_binary ? "/protocol.txt" : "/protocol.bin";
+  if (!writeProtocolFile(path, upload_buf, upload_size)) {
+    Serial.printf("[PROTO] error: cannot write %s\n", path);
+    return;
+  }
+  // /protocol.bin имеет приоритет — второй файл не должен подменить новый
+  if (FFat.exists(other)) FFat.remove(other);
+  Serial.printf("[PROTO] saved %s: %u segments\n", path, (unsigned)protocol.count);
+}
+
+bool updateProtocolUpload() {
+  if (upload_active && millis() - upload_last_ms > PROTOCOL_UPLOAD_TIMEOUT_MS) {
+    upload_active = false;
+    Serial.printf("[PROTO] error: timeout after %lu of %lu bytes\n",
+                  (unsigned long)upload_received, (unsigned long)upload_size);
+  }
+  return upload_active;
+}
+
+void feedProtocolUpload(uint8_t byte) {
+  if (!upload_active) return;
+  upload_buf[upload_received++] = byte;
+  upload_last_ms = millis();
+  if (upload_received == upload_size) finishProtocolUpload();
+}
+
+void handleProtocolCommand(const char* args) {
+  char cmd[8] = "", kind[8] = "";
+  unsigned long size = 0;
+  int argc = sscanf(args, "%7s %7s %lu", cmd, kind, &size);
+
+  if (argc <= 0) {
+    // Без аргументов — что сейчас загрузится из ffat
+    StimProtocol protocol;
+    char err[48];
+    if (!loadProtocolFromFlash(&protocol, err, sizeof(err))) {
+      Serial.printf("[PROTO] %s\n", err);
+      return;
+    }
+    uint64_t frames = 0;
+    for (uint16_t i = 0; i < protocol.count; i++) frames += protocol.segments[i].frames;
+    Serial.printf("[PROTO] %s: %u segments, %lu s\n",
+                  FFat.exists("/protocol.bin") ? "/protocol.bin" : "/protocol.txt",
+                  (unsigned)protocol.count, (unsigned long)(frames / SAMPLE_RATE));
+    return;
+  }
+  if (current_state != STATE_IDLE) {
+    Serial.println("[PROTO] busy: session running");
+    return;
+  }
+  if (strcmp(cmd, "rm") == 0) {
+    FFat.remove("/protocol.bin");
+    FFat.remove("/protocol.txt");
+    Serial.println("[PROTO] removed");
+    return;
+  }
+  bool binary = (strcmp(kind, "bin") == 0);
+  if (strcmp(cmd, "put") != 0 || argc != 3 || (!binary && strcmp(kind, "txt") != 0)) {
+    Serial.println("[PROTO] usage: proto [put txt|bin <bytes> | rm]");
+    return;
+  }
+  // Текст — с местом под '\0'
+  size_t max_size = binary ? sizeof(ProtocolFileHeader) + PROTOCOL_MAX_SEGMENTS * sizeof(ProtocolSegment)
+                           : sizeof(upload_buf) - 1;
+  if (size == 0 || size > max_size) {
+    Serial.printf("[PROTO] error: size must be 1..%u\n", (unsigned)max_size);
+    return;
+  }
+  upload_binary = binary;
+  upload_size = size;
+  upload_received = 0;
+  upload_last_ms = millis();
+  upload_active = true;
+  Serial.printf("[PROTO] receiving %lu bytes\n", size);
+}
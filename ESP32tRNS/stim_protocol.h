@@ -0,0 +1,130 @@
+#ifndef STIM_PROTOCOL_H
+#define STIM_PROTOCOL_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// ============================================================================
+// === STIMULATION PROTOCOL (предкомпилированный таймлайн сеанса) ===
+// ============================================================================
+// Протокол = последовательность сегментов (рампа, удержание, sham, смена режима).
+// Текстовая спецификация компилируется ОДИН раз (на хосте или на устройстве)
+// в компактную бинарную таблицу; в real-time пути только O(1) выборка
+// сегмента по номеру DAC-фрейма — без парсинга и без ветвлений на сэмпл.
+//
+// Текстовый формат (разделители: перевод строки или ';', комментарии с '#'):
+//   mode tacs 10      — режим (trns|tdcs|tacs) и частота tACS, Гц
+//   freq 40           — шаг частоты tACS
+//   ramp 30s 1.0      — линейная рампа к gain (0..1 или 0..100%)
+//   hold 20m          — удержание текущего gain
+//   sham 30s          — sham: нулевой ток, сеанс «идёт» для пользователя
+//                       (после sham ток возвращается только явной командой ramp)
+// Длительности: 500ms, 30s, 20m, не больше MAX_DURATION_MIN на сегмент. Команда
+// (без комментария) — до 63 символов, длиннее — ошибка. Смена режима/частоты при
+// ненулевом gain автоматически обрамляется рампой вниз, паузой и рампой обратно.
+
+// Типы сегментов
+enum ProtocolSegmentKind : uint8_t {
+  SEG_RAMP = 0,     // Линейная рампа gain_start → gain_end
+  SEG_HOLD = 1,     // Удержание (gain_start == gain_end)
+  SEG_SHAM = 2,     // Sham: gain = 0, но отображается как рабочий режим
+  SEG_SWITCH = 3    // Пауза с gain = 0 на смену формы сигнала
+};
+
+// Бинарный сегмент (16 байт, формат файла /protocol.bin)
+struct __attribute__((packed)) ProtocolSegment {
+  uint32_t frames;            // Длительность в DAC-фреймах
+  int16_t gain_start_q15;     // Gain на начале (Q15, 0..32767)
+  int16_t gain_end_q15;       // Gain на конце (Q15)
+  uint8_t kind;               // ProtocolSegmentKind
+  uint8_t mode;               // StimMode сегмента
+  uint16_t freq_centi_hz;     // Частота tACS × 100 (0 для tRNS/tDCS)
+  uint32_t reserved;
+};
+
+// Заголовок файла /protocol.bin
+struct __attribute__((packed)) ProtocolFileHeader {
+  char magic[8];              // "TRNSPRT1"
+  uint16_t segment_size;      // sizeof(ProtocolSegment)
+  uint16_t segment_count;
+  uint32_t reserved;
+};
+
+// Развёрнутый сегмент для исполнения (предрассчитано при загрузке)
+struct ProtocolStep {
+  uint64_t start_frame;       // Начало относительно старта протокола
+  uint32_t frames;
+  float gain;                 // Gain на начале сегмента
+  float slope;                // Приращение gain на фрейм
+  uint8_t kind;
+  uint8_t waveform;           // Индекс формы сигнала в waveforms[]
+};
+
+// Форма сигнала: режим + частота (генерируется в loop, не в real-time)
+struct ProtocolWaveform {
+  uint8_t mode;               // StimMode
+  float freq_Hz;              // Частота tACS
+};
+
+// Скомпилированный протокол
+struct StimProtocol {
+  ProtocolSegment segments[PROTOCOL_MAX_SEGMENTS];
+  uint16_t count;
+};
+
+// Исполняемый таймлайн
+struct ProtocolTimeline {
+  ProtocolStep steps[PROTOCOL_MAX_SEGMENTS];
+  ProtocolWaveform waveforms[PROTOCOL_MAX_SEGMENTS];
+  uint16_t count;
+  uint16_t waveform_count;
+  uint64_t total_frames;
+  uint16_t cursor;            // Последний найденный сегмент (монотонный поиск)
+};
+
+// Скомпилировать текст в протокол. initial_mode — режим до первой команды mode
+// Возвращает false и текст ошибки (с номером строки) при синтаксической ошибке
+bool compileProtocol(const char* text, uint8_t initial_mode, float initial_freq_Hz,
+                     StimProtocol* out, char* err, size_t err_len);
+
+// Стандартный сеанс: fadein → stable → fadeout
+void buildSingleCycleProtocol(uint8_t mode, float freq_Hz, uint32_t fade_frames,
+                              uint32_t stable_frames, StimProtocol* out);
+
+// Остаток протокола с позиции position_frames, с защитной рампой 0 → gain
+// длиной ramp_frames в начале (продолжение сеанса после сбоя)
+// Возвращает false, если протокол уже закончился или не влезает в таблицу
+bool sliceProtocol(const StimProtocol* src, uint64_t position_frames, uint32_t ramp_frames,
+                   StimProtocol* out);
+
+// Семантическая проверка таблицы — те же гарантии, что даёт компилятор текста:
+// допустимые kind/mode/частота, gain в 0..1 и непрерывен между сегментами,
+// смена формы сигнала только в сегменте SWITCH (нулевой ток), конец на gain 0
+bool validateProtocol(const StimProtocol* protocol, char* err, size_t err_len);
+
+// Загрузить бинарный протокол (формат /protocol.bin) из памяти
+// Возвращает false и текст ошибки, если файл битый или не проходит validateProtocol
+bool loadProtocolBinary(const uint8_t* data, size_t len, StimProtocol* out,
+                        char* err, size_t err_len);
+
+// Развернуть протокол в исполняемый таймлайн (вне real-time пути)
+void prepareProtocolTimeline(const StimProtocol* protocol, ProtocolTimeline* tl);
+
+// Загрузить протокол из ffat: /protocol.bin (готовая таблица) или /protocol.txt (компиляция)
+bool loadProtocolFromFlash(StimProtocol* out, char* err, size_t err_len);
+
+// === ЗАГРУЗКА ПО Serial (без USB MSC) ===
+// "proto" — что загрузится из ffat; "proto put txt|bin <bytes>" — следом ровно
+// <bytes> байт файла; "proto rm" — удалить протокол. Файл проверяется до записи
+void handleProtocolCommand(const char* args);
+
+// true — идёт приём файла: байты Serial отдавать в feedProtocolUpload
+// (обрыв дольше PROTOCOL_UPLOAD_TIMEOUT_MS отменяет приём)
+bool updateProtocolUpload();
+void feedProtocolUpload(uint8_t byte);
+
+// Найти сегмент для фрейма (относительно старта): O(1) амортизированно
+// Возвращает индекс сегмента или -1, если протокол закончился
+int findProtocolStep(ProtocolTimeline* tl, uint64_t frame);
+
+#endif // STIM_PROTOCOL_H
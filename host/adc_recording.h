@@ -0,0 +1,207 @@
+// ============================================================================
+// === DMA фреймы АЦП для стендов: запись с устройства или синтетика ===
+// ============================================================================
+// Запись: по Serial "frames <n>" (n ≤ ADC_FRAME_CAPTURE_MAX) во время сеанса,
+// вывод монитора сохранить в файл. loadAdcRecording берёт из него строки
+// "[FRAME] <R> <hex>" — сырые фреймы TYPE1 до разбора, остальное пропускает.
+//
+// Без записи стенды берут synthAdcFrames: та же раскладка слов (sign, mag,
+// sign, mag…) и размер фрейма, что у драйвера при передискретизации R, плюс
+// известная истина на каждую пару и управляемые дефекты — шум модуля,
+// потерянные конверсии (рассинхрон пары), выбросы выше ADC_MAG_OVERRANGE_CODE.
+
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+#include <fstream>
+#include "hal/adc_types.h"
+#include "config.h"
+
+struct AdcFrame {
+  uint8_t ratio;               // Передискретизация R, с которой фрейм записан
+  std::vector<uint8_t> bytes;  // Слова TYPE1, little-endian
+  uint32_t convCount() const { return (uint32_t)(bytes.size() / SOC_ADC_DIGI_DATA_BYTES_PER_CONV); }
+};
+
+static int hexNibble(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+// Фреймы из лога монитора порта. false — файла нет или в нём нет ни одного фрейма
+static bool loadAdcRecording(const char* path, std::vector<AdcFrame>* frames) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t at = line.find("[FRAME] ");
+    if (at == std::string::npos) continue;
+    const char* p = line.c_str() + at + 8;
+    char* end;
+    unsigned long ratio = strtoul(p, &end, 10);
+    if (end == p || *end != ' ' || ratio == 0) continue;  // Строки состояния ("armed", "captured")
+    AdcFrame f;
+    f.ratio = (uint8_t)ratio;
+    for (p = end + 1; hexNibble(p[0]) >= 0 && hexNibble(p[1]) >= 0; p += 2) {
+      f.bytes.push_back((uint8_t)(hexNibble(p[0]) << 4 | hexNibble(p[1])));
+    }
+    if (f.bytes.size() >= SOC_ADC_DIGI_DATA_BYTES_PER_CONV) frames->push_back(f);
+  }
+  return !frames->empty();
+}
+
+// === СИНТЕТИЧЕСКИЙ ПОТОК ===
+enum AdcSynthWave : uint8_t {
+  SYNTH_DC,     // Постоянный ток (tDCS)
+  SYNTH_SINE,   // Синус freq_hz (tACS)
+  SYNTH_NOISE,  // Шум в полосе пресета tRNS, σ = amplitude / 3, держится сэмпл DAC
+  SYNTH_STEP    // Меандр amplitude / 4 ↔ amplitude с периодом 1 / freq_hz (ступени; низ не у нуля,
+                //   где шум модуля выпрямляется)
+};
+
+struct AdcSynthConfig {
+  AdcSynthWave wave = SYNTH_SINE;
+  uint8_t ratio = ADC_OVERSAMPLE;  // Передискретизация: пар на выходной сэмпл
+  float amplitude = 1000.0f;       // Пик, коды модуля
+  float freq_hz = 10.0f;
+  float noise = 0.0f;              // СКО шума модуля, коды
+  float balance = 0.0f;            // Баланс полуволн (как у регулятора): «+» × (1 − b), «−» × (1 + b)
+  float sign_skew_us = 0.0f;       // Знак H-моста отстаёт от модуля (+), мкс; ≠ 0 — знак
+                                   //   по сэмплам DAC, модуль оцифрован на полпары позже
+                                   //   знака, как у драйвера
+  float burst_hz = 0.0f;           // ≠ 0: амплитуда пачками 1 ↔ 1/4 с периодом 1 / burst_hz
+                                   //   (фронты огибающей tACS/tRNS)
+  float drop_prob = 0.0f;          // Вероятность потерять конверсию
+  float spike_prob = 0.0f;         // Вероятность выброса модуля
+  float spike_codes = 0.0f;        // 0 — выброс вне калибровки (> ADC_MAG_OVERRANGE_CODE), иначе +коды к модулю
+  uint32_t seed = 1;
+};
+
+struct SynthRng {
+  uint32_t s;
+  explicit SynthRng(uint32_t seed) : s(seed ? seed : 1) {}
+  uint32_t next() {
+    s ^= s << 13;
+    s ^= s >> 17;
+    s ^= s << 5;
+    return s;
+  }
+  float uniform() { return (next() >> 8) * (1.0f / 16777216.0f); }
+  float gauss() {
+    float u = uniform() + 1e-7f;
+    return sqrtf(-2.0f * logf(u)) * cosf(6.2831853f * uniform());
+  }
+};
+
+static void pushWord(std::vector<uint8_t>* out, uint8_t channel, int32_t code) {
+  if (code < 0) code = 0;
+  if (code > 4095) code = 4095;
+  uint16_t w = (uint16_t)(channel << 12 | code);
+  out->push_back((uint8_t)(w & 0xFF));
+  out->push_back((uint8_t)(w >> 8));
+}
+
+// frames фреймов по ADC_SAMPLES_PER_FRAME × 2 × R конверсий. truth (если задан)
+// получает истинный знаковый ток каждой сгенерированной пары — до шума и дефектов,
+// spikes — номера пар с выбросом
+static void synthAdcFrames(const AdcSynthConfig& cfg, uint32_t frames,
+                           std::vector<AdcFrame>* out, std::vector<float>* truth = nullptr,
+                           std::vector<uint32_t>* spikes = nullptr) {
+  SynthRng rng(cfg.seed);
+  const uint32_t frame_bytes = (uint32_t)ADC_SAMPLES_PER_FRAME * 2 * cfg.ratio *
+                               SOC_ADC_DIGI_DATA_BYTES_PER_CONV;
+  const double pair_rate = (double)ADC_SAMPLE_RATE * cfg.ratio;
+
+  // tRNS: сумма тонов SPECTRUM_TRNS_LO_HZ..HI_HZ со случайными фазами
+  const int tones = 40;
+  double tone_hz[tones], tone_phase[tones];
+  for (int k = 0; k < tones; k++) {
+    tone_hz[k] = SPECTRUM_TRNS_LO_HZ + (double)(SPECTRUM_TRNS_HI_HZ - SPECTRUM_TRNS_LO_HZ) * k / (tones - 1);
+    tone_phase[k] = 2.0 * M_PI * rng.uniform();
+  }
+  const double tone_amp = cfg.amplitude / 3.0 / sqrt(tones / 2.0);
+
+  std::vector<uint8_t> stream;
+  stream.reserve((size_t)frames * frame_bytes);
+  // tRNS держит сэмпл DAC: значение формы на сетке SAMPLE_RATE
+  auto shapeAt = [&](double t) -> float {
+    switch (cfg.wave) {
+      case SYNTH_DC: return cfg.amplitude;
+      case SYNTH_SINE: return cfg.amplitude * (float)sin(2.0 * M_PI * cfg.freq_hz * t);
+      case SYNTH_STEP: return (fmod(t * cfg.freq_hz, 1.0) < 0.5) ? cfg.amplitude : cfg.amplitude / 4;
+      default: {
+        double th = floor(t * ADC_SAMPLE_RATE + 1e-9) / ADC_SAMPLE_RATE;
+        double a = 0.0;
+        for (int k = 0; k < tones; k++) a += sin(2.0 * M_PI * tone_hz[k] * th + tone_phase[k]);
+        float v = (float)(tone_amp * a);
+        if (v > cfg.amplitude) v = cfg.amplitude;
+        if (v < -cfg.amplitude) v = -cfg.amplitude;
+        return v;
+      }
+    }
+  };
+  // Пачки переключаются на сэмпле DAC
+  auto waveAt = [&](double t) -> float {
+    if (cfg.burst_hz <= 0.0f) return shapeAt(t);
+    double tg = floor(t * ADC_SAMPLE_RATE + 1e-9) / ADC_SAMPLE_RATE;
+    return (fmod(tg * cfg.burst_hz, 1.0) < 0.5) ? shapeAt(t) : 0.25f * shapeAt(t);
+  };
+  for (uint64_t pair = 0; stream.size() < (size_t)frames * frame_bytes; pair++) {
+    double t = pair / pair_rate;
+    float x = waveAt(t);
+    float x_sign = x;
+    if (cfg.sign_skew_us != 0.0f) {
+      // Знак — сэмплы DAC с той же реконструкцией, что у модуля: tRNS держит сэмпл
+      // (фронт на границе), гладкая форма — фронт посередине между сэмплами
+      double ts = t - cfg.sign_skew_us * 1e-6;
+      if (cfg.wave != SYNTH_NOISE) ts = floor(ts * ADC_SAMPLE_RATE + 0.5) / ADC_SAMPLE_RATE;
+      x_sign = waveAt(ts);
+      x = waveAt(t + 0.5 / pair_rate);
+    }
+    if (cfg.balance != 0.0f) x *= (x >= 0.0f) ? 1.0f - cfg.balance : 1.0f + cfg.balance;
+    if (truth) truth->push_back(x);
+
+    // Знак — компаратор (почти рельсы), модуль — |x| + шум
+    int32_t sign_code = (x_sign >= 0.0f) ? 4000 : 60;
+    int32_t mag_code = (int32_t)lrintf(fabsf(x) + cfg.noise * rng.gauss());
+    if (cfg.spike_prob > 0.0f && rng.uniform() < cfg.spike_prob) {
+      if (cfg.spike_codes > 0.0f) {
+        mag_code += (int32_t)cfg.spike_codes;
+      } else {
+        mag_code = ADC_MAG_OVERRANGE_CODE + 1 + (int32_t)(rng.next() % (4095 - ADC_MAG_OVERRANGE_CODE));
+      }
+      if (spikes) spikes->push_back((uint32_t)pair);
+    }
+    if (!(cfg.drop_prob > 0.0f && rng.uniform() < cfg.drop_prob)) {
+      pushWord(&stream, ADC_SIGN_CHANNEL, sign_code);
+    }
+    if (!(cfg.drop_prob > 0.0f && rng.uniform() < cfg.drop_prob)) {
+      pushWord(&stream, ADC_MOD_CHANNEL, mag_code);
+    }
+  }
+  for (uint32_t f = 0; f < frames; f++) {
+    AdcFrame frame;
+    frame.ratio = cfg.ratio;
+    frame.bytes.assign(stream.begin() + (size_t)f * frame_bytes,
+                       stream.begin() + (size_t)(f + 1) * frame_bytes);
+    out->push_back(frame);
+  }
+}
+
+// Такт для "циклов на сэмпл": TSC на x86 (опорная частота, не ядро), иначе 0
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+static inline uint64_t hostCycles() { return __rdtsc(); }
+#else
+static inline uint64_t hostCycles() { return 0; }
+#endif
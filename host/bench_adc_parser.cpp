@@ -0,0 +1,194 @@
+// ============================================================================
+// === Стенд разбора DMA фрейма: parseAdcFrame против прежнего пути ===
+// ============================================================================
+// Прежний путь — readADCFromDMA до блочного парсера: битовые поля
+// adc_digi_output_data_t, ветвление на каждую конверсию, float скользящее
+// среднее и запись в кольцо через %. Новый — adc_frame_parser.cpp как есть.
+//
+//   bench_adc_parser [запись.log]
+//       без записи — синтетические фреймы (adc_recording.h)
+//
+// Печатает нс и такты на сэмпл (TSC хоста — для сравнения путей между собой;
+// на устройстве то же даёт getADCIngestCyclesPerSample; у S2 нет FPU, и разрыв
+// с float путём там больше, чем на хосте) и проверяет, что на
+// потоке без рассинхрона выходы совпадают с точностью до 1 кода.
+// Код возврата ненулевой при расхождении.
+
+#include "adc_recording.h"
+#include "adc_frame_parser.h"
+#include <chrono>
+
+// === ПРЕЖНИЙ ПУТЬ (readADCFromDMA + applyMovingAverage) ===
+struct LegacyType1 {
+  uint16_t data : 12;
+  uint16_t channel : 4;
+};
+
+struct LegacyParser {
+  int16_t ma_buffer[3] = { 0, 0, 0 };
+  uint8_t ma_index = 0;
+  float ma_avg = 0.0f;
+  int16_t* ring;
+  uint32_t write_index = 0;
+
+  int16_t movingAverage(int16_t new_sample) {
+    int16_t oldest = ma_buffer[ma_index];
+    ma_avg = ma_avg + (new_sample - oldest) / 3.0f;
+    ma_buffer[ma_index] = new_sample;
+    ma_index = (ma_index + 1) % 3;
+    return (int16_t)(ma_avg + 0.5f);
+  }
+
+  void readFrame(const uint8_t* dma_buffer, uint32_t bytes_read) {
+    uint32_t samples_read = bytes_read / SOC_ADC_DIGI_DATA_BYTES_PER_CONV;
+    uint16_t sign_value = 0;
+    uint16_t mag_value = 0;
+    bool has_sign = false;
+    bool has_mag = false;
+    for (uint32_t i = 0; i < samples_read; i++) {
+      const LegacyType1* p = (const LegacyType1*)&dma_buffer[i * SOC_ADC_DIGI_DATA_BYTES_PER_CONV];
+      uint32_t chan_num = p->channel;
+      uint32_t data = p->data;
+      if (chan_num == ADC_SIGN_CHANNEL) {
+        sign_value = data;
+        has_sign = true;
+      } else if (chan_num == ADC_MOD_CHANNEL) {
+        mag_value = data;
+        has_mag = true;
+      }
+      if (has_sign && has_mag) {
+        bool is_positive = (sign_value > ADC_SIGN_THRESHOLD);
+        if (mag_value > ADC_MAG_OVERRANGE_CODE) mag_value = 0;
+        int16_t signed_value = is_positive ? (int16_t)mag_value : -(int16_t)mag_value;
+        ring[write_index] = movingAverage(signed_value);
+        write_index = (write_index + 1) % ADC_RING_SIZE;
+        has_sign = false;
+        has_mag = false;
+      }
+    }
+  }
+};
+
+static int16_t legacy_ring[ADC_RING_SIZE];
+static int16_t parsed[ADC_FRAME_SIZE / 2 + 1];
+
+struct BenchResult {
+  double ns_per_sample;
+  double cycles_per_sample;
+};
+
+// Прогоны по всем фреймам, пока не наберётся ~4 млн сэмплов
+template<class Fn>
+static BenchResult timeFrames(const std::vector<AdcFrame>& frames, Fn run) {
+  uint64_t samples = 0;
+  auto t0 = std::chrono::steady_clock::now();
+  uint64_t c0 = hostCycles();
+  while (samples < 4000000) {
+    for (const AdcFrame& f : frames) samples += run(f);
+  }
+  uint64_t c1 = hostCycles();
+  auto t1 = std::chrono::steady_clock::now();
+  return { std::chrono::duration<double, std::nano>(t1 - t0).count() / samples,
+           (double)(c1 - c0) / samples };
+}
+
+static void initParser(AdcPairParser* st, bool bypass) {
+  initAdcPairParser(st, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD, ADC_MAG_OVERRANGE_CODE);
+  st->bypass_filter = bypass;
+}
+
+// Тайминги трёх путей и сверка фильтрованного выхода с прежним. false — расхождение
+static bool benchSet(const char* name, const std::vector<AdcFrame>& frames) {
+  AdcPairParser st;
+  initParser(&st, false);
+  BenchResult filt = timeFrames(frames, [&](const AdcFrame& f) {
+    return parseAdcFrame(&st, f.bytes.data(), f.convCount(), parsed);
+  });
+  initParser(&st, true);
+  BenchResult raw = timeFrames(frames, [&](const AdcFrame& f) {
+    return parseAdcFrame(&st, f.bytes.data(), f.convCount(), parsed);
+  });
+  LegacyParser legacy;
+  legacy.ring = legacy_ring;
+  BenchResult old = timeFrames(frames, [&](const AdcFrame& f) {
+    uint32_t w = legacy.write_index;
+    legacy.readFrame(f.bytes.data(), (uint32_t)f.bytes.size());
+    return (legacy.write_index - w) & (ADC_RING_SIZE - 1);
+  });
+
+  // Сверка: оба пути с нуля по тем же фреймам
+  initParser(&st, false);
+  LegacyParser ref;
+  ref.ring = legacy_ring;
+  uint64_t compared = 0;
+  int32_t max_diff = 0;
+  bool count_mismatch = false;
+  for (const AdcFrame& f : frames) {
+    uint32_t n = parseAdcFrame(&st, f.bytes.data(), f.convCount(), parsed);
+    uint32_t w = ref.write_index;
+    ref.readFrame(f.bytes.data(), (uint32_t)f.bytes.size());
+    uint32_t m = (ref.write_index - w) & (ADC_RING_SIZE - 1);
+    if (n != m) count_mismatch = true;
+    for (uint32_t i = 0; i < n && i < m; i++) {
+      int32_t d = abs(parsed[i] - legacy_ring[(w + i) & (ADC_RING_SIZE - 1)]);
+      if (d > max_diff) max_diff = d;
+      compared++;
+    }
+  }
+  bool clean = (st.desync_count == 0);
+
+  printf("%-14s R=%u  %u frames\n", name, (unsigned)frames[0].ratio, (unsigned)frames.size());
+  printf("  parseAdcFrame [1,1,1]/3 %6.2f ns  %6.1f cyc/sample\n", filt.ns_per_sample, filt.cycles_per_sample);
+  printf("  parseAdcFrame bypass    %6.2f ns  %6.1f cyc/sample\n", raw.ns_per_sample, raw.cycles_per_sample);
+  printf("  legacy float + %%        %6.2f ns  %6.1f cyc/sample  (x%.1f)\n",
+         old.ns_per_sample, old.cycles_per_sample, old.ns_per_sample / filt.ns_per_sample);
+  printf("  desync %lu, overrange %lu; max |diff| %ld codes over %llu samples\n",
+         (unsigned long)st.desync_count, (unsigned long)st.overrange_count,
+         (long)max_diff, (unsigned long long)compared);
+  if (!clean) {
+    // Прежний путь собирает пару в любом порядке каналов — при рассинхроне выходы
+    // законно расходятся, сравнивается только стоимость
+    printf("  (desync in stream: agreement not checked)\n");
+    return true;
+  }
+  if (count_mismatch || max_diff > 1) {
+    printf("  FAIL: outputs differ from the legacy path\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  bool ok = true;
+  if (argc > 1) {
+    std::vector<AdcFrame> frames;
+    if (!loadAdcRecording(argv[1], &frames)) {
+      fprintf(stderr, "no [FRAME] lines in %s\n", argv[1]);
+      return 1;
+    }
+    ok = benchSet(argv[1], frames);
+    return ok ? 0 : 1;
+  }
+
+  AdcSynthConfig cfg;
+  std::vector<AdcFrame> frames;
+  cfg.wave = SYNTH_SINE;
+  cfg.ratio = 1;
+  cfg.noise = 8.0f;
+  synthAdcFrames(cfg, 32, &frames);
+  ok &= benchSet("tacs 10Hz", frames);
+
+  frames.clear();
+  cfg.wave = SYNTH_NOISE;
+  cfg.ratio = ADC_OVERSAMPLE;
+  cfg.amplitude = 1500.0f;
+  synthAdcFrames(cfg, 32, &frames);
+  ok &= benchSet("trns", frames);
+
+  frames.clear();
+  cfg.drop_prob = 0.001f;
+  cfg.spike_prob = 0.002f;
+  synthAdcFrames(cfg, 32, &frames);
+  ok &= benchSet("trns+defects", frames);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+// ============================================================================
+// === Стенд прореживания: стоимость decimateAdcBlock на фрейм и АЧХ ===
+// ============================================================================
+// Фреймы разбираются parseAdcFrame (bypass_filter, как в ingest при R > 1),
+// затем decimateAdcBlock прореживает каждый фрейм отдельным вызовом — ровно
+// то, что на устройстве меряет getADCDecimatorCyclesPerFrame.
+//
+//   bench_decimator [запись.log]
+//       запись — только стоимость (истины нет); без записи — синтетика:
+//       стоимость для R = 2, 4, 8 и пути ×1 (окно [1,1,1]/3 в парсере),
+//       АЧХ по тонам, подавление наложения у ADC_SAMPLE_RATE и шум на выходе
+//
+// Проверки (код возврата): полоса до 640 Гц плоская в ±5 % (при R > 1), DC без смещения,
+// тон у ADC_SAMPLE_RATE подавлен не хуже чем в 20 раз.
+
+#include "adc_recording.h"
+#include "adc_frame_parser.h"
+#include "adc_decimator.h"
+#include <chrono>
+
+static int16_t block[ADC_FRAME_SIZE + 1];  // Пар во фрейме при R = 8
+
+static void initParser(AdcPairParser* st, bool bypass) {
+  initAdcPairParser(st, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD, ADC_MAG_OVERRANGE_CODE);
+  st->bypass_filter = bypass;
+}
+
+// Разбор + прореживание всего потока; выход — сэмплы ADC_SAMPLE_RATE
+static std::vector<int16_t> runChain(const std::vector<AdcFrame>& frames, uint8_t shift) {
+  AdcPairParser st;
+  initParser(&st, shift > 0);
+  AdcDecimator dec;
+  if (shift > 0) initAdcDecimator(&dec, shift);
+  std::vector<int16_t> out;
+  for (const AdcFrame& f : frames) {
+    uint32_t n = parseAdcFrame(&st, f.bytes.data(), f.convCount(), block);
+    if (shift > 0) n = decimateAdcBlock(&dec, block, n);
+    out.insert(out.end(), block, block + n);
+  }
+  return out;
+}
+
+// Стоимость на фрейм: повторяем весь набор, считаем только вызов прореживания
+// (для ×1 — вызов парсера с окном: это его замена в пути без передискретизации)
+static void benchCost(const char* name, const std::vector<AdcFrame>& frames, uint8_t shift) {
+  std::vector<std::vector<int16_t>> parsed;
+  AdcPairParser st;
+  initParser(&st, shift > 0);
+  for (const AdcFrame& f : frames) {
+    uint32_t n = parseAdcFrame(&st, f.bytes.data(), f.convCount(), block);
+    parsed.emplace_back(block, block + n);
+  }
+  AdcDecimator dec;
+  if (shift > 0) initAdcDecimator(&dec, shift);
+  initParser(&st, false);
+
+  uint64_t calls = 0, cycles = 0, samples_in = 0;
+  double ns = 0.0;
+  while (calls < 20000) {
+    for (size_t i = 0; i < frames.size(); i++) {
+      uint32_t n = (uint32_t)parsed[i].size();
+      memcpy(block, parsed[i].data(), n * sizeof(int16_t));
+      auto t0 = std::chrono::steady_clock::now();
+      uint64_t c0 = hostCycles();
+      if (shift > 0) {
+        decimateAdcBlock(&dec, block, n);
+      } else {
+        n = parseAdcFrame(&st, frames[i].bytes.data(), frames[i].convCount(), block);
+      }
+      cycles += hostCycles() - c0;
+      ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count();
+      samples_in += n;
+      calls++;
+    }
+  }
+  printf("%-10s R=%-2u %8.0f ns  %8.0f cyc/frame  %5.2f cyc/input sample\n", name, 1u << shift,
+         ns / calls, (double)cycles / calls, (double)cycles / samples_in);
+}
+
+// Амплитуда тона на выходе относительно входа (вторая половина — без переходного)
+static double toneGain(uint8_t shift, float freq_hz, float amplitude) {
+  AdcSynthConfig cfg;
+  cfg.wave = SYNTH_SINE;
+  cfg.ratio = (uint8_t)(1u << shift);
+  cfg.freq_hz = freq_hz;
+  cfg.amplitude = amplitude;
+  std::vector<AdcFrame> frames;
+  synthAdcFrames(cfg, 32, &frames);
+  std::vector<int16_t> y = runChain(frames, shift);
+  double s = 0.0;
+  size_t from = y.size() / 2;
+  for (size_t i = from; i < y.size(); i++) s += (double)y[i] * y[i];
+  return sqrt(2.0 * s / (y.size() - from)) / amplitude;
+}
+
+static bool benchResponse(uint8_t shift) {
+  static const float tones[] = { 10, 100, 300, 640, 1000, 2000, 3000 };
+  bool ok = true;
+  printf("R=%u response:", 1u << shift);
+  for (float f : tones) {
+    double g = toneGain(shift, f, 2000.0f);
+    printf("  %.0f Hz %.3f", f, g);
+    if (shift > 0 && f <= 640.0f && fabs(g - 1.0) > 0.05) ok = false;  // ×1: завал окна ожидаем
+  }
+  printf("\n");
+
+  // DC: ступень −1234 кодов, последний выход
+  AdcSynthConfig cfg;
+  cfg.wave = SYNTH_DC;
+  cfg.ratio = (uint8_t)(1u << shift);
+  cfg.amplitude = -1234.0f;
+  std::vector<AdcFrame> frames;
+  synthAdcFrames(cfg, 4, &frames);
+  int16_t dc = runChain(frames, shift).back();
+  printf("  DC -1234 -> %d", dc);
+  if (abs(dc + 1234) > 1) ok = false;
+
+  if (shift > 0) {
+    // Тон у частоты выхода наложился бы на 100 Гц — CIC ставит там ноль
+    double alias = toneGain(shift, ADC_SAMPLE_RATE - 100.0f, 2000.0f);
+    printf(", %.0f Hz alias %.4f", (double)ADC_SAMPLE_RATE - 100.0, alias);
+    if (alias > 0.05) ok = false;
+  }
+
+  // Белый шум модуля σ = 50 кодов на постоянном токе: СКО на выходе
+  cfg.amplitude = 1000.0f;
+  cfg.noise = 50.0f;
+  frames.clear();
+  synthAdcFrames(cfg, 32, &frames);
+  std::vector<int16_t> y = runChain(frames, shift);
+  double s = 0.0, m = 0.0;
+  size_t from = y.size() / 2;
+  for (size_t i = from; i < y.size(); i++) m += y[i];
+  m /= (y.size() - from);
+  for (size_t i = from; i < y.size(); i++) s += (y[i] - m) * (y[i] - m);
+  printf(", noise 50 -> %.1f codes rms\n", sqrt(s / (y.size() - from)));
+  if (!ok) printf("  FAIL\n");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    std::vector<AdcFrame> frames;
+    if (!loadAdcRecording(argv[1], &frames)) {
+      fprintf(stderr, "no [FRAME] lines in %s\n", argv[1]);
+      return 1;
+    }
+    uint8_t shift = 0;
+    while ((1u << shift) < frames[0].ratio) shift++;
+    benchCost(argv[1], frames, shift);
+    return 0;
+  }
+
+  bool ok = true;
+  for (uint8_t shift = 0; shift <= 3; shift++) {
+    AdcSynthConfig cfg;
+    cfg.wave = SYNTH_NOISE;
+    cfg.ratio = (uint8_t)(1u << shift);
+    cfg.amplitude = 1500.0f;
+    cfg.noise = 8.0f;
+    std::vector<AdcFrame> frames;
+    synthAdcFrames(cfg, 32, &frames);
+    benchCost(shift > 0 ? "cic+fir" : "[1,1,1]/3", frames, shift);
+  }
+  for (uint8_t shift = 0; shift <= 3; shift++) ok &= benchResponse(shift);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,150 @@
+// ============================================================================
+// === Стенд контроля контакта: adc_contact.cpp при ошибке привязки фазы ===
+// ============================================================================
+// adc_contact.cpp собирается как есть; ingest заменён потоком блоков мкА:
+//   ток сэмпла = полярность × команда его истинной фазы лупа × k + шум,
+// а getADCLoopPhase отдаёт фазу с ошибкой привязки (anchor) — как
+// adc_loop_average при джиттере записи в I2S (до DMA буфера, сглаженно).
+// Формы: tDCS, tACS 1.46 Гц (3 периода на луп), 40 Гц, tRNS — сумма тонов
+// 100–640 Гц, периодичных на лупе (как пресет), пик = MAX_VAL, 2 мА.
+//
+// Проверки (код возврата):
+//   - исправная цепь при ошибке привязки до ±ANCHOR_MAX сэмплов — ADC_CONTACT_OK
+//     во всех формах (в tRNS/быстром tACS знак не сравнивается), и худшее
+//     оценённое отношение тока — на 10 п.п. выше ADC_CONTACT_MIN_RATIO_PCT;
+//   - обратная полярность в tDCS и tACS 1.46 Гц — ADC_CONTACT_SIGN при той же
+//     ошибке привязки;
+//   - обрыв (только шум) — ADC_CONTACT_OPEN, в tACS 1.46 Гц тоже (окна у нуля
+//     команды по отношению не судятся, остальные — да).
+
+#include <Arduino.h>
+#include "adc_contact.h"
+#include "adc_loop_average.h"
+#include "dac_control.h"
+
+#define SIM_PEAK_UA   2000.0f  // Пик команды
+#define SIM_NOISE_UA  20.0f    // СКО шума измерения
+#define SIM_BLOCK     ADC_SAMPLES_PER_FRAME
+#define SIM_SECONDS   3        // После успокоения очереди DAC
+#define ANCHOR_MAX    190      // Ошибка привязки фазы в стенде, сэмплов
+
+// === Символы прошивки, которые берёт adc_contact ===
+int16_t* signal_buffer = NULL;
+static int32_t anchor_error = 0;
+
+bool getADCLoopPhase(uint32_t seq, uint32_t* phase) {
+  *phase = (uint32_t)(seq + anchor_error) & (SIGNAL_SAMPLES - 1);
+  return true;
+}
+
+static int16_t loop_signal[SIGNAL_SAMPLES];
+static uint32_t sim_rng = 1;
+
+static float simGauss() {
+  float s = 0.0f;
+  for (int k = 0; k < 4; k++) {
+    sim_rng ^= sim_rng << 13;
+    sim_rng ^= sim_rng >> 17;
+    sim_rng ^= sim_rng << 5;
+    s += (sim_rng >> 8) * (1.0f / 16777216.0f) - 0.5f;
+  }
+  return s * 1.732f;  // Сумма 4 равномерных: σ = 1
+}
+
+enum SimWave { WAVE_TDCS, WAVE_TACS_SLOW, WAVE_TACS_FAST, WAVE_TRNS };
+
+static const char* waveName(SimWave w) {
+  switch (w) {
+    case WAVE_TDCS: return "tdcs";
+    case WAVE_TACS_SLOW: return "tacs 1.46 Hz";
+    case WAVE_TACS_FAST: return "tacs 40 Hz";
+    default: return "trns";
+  }
+}
+
+static void makeWave(SimWave w) {
+  static float tmp[SIGNAL_SAMPLES];
+  float peak = 0.0f;
+  for (uint32_t i = 0; i < SIGNAL_SAMPLES; i++) {
+    double t = 2.0 * M_PI * i / SIGNAL_SAMPLES;  // Фаза лупа
+    double x;
+    switch (w) {
+      case WAVE_TDCS: x = 1.0; break;
+      case WAVE_TACS_SLOW: x = sin(3 * t); break;
+      case WAVE_TACS_FAST: x = sin(82 * t); break;  // 82 × 8000 / 16384 ≈ 40 Гц
+      default: {
+        // Тоны с целым числом периодов на луп, фазы — фиксированный ГПСЧ
+        x = 0.0;
+        uint32_t r = 12345;
+        for (uint32_t bin = 205; bin <= 1311; bin += 3) {  // 100..640 Гц
+          r = r * 1103515245u + 12345u;
+          x += sin(bin * t + (r >> 8) * (2.0 * M_PI / 16777216.0));
+        }
+        break;
+      }
+    }
+    tmp[i] = (float)x;
+    peak = fmaxf(peak, fabsf((float)x));
+  }
+  for (uint32_t i = 0; i < SIGNAL_SAMPLES; i++) {
+    loop_signal[i] = (int16_t)lrintf(tmp[i] / peak * MAX_VAL);
+  }
+  signal_buffer = loop_signal;
+}
+
+// polarity: +1 — исправно, −1 — перепутан знак H-моста; k = 0 — обрыв
+static float worst_ratio, worst_sign;  // По всем окнам прогона
+
+static AdcContactStatus runCase(SimWave w, int32_t anchor, float polarity, float k) {
+  makeWave(w);
+  worst_ratio = worst_sign = 1e9f;
+  anchor_error = anchor;
+  float uA_per_code = SIM_PEAK_UA / MAX_VAL;
+  configureADCContact(uA_per_code);
+  int16_t block[SIM_BLOCK];
+  uint32_t total = DAC_PIPELINE_FRAMES + SIM_SECONDS * ADC_SAMPLE_RATE;
+  for (uint32_t seq = 0; seq < total; seq += SIM_BLOCK) {
+    for (uint32_t i = 0; i < SIM_BLOCK; i++) {
+      float c = loop_signal[(seq + i) & (SIGNAL_SAMPLES - 1)] * uA_per_code;
+      block[i] = (int16_t)lrintf(polarity * k * c + SIM_NOISE_UA * simGauss());
+    }
+    updateADCContact(block, SIM_BLOCK, seq, true, 0, SIM_BLOCK * ADC_OVERSAMPLE);
+    AdcContactStatus st;
+    getADCContactStatus(&st);
+    if (st.valid) worst_sign = fminf(worst_sign, st.sign_pct);
+    if (st.ratio_valid) worst_ratio = fminf(worst_ratio, st.ratio_pct);
+  }
+  AdcContactStatus st;
+  getADCContactStatus(&st);
+  return st;
+}
+
+static bool check(SimWave w, int32_t anchor, float polarity, float k, uint8_t expect) {
+  AdcContactStatus st = runCase(w, anchor, polarity, k);
+  bool ok = st.valid && st.fault == expect;
+  // Исправная цепь: каждое окно, где отношение оценивалось, — с запасом до порога
+  if (expect == ADC_CONTACT_OK) ok &= worst_ratio >= ADC_CONTACT_MIN_RATIO_PCT + 10;
+  char name[64];
+  snprintf(name, sizeof(name), "%s anchor %+ld%s%s", waveName(w), (long)anchor,
+           polarity < 0 ? " reversed" : "", k == 0.0f ? " open" : "");
+  printf("%-34s worst ratio %5.1f%% sign %5.1f%% -> %-13s %s\n", name, worst_ratio, worst_sign,
+         getADCContactFaultName(st.fault), ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  for (SimWave w : { WAVE_TDCS, WAVE_TACS_SLOW, WAVE_TACS_FAST, WAVE_TRNS }) {
+    for (int32_t anchor : { 0, 40, -ANCHOR_MAX / 2, ANCHOR_MAX, -ANCHOR_MAX }) {
+      ok &= check(w, anchor, 1.0f, 1.0f, ADC_CONTACT_OK);
+    }
+  }
+  for (SimWave w : { WAVE_TDCS, WAVE_TACS_SLOW }) {
+    for (int32_t anchor : { 0, ANCHOR_MAX, -ANCHOR_MAX }) {
+      ok &= check(w, anchor, -1.0f, 1.0f, ADC_CONTACT_SIGN);
+    }
+  }
+  ok &= check(WAVE_TRNS, ANCHOR_MAX, 1.0f, 0.0f, ADC_CONTACT_OPEN);
+  ok &= check(WAVE_TACS_SLOW, ANCHOR_MAX, 1.0f, 0.0f, ADC_CONTACT_OPEN);
+  return ok ? 0 : 1;
+}
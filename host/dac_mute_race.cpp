@@ -0,0 +1,293 @@
+// ============================================================================
+// === Стенд аварийной тишины DAC: muteDACOutput против записи фрагмента ===
+// ============================================================================
+// dac_control.cpp собирается как есть поверх модели легаси драйвера I2S:
+// кольцо DMA_BUFFER_COUNT буферов по DMA_BUFFER_LEN стерео-фреймов, DMA играет
+// их по кругу, сыгранный буфер обнуляется (tx_desc_auto_clear) и уходит в
+// очередь свободных с событием TX_DONE; i2s_write копирует в свободные буферы
+// частями и при нехватке места ждёт до таймаута (модельное время: буфер
+// играет DMA_BUFFER_LEN / SAMPLE_RATE, ожидание дольше — DMA доиграл буфер).
+//
+// Вытеснение: в точках, где loop() может уступить задаче аварии (приоритет
+// выше) — перед захватом мьютекса, перед и в середине каждого memcpy драйвера,
+// в ожидании места, — на k-й точке запускается задача аварии (muteDACOutput).
+// Мьютекс занят — она ждёт его освобождения (наследование приоритета: сразу
+// после xSemaphoreGive). k перебирается по всем точкам нескольких вызовов
+// keepDMAFilled, начиная с предзаполнения.
+//
+// Проверка (код возврата): после завершения muteDACOutput в любой точке
+// вытеснения все буферы DMA (всё, что ещё может выйти на DAC) и всё
+// сыгранное — нули в канале модуля.
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include <deque>
+#include <vector>
+#include "dac_control.h"
+#include "session_control.h"
+#include <freertos/semphr.h>
+
+#define RACE_LOOP_CALLS 24  // Вызовов keepDMAFilled на сценарий
+
+// === Символы прошивки, которые берёт dac_control ===
+SessionSettings current_settings = {};
+StimMode session_mode = MODE_TRNS;
+float tacs_active_frequency = 0.0f;
+uint32_t session_timer_start_ms = 0;
+HardwareSerial Serial;
+void HardwareSerial::printf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+uint32_t millis() { return 1; }
+void refreshDisplay() {}
+void scheduleADCCaptureStart(uint32_t delay_ms) { (void)delay_ms; }
+void noteDACLoopStart(int32_t frames_until_play) { (void)frames_until_play; }
+void getSessionGainSegment(uint64_t frame, float* gain, float* slope, uint32_t* run) {
+  (void)frame;
+  *gain = 1.0f;
+  *slope = 0.0f;
+  *run = 0xFFFFFFFFu;
+}
+
+// === МОДЕЛЬ ВЫТЕСНЕНИЯ ===
+struct HostMutex {
+  bool held;
+};
+static HostMutex dac_mutex_obj;
+static uint32_t point_count = 0;      // Точек вытеснения с начала сценария
+static uint32_t trip_at = 0;          // На какой точке приходит авария
+static bool trip_waiting = false;     // Задача аварии ждёт мьютекс
+static bool in_trip = false;
+static bool mute_done = false;
+static size_t deferred_bytes = 0;     // Скопировано драйвером, пока авария ждала
+static size_t worst_deferred = 0;
+static uint32_t violations = 0;
+
+static void runTripTask() {
+  in_trip = true;
+  trip_waiting = false;
+  muteDACOutput();
+  in_trip = false;
+  mute_done = true;
+  if (deferred_bytes > worst_deferred) worst_deferred = deferred_bytes;
+}
+
+static void checkSilence(const char* where);
+
+// Точка, где loop() может быть вытеснен задачей аварии
+static void preemptionPoint() {
+  if (in_trip) return;
+  if (point_count++ == trip_at) {
+    if (dac_mutex_obj.held) {
+      trip_waiting = true;  // Заблокируется на мьютексе
+    } else {
+      runTripTask();
+    }
+  }
+  if (mute_done) checkSilence("preemption point");
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  dac_mutex_obj.held = false;
+  return &dac_mutex_obj;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks) {
+  (void)ticks;
+  if (!in_trip) preemptionPoint();
+  if (mutex->held) {
+    fprintf(stderr, "mutex taken twice in one context\n");
+    exit(2);
+  }
+  mutex->held = true;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex) {
+  mutex->held = false;
+  if (trip_waiting && !in_trip) runTripTask();  // Ждавшая задача выше приоритетом — сразу
+  return pdTRUE;
+}
+
+// === МОДЕЛЬ ЛЕГАСИ ДРАЙВЕРА I2S ===
+static const size_t BUF_BYTES = DMA_BUFFER_LEN * 2 * sizeof(int16_t);
+struct HostQueue {
+  std::deque<i2s_event_t> events;
+};
+static HostQueue tx_events;
+static int16_t dma_buf[DMA_BUFFER_COUNT][DMA_BUFFER_LEN * 2];
+static const uint32_t BUF_MS = DMA_BUFFER_LEN * 1000 / SAMPLE_RATE;  // Буфер играет столько
+static uint32_t now_ms = 0;         // Модельное время
+static uint32_t buf_done_ms = 0;    // Когда DMA доиграет текущий буфер
+static std::deque<int> free_bufs;   // Сыгранные, ждут записи
+static int play_buf = 0;            // Следующий на выход
+static int curr_buf = -1;           // Заполняемый i2s_write
+static size_t rw_pos = 0;
+static std::vector<int16_t> played_after_mute;
+
+static void resetDriverModel() {
+  memset(dma_buf, 0, sizeof(dma_buf));
+  free_bufs.clear();
+  for (int i = 0; i < DMA_BUFFER_COUNT; i++) free_bufs.push_back(i);
+  play_buf = 0;
+  now_ms = 0;
+  buf_done_ms = BUF_MS;
+  curr_buf = -1;
+  rw_pos = 0;
+  tx_events.events.clear();
+}
+
+// DMA выводит буфер целиком, обнуляет его и отдаёт записи
+static void playOneBuffer() {
+  int b = play_buf;
+  play_buf = (play_buf + 1) % DMA_BUFFER_COUNT;
+  if (mute_done) {
+    for (int i = 1; i < DMA_BUFFER_LEN * 2; i += 2) played_after_mute.push_back(dma_buf[b][i]);
+  }
+  memset(dma_buf[b], 0, BUF_BYTES);
+  bool queued = (b == curr_buf);
+  for (int f : free_bufs) queued = queued || (f == b);
+  if (!queued) free_bufs.push_back(b);
+  tx_events.events.push_back({ I2S_EVENT_TX_DONE, BUF_BYTES });
+  if (tx_events.events.size() > DMA_BUFFER_COUNT) tx_events.events.pop_front();
+}
+
+// Ожидание до ticks мс: true — за это время DMA доиграл буфер
+static bool waitForBuffer(TickType_t ticks) {
+  preemptionPoint();
+  if (ticks != portMAX_DELAY && now_ms + ticks < buf_done_ms) {
+    now_ms += ticks;
+    return false;
+  }
+  now_ms = buf_done_ms;
+  buf_done_ms += BUF_MS;
+  playOneBuffer();
+  return true;
+}
+
+static void checkSilence(const char* where) {
+  for (int b = 0; b < DMA_BUFFER_COUNT; b++) {
+    for (int i = 1; i < DMA_BUFFER_LEN * 2; i += 2) {
+      if (dma_buf[b][i] != 0) {
+        if (violations++ == 0) {
+          printf("  FAIL trip at point %u: buffer %d sample %d = %d after mute (%s)\n",
+                 trip_at, b, i / 2, dma_buf[b][i], where);
+        }
+        return;
+      }
+    }
+  }
+  for (int16_t v : played_after_mute) {
+    if (v != 0) {
+      if (violations++ == 0) printf("  FAIL trip at point %u: non-zero played after mute\n", trip_at);
+      return;
+    }
+  }
+}
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queue_size, void* queue) {
+  (void)port; (void)config; (void)queue_size;
+  if (queue) *(QueueHandle_t*)queue = &tx_events;
+  resetDriverModel();
+  return ESP_OK;
+}
+esp_err_t i2s_set_pin(i2s_port_t, const i2s_pin_config_t*) { return ESP_OK; }
+esp_err_t i2s_set_clk(i2s_port_t, uint32_t, uint32_t, i2s_channel_t) { return ESP_OK; }
+esp_err_t i2s_start(i2s_port_t) { return ESP_OK; }
+esp_err_t i2s_stop(i2s_port_t) { return ESP_OK; }
+
+esp_err_t i2s_zero_dma_buffer(i2s_port_t) {
+  memset(dma_buf, 0, sizeof(dma_buf));
+  return ESP_OK;
+}
+
+// Как в драйвере: берёт свободный буфер (ждёт до ticks), копирует частями
+esp_err_t i2s_write(i2s_port_t, const void* src, size_t size, size_t* bytes_written, TickType_t ticks) {
+  const uint8_t* p = (const uint8_t*)src;
+  *bytes_written = 0;
+  while (size > 0) {
+    if (curr_buf < 0 || rw_pos == BUF_BYTES) {
+      if (free_bufs.empty()) {
+        // Ждём места: DMA доигрывает буфер
+        if (ticks == 0 || !waitForBuffer(ticks)) break;
+      }
+      curr_buf = free_bufs.front();
+      free_bufs.pop_front();
+      rw_pos = 0;
+    }
+    size_t n = BUF_BYTES - rw_pos;
+    if (n > size) n = size;
+    size_t half = (n / 2) & ~(size_t)3;
+    preemptionPoint();
+    memcpy((uint8_t*)dma_buf[curr_buf] + rw_pos, p, half);
+    if (trip_waiting) deferred_bytes += half;
+    preemptionPoint();
+    memcpy((uint8_t*)dma_buf[curr_buf] + rw_pos + half, p + half, n - half);
+    if (trip_waiting) deferred_bytes += n - half;
+    rw_pos += n;
+    p += n;
+    size -= n;
+    *bytes_written += n;
+  }
+  return ESP_OK;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  if (queue->events.empty()) {
+    // loop() спит до TX_DONE
+    if (ticks == 0 || !waitForBuffer(ticks)) return pdFALSE;
+  }
+  *(i2s_event_t*)item = queue->events.front();
+  queue->events.pop_front();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  queue->events.clear();
+  return pdTRUE;
+}
+
+// Сценарий: сеанс с начала, авария на точке trip. Возвращает число точек
+static uint32_t runScenario(uint32_t trip) {
+  trip_at = trip;
+  point_count = 0;
+  trip_waiting = false;
+  mute_done = false;
+  deferred_bytes = 0;
+  played_after_mute.clear();
+  resetDriverModel();
+  clearDACMute();
+  resetDacPlayback();
+  for (int i = 0; i < RACE_LOOP_CALLS; i++) {
+    keepDMAFilled();
+    if (mute_done) checkSilence("after keepDMAFilled");
+  }
+  if (trip < point_count && !mute_done) {
+    if (violations++ == 0) printf("  FAIL trip at point %u: mute never ran\n", trip);
+  }
+  return point_count;
+}
+
+int main() {
+  // Модуль не обнуляется нигде: любой ненулевой сэмпл после аварии виден
+  static int16_t signal[SIGNAL_SAMPLES];
+  for (int i = 0; i < SIGNAL_SAMPLES; i++) {
+    signal[i] = (int16_t)(((i & 1) ? 1 : -1) * (1000 + (i * 37) % 20000));
+  }
+  signal_buffer = signal;
+  setAmplitudeScale(0.5f);
+  initDAC();
+
+  uint32_t points = runScenario(0xFFFFFFFFu);  // Без аварии: сколько точек
+  uint32_t scenarios = 0;
+  for (uint32_t k = 0; k < points; k++) {
+    runScenario(k);
+    scenarios++;
+  }
+  printf("dac mute race: %u trip points over %d loop calls, worst wait %zu bytes copied, %u violations\n",
+         scenarios, RACE_LOOP_CALLS, worst_deferred, violations);
+  return violations ? 1 : 0;
+}
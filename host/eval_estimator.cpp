@@ -0,0 +1,379 @@
+// ============================================================================
+// === Офлайн оценка alpha-beta оценщика: шум против скорости фронта ===
+// ============================================================================
+// Цепочка как в processADCFrame: parseAdcFrame → (R > 1) runAdcHampel на
+// сырых парах → decimateAdcBlock → runAdcEstimator с моделью режима из
+// config.h (ADC_EST_*). Сравнивается с той же цепочкой без отбраковки и
+// оценщика — прежний путь: окно [1,1,1]/3 в парсере при ×1, только
+// прореживание при R > 1.
+//
+//   eval_estimator
+//       синтетика с известной истиной: tDCS ступени, tACS 40 Гц и tRNS шум —
+//       ровно и пачками (амплитуда 1 ↔ 1/4, EVAL_BURST_HZ); шум модуля
+//       σ = 30 кодов и выбросы (вне калибровки и +2000 кодов); в конце —
+//       такты на пару против прежнего float окна
+//   eval_estimator <запись.log> <tdcs|tacs|trns> <пик, коды>
+//       запись с устройства (например, ступени автокалибровки): истины нет,
+//       шум считается против сглаженной опоры, фронты ищутся по опоре
+//
+// Метрики: СКО ошибки на ровных участках (коды), худший остаток на выбросе,
+// СКО ошибки в EVAL_EDGE_SAMPLES после фронтов (ступени, пачки), фронт
+// 10–90 % (мс), задержка выхода относительно истины (сэмплы).
+// Проверки (код возврата, только синтетика): tDCS — шум ниже, чем у окна, и
+// фронт не длиннее EVAL_MAX_RISE_MS; выбросы подавлены во всех режимах (в tRNS
+// тоже); tACS/tRNS пачками — ошибка после фронтов не больше
+// EVAL_MAX_EDGE_RATIO × прежнего пути.
+
+#include "adc_recording.h"
+#include "adc_frame_parser.h"
+#include "adc_decimator.h"
+#include "adc_estimator.h"
+#include <algorithm>
+
+#define EVAL_NOISE_CODES   30.0f
+#define EVAL_PEAK_CODES    1500.0f
+#define EVAL_MAX_RISE_MS    5.0   // Фронт tDCS с оценщиком не длиннее (мс)
+#define EVAL_EDGE_SAMPLES   80    // Окно после фронта: вне СКО, в ошибке фронта
+#define EVAL_BURST_HZ       4.0f  // Пачки tACS/tRNS: амплитуда 1 ↔ 1/4
+#define EVAL_MAX_EDGE_RATIO 1.25  // Ошибка после фронтов с оценщиком — не больше × прежнего пути
+
+struct ModeModel {
+  const char* name;
+  uint8_t ratio;
+  uint16_t alpha, beta;
+  uint8_t floor_pct;
+};
+
+static const ModeModel kModels[] = {
+  { "tdcs", ADC_RATE_SCHEDULING ? 1 : ADC_OVERSAMPLE, ADC_EST_TDCS_ALPHA, ADC_EST_TDCS_BETA, ADC_EST_FLOOR_PCT },
+  { "tacs", ADC_OVERSAMPLE, ADC_EST_TACS_ALPHA, ADC_EST_TACS_BETA, ADC_EST_FLOOR_PCT },
+  { "trns", ADC_OVERSAMPLE, ADC_EST_TRNS_ALPHA, ADC_EST_TRNS_BETA, ADC_EST_FLOOR_PCT_TRNS },
+};
+
+static int16_t block[ADC_FRAME_SIZE / 2 + 1];
+
+// Вся цепочка по фреймам; with_estimator = false — прежний путь
+static std::vector<int16_t> runChain(const std::vector<AdcFrame>& frames, const ModeModel& m,
+                                     float peak_codes, bool with_estimator) {
+  uint8_t shift = 0;
+  while ((1u << shift) < m.ratio) shift++;
+  AdcPairParser st;
+  initAdcPairParser(&st, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD, ADC_MAG_OVERRANGE_CODE);
+  st.bypass_filter = with_estimator || shift > 0;
+  AdcDecimator dec;
+  if (shift > 0) initAdcDecimator(&dec, shift);
+  AdcEstimator est;
+  initAdcEstimator(&est);
+  int32_t floor_codes = (int32_t)(peak_codes * m.floor_pct / 100);
+  if (floor_codes < ADC_EST_MIN_FLOOR_CODES) floor_codes = ADC_EST_MIN_FLOOR_CODES;
+  setAdcEstimatorModel(&est, m.alpha, m.beta, (int16_t)floor_codes, ADC_EST_MAX_RUN);
+
+  AdcHampel raw;
+  initAdcHampel(&raw, ADC_EST_RAW_FLOOR_CODES);
+
+  std::vector<int16_t> out;
+  for (const AdcFrame& f : frames) {
+    uint32_t n = parseAdcFrame(&st, f.bytes.data(), f.convCount(), block);
+    if (with_estimator && shift > 0) runAdcHampel(&raw, block, n);
+    if (shift > 0) n = decimateAdcBlock(&dec, block, n);
+    if (with_estimator) runAdcEstimator(&est, block, n);
+    out.insert(out.end(), block, block + n);
+  }
+  return out;
+}
+
+// Фронт 10–90 % после края e (от уровня lo к hi), в сэмплах; −1 — не дошёл
+static int riseSamples(const std::vector<int16_t>& y, size_t e, double lo, double hi, size_t span) {
+  double dir = (hi > lo) ? 1.0 : -1.0;
+  double t10 = lo + 0.1 * (hi - lo), t90 = lo + 0.9 * (hi - lo);
+  int i10 = -1;
+  for (size_t i = e; i < y.size() && i < e + span; i++) {
+    if (i10 < 0 && (y[i] - t10) * dir >= 0) i10 = (int)i;
+    if ((y[i] - t90) * dir >= 0) return (i10 < 0) ? 0 : (int)i - i10;
+  }
+  return -1;
+}
+
+struct Metrics {
+  double noise = 0;   // СКО на ровных участках, коды
+  double spike = 0;   // Худший |ошибка| около выброса, коды
+  double edge = 0;    // СКО ошибки после фронтов (ступени, пачки), коды
+  double rise_ms = 0; // Средний фронт 10–90 %
+  int lag = 0;        // Задержка выхода, сэмплы
+  int edges = 0;
+};
+
+static void printMetrics(const char* path, const Metrics& m) {
+  printf("  %-10s noise %6.1f  spike %6.0f  edge %6.1f  rise %5.2f ms (%d edges)  lag %d\n", path,
+         m.noise, m.spike, m.edge, m.rise_ms, m.edges, m.lag);
+}
+
+// === СИНТЕТИКА: ошибка против истины ===
+static Metrics evalSynthetic(const std::vector<int16_t>& y, const std::vector<float>& truth_pairs,
+                             const std::vector<uint32_t>& spike_pairs, uint8_t ratio, bool steps,
+                             float burst_hz) {
+  size_t n = y.size();
+  std::vector<float> t(n);
+  for (size_t k = 0; k < n; k++) t[k] = truth_pairs[k * ratio];
+
+  // Края и окрестности выбросов — вне СКО (их меряют фронт и остаток выброса)
+  std::vector<uint8_t> skip(n, 0);
+  std::vector<size_t> edges;
+  auto burstOn = [&](size_t k) { return fmod((double)k / ADC_SAMPLE_RATE * burst_hz, 1.0) < 0.5; };
+  for (size_t k = 1; k < n; k++) {
+    bool step = steps && fabsf(t[k] - t[k - 1]) > EVAL_PEAK_CODES / 2;
+    bool burst = burst_hz > 0.0f && burstOn(k) != burstOn(k - 1);
+    if (step || burst) {
+      edges.push_back(k);
+      for (size_t j = k; j < n && j < k + EVAL_EDGE_SAMPLES; j++) skip[j] = 1;
+    }
+  }
+  for (uint32_t p : spike_pairs) {
+    size_t k = p / ratio;
+    for (size_t j = k; j < n && j < k + 8; j++) skip[j] = 1;
+  }
+  size_t from = 400;  // Без переходного процесса фильтров
+
+  Metrics m;
+  double best = 1e30;
+  for (int lag = 0; lag <= 16; lag++) {
+    double s = 0;
+    size_t c = 0;
+    for (size_t k = from; k + lag < n; k++) {
+      if (skip[k]) continue;
+      double d = y[k + lag] - t[k];
+      s += d * d;
+      c++;
+    }
+    if (c > 0 && s / c < best) {
+      best = s / c;
+      m.lag = lag;
+    }
+  }
+  m.noise = sqrt(best);
+  for (uint32_t p : spike_pairs) {
+    size_t k = p / ratio;
+    if (k < from) continue;
+    for (size_t j = k; j < k + 8 && j + m.lag < n; j++) {
+      m.spike = std::max(m.spike, fabs((double)y[j + m.lag] - t[j]));
+    }
+  }
+  double edge_sq = 0;
+  size_t edge_count = 0;
+  int sum = 0;
+  for (size_t e : edges) {
+    if (e < from) continue;
+    for (size_t j = e; j < e + EVAL_EDGE_SAMPLES && j + m.lag < n; j++) {
+      double d = y[j + m.lag] - t[j];
+      edge_sq += d * d;
+      edge_count++;
+    }
+    if (!steps) continue;
+    int r = riseSamples(y, e, t[e - 1], t[e], 400);
+    if (r < 0) continue;
+    sum += r;
+    m.edges++;
+  }
+  if (m.edges > 0) m.rise_ms = 1000.0 * sum / m.edges / ADC_SAMPLE_RATE;
+  if (edge_count > 0) m.edge = sqrt(edge_sq / edge_count);
+  return m;
+}
+
+// === ЗАПИСЬ: опора — центрированное среднее прежнего пути ===
+#define REF_HALF 32
+static Metrics evalRecorded(const std::vector<int16_t>& y, const std::vector<int16_t>& base) {
+  size_t n = base.size();
+  std::vector<double> ref(n, 0.0);
+  double full = 1.0;
+  for (size_t k = REF_HALF; k + REF_HALF < n; k++) {
+    double s = 0;
+    for (size_t j = k - REF_HALF; j <= k + REF_HALF; j++) s += base[j];
+    ref[k] = s / (2 * REF_HALF + 1);
+    full = std::max(full, fabs(ref[k]));
+  }
+
+  Metrics m;
+  double s = 0;
+  size_t c = 0;
+  std::vector<size_t> edges;
+  for (size_t k = 2 * REF_HALF; k + 2 * REF_HALF < n; k++) {
+    double before = ref[k - REF_HALF], after = ref[k + REF_HALF];
+    // Ровный участок: опора почти не меняется на ±REF_HALF
+    if (fabs(after - before) < 0.02 * full + 10) {
+      double d = y[k] - ref[k];
+      s += d * d;
+      c++;
+    }
+    // Фронт: середина скачка больше 20 % шкалы (одна точка на фронт)
+    double mid = (before + after) / 2;
+    if (fabs(after - before) > 0.2 * full &&
+        (ref[k - 1] - mid) * (ref[k] - mid) <= 0 && (edges.empty() || k > edges.back() + 2 * REF_HALF)) {
+      edges.push_back(k);
+    }
+  }
+  m.noise = (c > 0) ? sqrt(s / c) : 0;
+  int sum = 0;
+  for (size_t e : edges) {
+    double lo = ref[e - 2 * REF_HALF], hi = ref[e + 2 * REF_HALF];
+    int r = riseSamples(y, e - REF_HALF, lo, hi, 4 * REF_HALF);
+    if (r < 0) continue;
+    sum += r;
+    m.edges++;
+  }
+  if (m.edges > 0) m.rise_ms = 1000.0 * sum / m.edges / ADC_SAMPLE_RATE;
+  return m;
+}
+
+static bool evalMode(const ModeModel& model, AdcSynthWave wave, float freq_hz, float spike_codes,
+                     float burst_hz) {
+  AdcSynthConfig cfg;
+  cfg.wave = wave;
+  cfg.ratio = model.ratio;
+  cfg.amplitude = EVAL_PEAK_CODES;
+  cfg.freq_hz = freq_hz;
+  cfg.noise = EVAL_NOISE_CODES;
+  cfg.spike_prob = 0.0005f / model.ratio;  // ~4 выброса в секунду на любом R
+  cfg.spike_codes = spike_codes;
+  cfg.burst_hz = burst_hz;
+  std::vector<AdcFrame> frames;
+  std::vector<float> truth;
+  std::vector<uint32_t> spikes;
+  synthAdcFrames(cfg, 64, &frames, &truth, &spikes);
+
+  std::vector<int16_t> base = runChain(frames, model, EVAL_PEAK_CODES, false);
+  std::vector<int16_t> est = runChain(frames, model, EVAL_PEAK_CODES, true);
+  Metrics mb = evalSynthetic(base, truth, spikes, model.ratio, wave == SYNTH_STEP, burst_hz);
+  Metrics me = evalSynthetic(est, truth, spikes, model.ratio, wave == SYNTH_STEP, burst_hz);
+  printf("%s R=%u, %s spikes%s (alpha %u, beta %u, floor %u%%)\n", model.name, (unsigned)model.ratio,
+         spike_codes > 0 ? "in-range" : "overrange", burst_hz > 0.0f ? ", bursts" : "",
+         model.alpha, model.beta, model.floor_pct);
+  printMetrics(model.ratio > 1 ? "decimator" : "window", mb);
+  printMetrics("estimator", me);
+
+  bool ok = true;
+  if (me.spike > mb.spike + 1.0 && me.spike > 3 * EVAL_NOISE_CODES) {
+    printf("  FAIL: spikes not rejected\n");
+    ok = false;
+  }
+  if (burst_hz > 0.0f && me.edge > mb.edge * EVAL_MAX_EDGE_RATIO) {
+    printf("  FAIL: edges distorted\n");
+    ok = false;
+  }
+  if (wave == SYNTH_STEP) {
+    if (me.noise >= mb.noise) {
+      printf("  FAIL: no noise reduction on DC\n");
+      ok = false;
+    }
+    if (me.edges == 0 || me.rise_ms > EVAL_MAX_RISE_MS) {
+      printf("  FAIL: step rise too slow\n");
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+// === ЦЕНА: такты на пару против прежнего float окна ===
+// Прежний фильтр — float скользящее среднее [1,1,1]/3 на каждую пару (как
+// applyMovingAverage); новый — Hampel на парах + оценщик на выходных сэмплах.
+// Дециматор общий, его меряет bench_decimator. Блоки — уже разобранные пары.
+struct LegacyAverage {
+  int16_t buf[3] = { 0, 0, 0 };
+  uint8_t index = 0;
+  float avg = 0.0f;
+  int16_t next(int16_t x) {
+    int16_t oldest = buf[index];
+    avg = avg + (x - oldest) / 3.0f;
+    buf[index] = x;
+    index = (index + 1) % 3;
+    return (int16_t)(avg + 0.5f);
+  }
+};
+
+template<class Fn>
+static double cyclesPerPair(const std::vector<std::vector<int16_t>>& blocks, Fn run) {
+  uint64_t pairs = 0;
+  uint64_t c0 = hostCycles();
+  while (pairs < 4000000) {
+    for (const std::vector<int16_t>& b : blocks) {
+      memcpy(block, b.data(), b.size() * sizeof(int16_t));
+      run((uint32_t)b.size());
+      pairs += b.size();
+    }
+  }
+  return (double)(hostCycles() - c0) / pairs;
+}
+
+static void benchFilters(const ModeModel& model) {
+  AdcSynthConfig cfg;
+  cfg.wave = SYNTH_SINE;
+  cfg.ratio = model.ratio;
+  cfg.amplitude = EVAL_PEAK_CODES;
+  cfg.freq_hz = 40.0f;
+  cfg.noise = EVAL_NOISE_CODES;
+  std::vector<AdcFrame> frames;
+  synthAdcFrames(cfg, 16, &frames);
+  AdcPairParser st;
+  initAdcPairParser(&st, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD, ADC_MAG_OVERRANGE_CODE);
+  st.bypass_filter = true;
+  std::vector<std::vector<int16_t>> blocks;
+  for (const AdcFrame& f : frames) {
+    uint32_t n = parseAdcFrame(&st, f.bytes.data(), f.convCount(), block);
+    blocks.emplace_back(block, block + n);
+  }
+
+  LegacyAverage legacy;
+  double old_cycles = cyclesPerPair(blocks, [&](uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) block[i] = legacy.next(block[i]);
+  });
+  AdcHampel raw;
+  initAdcHampel(&raw, ADC_EST_RAW_FLOOR_CODES);
+  double hampel_cycles = cyclesPerPair(blocks, [&](uint32_t n) { runAdcHampel(&raw, block, n); });
+  AdcEstimator est;
+  initAdcEstimator(&est);
+  setAdcEstimatorModel(&est, model.alpha, model.beta, ADC_EST_MIN_FLOOR_CODES, ADC_EST_MAX_RUN);
+  // Оценщик идёт после дециматора: на пару — 1/R его выходного сэмпла
+  double est_cycles = cyclesPerPair(blocks, [&](uint32_t n) {
+    runAdcEstimator(&est, block, n / model.ratio);
+  });
+  printf("cost %s R=%u, cycles/pair (host TSC): legacy float %.2f, hampel %.2f + estimator %.2f\n",
+         model.name, (unsigned)model.ratio, old_cycles, hampel_cycles, est_cycles);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) {
+    if (argc < 4) {
+      fprintf(stderr, "usage: eval_estimator [<recording.log> <tdcs|tacs|trns> <peak_codes>]\n");
+      return 1;
+    }
+    const ModeModel* model = nullptr;
+    for (const ModeModel& m : kModels) {
+      if (strcmp(argv[2], m.name) == 0) model = &m;
+    }
+    std::vector<AdcFrame> frames;
+    if (model == nullptr || !loadAdcRecording(argv[1], &frames)) {
+      fprintf(stderr, "bad mode or no [FRAME] lines\n");
+      return 1;
+    }
+    // R — как записано, модель оценщика — как у режима
+    ModeModel m = *model;
+    m.ratio = frames[0].ratio;
+    float peak = (float)atof(argv[3]);
+    std::vector<int16_t> base = runChain(frames, m, peak, false);
+    std::vector<int16_t> est = runChain(frames, m, peak, true);
+    printf("%s: %s R=%u, %u samples\n", argv[1], m.name, (unsigned)m.ratio, (unsigned)base.size());
+    printMetrics(m.ratio > 1 ? "decimator" : "window", evalRecorded(base, base));
+    printMetrics("estimator", evalRecorded(est, base));
+    return 0;
+  }
+
+  bool ok = true;
+  for (float spike_codes : { 0.0f, 2000.0f }) {
+    ok &= evalMode(kModels[0], SYNTH_STEP, 4.0f, spike_codes, 0.0f);
+    ok &= evalMode(kModels[1], SYNTH_SINE, 40.0f, spike_codes, 0.0f);
+    ok &= evalMode(kModels[1], SYNTH_SINE, 40.0f, spike_codes, EVAL_BURST_HZ);
+    ok &= evalMode(kModels[2], SYNTH_NOISE, 0.0f, spike_codes, 0.0f);
+    ok &= evalMode(kModels[2], SYNTH_NOISE, 0.0f, spike_codes, EVAL_BURST_HZ);
+  }
+  benchFilters(kModels[1]);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,126 @@
+// ============================================================================
+// === Компилятор протокола стимуляции на хосте ===
+// ============================================================================
+// Тот же compileProtocol/validateProtocol, что и в прошивке: stim_protocol.cpp
+// собирается как есть, формат /protocol.bin совпадает байт в байт.
+//
+//   protocol_compiler <in.txt> <out.bin> [trns|tdcs|tacs] [freq_Hz]
+//       режим и частота — как в меню устройства до первой команды mode
+//   protocol_compiler --check <file.bin>
+//       проверить готовый бинарь теми же правилами, что и при загрузке
+//
+// На устройство: python3 protocol_upload.py <порт> <out.bin | in.txt>
+
+#include "stim_protocol.h"
+#include "session_control.h"
+
+// То, что stim_protocol.cpp берёт из session_control (меню и состояние сеанса)
+SessionSettings current_settings;
+SessionState current_state = STATE_IDLE;
+
+static const char* kindName(uint8_t kind) {
+  switch (kind) {
+    case SEG_RAMP: return "ramp";
+    case SEG_HOLD: return "hold";
+    case SEG_SHAM: return "sham";
+    case SEG_SWITCH: return "switch";
+    default: return "?";
+  }
+}
+
+static const char* modeName(uint8_t mode) {
+  switch (mode) {
+    case MODE_TRNS: return "trns";
+    case MODE_TDCS: return "tdcs";
+    case MODE_TACS: return "tacs";
+    default: return "?";
+  }
+}
+
+static void printProtocol(const StimProtocol* p) {
+  uint64_t frame = 0;
+  for (uint16_t i = 0; i < p->count; i++) {
+    const ProtocolSegment* s = &p->segments[i];
+    printf("%2u  %8.2f s  %-6s %-4s %7.2f Hz  gain %.3f -> %.3f  (%.2f s)\n", (unsigned)i,
+           (double)frame / SAMPLE_RATE, kindName(s->kind), modeName(s->mode),
+           s->freq_centi_hz / 100.0, s->gain_start_q15 / 32767.0, s->gain_end_q15 / 32767.0,
+           (double)s->frames / SAMPLE_RATE);
+    frame += s->frames;
+  }
+  printf("total %.1f s, %u segments\n", (double)frame / SAMPLE_RATE, (unsigned)p->count);
+}
+
+static size_t readFile(const char* path, uint8_t* buf, size_t cap) {
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "cannot open %s\n", path);
+    exit(1);
+  }
+  size_t len = fread(buf, 1, cap, f);
+  bool more = (fgetc(f) != EOF);
+  fclose(f);
+  if (more) {
+    fprintf(stderr, "%s: larger than %u bytes\n", path, (unsigned)cap);
+    exit(1);
+  }
+  return len;
+}
+
+static bool parseModeArg(const char* s, StimMode* mode) {
+  if (strcasecmp(s, "trns") == 0) { *mode = MODE_TRNS; return true; }
+  if (strcasecmp(s, "tdcs") == 0) { *mode = MODE_TDCS; return true; }
+  if (strcasecmp(s, "tacs") == 0) { *mode = MODE_TACS; return true; }
+  return false;
+}
+
+int main(int argc, char** argv) {
+  static StimProtocol protocol;
+  char err[48];
+
+  if (argc == 3 && strcmp(argv[1], "--check") == 0) {
+    static uint8_t buf[sizeof(ProtocolFileHeader) + PROTOCOL_MAX_SEGMENTS * sizeof(ProtocolSegment)];
+    size_t len = readFile(argv[2], buf, sizeof(buf));
+    if (!loadProtocolBinary(buf, len, &protocol, err, sizeof(err))) {
+      fprintf(stderr, "%s: %s\n", argv[2], err);
+      return 1;
+    }
+    printProtocol(&protocol);
+    return 0;
+  }
+
+  if (argc < 3 || argc > 5) {
+    fprintf(stderr, "usage: %s <in.txt> <out.bin> [trns|tdcs|tacs] [freq_Hz]\n"
+                    "       %s --check <file.bin>\n", argv[0], argv[0]);
+    return 2;
+  }
+  StimMode mode = MODE_TRNS;
+  if (argc >= 4 && !parseModeArg(argv[3], &mode)) {
+    fprintf(stderr, "bad mode %s\n", argv[3]);
+    return 2;
+  }
+  float freq_Hz = (argc == 5) ? strtof(argv[4], NULL) : DEF_TACS_FREQUENCY_HZ;
+
+  static char text[PROTOCOL_MAX_TEXT];
+  size_t len = readFile(argv[1], (uint8_t*)text, sizeof(text) - 1);
+  text[len] = '\0';
+  if (!compileProtocol(text, mode, freq_Hz, &protocol, err, sizeof(err))) {
+    fprintf(stderr, "%s: %s\n", argv[1], err);
+    return 1;
+  }
+
+  ProtocolFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, "TRNSPRT1", 8);
+  header.segment_size = sizeof(ProtocolSegment);
+  header.segment_count = protocol.count;
+  FILE* f = fopen(argv[2], "wb");
+  if (!f) {
+    fprintf(stderr, "cannot write %s\n", argv[2]);
+    return 1;
+  }
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(protocol.segments, sizeof(ProtocolSegment), protocol.count, f);
+  fclose(f);
+  printProtocol(&protocol);
+  return 0;
+}
@@ -0,0 +1,58 @@
+#!/usr/bin/env python3
+"""Загрузка протокола стимуляции в ffat устройства по Serial (без USB MSC).
+
+    python3 protocol_upload.py <порт> <protocol.bin | protocol.txt>
+    python3 protocol_upload.py <порт> --rm
+
+Текст компилируется на устройстве, бинарь (build/protocol_compiler) проверяется
+validateProtocol — в ffat файл попадает только после успешной проверки.
+Нужен pyserial: pip install pyserial
+"""
+import sys
+import time
+
+import serial
+
+BAUD = 921600
+REPLY_TIMEOUT_S = 5.0
+
+
+def wait_reply(port, prefix="[PROTO]"):
+    """Первая строка ответа загрузчика; остальной лог устройства пропускается."""
+    deadline = time.monotonic() + REPLY_TIMEOUT_S
+    while time.monotonic() < deadline:
+        line = port.readline().decode("utf-8", "replace").strip()
+        if line.startswith(prefix):
+            return line
+    raise SystemExit("no reply from device")
+
+
+def main():
+    if len(sys.argv) != 3:
+        raise SystemExit(__doc__)
+    with serial.Serial(sys.argv[1], BAUD, timeout=0.2) as port:
+        port.reset_input_buffer()
+        if sys.argv[2] == "--rm":
+            port.write(b"proto rm\n")
+            print(wait_reply(port))
+            return
+
+        path = sys.argv[2]
+        data = open(path, "rb").read()
+        kind = "bin" if data[:8] == b"TRNSPRT1" else "txt"
+        port.write(f"proto put {kind} {len(data)}\n".encode())
+        reply = wait_reply(port)
+        print(reply)
+        if "receiving" not in reply:
+            raise SystemExit(1)
+        port.write(data)
+        reply = wait_reply(port)
+        print(reply)
+        if "saved" not in reply:
+            raise SystemExit(1)
+        port.write(b"proto\n")
+        print(wait_reply(port))
+
+
+if __name__ == "__main__":
+    main()
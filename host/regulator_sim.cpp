@@ -0,0 +1,240 @@
+// ============================================================================
+// === Стенд регулятора тока: session_regulator.cpp на модели объекта ===
+// ============================================================================
+// session_regulator.cpp собирается как есть; вместо DAC/ADC — объект:
+//   ток = команда × k × trim полуволны, k — ошибка усиления тракта (насос
+//   Хауленда, импеданс электродов), положительная полуволна ещё × (1 + asym)
+//   (H-мост: остаточное DC). Статистика окна-лупа считается аналитически для
+//   формы режима (tDCS — постоянный, tACS — синус, tRNS — гаусс σ = пик / 3.38)
+//   с шумом измерения; новая подстройка видна в окне только через
+//   SIM_APPLY_LAG_MS (очередь DAC + окно-луп), как на устройстве.
+// Цель и масштаб — как в applyModeScaling (в tRNS оба с trns_multiplier).
+//
+// Проверки (код возврата):
+//   - объект в пределах подстройки: ошибка метрики ≤ 2 % и (tRNS/tACS) |DC| ≤ 3 × зона DC
+//     за SIM_SETTLE_STEPS шагов, каждый шаг |Δtrim| ≤ SESSION_REG_MAX_STEP;
+//   - идеальный объект (k = 1) — trim не уходит из зоны нечувствительности;
+//   - ошибка вне пределов — trim стоит на пределе (limited), без накопления:
+//     после возврата объекта сходится за те же SIM_SETTLE_STEPS;
+//   - запас DAC меньше TRIM_MAX — trim × (1 + |balance|) не выше запаса;
+//   - вне STABLE (fadein, снижение усиления) подстройка заморожена.
+
+#include <Arduino.h>
+#include <stdarg.h>
+#include "session_regulator.h"
+#include "session_control.h"
+#include "adc_window_stats.h"
+
+#define SIM_TICK_MS       100   // Период вызова updateSessionRegulator (loop)
+#define SIM_APPLY_LAG_MS  2500  // Подстройка → полностью в окне-лупе
+#define SIM_SETTLE_STEPS  40    // Шагов регулятора на сходимость
+
+// === Символы прошивки, которые берёт регулятор ===
+SessionState current_state = STATE_STABLE;
+float dynamic_dac_gain = 1.0f;
+HardwareSerial Serial;
+void HardwareSerial::printf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+static uint32_t now_ms = 1;
+uint32_t millis() { return now_ms; }
+
+// === ОБЪЕКТ ===
+struct Plant {
+  uint8_t mode;
+  float peak_uA;       // Пик команды при trim = 1 (разомкнутый масштаб)
+  float k;             // Усиление тракта
+  float asym;          // Добавка к положительной полуволне
+  float headroom;      // getDACTrimHeadroom: 32767 / пик стерео-буфера
+  float noise_pct;     // Шум измерения метрики
+};
+
+static Plant plant;
+static float trim_pos = 1.0f, trim_neg = 1.0f;       // Последняя команда
+static float seen_pos = 1.0f, seen_neg = 1.0f;       // То, что сейчас в окне
+static uint32_t trim_set_ms = 0;
+static uint32_t sim_rng = 1;
+
+void setDACCurrentTrim(float trim, float balance) {
+  trim_pos = trim * (1.0f - balance);
+  trim_neg = trim * (1.0f + balance);
+  trim_set_ms = now_ms;
+}
+
+float getDACTrimHeadroom() {
+  return plant.headroom;
+}
+
+static float simNoise() {
+  sim_rng ^= sim_rng << 13;
+  sim_rng ^= sim_rng >> 17;
+  sim_rng ^= sim_rng << 5;
+  return (sim_rng >> 8) * (2.0f / 16777216.0f) - 1.0f;  // [-1, 1)
+}
+
+bool getADCWindowStats(AdcWindow window, AdcWindowStats* out) {
+  (void)window;
+  if (now_ms - trim_set_ms >= SIM_APPLY_LAG_MS) {
+    seen_pos = trim_pos;
+    seen_neg = trim_neg;
+  }
+  float p = plant.peak_uA * plant.k * seen_pos * (1.0f + plant.asym);
+  float n = plant.peak_uA * plant.k * seen_neg;
+  double mean, ms;
+  if (plant.mode == MODE_TDCS) {
+    mean = p;
+    ms = (double)p * p;
+  } else if (plant.mode == MODE_TACS) {
+    mean = (p - n) / M_PI;                  // Полуволны синуса
+    ms = ((double)p * p + (double)n * n) / 4.0;
+  } else {
+    double s = 1.0 / TRNS_SIGMA_TO_AMPLITUDE;  // Гаусс: E|x| = σ √(2/π) на полуось
+    mean = s * sqrt(2.0 / M_PI) * (p - n) / 2.0;
+    ms = s * s * ((double)p * p + (double)n * n) / 2.0;
+  }
+  double sigma = sqrt(fmax(ms - mean * mean, 0.0));
+  double rel = 1.0 + plant.noise_pct / 100.0 * simNoise();
+  memset(out, 0, sizeof(*out));
+  out->count = ADC_RING_SIZE;
+  out->mean_uA = (int32_t)lrint(mean * rel + 2.0 * simNoise());
+  out->rms_uA = (uint32_t)lrint(sqrt(ms) * rel);
+  out->sigma_uA = (uint32_t)lrint(sigma * rel);
+  return true;
+}
+
+// === СЦЕНАРИИ ===
+// Цель и пик как в applyModeScaling: tDCS — amp, tACS — amp / √2, tRNS — σ
+static void startSession(uint8_t mode, float amplitude_mA, float trns_multiplier) {
+  plant.mode = mode;
+  plant.peak_uA = amplitude_mA * 1000.0f * ((mode == MODE_TRNS) ? trns_multiplier : 1.0f);
+  float target_mA = amplitude_mA;
+  if (mode == MODE_TACS) target_mA = amplitude_mA / sqrtf(2.0f);
+  if (mode == MODE_TRNS) target_mA = amplitude_mA * trns_multiplier / TRNS_SIGMA_TO_AMPLITUDE;
+  current_state = STATE_STABLE;
+  dynamic_dac_gain = 1.0f;
+  configureSessionRegulator(mode, (int32_t)(target_mA * 1000.0f + 0.5f));
+  seen_pos = trim_pos;
+  seen_neg = trim_neg;
+}
+
+struct RunResult {
+  RegulatorReport last;
+  float max_step;       // Наибольший |Δtrim| за шаг
+  float max_drive;      // Наибольший trim × (1 + |balance|)
+  int settled_at;       // Шаг, с которого ошибка и DC в допуске (-1 — нет)
+};
+
+static RunResult runSteps(int steps) {
+  RunResult r = {};
+  r.settled_at = -1;
+  RegulatorReport prev;
+  getSessionRegulator(&prev);
+  for (int s = 0; s < steps; s++) {
+    for (uint32_t t = 0; t < SESSION_REG_PERIOD_MS; t += SIM_TICK_MS) {
+      now_ms += SIM_TICK_MS;
+      updateSessionRegulator();
+    }
+    RegulatorReport cur;
+    getSessionRegulator(&cur);
+    r.max_step = fmaxf(r.max_step, fabsf(cur.trim - prev.trim));
+    r.max_drive = fmaxf(r.max_drive, cur.trim * (1.0f + fabsf(cur.balance)));
+    bool in_tol = fabsf(cur.error_pct) <= 2.0f &&
+                  (plant.mode == MODE_TDCS || abs(cur.dc_uA) <= 3 * SESSION_REG_DC_DEADBAND_UA);
+    if (!in_tol) r.settled_at = -1;
+    else if (r.settled_at < 0) r.settled_at = s;
+    prev = cur;
+    r.last = cur;
+  }
+  return r;
+}
+
+static const char* modeName(uint8_t mode) {
+  return (mode == MODE_TDCS) ? "tdcs" : ((mode == MODE_TACS) ? "tacs" : "trns");
+}
+
+static bool report(const char* name, const RunResult& r, bool ok) {
+  printf("%-24s trim %.3f balance %+.3f error %+5.1f%% DC %+4ld uA, settled @%d, max step %.3f%s  %s\n",
+         name, r.last.trim, r.last.balance, r.last.error_pct, (long)r.last.dc_uA, r.settled_at,
+         r.max_step, r.last.limited ? " (limited)" : "", ok ? "ok" : "FAIL");
+  return ok;
+}
+
+// Объект в пределах: сходимость, ограничение скорости
+static bool checkConverge(uint8_t mode, float k, float asym) {
+  plant = { mode, 0, k, asym, 2.0f, 0.3f };
+  startSession(mode, 1.5f, DEF_TRNS_MULTIPLIER);
+  RunResult r = runSteps(SIM_SETTLE_STEPS + 20);
+  bool ok = r.settled_at >= 0 && r.settled_at <= SIM_SETTLE_STEPS &&
+            r.max_step <= SESSION_REG_MAX_STEP + 1e-6f;
+  char name[48];
+  snprintf(name, sizeof(name), "%s k=%.2f asym=%+.2f", modeName(mode), k, asym);
+  return report(name, r, ok);
+}
+
+// Идеальный объект: trim остаётся у 1 (в tRNS — проверка цели с trns_multiplier)
+static bool checkIdeal(uint8_t mode) {
+  plant = { mode, 0, 1.0f, 0.0f, 2.0f, 0.3f };
+  startSession(mode, 1.5f, DEF_TRNS_MULTIPLIER);
+  RunResult r = runSteps(SIM_SETTLE_STEPS);
+  bool ok = fabsf(r.last.trim - 1.0f) <= SESSION_REG_DEADBAND_PCT / 100.0f && !r.last.limited;
+  char name[48];
+  snprintf(name, sizeof(name), "%s ideal", modeName(mode));
+  return report(name, r, ok);
+}
+
+// Ошибка вне пределов: насыщение без накопления, затем возврат объекта
+static bool checkSaturation(uint8_t mode) {
+  plant = { mode, 0, 0.75f, 0.0f, 2.0f, 0.3f };
+  startSession(mode, 1.5f, DEF_TRNS_MULTIPLIER);
+  RunResult r = runSteps(SIM_SETTLE_STEPS);
+  char name[48];
+  snprintf(name, sizeof(name), "%s k=0.75 (saturate)", modeName(mode));
+  bool ok = report(name, r, fabsf(r.last.trim - SESSION_REG_TRIM_MAX) < 1e-4f && r.last.limited);
+  plant.k = 1.0f;
+  r = runSteps(SIM_SETTLE_STEPS + 20);
+  snprintf(name, sizeof(name), "%s k 0.75 -> 1.00", modeName(mode));
+  return report(name, r, r.settled_at >= 0 && r.settled_at <= SIM_SETTLE_STEPS) && ok;
+}
+
+// Запас DAC меньше TRIM_MAX: пик полуволны не выходит за 32767
+static bool checkHeadroom() {
+  plant = { MODE_TACS, 0, 0.85f, 0.04f, 1.08f, 0.3f };
+  startSession(MODE_TACS, 1.5f, DEF_TRNS_MULTIPLIER);
+  RunResult r = runSteps(SIM_SETTLE_STEPS);
+  bool ok = r.max_drive <= plant.headroom + 1e-4f && r.last.limited;
+  printf("  drive %.3f vs headroom %.3f\n", r.max_drive, plant.headroom);
+  return report("tacs headroom 1.08", r, ok);
+}
+
+// Вне STABLE и при сниженном усилении trim заморожен
+static bool checkFrozen() {
+  plant = { MODE_TDCS, 0, 0.9f, 0.0f, 2.0f, 0.3f };
+  startSession(MODE_TDCS, 1.5f, DEF_TRNS_MULTIPLIER);
+  current_state = STATE_FADEIN;
+  RunResult r = runSteps(10);
+  bool ok = r.last.steps == 0;
+  current_state = STATE_STABLE;
+  dynamic_dac_gain = 0.9f;
+  r = runSteps(10);
+  ok = ok && r.last.steps == 0;
+  dynamic_dac_gain = 1.0f;
+  return report("tdcs fadein / gain<1", r, ok);
+}
+
+int main() {
+  bool ok = true;
+  for (uint8_t mode : { MODE_TDCS, MODE_TACS, MODE_TRNS }) {
+    ok &= checkIdeal(mode);
+    ok &= checkConverge(mode, 0.90f, 0.0f);
+    ok &= checkConverge(mode, 1.10f, 0.0f);
+    if (mode != MODE_TDCS) ok &= checkConverge(mode, 0.95f, 0.06f);
+    ok &= checkSaturation(mode);
+  }
+  ok &= checkHeadroom();
+  ok &= checkFrozen();
+  return ok ? 0 : 1;
+}
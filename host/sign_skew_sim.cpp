@@ -0,0 +1,77 @@
+// ============================================================================
+// === Стенд перекоса знака: scanAdcSignSkewFrame на синтетике с известным перекосом ===
+// ============================================================================
+// synthAdcFrames с sign_skew_us: компаратор знака H-моста переключается по
+// форме, сдвинутой на перекос, модуль — |форма| с шумом, оцифрован на полпары
+// позже знака (как у драйвера). Параметры детектора — как у initADC
+// (ADC_SKEW_*), пары при ×ADC_OVERSAMPLE.
+//
+// Проверки (код возврата):
+//   - tACS 1.46 / 9.77 / 40.04 Гц (целое число периодов на луп) и tRNS: средний
+//     перекос совпадает с заданным (−60…+60 мкс) с точностью до пары АЦП + 3σ
+//     среднего (знак меняется на сэмплах DAC, синхронных с парами), засчитано
+//     не меньше ADC_SKEW_MIN_EDGES переходов;
+//   - tDCS: ни одного засчитанного перехода (перекос не оценивается).
+
+#include "adc_recording.h"
+#include "adc_sign_skew.h"
+
+#define PEAK_CODES   1500.0f  // Пик команды (коды модуля)
+#define NOISE_CODES  4.0f     // СКО шума модуля
+#define SIM_SECONDS  8
+
+static bool runCase(const char* name, AdcSynthWave wave, float freq_hz, float skew_us, uint32_t min_edges) {
+  AdcSynthConfig cfg;
+  cfg.wave = wave;
+  cfg.freq_hz = freq_hz;
+  cfg.amplitude = PEAK_CODES;
+  cfg.noise = NOISE_CODES;
+  cfg.sign_skew_us = (skew_us != 0.0f) ? skew_us : 1e-3f;  // ≠ 0: модуль на полпары позже
+  cfg.seed = 7;
+  const double pair_rate = (double)ADC_SAMPLE_RATE * cfg.ratio;
+  // Переходов не меньше min_edges (tACS: 2 на период), иначе SIM_SECONDS
+  double seconds = SIM_SECONDS;
+  if (wave == SYNTH_SINE) seconds = fmax(seconds, (min_edges + 2) / (2.0 * freq_hz));
+  uint32_t frames = (uint32_t)(seconds * ADC_SAMPLE_RATE / ADC_SAMPLES_PER_FRAME) + 1;
+  std::vector<AdcFrame> stream;
+  synthAdcFrames(cfg, frames, &stream);
+
+  AdcSignSkew sk;
+  initAdcSignSkew(&sk, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD, ADC_SKEW_LEVEL_CODE,
+                  (uint16_t)(ADC_SKEW_MAX_DIP_US * pair_rate / 1e6),
+                  (uint16_t)(ADC_SKEW_WINDOW_US * pair_rate / 1e6));
+  for (const AdcFrame& f : stream) scanAdcSignSkewFrame(&sk, f.bytes.data(), f.convCount());
+
+  double us_per_q8 = 1e6 / pair_rate / 256.0;
+  double mean_us = sk.count ? (double)sk.sum_q8 / sk.count * us_per_q8 : 0.0;
+  double var_q16 = sk.count ? (double)sk.sum_sq_q16 / sk.count - pow((double)sk.sum_q8 / sk.count, 2) : 0.0;
+  double sigma_us = sqrt(var_q16 > 0.0 ? var_q16 : 0.0) * us_per_q8;
+
+  bool ok;
+  if (min_edges == 0) {
+    ok = (sk.count == 0);
+  } else {
+    // Знак меняется только на сэмплах DAC, а они жёстко привязаны к парам АЦП:
+    // разрешение — пара (без дрейфа часов не усредняется), плюс 3σ среднего
+    double tol_us = 1e6 / pair_rate + 3.0 * sigma_us / sqrt((double)sk.count);
+    ok = sk.count >= min_edges && fabs(mean_us - skew_us) <= tol_us;
+  }
+  printf("%-22s skew %+6.1f us: measured %+7.2f us (sigma %5.1f), edges %5lu, rejected %5lu  %s\n",
+         name, skew_us, mean_us, sigma_us, (unsigned long)sk.count, (unsigned long)sk.rejected,
+         ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main() {
+  bool ok = true;
+  // Частоты tACS — как у getValidTACSFrequency: целое число периодов на луп
+  const float hz_per_cycle = (float)SAMPLE_RATE / SIGNAL_SAMPLES;
+  for (float skew : { -60.0f, -1.5f, 0.0f, 25.0f, 60.0f }) {
+    ok &= runCase("tacs 1.46 Hz", SYNTH_SINE, 3 * hz_per_cycle, skew, ADC_SKEW_MIN_EDGES);
+    ok &= runCase("tacs 9.77 Hz", SYNTH_SINE, 20 * hz_per_cycle, skew, ADC_SKEW_MIN_EDGES);
+    ok &= runCase("tacs 40.04 Hz", SYNTH_SINE, 82 * hz_per_cycle, skew, ADC_SKEW_MIN_EDGES);
+    ok &= runCase("trns", SYNTH_NOISE, 0.0f, skew, ADC_SKEW_MIN_EDGES);
+  }
+  ok &= runCase("tdcs", SYNTH_DC, 0.0f, 25.0f, 0);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+// Минимальная замена Arduino-ESP32 для хостовых утилит и стендов (host/).
+// Только то, что используют собираемые здесь модули прошивки
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "freertos/FreeRTOS.h"
+#include "esp_attr.h"
+
+#define PI 3.14159265358979f
+
+template<class T, class L, class H> T constrain(T x, L lo, H hi) {
+  return x < lo ? (T)lo : (x > hi ? (T)hi : x);
+}
+using std::min;
+using std::max;
+
+uint32_t millis();
+uint32_t micros();
+
+// Serial → stdout
+struct HardwareSerial {
+  void printf(const char* fmt, ...);
+  void println(const char* s = "");
+  void print(const char* s);
+  int available() { return 0; }
+  int read() { return -1; }
+};
+extern HardwareSerial Serial;
+
+// Файл ffat → обычный файл в каталоге HOST_FFAT_DIR (по умолчанию текущий)
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+class File {
+ public:
+  File(FILE* f = NULL) : fp(f) {}
+  size_t write(const uint8_t* data, size_t len) { return fp ? fwrite(data, 1, len, fp) : 0; }
+  size_t read(uint8_t* data, size_t len) { return fp ? fread(data, 1, len, fp) : 0; }
+  size_t size();
+  void flush() { if (fp) fflush(fp); }
+  void close() { if (fp) fclose(fp); fp = NULL; }
+  operator bool() const { return fp != NULL; }
+ private:
+  FILE* fp;
+};
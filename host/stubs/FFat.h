@@ -0,0 +1,10 @@
+#pragma once
+#include "Arduino.h"
+
+struct HostFFat {
+  bool begin(bool format_on_fail = false) { (void)format_on_fail; return true; }
+  File open(const char* path, const char* mode = FILE_READ);
+  bool exists(const char* path);
+  bool remove(const char* path);
+};
+extern HostFFat FFat;
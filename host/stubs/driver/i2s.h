@@ -0,0 +1,56 @@
+// Легаси драйвер I2S: типы и объявления, которые берёт dac_control.
+// Реализацию (очередь DMA буферов) даёт стенд, который линкует dac_control.cpp
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+typedef enum { I2S_NUM_0 = 0 } i2s_port_t;
+typedef int i2s_mode_t;
+typedef int i2s_bits_per_sample_t;
+typedef int i2s_channel_fmt_t;
+typedef int i2s_comm_format_t;
+typedef int i2s_channel_t;
+#define I2S_MODE_MASTER 1
+#define I2S_MODE_TX 4
+#define I2S_BITS_PER_SAMPLE_16BIT 16
+#define I2S_CHANNEL_FMT_RIGHT_LEFT 0
+#define I2S_COMM_FORMAT_STAND_I2S 1
+#define I2S_CHANNEL_STEREO 2
+#define I2S_PIN_NO_CHANGE -1
+
+typedef struct {
+  i2s_mode_t mode;
+  uint32_t sample_rate;
+  i2s_bits_per_sample_t bits_per_sample;
+  i2s_channel_fmt_t channel_format;
+  i2s_comm_format_t communication_format;
+  int intr_alloc_flags;
+  int dma_buf_count;
+  int dma_buf_len;
+  bool use_apll;
+  bool tx_desc_auto_clear;
+  int fixed_mclk;
+} i2s_config_t;
+
+typedef struct {
+  int bck_io_num;
+  int ws_io_num;
+  int data_out_num;
+  int data_in_num;
+} i2s_pin_config_t;
+
+typedef enum { I2S_EVENT_DMA_ERROR, I2S_EVENT_TX_DONE, I2S_EVENT_RX_DONE, I2S_EVENT_TX_Q_OVF } i2s_event_type_t;
+typedef struct {
+  i2s_event_type_t type;
+  size_t size;
+} i2s_event_t;
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queue_size, void* queue);
+esp_err_t i2s_set_pin(i2s_port_t port, const i2s_pin_config_t* pins);
+esp_err_t i2s_set_clk(i2s_port_t port, uint32_t rate, uint32_t bits, i2s_channel_t ch);
+esp_err_t i2s_write(i2s_port_t port, const void* src, size_t size, size_t* bytes_written, TickType_t ticks);
+esp_err_t i2s_zero_dma_buffer(i2s_port_t port);
+esp_err_t i2s_start(i2s_port_t port);
+esp_err_t i2s_stop(i2s_port_t port);
@@ -0,0 +1,6 @@
+// Драйвер continuous ADC: только тип дескриптора для объявлений adc_control.h
+#pragma once
+#include "hal/adc_types.h"
+#include "esp_err.h"
+
+typedef struct adc_continuous_ctx_t* adc_continuous_handle_t;
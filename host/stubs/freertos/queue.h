@@ -0,0 +1,7 @@
+#pragma once
+#include "FreeRTOS.h"
+
+// Только объявления: очереди реализует стенд, которому они нужны (модель драйвера)
+typedef struct HostQueue* QueueHandle_t;
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+BaseType_t xQueueReset(QueueHandle_t queue);
@@ -0,0 +1,8 @@
+#pragma once
+#include "queue.h"
+
+// Только объявления: мьютекс реализует стенд (модель вытеснения задач)
+typedef struct HostMutex* SemaphoreHandle_t;
+SemaphoreHandle_t xSemaphoreCreateMutex();
+BaseType_t xSemaphoreTake(SemaphoreHandle_t mutex, TickType_t ticks);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t mutex);
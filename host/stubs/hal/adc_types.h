@@ -0,0 +1,10 @@
+// Перечисления ESP-IDF, на которые ссылается config.h (каналы АЦП).
+// Значения совпадают с IDF: номер канала = его код в слове TYPE1
+#pragma once
+
+typedef enum {
+  ADC_CHANNEL_0, ADC_CHANNEL_1, ADC_CHANNEL_2, ADC_CHANNEL_3, ADC_CHANNEL_4,
+  ADC_CHANNEL_5, ADC_CHANNEL_6, ADC_CHANNEL_7, ADC_CHANNEL_8, ADC_CHANNEL_9,
+} adc_channel_t;
+
+#define SOC_ADC_DIGI_DATA_BYTES_PER_CONV 2
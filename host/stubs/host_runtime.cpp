@@ -0,0 +1,56 @@
+// Реализация заглушек host/stubs: Serial, время, ffat поверх файловой системы
+#include "Arduino.h"
+#include "FFat.h"
+#include <stdarg.h>
+#include <string>
+#include <chrono>
+
+HardwareSerial Serial;
+HostFFat FFat;
+
+void HardwareSerial::printf(const char* fmt, ...) {
+  va_list args;
+  va_start(args, fmt);
+  vprintf(fmt, args);
+  va_end(args);
+}
+
+void HardwareSerial::println(const char* s) { puts(s); }
+void HardwareSerial::print(const char* s) { fputs(s, stdout); }
+
+static uint64_t hostMicros() {
+  static const auto t0 = std::chrono::steady_clock::now();
+  return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - t0).count();
+}
+uint32_t millis() { return (uint32_t)(hostMicros() / 1000); }
+uint32_t micros() { return (uint32_t)hostMicros(); }
+
+size_t File::size() {
+  if (!fp) return 0;
+  long pos = ftell(fp);
+  fseek(fp, 0, SEEK_END);
+  long end = ftell(fp);
+  fseek(fp, pos, SEEK_SET);
+  return (size_t)end;
+}
+
+static std::string hostPath(const char* path) {
+  const char* dir = getenv("HOST_FFAT_DIR");
+  return std::string(dir ? dir : ".") + path;
+}
+
+File HostFFat::open(const char* path, const char* mode) {
+  std::string m = std::string(mode) + "b";
+  return File(fopen(hostPath(path).c_str(), m.c_str()));
+}
+
+bool HostFFat::exists(const char* path) {
+  FILE* f = fopen(hostPath(path).c_str(), "rb");
+  if (f) fclose(f);
+  return f != NULL;
+}
+
+bool HostFFat::remove(const char* path) {
+  return ::remove(hostPath(path).c_str()) == 0;
+}
@@ -0,0 +1,261 @@
+// ============================================================================
+// === Стенд аварийной защиты: задержка scanAdcTripFrame на фреймах TYPE1 ===
+// ============================================================================
+// Синтетические блоки (adc_recording.h) режутся на фреймы DMA по
+// ADC_DMA_FRAMES_PER_BLOCK и идут в scanAdcTripFrame по одному, как в
+// conv_done ISR; с заданной пары в поток подмешивается авария:
+//   перегрузка — модуль выше порога (пробой/КЗ нагрузки),
+//   DC авария — знак залип в «+» (H-мост), модуль как был.
+// Пороги — как у configureADCTrip (ADC_TRIP_*), коды ≈ мкА (хост без LUT);
+// подтверждение и окно DC — как у applyADCRateProfile для данного R.
+//
+// Проверки (код возврата):
+//   - без аварии (шум, одиночные выбросы вне калибровки) — ни одного срабатывания;
+//   - перегрузка: onset_pairs совпадает с истинной задержкой (от первой пары
+//     аварии до конца фрейма срабатывания), не больше фрейма DMA + подтверждения
+//     и меньше TRIP_MAX_DETECT_US;
+//   - DC авария: срабатывает не позже двух окон + фрейма, если среднее |тока|
+//     формы выше порога DC (иначе залипший знак этим детектором не виден —
+//     печатается, но не считается провалом);
+//   - окно DC — целое число лупов DAC: tACS 1.46 Гц (3 периода на луп) и tRNS
+//     на 2 мА × SESSION_REG_TRIM_MAX, с балансом полуволн ±SESSION_REG_DC_MAX
+//     и с окном не с начала периода, — без ложных срабатываний, а залипший
+//     знак обязан сработать.
+// Начало аварии перебирается по всему фрейму — худший случай печатается в мкс.
+
+#include "adc_recording.h"
+#include "adc_trip.h"
+
+#define PEAK_CODES 1500.0f        // Пик команды (коды ≈ мкА)
+#define TRIP_MAX_DETECT_US 1000.0  // Перегрузка: худшая задержка обнаружения
+
+struct TripSetup {
+  uint8_t shift;
+  uint16_t trip_code;
+  uint16_t confirm;
+  uint16_t dc_code;
+  uint32_t dc_window;
+  uint32_t frame_pairs;
+  double pair_rate;
+};
+
+// trip_peak — наибольший пик команды (как trip_peak_uA в applyModeScaling)
+static TripSetup makeSetup(uint8_t shift, float trip_peak) {
+  TripSetup s;
+  s.shift = shift;
+  int32_t trip = (int32_t)(trip_peak * ADC_TRIP_OVERCURRENT_PCT / 100);
+  if (trip < ADC_TRIP_MIN_UA) trip = ADC_TRIP_MIN_UA;
+  if (trip > ADC_TRIP_MAX_UA) trip = ADC_TRIP_MAX_UA;
+  s.trip_code = (uint16_t)trip;
+  uint32_t down = ADC_OVERSAMPLE_SHIFT - shift;
+  s.confirm = (uint16_t)(ADC_TRIP_CONFIRM_PAIRS >> down);
+  if (s.confirm < 1) s.confirm = 1;
+  s.dc_code = ADC_TRIP_DC_UA;
+  s.dc_window = ADC_TRIP_DC_WINDOW_PAIRS >> down;
+  s.frame_pairs = ((uint32_t)ADC_SAMPLES_PER_FRAME << shift) / ADC_DMA_FRAMES_PER_BLOCK;
+  s.pair_rate = (double)ADC_SAMPLE_RATE * (1u << shift);
+  return s;
+}
+
+enum FaultKind { FAULT_NONE, FAULT_OVERCURRENT, FAULT_DC };
+
+// Подмешать аварию с пары fault_pair до конца потока (поток без потерь: пара p —
+// конверсии 2p (знак) и 2p + 1 (модуль) сквозь фреймы)
+static void injectFault(std::vector<AdcFrame>* frames, FaultKind kind, uint64_t fault_pair,
+                        uint16_t trip_code) {
+  uint64_t conv_base = 0;
+  for (AdcFrame& f : *frames) {
+    uint32_t n = f.convCount();
+    for (uint32_t i = 0; i < n; i++) {
+      uint64_t g = conv_base + i;
+      if (g / 2 < fault_pair) continue;
+      uint16_t w = (uint16_t)(f.bytes[2 * i] | f.bytes[2 * i + 1] << 8);
+      uint8_t ch = w >> 12;
+      uint16_t code = w & 0x0FFF;
+      if (kind == FAULT_OVERCURRENT && ch == ADC_MOD_CHANNEL) code = trip_code + 200;
+      if (kind == FAULT_DC && ch == ADC_SIGN_CHANNEL) code = 4000;
+      w = (uint16_t)(ch << 12 | code);
+      f.bytes[2 * i] = (uint8_t)(w & 0xFF);
+      f.bytes[2 * i + 1] = (uint8_t)(w >> 8);
+    }
+    conv_base += n;
+  }
+}
+
+struct TripResult {
+  bool tripped;
+  uint8_t reason;
+  uint64_t end_pair;     // Пар с начала потока до конца фрейма срабатывания
+  uint32_t onset_pairs;  // Что доложил детектор
+};
+
+// Блоки → фреймы DMA драйвера (conv_frame_size = блок / ADC_DMA_FRAMES_PER_BLOCK)
+static TripResult runDetector(const std::vector<AdcFrame>& frames, const TripSetup& s) {
+  AdcTripDetector det;
+  initAdcTripDetector(&det, ADC_SIGN_CHANNEL, ADC_MOD_CHANNEL, ADC_SIGN_THRESHOLD);
+  configureAdcTripDetector(&det, s.trip_code, s.confirm, s.dc_code, s.dc_window);
+  TripResult r = { false, ADC_TRIP_NONE, 0, 0 };
+  uint64_t pairs = 0;
+  for (const AdcFrame& f : frames) {
+    uint32_t dma_conv = f.convCount() / ADC_DMA_FRAMES_PER_BLOCK;
+    for (uint32_t at = 0; at < f.convCount(); at += dma_conv) {
+      pairs += dma_conv / 2;
+      if (scanAdcTripFrame(&det, f.bytes.data() + at * SOC_ADC_DIGI_DATA_BYTES_PER_CONV, dma_conv)) {
+        return { true, det.reason, pairs, det.onset_pairs };
+      }
+    }
+  }
+  return r;
+}
+
+static AdcSynthConfig streamConfig(AdcSynthWave wave, uint8_t shift) {
+  AdcSynthConfig cfg;
+  cfg.wave = wave;
+  cfg.ratio = (uint8_t)(1u << shift);
+  cfg.amplitude = PEAK_CODES;
+  cfg.freq_hz = 40.0f;
+  cfg.noise = 20.0f;
+  cfg.spike_prob = 0.002f;  // Одиночные выбросы вне калибровки: не авария
+  return cfg;
+}
+
+static std::vector<AdcFrame> makeStream(AdcSynthWave wave, uint8_t shift, uint32_t frames) {
+  std::vector<AdcFrame> out;
+  synthAdcFrames(streamConfig(wave, shift), frames, &out);
+  return out;
+}
+
+// DC авария: знак залип с середины первого окна. Среднее после залипания —
+// среднее модуля (выбросы вне калибровки детектор тоже считает).
+// must_detect — среднее заведомо выше порога: не сработал — провал
+static bool checkDcFault(const char* name, const std::vector<AdcFrame>& clean, const TripSetup& s,
+                         bool must_detect) {
+  uint32_t block_pairs = s.frame_pairs * ADC_DMA_FRAMES_PER_BLOCK;
+  double mag_sum = 0;
+  uint64_t mag_n = 0;
+  for (const AdcFrame& fr : clean) {
+    for (uint32_t i = 1; i < fr.convCount(); i += 2) {
+      mag_sum += (fr.bytes[2 * i] | fr.bytes[2 * i + 1] << 8) & 0x0FFF;
+      mag_n++;
+    }
+  }
+  double mean_mag = mag_sum / mag_n;
+  uint64_t fault = s.dc_window / 2 + 123;
+  std::vector<AdcFrame> f = clean;
+  injectFault(&f, FAULT_DC, fault, s.trip_code);
+  TripResult r = runDetector(f, s);
+  uint64_t latency = r.tripped ? r.end_pair - fault : 0;
+  if (!must_detect && mean_mag < 1.1 * s.dc_code) {
+    printf("  %s DC fault: mean |I| %.0f codes vs limit %u: %s (not checked)\n", name, mean_mag,
+           s.dc_code, r.tripped ? "tripped" : "not detectable");
+  } else if (!r.tripped || r.reason != ADC_TRIP_DC_FAULT || latency > 2 * s.dc_window + block_pairs) {
+    printf("  %s: FAIL DC fault (mean |I| %.0f codes): tripped %d reason %u\n", name, mean_mag,
+           r.tripped, r.reason);
+    return false;
+  } else {
+    printf("  %s DC fault: mean |I| %.0f codes, %llu pairs = %.0f ms (bound %lu pairs)\n", name,
+           mean_mag, (unsigned long long)latency, latency * 1e3 / s.pair_rate,
+           (unsigned long)(2 * s.dc_window + block_pairs));
+  }
+  return true;
+}
+
+// Окно DC на длинных периодах: исправная форма не срабатывает, залипший знак — да.
+// Поток начинается с skip_blocks блока — окно не совпадает с началом периода/лупа
+static bool checkDcWindow(const char* name, const AdcSynthConfig& cfg, uint8_t shift,
+                          uint32_t skip_blocks) {
+  // Порог перегрузки — с запасом регулятора на баланс, как в applyModeScaling
+  TripSetup s = makeSetup(shift, cfg.amplitude * (1.0f + SESSION_REG_DC_MAX));
+  uint32_t block_pairs = s.frame_pairs * ADC_DMA_FRAMES_PER_BLOCK;
+  uint32_t frames = (uint32_t)(4 * s.dc_window / block_pairs) + 4;
+  std::vector<AdcFrame> all;
+  synthAdcFrames(cfg, frames + skip_blocks, &all);
+  std::vector<AdcFrame> clean(all.begin() + skip_blocks, all.end());
+  TripResult r = runDetector(clean, s);
+  if (r.tripped) {
+    printf("  %s: FAIL false trip, reason %u at pair %llu\n", name, r.reason,
+           (unsigned long long)r.end_pair);
+    return false;
+  }
+  return checkDcFault(name, clean, s, true);
+}
+
+static bool checkShift(uint8_t shift) {
+  TripSetup s = makeSetup(shift, PEAK_CODES);
+  bool ok = true;
+  printf("R=%u: trip %u codes x%u pairs, DC %u codes / %lu pairs, DMA frame %lu pairs\n",
+         1u << shift, s.trip_code, s.confirm, s.dc_code, (unsigned long)s.dc_window,
+         (unsigned long)s.frame_pairs);
+
+  // Окно DC — луп DAC: поток на 4 окна (в блоках по ADC_DMA_FRAMES_PER_BLOCK фреймов)
+  uint32_t block_pairs = s.frame_pairs * ADC_DMA_FRAMES_PER_BLOCK;
+  uint32_t frames = (uint32_t)(4 * s.dc_window / block_pairs) + 4;
+  for (AdcSynthWave wave : { SYNTH_SINE, SYNTH_NOISE }) {
+    const char* name = (wave == SYNTH_SINE) ? "tacs" : "trns";
+    std::vector<AdcFrame> clean = makeStream(wave, shift, frames);
+    TripResult r = runDetector(clean, s);
+    if (r.tripped) {
+      printf("  %s: FAIL false trip, reason %u at pair %llu\n", name, r.reason,
+             (unsigned long long)r.end_pair);
+      ok = false;
+    }
+
+    // Перегрузка: начало аварии по всем позициям во фрейме (шаг 7 пар)
+    uint32_t worst = 0;
+    uint64_t base = 8 * (uint64_t)block_pairs + 3 * s.frame_pairs;
+    for (uint32_t off = 0; off < s.frame_pairs; off++) {
+      std::vector<AdcFrame> f(clean.begin(), clean.begin() + 16);
+      injectFault(&f, FAULT_OVERCURRENT, base + off, s.trip_code);
+      r = runDetector(f, s);
+      uint64_t truth = r.end_pair - (base + off);
+      if (!r.tripped || r.reason != ADC_TRIP_OVERCURRENT || r.onset_pairs != truth ||
+          truth > s.frame_pairs + s.confirm - 1) {
+        printf("  %s: FAIL overcurrent at +%lu: tripped %d reason %u onset %lu, true %llu pairs\n",
+               name, (unsigned long)off, r.tripped, r.reason, (unsigned long)r.onset_pairs,
+               (unsigned long long)truth);
+        ok = false;
+        break;
+      }
+      if (truth > worst) worst = (uint32_t)truth;
+    }
+    double worst_us = worst * 1e6 / s.pair_rate;
+    printf("  %s overcurrent: worst %lu pairs = %.0f us (bound %lu pairs, %.0f us)\n", name,
+           (unsigned long)worst, worst_us, (unsigned long)(s.frame_pairs + s.confirm - 1),
+           TRIP_MAX_DETECT_US);
+    if (worst_us >= TRIP_MAX_DETECT_US) {
+      printf("  %s: FAIL overcurrent detect latency %.0f us\n", name, worst_us);
+      ok = false;
+    }
+
+    ok &= checkDcFault(name, clean, s, false);
+  }
+
+  // Длинные периоды: 2 мА с полным запасом регулятора, баланс полуволн на пределе
+  float peak = 2000.0f * SESSION_REG_TRIM_MAX;
+  AdcSynthConfig slow = streamConfig(SYNTH_SINE, shift);
+  slow.amplitude = peak;
+  slow.freq_hz = 3.0f * SAMPLE_RATE / SIGNAL_SAMPLES;  // 1.46 Гц: 3 периода на луп
+  char name[64];
+  for (float balance : { 0.0f, SESSION_REG_DC_MAX, -SESSION_REG_DC_MAX }) {
+    slow.balance = balance;
+    for (uint32_t skip : { 0u, 7u }) {  // Окно с начала периода (+ полуволна в остатке) и со сдвигом
+      snprintf(name, sizeof(name), "tacs %.2f Hz %.0f balance %+.2f skip %u", slow.freq_hz, peak,
+               balance, (unsigned)skip);
+      ok &= checkDcWindow(name, slow, shift, skip);
+    }
+  }
+  AdcSynthConfig noise = streamConfig(SYNTH_NOISE, shift);
+  noise.amplitude = peak;
+  for (float balance : { 0.0f, SESSION_REG_DC_MAX }) {
+    noise.balance = balance;
+    snprintf(name, sizeof(name), "trns %.0f balance %+.2f", peak, balance);
+    ok &= checkDcWindow(name, noise, shift, 5);
+  }
+  return ok;
+}
+
+int main() {
+  bool ok = checkShift(0);
+  ok &= checkShift(ADC_OVERSAMPLE_SHIFT);
+  return ok ? 0 : 1;
+}